@@ -0,0 +1,165 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "syntheticdata.h"
+
+#include "../mapcraftercore/renderer/blockimages.h"
+#include "../mapcraftercore/renderer/image.h"
+#include "../mapcraftercore/renderer/image/quantization.h"
+#include "../mapcraftercore/renderer/image/scaling.h"
+
+#include <benchmark/benchmark.h>
+#include <vector>
+
+namespace renderer = mapcrafter::renderer;
+using renderer::RGBAImage;
+using renderer::RGBAPixel;
+
+static const int TILE_SIZE = 384;
+static const int BLOCK_SIZE = 16;
+
+static void BM_Blend(benchmark::State& state) {
+	RGBAImage source = synthetic::createTileImage(TILE_SIZE, TILE_SIZE, 1);
+	RGBAImage dest = synthetic::createTileImage(TILE_SIZE, TILE_SIZE, 2);
+	const RGBAPixel* src = &source.data[0];
+	for (auto _ : state) {
+		RGBAPixel* d = &dest.data[0];
+		for (size_t i = 0; i < dest.data.size(); i++)
+			renderer::blend(d[i], src[i] & 0x80ffffff);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * dest.data.size());
+}
+BENCHMARK(BM_Blend);
+
+static void BM_AlphaBlit(benchmark::State& state) {
+	RGBAImage block, uv_mask;
+	synthetic::createBlockImage(BLOCK_SIZE * 2, 3, block, uv_mask);
+	RGBAImage tile(TILE_SIZE, TILE_SIZE);
+	int blits = 0;
+	for (auto _ : state) {
+		// blit the block images in rows like the tile renderer does
+		for (int y = 0; y < TILE_SIZE; y += BLOCK_SIZE)
+			for (int x = 0; x < TILE_SIZE; x += BLOCK_SIZE * 2) {
+				tile.alphaBlit(block, x + (y / BLOCK_SIZE % 2) * BLOCK_SIZE, y);
+				blits++;
+			}
+		benchmark::DoNotOptimize(tile.data.data());
+	}
+	state.SetItemsProcessed(blits);
+}
+BENCHMARK(BM_AlphaBlit);
+
+static void BM_BlockImageMultiply(benchmark::State& state) {
+	RGBAImage original, uv_mask;
+	synthetic::createBlockImage(state.range(0), 4, original, uv_mask);
+	renderer::CornerValues left = {{1.0f, 0.8f, 0.6f, 0.4f}};
+	renderer::CornerValues right = {{0.5f, 0.6f, 0.7f, 0.8f}};
+	renderer::CornerValues up = {{0.9f, 1.0f, 0.9f, 0.8f}};
+	RGBAImage block = original;
+	for (auto _ : state) {
+		block.data = original.data;
+		renderer::blockImageMultiply(block, uv_mask, left, right, up);
+		benchmark::DoNotOptimize(block.data.data());
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BlockImageMultiply)->Arg(24)->Arg(48);
+
+static void BM_ImageResizeHalf(benchmark::State& state) {
+	RGBAImage image = synthetic::createTileImage(TILE_SIZE, TILE_SIZE, 5);
+	RGBAImage dest;
+	for (auto _ : state) {
+		renderer::imageResizeHalf(image, dest);
+		benchmark::DoNotOptimize(dest.data.data());
+	}
+	state.SetBytesProcessed(state.iterations() * image.data.size() * sizeof(RGBAPixel));
+}
+BENCHMARK(BM_ImageResizeHalf);
+
+static void BM_ResizeHalfInto(benchmark::State& state) {
+	renderer::DownsampleMode mode = (renderer::DownsampleMode) state.range(0);
+	RGBAImage image = synthetic::createTileImage(TILE_SIZE, TILE_SIZE, 6);
+	RGBAImage composite(TILE_SIZE, TILE_SIZE);
+	for (auto _ : state) {
+		// downscale the four children of a composite tile into their quadrants
+		for (int i = 0; i < 4; i++)
+			image.resizeHalfInto(composite, i % 2 * TILE_SIZE / 2, i / 2 * TILE_SIZE / 2, mode);
+		benchmark::DoNotOptimize(composite.data.data());
+	}
+	state.SetBytesProcessed(state.iterations() * 4 * image.data.size() * sizeof(RGBAPixel));
+}
+BENCHMARK(BM_ResizeHalfInto)
+	->Arg((int) renderer::DownsampleMode::AVERAGE)
+	->Arg((int) renderer::DownsampleMode::ALPHA_WEIGHTED)
+	->Arg((int) renderer::DownsampleMode::LINEAR);
+
+static void BM_EncodePNG(benchmark::State& state) {
+	RGBAImage image = synthetic::createTileImage(TILE_SIZE, TILE_SIZE, 7);
+	renderer::PNGWriteOptions options = state.range(0) ? renderer::PNGWriteOptions::fast()
+			: renderer::PNGWriteOptions();
+	std::vector<uint8_t> buffer;
+	for (auto _ : state) {
+		buffer.clear();
+		if (!image.encodePNG(buffer, options))
+			state.SkipWithError("Unable to encode PNG");
+	}
+	state.SetBytesProcessed(state.iterations() * image.data.size() * sizeof(RGBAPixel));
+	state.counters["size"] = buffer.size();
+}
+BENCHMARK(BM_EncodePNG)->ArgName("fast")->Arg(0)->Arg(1);
+
+static void BM_EncodeJPEG(benchmark::State& state) {
+	RGBAImage image = synthetic::createTileImage(TILE_SIZE, TILE_SIZE, 8);
+	renderer::JPEGWriteOptions options(state.range(0));
+	std::vector<uint8_t> buffer;
+	for (auto _ : state) {
+		buffer.clear();
+		if (!image.encodeJPEG(buffer, options))
+			state.SkipWithError("Unable to encode JPEG");
+	}
+	state.SetBytesProcessed(state.iterations() * image.data.size() * sizeof(RGBAPixel));
+	state.counters["size"] = buffer.size();
+}
+BENCHMARK(BM_EncodeJPEG)->ArgName("quality")->Arg(70)->Arg(90);
+
+static void BM_OctreeColorQuantize(benchmark::State& state) {
+	RGBAImage image = synthetic::createTileImage(TILE_SIZE, TILE_SIZE, 9);
+	std::vector<RGBAPixel> colors;
+	for (auto _ : state) {
+		colors.clear();
+		renderer::octreeColorQuantize(image, 256, colors);
+		benchmark::DoNotOptimize(colors.data());
+	}
+	state.SetItemsProcessed(state.iterations() * image.data.size());
+}
+BENCHMARK(BM_OctreeColorQuantize);
+
+static void BM_EncodeIndexedPNG(benchmark::State& state) {
+	RGBAImage image = synthetic::createTileImage(TILE_SIZE, TILE_SIZE, 10);
+	std::vector<uint8_t> buffer;
+	for (auto _ : state) {
+		buffer.clear();
+		if (!image.encodeIndexedPNG(buffer, 8, state.range(0)))
+			state.SkipWithError("Unable to encode indexed PNG");
+	}
+	state.SetBytesProcessed(state.iterations() * image.data.size() * sizeof(RGBAPixel));
+	state.counters["size"] = buffer.size();
+}
+BENCHMARK(BM_EncodeIndexedPNG)->ArgName("dithered")->Arg(0)->Arg(1);
@@ -0,0 +1,207 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "renderfixture.h"
+#include "syntheticdata.h"
+#include "../mapcraftercore/renderer/tileimageformat.h"
+#include "../mapcraftercore/util.h"
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+
+namespace config = mapcrafter::config;
+namespace renderer = mapcrafter::renderer;
+namespace util = mapcrafter::util;
+
+namespace {
+
+double getSeconds(std::chrono::steady_clock::duration duration) {
+	return std::chrono::duration<double>(duration).count();
+}
+
+}
+
+/**
+ * Renders a number of tiles of a map and reports how many tiles per second were
+ * rendered (and encoded) by a single thread. Without a configuration file, a synthetic
+ * world is generated for this in a temporary directory, so the results are
+ * reproducible and don't depend on any real world.
+ */
+int main(int argc, char** argv) {
+	synthetic::WorldOptions world_options;
+	std::string config_file, map, work_dir, template_dir, block_dir;
+	std::string view_name, mode_name, image_format;
+	int size, texture_size, tiles_count;
+
+	po::options_description all("Allowed options");
+	all.add_options()
+		("help,h", "shows this help message")
+
+		("tiles,n", po::value<int>(&tiles_count)->default_value(100),
+			"the count of render tiles to render")
+		("no-encode", "only renders the tiles, doesn't encode them")
+
+		("config,c", po::value<std::string>(&config_file),
+			"the configuration file of a map to render, "
+			"a synthetic world is rendered if not specified")
+		("map,m", po::value<std::string>(&map),
+			"the map of the configuration file to render, defaults to the first one")
+
+		("work-dir", po::value<std::string>(&work_dir),
+			"the directory to write the synthetic world to, "
+			"a temporary directory is used (and removed) if not specified")
+		("size,s", po::value<int>(&size)->default_value(32),
+			"the size of the synthetic world in chunks (size x size chunks)")
+		("seed", po::value<uint32_t>(&world_options.seed)->default_value(world_options.seed),
+			"the seed of the synthetic world")
+		("roughness", po::value<double>(&world_options.roughness)
+				->default_value(world_options.roughness),
+			"how hilly the terrain is, from 0 (almost flat) to 1 (mountains)")
+		("water-ratio", po::value<double>(&world_options.water_ratio)
+				->default_value(world_options.water_ratio),
+			"the fraction of the surface that is covered with water (0 to 1)")
+		("cave-density", po::value<double>(&world_options.cave_density)
+				->default_value(world_options.cave_density),
+			"the fraction of the underground that is carved out by caves (0 to 1)")
+		("render-view", po::value<std::string>(&view_name)->default_value("isometric"),
+			"the render view of the synthetic map")
+		("render-mode", po::value<std::string>(&mode_name)->default_value("daylight"),
+			"the render mode of the synthetic map")
+		("texture-size", po::value<int>(&texture_size)->default_value(12),
+			"the texture size of the synthetic map")
+		("image-format", po::value<std::string>(&image_format)->default_value("png"),
+			"the image format of the synthetic map")
+		("template-dir", po::value<std::string>(&template_dir),
+			"the template directory, automatically determined if not specified")
+		("block-dir", po::value<std::string>(&block_dir),
+			"the block directory, automatically determined if not specified");
+
+	po::variables_map vm;
+	try {
+		po::store(po::parse_command_line(argc, argv, all), vm);
+	} catch (po::error& ex) {
+		std::cout << "There is a problem parsing the command line arguments: "
+				<< ex.what() << std::endl << std::endl;
+		std::cout << all << std::endl;
+		return 1;
+	}
+
+	po::notify(vm);
+
+	if (vm.count("help")) {
+		std::cout << all << std::endl;
+		return 1;
+	}
+
+	// the synthetic world is written to a temporary directory if not specified
+	fs::path work_path = work_dir;
+	if (config_file.empty() && work_dir.empty())
+		work_path = fs::temp_directory_path() / fs::unique_path("mapcrafter-bench-%%%%-%%%%");
+	synthetic::DirectoryRemover remover(work_dir.empty() && config_file.empty() ? work_path : fs::path());
+
+	config::MapcrafterConfig config;
+	config::ValidationMap validation;
+	if (!config_file.empty()) {
+		validation = config.parseFile(config_file);
+	} else {
+		synthetic::WorldGenerator generator(world_options);
+		LOG(INFO) << "Writing a synthetic world with " << size << "x" << size
+				<< " chunks to " << work_path << "...";
+		if (generator.writeWorld(work_path / "world", size) == -1) {
+			LOG(FATAL) << "Unable to write the synthetic world!";
+			return 1;
+		}
+		validation = config.parseString(synthetic::createMapConfig(work_path, view_name, mode_name,
+				texture_size, image_format, template_dir, block_dir), work_path);
+	}
+
+	if (!validation.isEmpty()) {
+		if (validation.isCritical())
+			LOG(FATAL) << "The configuration is invalid!";
+		else
+			LOG(WARNING) << "Some notes on the configuration:";
+		validation.log();
+	}
+	if (validation.isCritical() || config.getMaps().empty())
+		return 1;
+
+	if (map.empty())
+		map = config.getMaps().begin()->getShortName();
+	if (!config.hasMap(map)) {
+		LOG(FATAL) << "Unknown map '" << map << "'.";
+		return 1;
+	}
+	renderer::RenderRotation::Direction rotation = *config.getMap(map).getRotations().begin();
+
+	auto time_start = std::chrono::steady_clock::now();
+	synthetic::RenderFixture fixture;
+	if (!fixture.setUp(config, map, rotation))
+		return 1;
+
+	double setup_seconds = getSeconds(std::chrono::steady_clock::now() - time_start);
+
+	// render a contiguous range of tiles from the middle of the map, the tiles at the
+	// border of the world are only partially covered by chunks
+	const std::vector<renderer::TilePos>& required = fixture.getRenderTiles();
+	int count = std::min<int>(tiles_count, required.size());
+	size_t first = (required.size() - count) / 2;
+	bool encode = !vm.count("no-encode");
+	LOG(INFO) << "Rendering " << count << " of " << required.size() << " render tiles of map '"
+			<< map << "'...";
+
+	std::chrono::steady_clock::duration render_time(0), encode_time(0);
+	renderer::RGBAImage image;
+	std::vector<uint8_t> buffer;
+	size_t encoded_bytes = 0;
+	int empty = 0;
+	for (int i = 0; i < count; i++) {
+		auto start = std::chrono::steady_clock::now();
+		fixture.renderTile(required[first + i], image);
+		auto rendered = std::chrono::steady_clock::now();
+		render_time += rendered - start;
+		if (image.isTransparent()) {
+			empty++;
+			continue;
+		}
+		if (encode) {
+			buffer.clear();
+			fixture.tile_format->encode(image, buffer, true);
+			encode_time += std::chrono::steady_clock::now() - rendered;
+			encoded_bytes += buffer.size();
+		}
+	}
+
+	double render_seconds = getSeconds(render_time), encode_seconds = getSeconds(encode_time);
+	double total_seconds = render_seconds + encode_seconds;
+	int encoded = count - empty;
+	std::cout << "setup:    " << setup_seconds << " s" << std::endl;
+	std::cout << "tiles:    " << count << " (" << empty << " empty)" << std::endl;
+	std::cout << "render:   " << (count ? render_seconds * 1000 / count : 0) << " ms/tile" << std::endl;
+	if (encode)
+		std::cout << "encode:   " << (encoded ? encode_seconds * 1000 / encoded : 0)
+				<< " ms/tile, " << (encoded ? encoded_bytes / encoded : 0) << " bytes/tile" << std::endl;
+	std::cout << "tiles/s:  " << (total_seconds > 0 ? count / total_seconds : 0) << std::endl;
+	return 0;
+}
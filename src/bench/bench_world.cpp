@@ -0,0 +1,148 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "syntheticdata.h"
+
+#include "../mapcraftercore/mc/blockstate.h"
+#include "../mapcraftercore/mc/chunk.h"
+#include "../mapcraftercore/mc/world.h"
+#include "../mapcraftercore/mc/worldcache.h"
+#include "../mapcraftercore/renderer/biomes.h"
+#include "../mapcraftercore/renderer/blockimages.h"
+
+#include <benchmark/benchmark.h>
+#include <boost/filesystem.hpp>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace fs = boost::filesystem;
+namespace mc = mapcrafter::mc;
+namespace renderer = mapcrafter::renderer;
+
+static void BM_ChunkReadNBT(benchmark::State& state) {
+	renderer::Biome::initializeBiomes();
+	mc::BlockStateRegistry registry;
+	std::vector<uint8_t> data = synthetic::createChunkData(mc::ChunkPos(3, 5), 1);
+	mc::Chunk chunk;
+	for (auto _ : state) {
+		if (!chunk.readNBT(registry, (const char*) data.data(), data.size()))
+			state.SkipWithError("Unable to read chunk");
+	}
+	state.SetItemsProcessed(state.iterations());
+	state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_ChunkReadNBT);
+
+static void BM_ReadPackedShorts(benchmark::State& state) {
+	int bits = state.range(0);
+	std::mt19937 random(2);
+	std::uniform_int_distribution<int> dist(0, (1 << bits) - 1);
+	std::vector<uint16_t> values(16 * 16 * 16);
+	for (size_t i = 0; i < values.size(); i++)
+		values[i] = dist(random);
+	std::vector<int64_t> data = synthetic::packShorts(values, bits);
+	std::vector<uint16_t> unpacked(values.size());
+	for (auto _ : state) {
+		mc::readPackedShorts_v116(data, unpacked.data(), unpacked.data() + unpacked.size());
+		benchmark::DoNotOptimize(unpacked.data());
+	}
+	state.SetItemsProcessed(state.iterations() * values.size());
+}
+BENCHMARK(BM_ReadPackedShorts)->ArgName("bits")->DenseRange(4, 8);
+
+static void BM_BiomeGetColor(benchmark::State& state) {
+	renderer::Biome::initializeBiomes();
+	renderer::ColorMap color_map;
+	color_map.parse("#ff55b7be|#ff96b481|#ff33cd49");
+	const char* names[] = {"minecraft:plains", "minecraft:forest", "minecraft:swamp",
+		"minecraft:dark_forest"};
+	std::vector<const renderer::Biome*> biomes;
+	for (size_t i = 0; i < 4; i++)
+		biomes.push_back(&renderer::Biome::getBiome(renderer::Biome::getBiomeId(names[i])));
+
+	int64_t colors = 0;
+	for (auto _ : state) {
+		for (int x = 0; x < 16; x++)
+			for (int z = 0; z < 16; z++) {
+				const renderer::Biome& biome = *biomes[(x / 4 + z / 4) % biomes.size()];
+				benchmark::DoNotOptimize(biome.getColor(mc::BlockPos(x, z, 64),
+						renderer::ColorMapType::GRASS, color_map));
+				colors++;
+			}
+	}
+	state.SetItemsProcessed(colors);
+}
+BENCHMARK(BM_BiomeGetColor);
+
+namespace {
+
+/**
+ * A temporary synthetic world.
+ */
+class SyntheticWorld {
+public:
+	SyntheticWorld(int chunks)
+		: dir(fs::temp_directory_path() / fs::unique_path("mapcrafter-bench-%%%%-%%%%")) {
+		fs::create_directories(dir / "cache");
+		synthetic::WorldGenerator(synthetic::WorldOptions()).writeWorld(dir / "world", chunks);
+
+		world.reset(new mc::World((dir / "world").string(), mc::Dimension::OVERWORLD,
+				(dir / "cache").string()));
+		world->load();
+	}
+
+	~SyntheticWorld() {
+		world.reset();
+		fs::remove_all(dir);
+	}
+
+	const mc::World& getWorld() const {
+		return *world;
+	}
+
+private:
+	fs::path dir;
+	std::unique_ptr<mc::World> world;
+};
+
+}
+
+static void BM_WorldCacheGetBlock(benchmark::State& state) {
+	const int chunks = 8;
+	renderer::Biome::initializeBiomes();
+	SyntheticWorld world(chunks);
+	mc::BlockStateRegistry registry;
+	mc::WorldCache cache(registry, world.getWorld());
+
+	int64_t blocks = 0;
+	for (auto _ : state) {
+		// walk the columns from the top like the tile renderer does
+		for (int x = 0; x < chunks * 16; x++)
+			for (int z = 0; z < chunks * 16; z++)
+				for (int y = 80; y >= 48; y--) {
+					mc::Block block = cache.getBlock(mc::BlockPos(x, z, y), nullptr,
+							mc::GET_ID | mc::GET_LIGHT);
+					benchmark::DoNotOptimize(block);
+					blocks++;
+				}
+	}
+	state.SetItemsProcessed(blocks);
+}
+BENCHMARK(BM_WorldCacheGetBlock)->Unit(benchmark::kMillisecond);
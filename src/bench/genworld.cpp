@@ -0,0 +1,109 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "syntheticdata.h"
+#include "../mapcraftercore/util.h"
+
+#include <iostream>
+#include <string>
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+namespace util = mapcrafter::util;
+
+/**
+ * Writes a synthetic Minecraft world, for example to benchmark rendering whole maps
+ * without needing a real world.
+ */
+int main(int argc, char** argv) {
+	synthetic::WorldOptions options;
+	std::string output_dir, biomes;
+	int size;
+
+	po::options_description all("Allowed options");
+	all.add_options()
+		("help,h", "shows this help message")
+
+		("output-dir,o", po::value<std::string>(&output_dir),
+			"the directory to write the world to (required)")
+		("size,s", po::value<int>(&size)->default_value(64),
+			"the size of the world in chunks (size x size chunks)")
+		("seed", po::value<uint32_t>(&options.seed)->default_value(options.seed),
+			"the seed of the world")
+		("roughness", po::value<double>(&options.roughness)->default_value(options.roughness),
+			"how hilly the terrain is, from 0 (almost flat) to 1 (mountains)")
+		("water-ratio", po::value<double>(&options.water_ratio)->default_value(options.water_ratio),
+			"the fraction of the surface that is covered with water (0 to 1)")
+		("cave-density", po::value<double>(&options.cave_density)->default_value(options.cave_density),
+			"the fraction of the underground that is carved out by caves (0 to 1)")
+		("biomes", po::value<std::string>(&biomes),
+			"the biomes of the land with their weights, "
+			"for example 'plains:3,forest:2,desert:1,swamp:1' (the default)");
+
+	po::variables_map vm;
+	try {
+		po::store(po::parse_command_line(argc, argv, all), vm);
+	} catch (po::error& ex) {
+		std::cout << "There is a problem parsing the command line arguments: "
+				<< ex.what() << std::endl << std::endl;
+		std::cout << all << std::endl;
+		return 1;
+	}
+
+	po::notify(vm);
+
+	if (vm.count("help")) {
+		std::cout << all << std::endl;
+		return 1;
+	}
+
+	if (!vm.count("output-dir")) {
+		std::cerr << "You have to specify an output directory!" << std::endl;
+		return 1;
+	}
+	if (size <= 0) {
+		std::cerr << "The size of the world must be positive!" << std::endl;
+		return 1;
+	}
+	if (options.roughness < 0 || options.roughness > 1
+			|| options.water_ratio < 0 || options.water_ratio > 1
+			|| options.cave_density < 0 || options.cave_density > 1) {
+		std::cerr << "Roughness, water ratio and cave density must be between 0 and 1!"
+				<< std::endl;
+		return 1;
+	}
+	if (!biomes.empty() && !options.parseBiomes(biomes)) {
+		std::cerr << "Invalid biomes '" << biomes << "'!" << std::endl;
+		return 1;
+	}
+
+	util::Logging::getInstance().setSinkLogProgress("__output__", true);
+
+	LOG(INFO) << "Writing a synthetic world with " << size << "x" << size
+			<< " chunks to " << output_dir << "...";
+	util::LogOutputProgressHandler progress;
+	synthetic::WorldGenerator generator(options);
+	int chunks = generator.writeWorld(output_dir, size, &progress);
+	if (chunks == -1) {
+		LOG(ERROR) << "Unable to write the world to " << output_dir << ".";
+		return 1;
+	}
+	LOG(INFO) << "Wrote " << chunks << " chunks.";
+	return 0;
+}
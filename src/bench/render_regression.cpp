@@ -0,0 +1,392 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "renderfixture.h"
+#include "syntheticdata.h"
+#include "../mapcraftercore/renderer/tilerenderer.h"
+#include "../mapcraftercore/util.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+
+namespace config = mapcrafter::config;
+namespace renderer = mapcrafter::renderer;
+namespace util = mapcrafter::util;
+
+namespace {
+
+const char* RENDER_VIEWS[] = {"isometric", "side", "topdown"};
+const char* RENDER_MODES[] = {"plain", "daylight", "nightlight", "cave", "cavelight"};
+
+/**
+ * The result of comparing a rendered image with its golden image.
+ */
+struct ImageDifference {
+	ImageDifference()
+		: pixels(0), max_difference(0) {}
+
+	// count of pixels whose channels differ more than the tolerance
+	int pixels;
+	// maximum difference of a channel of all pixels
+	int max_difference;
+};
+
+int getDifference(renderer::RGBAPixel p1, renderer::RGBAPixel p2) {
+	int difference = std::abs(renderer::rgba_red(p1) - renderer::rgba_red(p2));
+	difference = std::max(difference, std::abs(renderer::rgba_green(p1) - renderer::rgba_green(p2)));
+	difference = std::max(difference, std::abs(renderer::rgba_blue(p1) - renderer::rgba_blue(p2)));
+	return std::max(difference, std::abs(renderer::rgba_alpha(p1) - renderer::rgba_alpha(p2)));
+}
+
+/**
+ * Compares two images of the same size. The differing pixels are marked red in the
+ * difference image, the others are the faded golden image.
+ */
+ImageDifference compareImages(const renderer::RGBAImage& image,
+		const renderer::RGBAImage& golden, int tolerance, renderer::RGBAImage& diff) {
+	ImageDifference result;
+	diff = renderer::RGBAImage(image.getWidth(), image.getHeight());
+	for (int x = 0; x < image.getWidth(); x++)
+		for (int y = 0; y < image.getHeight(); y++) {
+			int difference = getDifference(image.getPixel(x, y), golden.getPixel(x, y));
+			result.max_difference = std::max(result.max_difference, difference);
+			if (difference > tolerance) {
+				result.pixels++;
+				diff.setPixel(x, y, renderer::rgba(255, 0, 0, 255));
+			} else {
+				renderer::RGBAPixel pixel = golden.getPixel(x, y);
+				diff.setPixel(x, y, renderer::rgba(renderer::rgba_red(pixel),
+						renderer::rgba_green(pixel), renderer::rgba_blue(pixel),
+						renderer::rgba_alpha(pixel) / 4));
+			}
+		}
+	return result;
+}
+
+/**
+ * Returns the (at most) count tiles nearest to the center of the map which are not
+ * empty, sorted by their position.
+ */
+std::vector<renderer::TilePos> getCenterTiles(synthetic::RenderFixture& fixture, int count) {
+	std::vector<renderer::TilePos> tiles = fixture.getRenderTiles();
+	double center_x = 0, center_y = 0;
+	for (auto it = tiles.begin(); it != tiles.end(); ++it) {
+		center_x += (double) it->getX() / tiles.size();
+		center_y += (double) it->getY() / tiles.size();
+	}
+	std::stable_sort(tiles.begin(), tiles.end(),
+		[center_x, center_y](const renderer::TilePos& t1, const renderer::TilePos& t2) {
+			return std::hypot(t1.getX() - center_x, t1.getY() - center_y)
+					< std::hypot(t2.getX() - center_x, t2.getY() - center_y);
+		});
+
+	std::vector<renderer::TilePos> center_tiles;
+	renderer::RGBAImage image;
+	for (auto it = tiles.begin(); it != tiles.end() && (int) center_tiles.size() < count; ++it) {
+		fixture.renderTile(*it, image);
+		if (!image.isTransparent())
+			center_tiles.push_back(*it);
+	}
+	std::sort(center_tiles.begin(), center_tiles.end());
+	return center_tiles;
+}
+
+/**
+ * Reads the per-tile time budgets (in milliseconds) of the test cases from a JSON file
+ * like {"budgets": {"isometric_daylight": 12.5, ...}}.
+ */
+bool readBudgets(const fs::path& filename, std::map<std::string, double>& budgets) {
+	std::ifstream in(filename.string());
+	if (!in)
+		return false;
+	std::stringstream ss;
+	ss << in.rdbuf();
+	std::string data = ss.str();
+
+	picojson::value value;
+	std::string json_error;
+	picojson::parse(value, data.begin(), data.end(), &json_error);
+	try {
+		if (!json_error.empty() || !value.is<picojson::object>())
+			throw util::JSONError(json_error);
+		picojson::object object = util::json_get<picojson::object>(
+				value.get<picojson::object>(), "budgets");
+		for (auto it = object.begin(); it != object.end(); ++it)
+			if (it->second.is<double>())
+				budgets[it->first] = it->second.get<double>();
+	} catch (util::JSONError& e) {
+		LOG(ERROR) << "The budget file " << filename << " is invalid: " << e.what();
+		return false;
+	}
+	return true;
+}
+
+bool writeBudgets(const fs::path& filename, const std::map<std::string, double>& budgets) {
+	// written by hand because picojson writes doubles with all their digits, a
+	// hundredth of a millisecond is precise enough
+	std::ostringstream out;
+	out << "{" << std::endl << "\t\"budgets\": {" << std::endl;
+	out << std::fixed << std::setprecision(2);
+	for (auto it = budgets.begin(); it != budgets.end(); ++it)
+		out << "\t\t\"" << it->first << "\": " << it->second
+			<< (std::next(it) != budgets.end() ? "," : "") << std::endl;
+	out << "\t}" << std::endl << "}" << std::endl;
+	std::string data = out.str();
+	return util::writeFileAtomic(filename, reinterpret_cast<const uint8_t*>(data.data()),
+			data.size());
+}
+
+}
+
+/**
+ * Renders a few tiles of a synthetic world in every render view and render mode and
+ * compares them with golden images, so changes of the renderer that change what the
+ * maps look like are noticed. It also measures how long rendering a tile takes and
+ * compares that with per-tile time budgets, so performance regressions are noticed.
+ */
+int main(int argc, char** argv) {
+	synthetic::WorldOptions world_options;
+	std::string golden_dir, output_dir, budget_file, work_dir, template_dir, block_dir;
+	std::string views, modes;
+	int size, texture_size, tiles_count, repeat, tolerance;
+	double max_diff_pixels, max_regression;
+
+	po::options_description all("Allowed options");
+	all.add_options()
+		("help,h", "shows this help message")
+
+		("golden-dir,g", po::value<std::string>(&golden_dir),
+			"the directory with the golden images (required)")
+		("update", "writes the rendered images as new golden images")
+		("output-dir,o", po::value<std::string>(&output_dir),
+			"the directory to write the rendered and difference images of failed tests to")
+		("tolerance", po::value<int>(&tolerance)->default_value(4),
+			"how much a color channel of a pixel may differ from the golden image (0 to 255)")
+		("max-diff-pixels", po::value<double>(&max_diff_pixels)->default_value(0.1),
+			"the percentage of pixels which may differ more than the tolerance")
+
+		("budgets,b", po::value<std::string>(&budget_file),
+			"the JSON file with the per-tile time budgets, the times are not checked if "
+			"not specified")
+		("update-budgets", "writes the measured times to the budget file")
+		("max-regression", po::value<double>(&max_regression)->default_value(20),
+			"by how many percent a per-tile time may exceed its budget")
+		("repeat,r", po::value<int>(&repeat)->default_value(5),
+			"how often every tile is rendered, the fastest time is used")
+
+		("views", po::value<std::string>(&views),
+			"the render views to test (comma separated), defaults to all")
+		("modes", po::value<std::string>(&modes),
+			"the render modes to test (comma separated), defaults to all")
+		("tiles,n", po::value<int>(&tiles_count)->default_value(2),
+			"the count of render tiles to render per render view and mode")
+		("size,s", po::value<int>(&size)->default_value(8),
+			"the size of the synthetic world in chunks (size x size chunks)")
+		("texture-size", po::value<int>(&texture_size)->default_value(12),
+			"the texture size of the maps")
+		("work-dir", po::value<std::string>(&work_dir),
+			"the directory to write the synthetic world to, "
+			"a temporary directory is used (and removed) if not specified")
+		("template-dir", po::value<std::string>(&template_dir),
+			"the template directory, automatically determined if not specified")
+		("block-dir", po::value<std::string>(&block_dir),
+			"the block directory, automatically determined if not specified");
+
+	po::variables_map vm;
+	try {
+		po::store(po::parse_command_line(argc, argv, all), vm);
+	} catch (po::error& ex) {
+		std::cout << "There is a problem parsing the command line arguments: "
+				<< ex.what() << std::endl << std::endl;
+		std::cout << all << std::endl;
+		return 1;
+	}
+
+	po::notify(vm);
+
+	if (vm.count("help")) {
+		std::cout << all << std::endl;
+		return 1;
+	}
+
+	if (golden_dir.empty()) {
+		std::cerr << "You have to specify the directory with the golden images!" << std::endl;
+		return 1;
+	}
+	if (vm.count("update-budgets") && budget_file.empty()) {
+		std::cerr << "You have to specify the budget file to update!" << std::endl;
+		return 1;
+	}
+	if (tiles_count <= 0 || repeat <= 0) {
+		std::cerr << "The count of tiles and repetitions must be positive!" << std::endl;
+		return 1;
+	}
+
+	bool update = vm.count("update");
+	std::map<std::string, double> budgets;
+	if (!budget_file.empty() && fs::exists(budget_file) && !readBudgets(budget_file, budgets))
+		return 1;
+	if (!budget_file.empty() && budgets.empty() && !vm.count("update-budgets"))
+		LOG(WARNING) << "There are no time budgets in " << budget_file << ".";
+
+	std::vector<std::string> test_views(std::begin(RENDER_VIEWS), std::end(RENDER_VIEWS));
+	std::vector<std::string> test_modes(std::begin(RENDER_MODES), std::end(RENDER_MODES));
+	if (!views.empty())
+		test_views = util::split(views, ',');
+	if (!modes.empty())
+		test_modes = util::split(modes, ',');
+
+	// the synthetic world is written to a temporary directory if not specified
+	fs::path work_path = work_dir;
+	if (work_dir.empty())
+		work_path = fs::temp_directory_path() / fs::unique_path("mapcrafter-regression-%%%%-%%%%");
+	synthetic::DirectoryRemover remover(work_dir.empty() ? work_path : fs::path());
+
+	synthetic::WorldGenerator generator(world_options);
+	if (generator.writeWorld(work_path / "world", size) == -1) {
+		LOG(FATAL) << "Unable to write the synthetic world!";
+		return 1;
+	}
+	if (update)
+		fs::create_directories(golden_dir);
+	if (!output_dir.empty())
+		fs::create_directories(output_dir);
+
+	int failures = 0;
+	for (auto view = test_views.begin(); view != test_views.end(); ++view)
+		for (auto mode = test_modes.begin(); mode != test_modes.end(); ++mode) {
+			std::string name = *view + "_" + *mode;
+
+			config::MapcrafterConfig config;
+			config::ValidationMap validation = config.parseString(synthetic::createMapConfig(
+					work_path, *view, *mode, texture_size, "png", template_dir, block_dir),
+					work_path);
+			if (validation.isCritical()) {
+				LOG(FATAL) << "The configuration of " << name << " is invalid!";
+				validation.log();
+				return 1;
+			}
+
+			synthetic::RenderFixture fixture;
+			if (!fixture.setUp(config, "synthetic", renderer::RenderRotation::TOP_LEFT))
+				return 1;
+
+			// render the tiles nearest to the center of the map, the tiles at the border
+			// of the world are only partially covered by chunks
+			std::vector<renderer::TilePos> tiles = getCenterTiles(fixture, tiles_count);
+			int count = tiles.size();
+			int tile_width = fixture.context.tile_renderer->getTileWidth();
+			int tile_height = fixture.context.tile_renderer->getTileHeight();
+
+			// the tiles are placed next to each other in one image, the fastest time of
+			// all repetitions is used for every tile
+			renderer::RGBAImage image(count * tile_width, tile_height), tile;
+			std::vector<double> times(count, std::numeric_limits<double>::max());
+			for (int r = 0; r < repeat; r++)
+				for (int i = 0; i < count; i++) {
+					auto start = std::chrono::steady_clock::now();
+					fixture.renderTile(tiles[i], tile);
+					std::chrono::duration<double, std::milli> time =
+							std::chrono::steady_clock::now() - start;
+					times[i] = std::min(times[i], time.count());
+					if (r == 0)
+						image.simpleBlit(tile, i * tile_width, 0);
+				}
+			double time_per_tile = 0;
+			for (int i = 0; i < count; i++)
+				time_per_tile += times[i] / count;
+
+			std::ostringstream status;
+			bool failed = false;
+			fs::path golden_file = fs::path(golden_dir) / (name + ".png");
+			renderer::RGBAImage golden;
+			if (update) {
+				if (!image.writePNG(golden_file.string())) {
+					LOG(FATAL) << "Unable to write the golden image " << golden_file << "!";
+					return 1;
+				}
+				status << "updated";
+			} else if (!golden.readPNG(golden_file.string())) {
+				status << "no golden image";
+				failed = true;
+			} else if (golden.getWidth() != image.getWidth()
+					|| golden.getHeight() != image.getHeight()) {
+				status << "image size " << image.getWidth() << "x" << image.getHeight()
+						<< " instead of " << golden.getWidth() << "x" << golden.getHeight();
+				failed = true;
+			} else {
+				renderer::RGBAImage diff;
+				ImageDifference difference = compareImages(image, golden, tolerance, diff);
+				double percentage = 100.0 * difference.pixels
+						/ (image.getWidth() * image.getHeight());
+				status << difference.pixels << " pixels differ (max " << difference.max_difference << ")";
+				if (percentage > max_diff_pixels) {
+					failed = true;
+					if (!output_dir.empty())
+						diff.writePNG((fs::path(output_dir) / (name + "_diff.png")).string());
+				}
+			}
+			if (failed && !output_dir.empty())
+				image.writePNG((fs::path(output_dir) / (name + ".png")).string());
+
+			status << ", " << std::fixed << std::setprecision(2) << time_per_tile << " ms/tile";
+			if (vm.count("update-budgets")) {
+				budgets[name] = time_per_tile;
+			} else if (budgets.count(name)) {
+				double regression = 100 * (time_per_tile / budgets[name] - 1);
+				status << " (budget " << budgets[name] << " ms, " << std::showpos
+						<< std::setprecision(0) << regression << "%" << std::noshowpos << ")";
+				if (regression > max_regression) {
+					status << " over budget";
+					failed = true;
+				}
+			}
+
+			std::cout << std::left << std::setw(24) << name << (failed ? "FAIL  " : "ok    ")
+					<< status.str() << std::endl;
+			if (failed)
+				failures++;
+		}
+
+	if (vm.count("update-budgets") && !writeBudgets(budget_file, budgets)) {
+		LOG(FATAL) << "Unable to write the budget file " << budget_file << "!";
+		return 1;
+	}
+
+	if (failures != 0) {
+		std::cout << failures << " of " << test_views.size() * test_modes.size()
+				<< " tests failed." << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "renderfixture.h"
+
+#include "../mapcraftercore/mc/world.h"
+#include "../mapcraftercore/renderer/biomes.h"
+#include "../mapcraftercore/renderer/blockimages.h"
+#include "../mapcraftercore/renderer/renderview.h"
+#include "../mapcraftercore/renderer/tileimageformat.h"
+#include "../mapcraftercore/renderer/tilerenderer.h"
+#include "../mapcraftercore/renderer/tileset.h"
+#include "../mapcraftercore/util.h"
+
+#include <sstream>
+
+namespace synthetic {
+
+namespace util = mapcrafter::util;
+
+std::string createMapConfig(const fs::path& work_dir, const std::string& render_view,
+		const std::string& render_mode, int texture_size, const std::string& image_format,
+		const std::string& template_dir, const std::string& block_dir) {
+	std::ostringstream config;
+	config << "output_dir = " << (work_dir / "output").string() << std::endl;
+	if (!template_dir.empty())
+		config << "template_dir = " << template_dir << std::endl;
+	config << "[world:synthetic]" << std::endl;
+	config << "input_dir = " << (work_dir / "world").string() << std::endl;
+	config << "[map:synthetic]" << std::endl;
+	config << "name = Synthetic" << std::endl;
+	config << "world = synthetic" << std::endl;
+	config << "render_view = " << render_view << std::endl;
+	config << "render_mode = " << render_mode << std::endl;
+	config << "texture_size = " << texture_size << std::endl;
+	config << "image_format = " << image_format << std::endl;
+	if (!block_dir.empty())
+		config << "block_dir = " << block_dir << std::endl;
+	return config.str();
+}
+
+RenderFixture::RenderFixture() {
+}
+
+RenderFixture::~RenderFixture() {
+}
+
+bool RenderFixture::setUp(const config::MapcrafterConfig& config, const std::string& map,
+		renderer::RenderRotation::Direction rotation) {
+	config::MapSection map_config = config.getMap(map);
+	config::WorldSection world_config = config.getWorld(map_config.getWorld());
+
+	fs::path cache_dir = config.getCachePath(world_config.getShortName());
+	fs::create_directories(cache_dir);
+	fs::create_directories(config.getCacheDir());
+	std::shared_ptr<mc::World> world(new mc::World(world_config.getInputDir().string(),
+			world_config.getDimension(), cache_dir.string()));
+	world->setWorldCrop(world_config.getWorldCrop());
+	if (!world->load()) {
+		LOG(FATAL) << "Unable to load the world!";
+		return false;
+	}
+
+	render_view.reset(renderer::createRenderView(
+			map_config.getRenderView(), rotation, map_config.getWaterOpacity()));
+	tile_set.reset(render_view->createTileSet(map_config.getTileWidth()));
+	tile_set->scan(*world);
+	tile_set->resetRequired();
+
+	block_images.reset(render_view->createBlockImages(block_registry));
+	render_view->configureBlockImages(block_images.get(), world_config, map_config);
+	renderer::RenderedBlockImages* rendered_block_images =
+			dynamic_cast<renderer::RenderedBlockImages*>(block_images.get());
+	if (rendered_block_images != nullptr) {
+		rendered_block_images->setCacheDir(config.getCacheDir());
+		if (!rendered_block_images->loadBlockImages(map_config.getBlockDir().string(),
+				util::str(map_config.getRenderView()), rotation, map_config.getTextureSize())) {
+			LOG(FATAL) << "Unable to load the block images!";
+			return false;
+		}
+	}
+	renderer::Biome::initializeBiomes();
+
+	context.background_color = config.getBackgroundColor();
+	context.world_config = world_config;
+	context.map_config = map_config;
+	context.render_view = render_view.get();
+	context.block_images = block_images.get();
+	context.tile_set = tile_set.get();
+	context.block_registry = &block_registry;
+	context.world = world;
+	context.initializeTileRenderer();
+
+	config::Color bg = context.background_color;
+	tile_format.reset(new renderer::TileImageFormat(map_config,
+			renderer::rgba(bg.red, bg.green, bg.blue, 255)));
+	if (tile_format->useGlobalPalette() && rendered_block_images != nullptr)
+		tile_format->setPalette(renderer::TileImageFormat::createBlockPalette(
+				rendered_block_images->exportBlocks()));
+	return true;
+}
+
+const std::vector<renderer::TilePos>& RenderFixture::getRenderTiles() const {
+	return tile_set->getRequiredRenderTiles();
+}
+
+void RenderFixture::renderTile(const renderer::TilePos& tile, renderer::RGBAImage& image) {
+	context.tile_renderer->renderTile(tile, image);
+}
+
+}
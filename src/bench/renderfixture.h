@@ -0,0 +1,102 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RENDERFIXTURE_H_
+#define RENDERFIXTURE_H_
+
+#include "../mapcraftercore/config/mapcrafterconfig.h"
+#include "../mapcraftercore/mc/blockstate.h"
+#include "../mapcraftercore/renderer/tilerenderworker.h"
+#include "../mapcraftercore/renderer/tileset.h"
+
+#include <memory>
+#include <string>
+#include <boost/filesystem.hpp>
+
+namespace synthetic {
+
+namespace fs = boost::filesystem;
+namespace config = mapcrafter::config;
+namespace mc = mapcrafter::mc;
+namespace renderer = mapcrafter::renderer;
+
+/**
+ * Removes a (temporary) directory when going out of scope.
+ */
+class DirectoryRemover {
+public:
+	DirectoryRemover(const fs::path& dir)
+		: dir(dir) {}
+
+	~DirectoryRemover() {
+		if (!dir.empty())
+			fs::remove_all(dir);
+	}
+
+private:
+	fs::path dir;
+};
+
+/**
+ * Returns the configuration of a map of a synthetic world in work_dir/world. Template
+ * and block directory are automatically determined if empty.
+ */
+std::string createMapConfig(const fs::path& work_dir, const std::string& render_view,
+		const std::string& render_mode, int texture_size, const std::string& image_format,
+		const std::string& template_dir, const std::string& block_dir);
+
+/**
+ * Sets up everything to render the tiles of a map rotation with a single tile renderer,
+ * like the render manager does for a map rotation.
+ */
+class RenderFixture {
+public:
+	RenderFixture();
+	~RenderFixture();
+
+	/**
+	 * Loads world, block images etc. of a map rotation. Returns false (and logs why)
+	 * if something couldn't be loaded.
+	 */
+	bool setUp(const config::MapcrafterConfig& config, const std::string& map,
+			renderer::RenderRotation::Direction rotation);
+
+	/**
+	 * Returns the render tiles of the map that contain something.
+	 */
+	const std::vector<renderer::TilePos>& getRenderTiles() const;
+
+	/**
+	 * Renders a render tile.
+	 */
+	void renderTile(const renderer::TilePos& tile, renderer::RGBAImage& image);
+
+	renderer::RenderContext context;
+	std::shared_ptr<renderer::TileImageFormat> tile_format;
+
+private:
+	mc::BlockStateRegistry block_registry;
+	std::shared_ptr<renderer::RenderView> render_view;
+	std::shared_ptr<renderer::TileSet> tile_set;
+	std::shared_ptr<renderer::BlockImages> block_images;
+};
+
+}
+
+#endif /* RENDERFIXTURE_H_ */
@@ -0,0 +1,544 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "syntheticdata.h"
+
+#include "../mapcraftercore/mc/chunk.h"
+#include "../mapcraftercore/mc/nbt.h"
+#include "../mapcraftercore/mc/region.h"
+#include "../mapcraftercore/renderer/blockatlas.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <sstream>
+#include <string>
+
+namespace synthetic {
+
+namespace nbt = mapcrafter::mc::nbt;
+using renderer::RGBAImage;
+using renderer::rgba;
+
+namespace {
+
+const int SEA_LEVEL = 62;
+const int WORLD_BOTTOM = mc::CHUNK_LOWEST * 16;
+const int WORLD_TOP = mc::CHUNK_HIGHEST * 16 - 1;
+const int DATA_VERSION = 3120;
+
+enum BlockType : uint8_t {
+	AIR,
+	CAVE_AIR,
+	BEDROCK,
+	DEEPSLATE,
+	STONE,
+	COAL_ORE,
+	IRON_ORE,
+	DIRT,
+	GRASS_BLOCK,
+	SAND,
+	WATER,
+	OAK_LOG,
+	OAK_LEAVES,
+
+	BLOCK_TYPES
+};
+
+struct BlockTypeInfo {
+	const char* name;
+	// a single property (or nullptr), like the block states of the block files
+	const char* property;
+	const char* value;
+};
+
+const BlockTypeInfo BLOCK_TYPE_INFOS[] = {
+	{"minecraft:air", nullptr, nullptr},
+	{"minecraft:cave_air", nullptr, nullptr},
+	{"minecraft:bedrock", nullptr, nullptr},
+	{"minecraft:deepslate", "axis", "y"},
+	{"minecraft:stone", nullptr, nullptr},
+	{"minecraft:coal_ore", nullptr, nullptr},
+	{"minecraft:iron_ore", nullptr, nullptr},
+	{"minecraft:dirt", nullptr, nullptr},
+	{"minecraft:grass_block", "snowy", "false"},
+	{"minecraft:sand", nullptr, nullptr},
+	{"minecraft:water", "level", "0"},
+	{"minecraft:oak_log", "axis", "y"},
+	{"minecraft:oak_leaves", nullptr, nullptr},
+};
+
+static_assert(sizeof(BLOCK_TYPE_INFOS) / sizeof(BLOCK_TYPE_INFOS[0]) == BLOCK_TYPES,
+		"Every block type needs a block state");
+
+uint32_t hash(uint32_t seed, int x, int y, int z) {
+	uint32_t h = (seed * 0x9e3779b9) ^ (x * 73856093) ^ (y * 19349663) ^ (z * 83492791);
+	h ^= h >> 16;
+	h *= 0x7feb352d;
+	h ^= h >> 15;
+	h *= 0x846ca68b;
+	return h ^ (h >> 16);
+}
+
+/**
+ * A pseudo-random value in [0, 1) for a position.
+ */
+double hashUnit(uint32_t seed, int x, int y, int z) {
+	return hash(seed, x, y, z) / 4294967296.0;
+}
+
+double smooth(double t) {
+	return t * t * (3 - 2 * t);
+}
+
+double lerp(double a, double b, double t) {
+	return a + (b - a) * t;
+}
+
+/**
+ * Value noise: Random values on an integer lattice, smoothly interpolated in between.
+ */
+double valueNoise(uint32_t seed, double x, double z) {
+	int x0 = std::floor(x), z0 = std::floor(z);
+	double tx = smooth(x - x0), tz = smooth(z - z0);
+	return lerp(
+			lerp(hashUnit(seed, x0, 0, z0), hashUnit(seed, x0 + 1, 0, z0), tx),
+			lerp(hashUnit(seed, x0, 0, z0 + 1), hashUnit(seed, x0 + 1, 0, z0 + 1), tx), tz);
+}
+
+double valueNoise(uint32_t seed, double x, double y, double z) {
+	int x0 = std::floor(x), y0 = std::floor(y), z0 = std::floor(z);
+	double tx = smooth(x - x0), ty = smooth(y - y0), tz = smooth(z - z0);
+	double layers[2];
+	for (int i = 0; i < 2; i++)
+		layers[i] = lerp(
+				lerp(hashUnit(seed, x0, y0 + i, z0), hashUnit(seed, x0 + 1, y0 + i, z0), tx),
+				lerp(hashUnit(seed, x0, y0 + i, z0 + 1), hashUnit(seed, x0 + 1, y0 + i, z0 + 1), tx),
+				tz);
+	return lerp(layers[0], layers[1], ty);
+}
+
+/**
+ * Returns the value below which the specified fraction of the samples is.
+ */
+double getQuantile(std::vector<double> samples, double fraction) {
+	if (fraction <= 0)
+		return -1;
+	if (fraction >= 1)
+		return 2;
+	std::sort(samples.begin(), samples.end());
+	return samples[fraction * (samples.size() - 1)];
+}
+
+int getBitsPerValue(size_t palette_size, int min_bits) {
+	int bits = min_bits;
+	while ((size_t(1) << bits) < palette_size)
+		bits++;
+	return bits;
+}
+
+double getTerrainNoise(uint32_t seed, double roughness, int x, int z) {
+	// more roughness makes the smaller octaves more important
+	double persistence = 0.35 + 0.3 * roughness;
+	double noise = 0, amplitude = 1, total = 0, scale = 1.0 / 128;
+	for (int octave = 0; octave < 4; octave++) {
+		noise += amplitude * valueNoise(seed + octave, x * scale, z * scale);
+		total += amplitude;
+		amplitude *= persistence;
+		scale *= 2;
+	}
+	return noise / total;
+}
+
+double getCaveNoise(uint32_t seed, int x, int y, int z) {
+	return valueNoise(seed + 100, x / 16.0, y / 10.0, z / 16.0);
+}
+
+}
+
+RGBAImage createTileImage(int width, int height, uint32_t seed) {
+	std::mt19937 random(seed);
+	std::uniform_int_distribution<int> color_dist(0, 15), noise_dist(-8, 8);
+	std::vector<renderer::RGBAPixel> colors;
+	for (int i = 0; i < 16; i++)
+		colors.push_back(rgba(40 + 12 * i, 160 - 6 * i, 30 + 9 * (i % 5), 255));
+
+	RGBAImage image(width, height);
+	const int cell = 8;
+	for (int cy = 0; cy < height; cy += cell) {
+		for (int cx = 0; cx < width; cx += cell) {
+			// the upper left corner is transparent like the border of a map
+			if (cx + cy < (width + height) / 4)
+				continue;
+			renderer::RGBAPixel color = colors[color_dist(random)];
+			for (int y = cy; y < std::min(cy + cell, height); y++)
+				for (int x = cx; x < std::min(cx + cell, width); x++) {
+					int noise = noise_dist(random);
+					image.pixel(x, y) = rgba(
+							std::max(0, std::min(255, renderer::rgba_red(color) + noise)),
+							std::max(0, std::min(255, renderer::rgba_green(color) + noise)),
+							std::max(0, std::min(255, renderer::rgba_blue(color) + noise)), 255);
+				}
+		}
+	}
+	return image;
+}
+
+void createBlockImage(int size, uint32_t seed, RGBAImage& block, RGBAImage& uv_mask) {
+	std::mt19937 random(seed);
+	std::uniform_int_distribution<int> noise_dist(-20, 20);
+	block.setSize(size, size);
+	uv_mask.setSize(size, size);
+	block.clear();
+	uv_mask.clear();
+
+	int half = size / 2, quarter = size / 4;
+	for (int y = 0; y < size; y++) {
+		for (int x = 0; x < size; x++) {
+			int dx = std::abs(x - half);
+			uint8_t face;
+			// the top face is a diamond, the side faces are below it
+			if (dx + 2 * std::abs(y - quarter) <= half)
+				face = renderer::FACE_UP_INDEX;
+			else if (y > quarter && y < size - dx / 2)
+				face = x < half ? renderer::FACE_LEFT_INDEX : renderer::FACE_RIGHT_INDEX;
+			else
+				continue;
+			int noise = noise_dist(random);
+			block.pixel(x, y) = rgba(120 + noise, 100 + noise, 80 + noise, 255);
+			uv_mask.pixel(x, y) = rgba(x * 255 / size, y * 255 / size, face, 255);
+		}
+	}
+}
+
+std::vector<int64_t> packShorts(const std::vector<uint16_t>& values, int bits) {
+	int per_long = 64 / bits;
+	std::vector<int64_t> data((values.size() + per_long - 1) / per_long, 0);
+	for (size_t i = 0; i < values.size(); i++)
+		data[i / per_long] |= int64_t(values[i]) << (bits * (i % per_long));
+	return data;
+}
+
+WorldOptions::WorldOptions(uint32_t seed)
+	: seed(seed), roughness(0.5), water_ratio(0.3), cave_density(0.05) {
+	parseBiomes("plains:3,forest:2,desert:1,swamp:1");
+}
+
+bool WorldOptions::parseBiomes(const std::string& str) {
+	std::vector<std::pair<std::string, double>> biomes;
+	std::stringstream ss(str);
+	std::string entry;
+	while (std::getline(ss, entry, ',')) {
+		std::string name = entry;
+		double weight = 1;
+		size_t colon = entry.find(':', entry.find("minecraft:") == 0 ? 10 : 0);
+		if (colon != std::string::npos) {
+			name = entry.substr(0, colon);
+			try {
+				weight = std::stod(entry.substr(colon + 1));
+			} catch (std::exception& e) {
+				return false;
+			}
+		}
+		if (name.empty() || weight <= 0)
+			return false;
+		if (name.find(':') == std::string::npos)
+			name = "minecraft:" + name;
+		biomes.push_back(std::make_pair(name, weight));
+	}
+	if (biomes.empty())
+		return false;
+	this->biomes = biomes;
+	return true;
+}
+
+WorldGenerator::WorldGenerator(const WorldOptions& options)
+	: options(options), ocean_biome("minecraft:ocean"), beach_biome("minecraft:beach") {
+	// the noise isn't uniformly distributed, so the thresholds for the water and cave
+	// ratios are determined from samples of the noise
+	std::vector<double> terrain_samples, cave_samples;
+	for (int i = 0; i < 4096; i++) {
+		terrain_samples.push_back(getTerrainNoise(options.seed, options.roughness,
+				(i % 64) * 37, (i / 64) * 37));
+		cave_samples.push_back(getCaveNoise(options.seed, (i % 16) * 13,
+				(i / 16 % 16) * 7, (i / 256) * 13));
+	}
+	sea_threshold = getQuantile(terrain_samples, options.water_ratio);
+	cave_threshold = getQuantile(cave_samples, options.cave_density);
+
+	double total = 0;
+	for (auto it = options.biomes.begin(); it != options.biomes.end(); ++it)
+		total += it->second;
+	double sum = 0;
+	for (auto it = options.biomes.begin(); it != options.biomes.end(); ++it) {
+		sum += it->second;
+		biome_weights.push_back(sum / total);
+	}
+}
+
+int WorldGenerator::getHeight(int x, int z) const {
+	double noise = getTerrainNoise(options.seed, options.roughness, x, z);
+	int height = SEA_LEVEL + std::floor((noise - sea_threshold) * (40 + 360 * options.roughness));
+	return std::max(WORLD_BOTTOM + 8, std::min(WORLD_TOP - 16, height));
+}
+
+const std::string& WorldGenerator::getBiome(int x, int z) const {
+	int height = getHeight(x, z);
+	if (height < SEA_LEVEL - 2)
+		return ocean_biome;
+	if (height <= SEA_LEVEL + 1)
+		return beach_biome;
+
+	// the land is divided into cells with wavy borders, every cell gets a random biome
+	double wx = x + (valueNoise(options.seed + 200, x / 32.0, z / 32.0) - 0.5) * 64;
+	double wz = z + (valueNoise(options.seed + 201, x / 32.0, z / 32.0) - 0.5) * 64;
+	double random = hashUnit(options.seed + 202, std::floor(wx / 96), 0, std::floor(wz / 96));
+	for (size_t i = 0; i + 1 < biome_weights.size(); i++)
+		if (random < biome_weights[i])
+			return options.biomes[i].first;
+	return options.biomes.back().first;
+}
+
+bool WorldGenerator::isCave(int x, int y, int z) const {
+	if (options.cave_density <= 0)
+		return false;
+	return getCaveNoise(options.seed, x, y, z) < cave_threshold;
+}
+
+bool WorldGenerator::isTree(int x, int z) const {
+	const std::string& biome = getBiome(x, z);
+	double chance = biome.find("forest") != std::string::npos ? 1.0 / 25
+			: (biome == "minecraft:plains" || biome == "minecraft:swamp" ? 1.0 / 400 : 0);
+	return hashUnit(options.seed + 300, x, 0, z) < chance;
+}
+
+std::vector<uint8_t> WorldGenerator::createChunkData(const mc::ChunkPos& pos) const {
+	int heights[16][16];
+	int top = SEA_LEVEL;
+	for (int x = 0; x < 16; x++)
+		for (int z = 0; z < 16; z++) {
+			heights[x][z] = getHeight(pos.x * 16 + x, pos.z * 16 + z);
+			// leave some space for the trees
+			top = std::max(top, heights[x][z] + 7);
+		}
+	// biomes are stored for 4x4x4 cells, they are the same for every y-coordinate here
+	std::vector<std::string> cell_biomes;
+	for (int i = 0; i < 16; i++)
+		cell_biomes.push_back(getBiome(pos.x * 16 + i % 4 * 4 + 2, pos.z * 16 + i / 4 * 4 + 2));
+
+	// the block types are ordered YZX, starting at the bottom of the world
+	int sections = std::min(top, WORLD_TOP) / 16 - mc::CHUNK_LOWEST + 1;
+	std::vector<uint8_t> blocks(sections * 16 * 16 * 16, AIR);
+	auto index = [](int x, int y, int z) {
+		return ((y - WORLD_BOTTOM) * 16 + z) * 16 + x;
+	};
+
+	for (int x = 0; x < 16; x++)
+		for (int z = 0; z < 16; z++) {
+			int wx = pos.x * 16 + x, wz = pos.z * 16 + z, height = heights[x][z];
+			const std::string& biome = cell_biomes[z / 4 * 4 + x / 4];
+			bool sandy = height < SEA_LEVEL || biome == beach_biome
+					|| biome == "minecraft:desert";
+			for (int y = WORLD_BOTTOM; y <= std::max(height, SEA_LEVEL); y++) {
+				BlockType type;
+				if (y == WORLD_BOTTOM)
+					type = BEDROCK;
+				else if (y > height)
+					type = WATER;
+				else if (y == height)
+					type = sandy ? SAND : GRASS_BLOCK;
+				else if (y > height - 4)
+					type = sandy ? SAND : DIRT;
+				else if (y > WORLD_BOTTOM + 4 && isCave(wx, y, wz))
+					type = CAVE_AIR;
+				else {
+					double random = hashUnit(options.seed + 400, wx, y, wz);
+					if (random < 0.01)
+						type = IRON_ORE;
+					else if (random < 0.03)
+						type = COAL_ORE;
+					else
+						type = y < 0 ? DEEPSLATE : STONE;
+				}
+				blocks[index(x, y, z)] = type;
+			}
+		}
+
+	// trees are only placed where all their leaves are inside of the chunk
+	for (int x = 2; x < 14; x++)
+		for (int z = 2; z < 14; z++) {
+			int height = heights[x][z];
+			if (blocks[index(x, height, z)] != GRASS_BLOCK
+					|| !isTree(pos.x * 16 + x, pos.z * 16 + z))
+				continue;
+			for (int dy = 3; dy <= 6; dy++) {
+				int radius = dy <= 4 ? 2 : 1;
+				for (int dx = -radius; dx <= radius; dx++)
+					for (int dz = -radius; dz <= radius; dz++) {
+						uint8_t& block = blocks[index(x + dx, height + dy, z + dz)];
+						if (std::abs(dx) + std::abs(dz) < 2 * radius && block == AIR)
+							block = OAK_LEAVES;
+					}
+			}
+			for (int dy = 1; dy <= 5; dy++)
+				blocks[index(x, height + dy, z)] = OAK_LOG;
+		}
+
+	nbt::TagList sections_tag(nbt::TagCompound::TAG_TYPE);
+	for (int section = 0; section < sections; section++) {
+		int section_y = section + mc::CHUNK_LOWEST;
+		int palette_ids[BLOCK_TYPES];
+		std::fill(palette_ids, palette_ids + BLOCK_TYPES, -1);
+		std::vector<uint8_t> palette;
+		std::vector<uint16_t> block_ids(16 * 16 * 16);
+		std::vector<int8_t> block_light(2048, 0), sky_light(2048, 0);
+		for (int i = 0; i < 16 * 16 * 16; i++) {
+			uint8_t type = blocks[section * 16 * 16 * 16 + i];
+			if (palette_ids[type] == -1) {
+				palette_ids[type] = palette.size();
+				palette.push_back(type);
+			}
+			block_ids[i] = palette_ids[type];
+		}
+		// the sky light is 15 above the topmost block of a column, 0 below
+		for (int x = 0; x < 16; x++)
+			for (int z = 0; z < 16; z++) {
+				int y = sections * 16 + WORLD_BOTTOM - 1;
+				while (y > WORLD_BOTTOM && blocks[index(x, y, z)] == AIR)
+					y--;
+				for (int ly = std::max(0, y + 1 - section_y * 16); ly < 16; ly++) {
+					int i = (ly * 16 + z) * 16 + x;
+					sky_light[i / 2] |= (i % 2 == 0 ? 0x0f : 0xf0);
+				}
+			}
+
+		nbt::TagList palette_tag(nbt::TagCompound::TAG_TYPE);
+		for (auto it = palette.begin(); it != palette.end(); ++it) {
+			const BlockTypeInfo& info = BLOCK_TYPE_INFOS[*it];
+			nbt::TagCompound entry;
+			entry.addTag("Name", nbt::TagString(info.name));
+			if (info.property != nullptr) {
+				nbt::TagCompound properties;
+				properties.addTag(info.property, nbt::TagString(info.value));
+				entry.addTag("Properties", properties);
+			}
+			palette_tag.payload.push_back(nbt::TagPtr(entry.clone()));
+		}
+		nbt::TagCompound block_states;
+		block_states.addTag("palette", palette_tag);
+		if (palette.size() > 1)
+			block_states.addTag("data", nbt::TagLongArray(
+					packShorts(block_ids, getBitsPerValue(palette.size(), 4))));
+
+		std::vector<std::string> biome_palette;
+		std::vector<uint16_t> biomes(4 * 4 * 4);
+		for (int i = 0; i < 4 * 4 * 4; i++) {
+			const std::string& biome = cell_biomes[i % 16];
+			size_t id = std::find(biome_palette.begin(), biome_palette.end(), biome)
+					- biome_palette.begin();
+			if (id == biome_palette.size())
+				biome_palette.push_back(biome);
+			biomes[i] = id;
+		}
+		nbt::TagList biome_palette_tag(nbt::TagString::TAG_TYPE);
+		for (auto it = biome_palette.begin(); it != biome_palette.end(); ++it)
+			biome_palette_tag.payload.push_back(nbt::TagPtr(nbt::TagString(*it).clone()));
+		nbt::TagCompound biomes_tag;
+		biomes_tag.addTag("palette", biome_palette_tag);
+		if (biome_palette.size() > 1)
+			biomes_tag.addTag("data", nbt::TagLongArray(
+					packShorts(biomes, getBitsPerValue(biome_palette.size(), 1))));
+
+		nbt::TagCompound section_tag;
+		section_tag.addTag("Y", nbt::TagByte(section_y));
+		section_tag.addTag("block_states", block_states);
+		section_tag.addTag("biomes", biomes_tag);
+		section_tag.addTag("BlockLight", nbt::TagByteArray(block_light));
+		section_tag.addTag("SkyLight", nbt::TagByteArray(sky_light));
+		sections_tag.payload.push_back(nbt::TagPtr(section_tag.clone()));
+	}
+
+	nbt::NBTFile nbt;
+	nbt.addTag("DataVersion", nbt::TagInt(DATA_VERSION));
+	nbt.addTag("xPos", nbt::TagInt(pos.x));
+	nbt.addTag("yPos", nbt::TagInt(mc::CHUNK_LOWEST));
+	nbt.addTag("zPos", nbt::TagInt(pos.z));
+	nbt.addTag("Status", nbt::TagString("full"));
+	nbt.addTag("sections", sections_tag);
+	std::stringstream ss(std::ios::in | std::ios::out | std::ios::binary);
+	nbt.writeNBT(ss, nbt::Compression::ZLIB);
+	std::string data = ss.str();
+	return std::vector<uint8_t>(data.begin(), data.end());
+}
+
+int WorldGenerator::writeWorld(const fs::path& world_dir, int size,
+		util::IProgressHandler* progress) const {
+	fs::path region_dir = world_dir / "region";
+	fs::create_directories(region_dir);
+
+	nbt::TagCompound version;
+	version.addTag("Id", nbt::TagInt(DATA_VERSION));
+	version.addTag("Name", nbt::TagString("1.19.2"));
+	version.addTag("Snapshot", nbt::TagByte(0));
+	nbt::TagCompound data;
+	data.addTag("DataVersion", nbt::TagInt(DATA_VERSION));
+	data.addTag("LevelName", nbt::TagString("Synthetic"));
+	data.addTag("RandomSeed", nbt::TagLong(options.seed));
+	data.addTag("SpawnX", nbt::TagInt(size * 8));
+	data.addTag("SpawnY", nbt::TagInt(getHeight(size * 8, size * 8) + 1));
+	data.addTag("SpawnZ", nbt::TagInt(size * 8));
+	data.addTag("Version", version);
+	nbt::NBTFile level;
+	level.addTag("Data", data);
+	try {
+		level.writeNBT((world_dir / "level.dat").string().c_str(), nbt::Compression::GZIP);
+	} catch (nbt::NBTError& e) {
+		return -1;
+	}
+
+	int regions = (size + 31) / 32, chunks = 0;
+	if (progress != nullptr)
+		progress->setMax(size * size);
+	for (int region_x = 0; region_x < regions; region_x++)
+		for (int region_z = 0; region_z < regions; region_z++) {
+			mc::RegionFile region;
+			for (int x = region_x * 32; x < std::min(size, region_x * 32 + 32); x++)
+				for (int z = region_z * 32; z < std::min(size, region_z * 32 + 32); z++) {
+					mc::ChunkPos pos(x, z);
+					// 2 is the zlib compression of the region format
+					region.setChunkData(pos, createChunkData(pos), 2);
+					// a fixed timestamp keeps the generated worlds identical
+					region.setChunkTimestamp(pos, 1600000000);
+					chunks++;
+					if (progress != nullptr)
+						progress->setValue(chunks);
+				}
+			fs::path filename = region_dir / ("r." + std::to_string(region_x) + "."
+					+ std::to_string(region_z) + ".mca");
+			if (!region.write(filename.string()))
+				return -1;
+		}
+	return chunks;
+}
+
+std::vector<uint8_t> createChunkData(const mc::ChunkPos& pos, uint32_t seed) {
+	return WorldGenerator(WorldOptions(seed)).createChunkData(pos);
+}
+
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SYNTHETICDATA_H_
+#define SYNTHETICDATA_H_
+
+#include "../mapcraftercore/mc/pos.h"
+#include "../mapcraftercore/renderer/image.h"
+#include "../mapcraftercore/util/progress.h"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/filesystem.hpp>
+
+/**
+ * Synthetic data for the benchmarks. Everything is generated from a seed, so the
+ * benchmarks always work on the same data.
+ */
+namespace synthetic {
+
+namespace fs = boost::filesystem;
+namespace mc = mapcrafter::mc;
+namespace renderer = mapcrafter::renderer;
+namespace util = mapcrafter::util;
+
+/**
+ * Creates a tile-like image: Blocks of terrain colors with a bit of noise, and a
+ * transparent area like at the border of a map.
+ */
+renderer::RGBAImage createTileImage(int width, int height, uint32_t seed);
+
+/**
+ * Creates the image and uv mask of a textured isometric block (left, right and top
+ * face) like the block images of the block atlas.
+ */
+void createBlockImage(int size, uint32_t seed, renderer::RGBAImage& block,
+		renderer::RGBAImage& uv_mask);
+
+/**
+ * Packs values with the specified bits per value into longs like the 1.16+ chunk
+ * format (values don't span multiple longs).
+ */
+std::vector<int64_t> packShorts(const std::vector<uint16_t>& values, int bits);
+
+/**
+ * The settings of the synthetic worlds.
+ */
+struct WorldOptions {
+	WorldOptions(uint32_t seed = 1);
+
+	/**
+	 * Parses a biome mix like "plains:3,forest:2,desert" (the weights default to 1).
+	 */
+	bool parseBiomes(const std::string& str);
+
+	uint32_t seed;
+	// how hilly the terrain is, from 0 (almost flat) to 1 (mountains)
+	double roughness;
+	// the (approximate) fraction of the surface that is below the sea level
+	double water_ratio;
+	// the (approximate) fraction of the underground that is carved out by caves
+	double cave_density;
+	// the biomes of the land with their weights, oceans are added automatically
+	std::vector<std::pair<std::string, double>> biomes;
+};
+
+/**
+ * Generates the chunks of a synthetic 1.18+ world: Stone (and deepslate) with dirt and
+ * grass or sand on top, water below the sea level, caves, some ores and trees in the
+ * forests. Everything only depends on the position and the world options, so the
+ * chunks can be generated in any order.
+ */
+class WorldGenerator {
+public:
+	WorldGenerator(const WorldOptions& options);
+
+	/**
+	 * Returns the height of the terrain (the y-coordinate of the topmost solid block)
+	 * at a block column.
+	 */
+	int getHeight(int x, int z) const;
+
+	/**
+	 * Returns the biome of a block column.
+	 */
+	const std::string& getBiome(int x, int z) const;
+
+	/**
+	 * Creates the zlib compressed NBT data of a chunk.
+	 */
+	std::vector<uint8_t> createChunkData(const mc::ChunkPos& pos) const;
+
+	/**
+	 * Writes a world of size x size chunks (starting at chunk 0:0) with a level.dat
+	 * to a directory. Returns the count of written chunks, or -1 if a file couldn't be
+	 * written.
+	 */
+	int writeWorld(const fs::path& world_dir, int size,
+			util::IProgressHandler* progress = nullptr) const;
+
+private:
+	bool isCave(int x, int y, int z) const;
+	bool isTree(int x, int z) const;
+
+	WorldOptions options;
+	double sea_threshold, cave_threshold;
+	std::vector<double> biome_weights;
+	std::string ocean_biome, beach_biome;
+};
+
+/**
+ * Creates the zlib compressed NBT data of a chunk of a synthetic world with the default
+ * world options.
+ */
+std::vector<uint8_t> createChunkData(const mc::ChunkPos& pos, uint32_t seed);
+
+}
+
+#endif /* SYNTHETICDATA_H_ */
@@ -0,0 +1,68 @@
+RenderCostControl.prototype = new BaseControl("RenderCostControl");
+
+/**
+ * This control widget allows the user to show the render costs of the map as overlay.
+ */
+function RenderCostControl() {
+	this.handler = new RenderCostHandler(this);
+	this.wrapper = null;
+	this.total = null;
+}
+
+RenderCostControl.prototype.create = function(wrapper) {
+	var select = document.createElement("select");
+	select.setAttribute("class", "form-control input-sm");
+
+	var option = document.createElement("option");
+	option.setAttribute("value", -1);
+	option.innerHTML = "No render costs";
+	select.appendChild(option);
+	for(var i = 0; i < RenderCostHandler.METRICS.length; i++) {
+		option = document.createElement("option");
+		option.setAttribute("value", i);
+		option.innerHTML = RenderCostHandler.METRICS[i].name;
+		select.appendChild(option);
+	}
+	select.addEventListener("change", (function(handler) {
+		return function() {
+			handler.setMetric(parseInt(this.value));
+		};
+	})(this.handler));
+
+	this.total = document.createElement("div");
+	this.total.setAttribute("class", "render-cost-total");
+
+	var body = document.createElement("div");
+	body.setAttribute("class", "panel-body");
+	body.appendChild(select);
+	body.appendChild(this.total);
+
+	L.DomEvent.disableClickPropagation(wrapper);
+	wrapper.appendChild(body);
+	this.wrapper = wrapper;
+};
+
+/**
+ * Shows the control only for maps with recorded render costs.
+ */
+RenderCostControl.prototype.setAvailable = function(available) {
+	this.wrapper.style.display = available ? "block" : "none";
+};
+
+/**
+ * Shows the total of the metric of the current map, hides it if value is null.
+ */
+RenderCostControl.prototype.setTotal = function(value, unit) {
+	if(value === null)
+		this.total.innerHTML = "";
+	else
+		this.total.innerHTML = "Total: " + (Math.round(value * 10) / 10) + (unit ? " " + unit : "");
+};
+
+RenderCostControl.prototype.getHandler = function() {
+	return this.handler;
+};
+
+RenderCostControl.prototype.getName = function() {
+	return "render-cost";
+};
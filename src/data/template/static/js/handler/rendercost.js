@@ -0,0 +1,166 @@
+RenderCostHandler.prototype = new BaseHandler();
+
+// the values of a tile in render-costs.json: [path, microseconds, blocks, chunks, bytes]
+RenderCostHandler.METRICS = [
+	{name: "Render time", unit: "s", scale: 0.000001},
+	{name: "Blocks drawn", unit: "", scale: 1},
+	{name: "Chunks loaded", unit: "", scale: 1},
+	{name: "Bytes written", unit: "MiB", scale: 1 / (1024 * 1024)},
+];
+
+/**
+ * Shows the render costs of the render tiles of maps with record_render_costs as
+ * heatmap overlay.
+ */
+function RenderCostHandler(control) {
+	this.control = control;
+	// the shown metric (index of METRICS), -1 if the overlay is hidden
+	this.metric = -1;
+	this.layer = null;
+	// the loaded render costs, reloaded when the map or rotation changes
+	this.costs = null;
+}
+
+RenderCostHandler.prototype.onMapChange = function(name, rotation) {
+	var mapConfig = this.ui.getCurrentMapConfig();
+	this.control.setAvailable(mapConfig.renderCosts === true);
+	this.costs = null;
+	this.update();
+};
+
+RenderCostHandler.prototype.setMetric = function(metric) {
+	this.metric = metric;
+	this.update();
+};
+
+RenderCostHandler.prototype.update = function() {
+	if(this.layer != null) {
+		this.ui.lmap.removeLayer(this.layer);
+		this.layer = null;
+	}
+	this.control.setTotal(null);
+
+	var mapConfig = this.ui.getCurrentMapConfig();
+	if(this.metric == -1 || mapConfig.renderCosts !== true)
+		return;
+	if(this.costs == null) {
+		this.load();
+		return;
+	}
+
+	var metric = RenderCostHandler.METRICS[this.metric];
+	this.control.setTotal(this.costs.getTotal(this.metric) * metric.scale, metric.unit);
+	this.layer = new RenderCostLayer(this.costs, this.metric, {
+		tileSize: L.point(mapConfig.tileSize[0], mapConfig.tileSize[1]),
+		maxZoom: mapConfig.maxZoom,
+		noWrap: true,
+		opacity: 0.6,
+	});
+	this.ui.lmap.addLayer(this.layer);
+};
+
+RenderCostHandler.prototype.load = function() {
+	var self = this;
+	var map = this.ui.getCurrentMap();
+	var rotation = this.ui.getCurrentRotation();
+	$.ajax({
+		url: map + "/" + ["tl", "tr", "br", "bl"][rotation] + "/render-costs.json",
+		dataType: "json",
+		cache: false,
+	}).done(function(data) {
+		// ignore it if the map was changed in the meantime
+		if(map != self.ui.getCurrentMap() || rotation != self.ui.getCurrentRotation())
+			return;
+		self.costs = new RenderCosts(data && data.tiles ? data.tiles : []);
+		self.update();
+	});
+};
+
+/**
+ * The render costs of the render tiles of a map rotation, summed up for every
+ * composite tile.
+ */
+function RenderCosts(tiles) {
+	// sums of the metrics of the tiles in the subtree of a tile path
+	this.sums = {};
+	// maximum sums of the metrics per depth
+	this.maxima = [];
+	this.depth = 0;
+
+	for(var i = 0; i < tiles.length; i++) {
+		var path = tiles[i][0];
+		var nodes = path.length > 0 ? path.split("/") : [];
+		this.depth = Math.max(this.depth, nodes.length);
+		for(var depth = 0; depth <= nodes.length; depth++) {
+			var prefix = nodes.slice(0, depth).join("/");
+			if(!(prefix in this.sums))
+				this.sums[prefix] = [0, 0, 0, 0];
+			var sum = this.sums[prefix];
+			if(this.maxima.length <= depth)
+				this.maxima.push([0, 0, 0, 0]);
+			for(var metric = 0; metric < 4; metric++) {
+				sum[metric] += tiles[i][metric + 1];
+				this.maxima[depth][metric] = Math.max(this.maxima[depth][metric], sum[metric]);
+			}
+		}
+	}
+}
+
+RenderCosts.prototype.getTotal = function(metric) {
+	return "" in this.sums ? this.sums[""][metric] : 0;
+};
+
+/**
+ * Returns the sum of a metric of a tile (leaflet tile coordinates) relative to the
+ * maximum of the tiles of the same zoom level, -1 if nothing is known about the tile.
+ */
+RenderCosts.prototype.getRelative = function(x, y, zoom, metric) {
+	var path = "";
+	for(var z = zoom - 1; z >= 0; --z) {
+		var node = Math.floor(x / Math.pow(2, z)) % 2 + 2 * (Math.floor(y / Math.pow(2, z)) % 2) + 1;
+		path += (path.length > 0 ? "/" : "") + node;
+	}
+	if(zoom >= this.maxima.length || !(path in this.sums) || this.maxima[zoom][metric] == 0)
+		return -1;
+	return this.sums[path][metric] / this.maxima[zoom][metric];
+};
+
+/**
+ * Draws the render costs as heatmap. Every tile is divided into cells of the tiles
+ * some zoom levels deeper, so the heatmap is more detailed than the tiles.
+ */
+var RenderCostLayer = L.GridLayer.extend({
+	initialize: function(costs, metric, options) {
+		this._costs = costs;
+		this._metric = metric;
+		L.setOptions(this, options);
+	},
+
+	createTile: function(coords) {
+		var size = this.getTileSize();
+		var canvas = L.DomUtil.create("canvas", "leaflet-tile");
+		canvas.width = size.x;
+		canvas.height = size.y;
+		var count = Math.pow(2, coords.z);
+		if(coords.x < 0 || coords.x >= count || coords.y < 0 || coords.y >= count
+				|| coords.z > this._costs.depth)
+			return canvas;
+
+		var zoom = Math.min(coords.z + 3, this._costs.depth);
+		var cells = Math.pow(2, zoom - coords.z);
+		var context = canvas.getContext("2d");
+		for(var cx = 0; cx < cells; cx++)
+			for(var cy = 0; cy < cells; cy++) {
+				var value = this._costs.getRelative(coords.x * cells + cx, coords.y * cells + cy,
+					zoom, this._metric);
+				if(value < 0)
+					continue;
+				// green (cheap) to red (expensive)
+				var hue = Math.round(120 * (1 - Math.sqrt(value)));
+				context.fillStyle = "hsl(" + hue + ", 100%, 50%)";
+				context.fillRect(Math.floor(cx * size.x / cells), Math.floor(cy * size.y / cells),
+					Math.ceil(size.x / cells), Math.ceil(size.y / cells));
+			}
+		return canvas;
+	},
+});
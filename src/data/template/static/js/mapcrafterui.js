@@ -5,8 +5,28 @@ var MCTileLayer = L.TileLayer.extend({
 	initialize: function(url, options) {
 		this._url = url;
 		this._imageFormat = options["imageFormat"];
+		// roots of the subtrees of empty tiles, which don't exist as image files
+		this._emptyTiles = {};
 		
 		L.setOptions(this, options);
+		this._loadEmptyTiles();
+	},
+	
+	_loadEmptyTiles: function() {
+		var self = this;
+		$.ajax({
+			url: this._url + "/empty-tiles.json",
+			dataType: "json",
+			cache: false,
+		}).done(function(data) {
+			if(!data || !data.tiles)
+				return;
+			for(var i = 0; i < data.tiles.length; i++)
+				self._emptyTiles[data.tiles[i]] = true;
+			if(data.tiles.length > 0 && self._map)
+				self.redraw();
+		});
+		// without the file (older renders, opened locally) every tile is requested
 	},
 	
 	getTileUrl: function(tile) {
@@ -14,19 +34,31 @@ var MCTileLayer = L.TileLayer.extend({
 		if(tile.x < 0 || tile.x >= Math.pow(2, tile.z) || tile.y < 0 || tile.y >= Math.pow(2, tile.z)) {
 			url += "/blank";
 		} else if(tile.z == 0) {
+			if(this._emptyTiles[""])
+				return MCTileLayer.EMPTY_TILE;
 			url += "/base";
 		} else {
+			var path = "";
+			if(this._emptyTiles[path])
+				return MCTileLayer.EMPTY_TILE;
 			for(var z = tile.z - 1; z >= 0; --z) {
 				var x = Math.floor(tile.x / Math.pow(2, z)) % 2;
 				var y = Math.floor(tile.y / Math.pow(2, z)) % 2;
-				url += "/" + (x + 2 * y + 1);
+				path += (path.length > 0 ? "/" : "") + (x + 2 * y + 1);
+				// a tile is empty if it or one of its parents is a root of an empty subtree
+				if(this._emptyTiles[path])
+					return MCTileLayer.EMPTY_TILE;
 			}
+			url += "/" + path;
 		}
 		url = url + "." + this._imageFormat;
 		return url;
 	},
 });
 
+// a transparent 1x1 image shown for empty tiles
+MCTileLayer.EMPTY_TILE = "data:image/gif;base64,R0lGODlhAQABAIAAAAAAAP///yH5BAEAAAAALAAAAAABAAEAAAIBRAA7";
+
 // Make the build height a variable
 var topBlock = 320;
 
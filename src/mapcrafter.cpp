@@ -22,6 +22,7 @@
 #include "mapcraftercore/util.h"
 #include "mapcraftercore/version.h"
 
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <cstring>
@@ -77,7 +78,27 @@ int main(int argc, char** argv) {
 			"renders the specified map(s) completely")
 		("render-force-all,F", "force renders all maps")
 		("jobs,j", po::value<int>(&opts.jobs)->default_value(1),
-			"the count of jobs to use when rendering the map");
+			"the count of jobs to use when rendering the map")
+		("profile-report", po::value<fs::path>(&opts.profile_report),
+			"profiles the rendering and writes a JSON report with the time spent in the "
+			"render stages of every map rotation to this file")
+		("metrics-file", po::value<fs::path>(&opts.metrics_file),
+			"periodically writes live metrics of the rendering to this file "
+			"(in the Prometheus text format, for the textfile collector of the node exporter)")
+		("metrics-interval", po::value<int>(&opts.metrics_interval)->default_value(15),
+			"the interval (in seconds) to write the metrics file in")
+		("trace-file", po::value<fs::path>(&opts.trace_file),
+			"records what the render threads are doing and writes it as Chrome trace "
+			"(for Perfetto) to this file")
+		("trace-buffer-size", po::value<int>(&opts.trace_buffer_size)->default_value(100000),
+			"the maximum count of spans kept per thread in the trace")
+		("memory-limit", po::value<std::string>(&opts.memory_limit),
+			"how much memory the world caches and tile buffers of the render threads may "
+			"use (for example 8G), caches are evicted and rendering throttled above it")
+		("estimate", "estimates CPU time, wall time (with the specified count of jobs), "
+			"output size and peak memory usage of the render without rendering anything")
+		("estimate-samples", po::value<int>(&opts.estimate_samples)->default_value(64),
+			"the count of tiles per map rotation rendered to estimate the render costs");
 
 	po::options_description all("Allowed options");
 	all.add(general).add(logging).add(renderer);
@@ -171,9 +192,17 @@ int main(int argc, char** argv) {
 	opts.skip_all = vm.count("render-reset");
 	opts.force_all = vm.count("render-force-all");
 	opts.batch = vm.count("batch");
+	opts.estimate = vm.count("estimate");
 	if (!vm.count("logging-config"))
 		opts.logging_config = util::findLoggingConfigFile();
 
+	uint64_t memory_limit = 0;
+	if (!opts.memory_limit.empty() && !util::parseByteSize(opts.memory_limit, memory_limit)) {
+		std::cerr << "Invalid memory limit '" << opts.memory_limit << "'." << std::endl;
+		std::cerr << "Use '" << argv[0] << " --help' for more information." << std::endl;
+		return 1;
+	}
+
 	if (opts.skip_all && opts.force_all) {
 		std::cerr << "You may only use one of --render-reset or --render-force-all!" << std::endl;
 		std::cerr << "Use '" << argv[0] << " --help' for more information." << std::endl;
@@ -207,6 +236,19 @@ int main(int argc, char** argv) {
 
 	renderer::RenderManager manager(config);
 	manager.setRenderBehaviors(renderer::RenderBehaviors::fromRenderOpts(config, opts));
+	if (!opts.profile_report.empty())
+		manager.setProfileReport(opts.profile_report);
+	if (!opts.metrics_file.empty())
+		manager.setMetricsFile(opts.metrics_file, opts.metrics_interval);
+	if (!opts.trace_file.empty())
+		manager.setTraceFile(opts.trace_file, opts.trace_buffer_size);
+	if (memory_limit != 0)
+		manager.setMemoryLimit(memory_limit);
+	if (opts.estimate) {
+		if (!manager.estimate(opts.jobs, std::max(1, opts.estimate_samples)))
+			return 1;
+		return 0;
+	}
 	if (!manager.run(opts.jobs, opts.batch))
 		return 1;
 	return 0;
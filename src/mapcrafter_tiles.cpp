@@ -0,0 +1,163 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "accumulator.h"
+#include "mapcraftercore/util.h"
+#include "mapcraftercore/config/mapcrafterconfig.h"
+#include "mapcraftercore/renderer/tilestorage.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+namespace util = mapcrafter::util;
+namespace config = mapcrafter::config;
+namespace renderer = mapcrafter::renderer;
+
+/**
+ * Copies all tiles of a map rotation stored in tile archives to the directory layout
+ * the web interface reads. The image files are copied as they are.
+ */
+bool exportTiles(const fs::path& archive_dir, const fs::path& export_dir,
+		const std::string& suffix) {
+	renderer::ArchiveTileStorage archives(archive_dir, suffix);
+	renderer::DirectoryTileStorage directory(export_dir, suffix);
+
+	std::vector<renderer::TilePath> tiles;
+	archives.listTiles(tiles);
+	if (tiles.empty()) {
+		LOG(WARNING) << "No tile archives found in " << archive_dir << ".";
+		return true;
+	}
+
+	util::LogOutputProgressHandler progress;
+	progress.setMax(tiles.size());
+	std::vector<uint8_t> data;
+	int failed = 0;
+	for (size_t i = 0; i < tiles.size(); i++) {
+		if (!archives.readTile(tiles[i], data)
+				|| !directory.writeTile(tiles[i], data.data(), data.size())) {
+			LOG(ERROR) << "Unable to export tile '" << tiles[i] << "'.";
+			failed++;
+		}
+		progress.setValue(i + 1);
+	}
+
+	LOG(INFO) << "Exported " << (tiles.size() - failed) << " tiles from "
+			<< archive_dir << " to " << export_dir << ".";
+	return failed == 0;
+}
+
+int main(int argc, char** argv) {
+	std::string config_file;
+	std::vector<std::string> maps;
+	std::string export_dir;
+	int verbosity = 0;
+
+	po::options_description all("Allowed options");
+	all.add_options()
+		("help,h", "shows this help message")
+		("verbose,v", accumulator<int>(&verbosity),
+				"verbose blah blah")
+
+		("config,c", po::value<std::string>(&config_file),
+			"the path to the configuration file (required)")
+		("map,m", po::value<std::vector<std::string>>(&maps),
+			"the maps to export, defaults to all maps using 'tile_storage = archive'")
+		("export-dir,o", po::value<std::string>(&export_dir),
+			"the directory to export the tiles to (as <map>/<rotation>/...), "
+			"defaults to the output directory of the configuration file, "
+			"next to the tile archives.");
+
+	po::variables_map vm;
+	try {
+		po::store(po::parse_command_line(argc, argv, all), vm);
+	} catch (po::error& ex) {
+		std::cout << "There is a problem parsing the command line arguments: "
+				<< ex.what() << std::endl << std::endl;
+		std::cout << all << std::endl;
+		return 1;
+	}
+
+	po::notify(vm);
+
+	if (vm.count("help")) {
+		std::cout << all << std::endl;
+		return 1;
+	}
+
+	if (!vm.count("config")) {
+		std::cerr << "You have to specify a configuration file!" << std::endl;
+		return 1;
+	}
+
+	util::LogLevel log_level = util::LogLevel::INFO;
+	if (verbosity > 0)
+		log_level = util::LogLevel::DEBUG;
+	util::Logging::getInstance().setSinkVerbosity("__output__", log_level);
+	util::Logging::getInstance().setSinkLogProgress("__output__", true);
+
+	config::MapcrafterConfig config;
+	config::ValidationMap validation = config.parseFile(config_file);
+
+	if (!validation.isEmpty()) {
+		if (validation.isCritical())
+			LOG(FATAL) << "Your configuration file is invalid!";
+		else
+			LOG(WARNING) << "Some notes on your configuration file:";
+		validation.log();
+	}
+
+	if (maps.empty()) {
+		auto config_maps = config.getMaps();
+		for (auto it = config_maps.begin(); it != config_maps.end(); ++it)
+			if (it->getTileStorage() == config::TileStorageType::ARCHIVE)
+				maps.push_back(it->getShortName());
+		if (maps.empty())
+			LOG(WARNING) << "There are no maps using 'tile_storage = archive'.";
+	}
+
+	bool ok = true;
+	for (auto map_it = maps.begin(); map_it != maps.end(); ++map_it) {
+		if (!config.hasMap(*map_it)) {
+			LOG(ERROR) << "Unknown map '" << *map_it << "'.";
+			ok = false;
+			continue;
+		}
+
+		config::MapSection map_config = config.getMap(*map_it);
+		auto rotations = map_config.getRotations();
+		for (auto rotation_it = rotations.begin(); rotation_it != rotations.end();
+				++rotation_it) {
+			std::string dir = *map_it + "/" + config::ROTATION_NAMES_SHORT[*rotation_it];
+			fs::path export_path = export_dir.empty() ? config.getOutputPath(dir)
+					: fs::path(export_dir) / dir;
+			LOG(INFO) << "Exporting map " << *map_it << " (rotation "
+					<< config::ROTATION_NAMES[*rotation_it] << ")...";
+			ok = exportTiles(config.getOutputPath(dir), export_path,
+					map_config.getImageFormatSuffix()) && ok;
+		}
+	}
+	return ok ? 0 : 1;
+}
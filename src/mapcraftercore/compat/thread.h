@@ -23,12 +23,17 @@
 #include "../config.h"
 
 #ifdef OPT_USE_BOOST_THREAD
+#  include <boost/chrono.hpp>
 #  include <boost/thread.hpp>
 namespace thread_ns = boost;
+namespace chrono_ns = boost::chrono;
 #else
+#  include <chrono>
 #  include <condition_variable>
 #  include <mutex>
+#  include <thread>
 namespace thread_ns = std;
+namespace chrono_ns = std::chrono;
 #endif
 
 #endif /* COMPAT_THREAD_H_ */
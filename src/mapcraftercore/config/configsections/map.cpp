@@ -33,6 +33,55 @@ config::ImageFormat as<config::ImageFormat>(const std::string& from) {
 	throw std::invalid_argument("Must be 'png' or 'jpeg'!");
 }
 
+template <>
+config::TileStorageType as<config::TileStorageType>(const std::string& from) {
+	if (from == "directory")
+		return config::TileStorageType::DIRECTORY;
+	else if (from == "archive")
+		return config::TileStorageType::ARCHIVE;
+	throw std::invalid_argument("Must be 'directory' or 'archive'!");
+}
+
+template <>
+renderer::PNGFilter as<renderer::PNGFilter>(const std::string& from) {
+	if (from == "none")
+		return renderer::PNGFilter::NONE;
+	else if (from == "sub")
+		return renderer::PNGFilter::SUB;
+	else if (from == "up")
+		return renderer::PNGFilter::UP;
+	else if (from == "average")
+		return renderer::PNGFilter::AVERAGE;
+	else if (from == "paeth")
+		return renderer::PNGFilter::PAETH;
+	else if (from == "adaptive")
+		return renderer::PNGFilter::ADAPTIVE;
+	throw std::invalid_argument("Must be one of 'none', 'sub', 'up', 'average', "
+			"'paeth' or 'adaptive'!");
+}
+
+template <>
+renderer::DownsampleMode as<renderer::DownsampleMode>(const std::string& from) {
+	if (from == "average")
+		return renderer::DownsampleMode::AVERAGE;
+	else if (from == "premultiplied")
+		return renderer::DownsampleMode::ALPHA_WEIGHTED;
+	else if (from == "linear")
+		return renderer::DownsampleMode::LINEAR;
+	throw std::invalid_argument("Must be 'average', 'premultiplied' or 'linear'!");
+}
+
+template <>
+renderer::JPEGSubsampling as<renderer::JPEGSubsampling>(const std::string& from) {
+	if (from == "444")
+		return renderer::JPEGSubsampling::YUV444;
+	else if (from == "422")
+		return renderer::JPEGSubsampling::YUV422;
+	else if (from == "420")
+		return renderer::JPEGSubsampling::YUV420;
+	throw std::invalid_argument("Must be '444', '422' or '420'!");
+}
+
 template <>
 renderer::RenderModeType as<renderer::RenderModeType>(const std::string& from) {
 	if (from == "plain")
@@ -132,6 +181,14 @@ std::ostream& operator<<(std::ostream& out, ImageFormat image_format) {
 	return out;
 }
 
+std::ostream& operator<<(std::ostream& out, TileStorageType tile_storage) {
+	if (tile_storage == TileStorageType::DIRECTORY)
+		out << "directory";
+	else if (tile_storage == TileStorageType::ARCHIVE)
+		out << "archive";
+	return out;
+}
+
 MapSection::MapSection()
 	: texture_size(12), render_biomes(false) {
 }
@@ -155,9 +212,19 @@ void MapSection::dump(std::ostream& out) const {
 	out << "  rotations = " << rotations << std::endl;
 	out << "  block_dir = " << block_dir << std::endl;
 	out << "  texture_size = " << texture_size << std::endl;
+	out << "  downsample_mode = " << downsample_mode << std::endl;
 	out << "  image_format = " << image_format << std::endl;
 	out << "  png_indexed = " << png_indexed << std::endl;
+	out << "  png_global_palette = " << png_global_palette << std::endl;
+	out << "  png_compression_level = " << png_compression_level << std::endl;
+	out << "  png_filter = " << png_filter << std::endl;
+	out << "  png_fast_render_tiles = " << png_fast_render_tiles << std::endl;
 	out << "  jpeg_quality = " << jpeg_quality << std::endl;
+	out << "  jpeg_subsampling = " << jpeg_subsampling << std::endl;
+	out << "  jpeg_fast_dct = " << jpeg_fast_dct << std::endl;
+	out << "  tile_storage = " << tile_storage << std::endl;
+	out << "  skip_empty_tiles = " << skip_empty_tiles << std::endl;
+	out << "  record_render_costs = " << record_render_costs << std::endl;
 	out << "  lighting_intensity = " << lighting_intensity << std::endl;
 	out << "  lighting_water_intensity = " << lighting_water_intensity << std::endl;
 	out << "  render_biomes = " << render_biomes << std::endl;
@@ -204,6 +271,10 @@ int MapSection::getTextureSize() const {
 	return texture_size.getValue();
 }
 
+renderer::DownsampleMode MapSection::getDownsampleMode() const {
+	return downsample_mode.getValue();
+}
+
 int MapSection::getTileWidth() const {
 	return tile_width.getValue();
 }
@@ -226,10 +297,46 @@ bool MapSection::isPNGIndexed() const {
 	return png_indexed.getValue();
 }
 
+bool MapSection::usePNGGlobalPalette() const {
+	return png_global_palette.getValue();
+}
+
+int MapSection::getPNGCompressionLevel() const {
+	return png_compression_level.getValue();
+}
+
+renderer::PNGFilter MapSection::getPNGFilter() const {
+	return png_filter.getValue();
+}
+
+bool MapSection::usePNGFastRenderTiles() const {
+	return png_fast_render_tiles.getValue();
+}
+
 int MapSection::getJPEGQuality() const {
 	return jpeg_quality.getValue();
 }
 
+renderer::JPEGSubsampling MapSection::getJPEGSubsampling() const {
+	return jpeg_subsampling.getValue();
+}
+
+bool MapSection::useJPEGFastDCT() const {
+	return jpeg_fast_dct.getValue();
+}
+
+TileStorageType MapSection::getTileStorage() const {
+	return tile_storage.getValue();
+}
+
+bool MapSection::skipEmptyTiles() const {
+	return skip_empty_tiles.getValue();
+}
+
+bool MapSection::recordRenderCosts() const {
+	return record_render_costs.getValue();
+}
+
 double MapSection::getLightingIntensity() const {
 	return lighting_intensity.getValue();
 }
@@ -276,10 +383,20 @@ void MapSection::preParse(const INIConfigSection& section,
 
 	texture_size.setDefault(12);
 	tile_width.setDefault(1);
+	downsample_mode.setDefault(renderer::DownsampleMode::AVERAGE);
 
 	image_format.setDefault(ImageFormat::PNG);
 	png_indexed.setDefault(false);
+	png_global_palette.setDefault(false);
+	png_compression_level.setDefault(6);
+	png_filter.setDefault(renderer::PNGFilter::ADAPTIVE);
+	png_fast_render_tiles.setDefault(false);
 	jpeg_quality.setDefault(85);
+	jpeg_subsampling.setDefault(renderer::JPEGSubsampling::YUV420);
+	jpeg_fast_dct.setDefault(false);
+	tile_storage.setDefault(TileStorageType::DIRECTORY);
+	skip_empty_tiles.setDefault(true);
+	record_render_costs.setDefault(false);
 
 	lighting_intensity.setDefault(1.0);
 	lighting_water_intensity.setDefault(0.85);
@@ -326,14 +443,36 @@ bool MapSection::parseField(const std::string key, const std::string value,
 		tile_width.load(key, value, validation);
 		if (tile_width.getValue() < 1)
 			validation.error("'tile_width' must be a positive number!");
+	} else if (key == "downsample_mode") {
+		downsample_mode.load(key, value, validation);
 	} else if (key == "image_format") {
 		image_format.load(key, value, validation);
 	} else if (key == "png_indexed") {
 		png_indexed.load(key, value, validation);
+	} else if (key == "png_global_palette") {
+		png_global_palette.load(key, value, validation);
+	} else if (key == "png_compression_level") {
+		if (png_compression_level.load(key, value, validation)
+				&& (png_compression_level.getValue() < 0 || png_compression_level.getValue() > 9))
+			validation.error("'png_compression_level' must be a number between 0 and 9!");
+	} else if (key == "png_filter") {
+		png_filter.load(key, value, validation);
+	} else if (key == "png_fast_render_tiles") {
+		png_fast_render_tiles.load(key, value, validation);
 	} else if (key == "jpeg_quality") {
 		if (jpeg_quality.load(key, value, validation)
 				&& (jpeg_quality.getValue() < 0 || jpeg_quality.getValue() > 100))
 			validation.error("'jpeg_quality' must be a number between 0 and 100!");
+	} else if (key == "jpeg_subsampling") {
+		jpeg_subsampling.load(key, value, validation);
+	} else if (key == "jpeg_fast_dct") {
+		jpeg_fast_dct.load(key, value, validation);
+	} else if (key == "tile_storage") {
+		tile_storage.load(key, value, validation);
+	} else if (key == "skip_empty_tiles") {
+		skip_empty_tiles.load(key, value, validation);
+	} else if (key == "record_render_costs") {
+		record_render_costs.load(key, value, validation);
 	} else if (key == "lighting_intensity") {
 		lighting_intensity.load(key, value, validation);
 	} else if (key == "lighting_water_intensity") {
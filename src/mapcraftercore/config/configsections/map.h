@@ -22,6 +22,7 @@
 
 #include "../configsection.h"
 #include "../validation.h"
+#include "../../renderer/image.h"
 #include "../../renderer/rendermode.h"
 #include "../../renderer/renderview.h"
 
@@ -81,6 +82,18 @@ enum class ImageFormat {
 
 std::ostream& operator<<(std::ostream& out, ImageFormat image_format);
 
+/**
+ * How the tile images of a map are stored in the output directory: As single image
+ * files in a directory tree (what the web interface reads), or packed into a few
+ * archive files with an index (see renderer::ArchiveTileStorage).
+ */
+enum class TileStorageType {
+	DIRECTORY,
+	ARCHIVE
+};
+
+std::ostream& operator<<(std::ostream& out, TileStorageType tile_storage);
+
 class INIConfigSection;
 
 class MapSection : public ConfigSection {
@@ -104,13 +117,23 @@ public:
 	fs::path getBlockDir() const;
 	int getTextureSize() const;
 	int getTextureBlur() const;
+	renderer::DownsampleMode getDownsampleMode() const;
 	double getWaterOpacity() const;
 	int getTileWidth() const;
 
 	ImageFormat getImageFormat() const;
 	std::string getImageFormatSuffix() const;
 	bool isPNGIndexed() const;
+	bool usePNGGlobalPalette() const;
+	int getPNGCompressionLevel() const;
+	renderer::PNGFilter getPNGFilter() const;
+	bool usePNGFastRenderTiles() const;
 	int getJPEGQuality() const;
+	renderer::JPEGSubsampling getJPEGSubsampling() const;
+	bool useJPEGFastDCT() const;
+	TileStorageType getTileStorage() const;
+	bool skipEmptyTiles() const;
+	bool recordRenderCosts() const;
 
 	double getLightingIntensity() const;
 	double getLightingWaterIntensity() const;
@@ -143,11 +166,20 @@ private:
 
 	Field<fs::path> block_dir;
 	Field<int> texture_size, tile_width;
+	Field<renderer::DownsampleMode> downsample_mode;
 	Field<double> water_opacity;
 
 	Field<ImageFormat> image_format;
-    Field<bool> png_indexed;
+    Field<bool> png_indexed, png_global_palette;
+	Field<int> png_compression_level;
+	Field<renderer::PNGFilter> png_filter;
+	Field<bool> png_fast_render_tiles;
 	Field<int> jpeg_quality;
+	Field<renderer::JPEGSubsampling> jpeg_subsampling;
+	Field<bool> jpeg_fast_dct;
+	Field<TileStorageType> tile_storage;
+	Field<bool> skip_empty_tiles;
+	Field<bool> record_render_costs;
 
 	Field<double> lighting_intensity, lighting_water_intensity;
 	Field<bool> cave_high_contrast;
@@ -87,6 +87,7 @@ void WorldSection::dump(std::ostream& out) const {
 	out << "  radius = " << radius << std::endl;
 	out << "  crop_unpopulated_chunks = " << crop_unpopulated_chunks << std::endl;
 	out << "  block_mask = " << block_mask << std::endl;
+	out << "  chunk_fingerprints = " << chunk_fingerprints << std::endl;
 }
 
 void WorldSection::setConfigDir(const fs::path& config_dir) {
@@ -129,6 +130,10 @@ bool WorldSection::hasCropUnpopulatedChunks() const {
 	return crop_unpopulated_chunks.getValue();
 }
 
+bool WorldSection::useChunkFingerprints() const {
+	return chunk_fingerprints.getValue();
+}
+
 std::string WorldSection::getBlockMask() const {
 	return block_mask.getValue();
 }
@@ -154,6 +159,7 @@ void WorldSection::preParse(const INIConfigSection& section,
 	sea_level.setDefault(62);
 
 	crop_unpopulated_chunks.setDefault(false);
+	chunk_fingerprints.setDefault(true);
 }
 
 bool WorldSection::parseField(const std::string key, const std::string value,
@@ -214,6 +220,8 @@ bool WorldSection::parseField(const std::string key, const std::string value,
 		crop_unpopulated_chunks.load(key, value, validation);
 	else if (key == "block_mask")
 		block_mask.load(key, value, validation);
+	else if (key == "chunk_fingerprints")
+		chunk_fingerprints.load(key, value, validation);
 	else
 		return false;
 	return true;
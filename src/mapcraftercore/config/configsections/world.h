@@ -59,6 +59,7 @@ public:
 	int getSeaLevel() const;
 
 	bool hasCropUnpopulatedChunks() const;
+	bool useChunkFingerprints() const;
 	std::string getBlockMask() const;
 
 	const mc::WorldCrop getWorldCrop() const;
@@ -88,6 +89,7 @@ private:
 	Field<int> center_x, center_z, radius;
 
 	Field<bool> crop_unpopulated_chunks;
+	Field<bool> chunk_fingerprints;
 	Field<std::string> block_mask;
 
 	mc::WorldCrop world_crop;
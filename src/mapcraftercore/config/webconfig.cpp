@@ -260,6 +260,7 @@ picojson::value WebConfig::getConfigJSON() const {
 		map_json["renderView"] = picojson::value(util::str(map_it->getRenderView()));
 		map_json["textureSize"] = picojson::value((double) map_it->getTextureSize());
 		map_json["imageFormat"] = picojson::value(map_it->getImageFormatSuffix());
+		map_json["renderCosts"] = picojson::value(map_it->recordRenderCosts());
 		if (world.getDefaultView() != mc::BlockPos(0, 0, 0)) {
 			mc::BlockPos default_view = world.getDefaultView();
 			picojson::array default_view_json;
@@ -21,6 +21,7 @@
 #include "blockstate.h"
 #include "../renderer/biomes.h"
 #include "../renderer/blockimages.h"
+#include "../util/profiler.h"
 
 #include <cmath>
 #include <iostream>
@@ -29,8 +30,6 @@
 namespace mapcrafter {
 namespace mc {
 
-namespace {
-
 void readPackedShorts_v116(const std::vector<int64_t>& data, uint16_t* palette, uint16_t* palette_end) {
 	uint32_t palette_size = palette_end - palette;
 	uint32_t shorts_per_long = (palette_size + data.size() - 1) / data.size();
@@ -49,8 +48,6 @@ void readPackedShorts_v116(const std::vector<int64_t>& data, uint16_t* palette,
 	}
 }
 
-} // namespace
-
 uint16_t Chunk::nop_id = 0;
 
 Chunk::Chunk()
@@ -154,6 +151,9 @@ bool Chunk::readNBT(mc::BlockStateRegistry& block_registry, const char* data, si
 		ChunkSection section;
 		section.y = y.payload;
 
+		// the rest of the section is timed as resolving the palettes
+		util::ProfileTimer timer(util::ProfileStage::PALETTE_RESOLVE);
+
 		/**
 		 * Get the block states palette
 		 */
@@ -384,5 +384,11 @@ const ChunkPos& Chunk::getPos() const {
 	return chunkpos;
 }
 
+size_t Chunk::getMemoryUsage() const {
+	// the extra data map needs roughly two pointers per entry in addition to the data
+	return sections.capacity() * sizeof(ChunkSection) + extra_data_map.size()
+			* (sizeof(std::pair<int, uint16_t>) + 2 * sizeof(void*));
+}
+
 }
 }
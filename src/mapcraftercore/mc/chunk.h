@@ -26,6 +26,7 @@
 
 #include <stdint.h>
 #include <unordered_map>
+#include <vector>
 
 namespace mapcrafter {
 namespace mc {
@@ -38,6 +39,13 @@ const int CHUNK_HIGHEST = 20;	// Excluded
 const int Y_CHUNKS_PER_REGION_FILE = 24;	// Number of chunksection in a chunk (to date)
 const int OUT_OF_WORLD_LIGHT = 9;	// Lighting value for shading side of the world
 
+/**
+ * Unpacks the values of a packed long array of the 1.16+ chunk format (values don't
+ * span multiple longs) into an array. The bits per value are derived from the size
+ * of the long array and the count of values.
+ */
+void readPackedShorts_v116(const std::vector<int64_t>& data, uint16_t* palette, uint16_t* palette_end);
+
 /**
  * A 16x16x16 section of a chunk.
  */
@@ -120,6 +128,11 @@ public:
 	 */
 	const ChunkPos& getPos() const;
 
+	/**
+	 * Returns (approximately) how much memory the loaded chunk data uses.
+	 */
+	size_t getMemoryUsage() const;
+
 	// ID of the "no operation" block
 	static uint16_t nop_id;
 
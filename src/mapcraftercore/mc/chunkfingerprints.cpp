@@ -0,0 +1,271 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "chunkfingerprints.h"
+
+#include "nbt.h"
+#include "region.h"
+#include "../util.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+namespace mapcrafter {
+namespace mc {
+
+namespace {
+
+// increase this when the format of the cache or the fingerprints change
+const int CACHE_VERSION = 2;
+
+// the top-level tags of a chunk which are relevant to rendering
+// (the status decides whether a chunk is rendered at all)
+const char* CHUNK_TAGS[] = {"DataVersion", "Status", "xPos", "yPos", "zPos"};
+// the tags of a chunk section which are relevant to rendering
+const char* SECTION_TAGS[] = {"Y", "block_states", "biomes", "BlockLight", "SkyLight"};
+
+/**
+ * Multiply-xorshift hash over a byte buffer, processing eight bytes at once.
+ */
+uint64_t hashBytes(const char* data, size_t len) {
+	uint64_t h = len * util::HASH_MULTIPLIER;
+	for (size_t i = 0; i < len; i += 8) {
+		uint64_t v = 0;
+		std::memcpy(&v, data + i, std::min<size_t>(8, len - i));
+		h = util::hashMix(h, v);
+	}
+	// never return 0, that's the fingerprint of invalid chunks
+	h ^= h >> 32;
+	return h != 0 ? h : 1;
+}
+
+}
+
+ChunkFingerprints::ChunkFingerprints(const fs::path& filename)
+	: filename(filename), unchanged(0) {
+}
+
+ChunkFingerprints::~ChunkFingerprints() {
+}
+
+bool ChunkFingerprints::read() {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	regions.clear();
+	if (!fs::exists(filename))
+		return false;
+
+	try {
+		nbt::NBTFile nbt_file;
+		nbt_file.readNBT(filename.string().c_str(), nbt::Compression::GZIP);
+		if (nbt_file.findTag<nbt::TagInt>("version").payload != CACHE_VERSION) {
+			LOG(DEBUG) << "Chunk fingerprint cache " << filename << " is outdated, ignoring it.";
+			return false;
+		}
+
+		const nbt::TagList& nbt_regions = nbt_file.findTag<nbt::TagList>("regions");
+		for (auto region_it = nbt_regions.payload.begin();
+				region_it != nbt_regions.payload.end(); ++region_it) {
+			const nbt::TagCompound& nbt_region = (*region_it)->cast<nbt::TagCompound>();
+			RegionPos pos(nbt_region.findTag<nbt::TagInt>("x").payload,
+					nbt_region.findTag<nbt::TagInt>("z").payload);
+
+			const std::vector<int32_t>& chunks = nbt_region.findTag<nbt::TagIntArray>(
+					"chunks").payload;
+			const std::vector<int32_t>& timestamps = nbt_region.findTag<nbt::TagIntArray>(
+					"timestamps").payload;
+			const std::vector<int32_t>& content_timestamps = nbt_region.findTag<
+					nbt::TagIntArray>("content_timestamps").payload;
+			const std::vector<int64_t>& fingerprints = nbt_region.findTag<nbt::TagLongArray>(
+					"fingerprints").payload;
+			if (chunks.size() != timestamps.size() || chunks.size() != content_timestamps.size()
+					|| chunks.size() != fingerprints.size())
+				throw nbt::NBTError("Invalid region entry");
+
+			std::vector<ChunkEntry>& entries = regions[pos];
+			entries.resize(chunks.size());
+			for (size_t i = 0; i < chunks.size(); i++) {
+				entries[i].index = chunks[i];
+				entries[i].timestamp = timestamps[i];
+				entries[i].content_timestamp = content_timestamps[i];
+				entries[i].fingerprint = fingerprints[i];
+			}
+		}
+	} catch (nbt::NBTError& e) {
+		LOG(WARNING) << "Unable to read chunk fingerprint cache " << filename << ": " << e.what();
+		regions.clear();
+		return false;
+	}
+	return true;
+}
+
+bool ChunkFingerprints::write() const {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	nbt::NBTFile nbt_file;
+	nbt::TagList nbt_regions(nbt::TagCompound::TAG_TYPE);
+	nbt_regions.payload.reserve(regions.size());
+
+	for (auto region_it = regions.begin(); region_it != regions.end(); ++region_it) {
+		const std::vector<ChunkEntry>& entries = region_it->second;
+		std::vector<int32_t> chunks, timestamps, content_timestamps;
+		std::vector<int64_t> fingerprints;
+		for (auto it = entries.begin(); it != entries.end(); ++it) {
+			chunks.push_back(it->index);
+			timestamps.push_back(it->timestamp);
+			content_timestamps.push_back(it->content_timestamp);
+			fingerprints.push_back(it->fingerprint);
+		}
+
+		nbt::TagCompound* nbt_region = new nbt::TagCompound();
+		nbt_region->addTag("x", nbt::TagInt(region_it->first.x));
+		nbt_region->addTag("z", nbt::TagInt(region_it->first.z));
+		nbt_region->addTag("chunks", nbt::TagIntArray(chunks));
+		nbt_region->addTag("timestamps", nbt::TagIntArray(timestamps));
+		nbt_region->addTag("content_timestamps", nbt::TagIntArray(content_timestamps));
+		nbt_region->addTag("fingerprints", nbt::TagLongArray(fingerprints));
+		nbt_regions.payload.push_back(nbt::TagPtr(nbt_region));
+	}
+
+	nbt_file.addTag("version", nbt::TagInt(CACHE_VERSION));
+	nbt_file.addTag("regions", nbt_regions);
+
+	try {
+		nbt_file.writeNBT(filename.string().c_str(), nbt::Compression::GZIP);
+	} catch (nbt::NBTError& e) {
+		LOG(WARNING) << "Unable to write chunk fingerprint cache " << filename << ": " << e.what();
+		return false;
+	}
+	return true;
+}
+
+void ChunkFingerprints::updateRegion(RegionFile& region_file,
+		const std::vector<int32_t>& chunks, std::vector<int32_t>& timestamps) {
+	std::vector<ChunkEntry> old_entries;
+	{
+		thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+		auto it = regions.find(region_file.getPos());
+		if (it != regions.end())
+			old_entries = it->second;
+	}
+
+	// find out which chunks changed and need a (new) fingerprint
+	std::vector<ChunkEntry> entries(chunks.size());
+	std::vector<const ChunkEntry*> old_chunk_entries(chunks.size(), nullptr);
+	bool data_required = false;
+	for (size_t i = 0; i < chunks.size(); i++) {
+		ChunkEntry& entry = entries[i];
+		entry.index = chunks[i];
+		entry.timestamp = entry.content_timestamp = timestamps[i];
+		entry.fingerprint = 0;
+
+		ChunkEntry search;
+		search.index = chunks[i];
+		auto old_it = std::lower_bound(old_entries.begin(), old_entries.end(), search,
+				[](const ChunkEntry& e1, const ChunkEntry& e2) { return e1.index < e2.index; });
+		if (old_it != old_entries.end() && old_it->index == chunks[i]) {
+			old_chunk_entries[i] = &*old_it;
+			if (old_it->timestamp == timestamps[i]) {
+				entry = *old_it;
+				continue;
+			}
+		}
+		data_required = true;
+	}
+
+	// the region data is only read if there are changed chunks,
+	// if it's corrupted the chunks just keep their timestamps
+	bool data_valid = data_required && region_file.read();
+	int region_unchanged = 0;
+	for (size_t i = 0; i < chunks.size(); i++) {
+		ChunkEntry& entry = entries[i];
+		if (data_valid && entry.fingerprint == 0) {
+			ChunkPos pos(region_file.getPos().x * 32 + entry.index % 32,
+					region_file.getPos().z * 32 + entry.index / 32);
+			entry.fingerprint = fingerprintChunk(region_file.getChunkData(pos),
+					region_file.getChunkDataCompression(pos));
+
+			// the chunk keeps the time of its last content change if its content is the same
+			const ChunkEntry* old_entry = old_chunk_entries[i];
+			if (old_entry != nullptr && entry.fingerprint != 0
+					&& old_entry->fingerprint == entry.fingerprint) {
+				entry.content_timestamp = old_entry->content_timestamp;
+				region_unchanged++;
+			}
+		}
+		timestamps[i] = entry.content_timestamp;
+	}
+
+	std::sort(entries.begin(), entries.end(),
+			[](const ChunkEntry& e1, const ChunkEntry& e2) { return e1.index < e2.index; });
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	regions[region_file.getPos()].swap(entries);
+	unchanged += region_unchanged;
+}
+
+void ChunkFingerprints::retainRegions(const World::RegionSet& available_regions) {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	for (auto it = regions.begin(); it != regions.end(); ) {
+		if (!available_regions.count(it->first))
+			it = regions.erase(it);
+		else
+			++it;
+	}
+}
+
+int ChunkFingerprints::getUnchangedCount() const {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	return unchanged;
+}
+
+uint64_t ChunkFingerprints::fingerprintChunk(const std::vector<uint8_t>& data,
+		uint8_t compression) {
+	if (data.empty())
+		return 0;
+	nbt::Compression comp = nbt::Compression::NO_COMPRESSION;
+	if (compression == 1)
+		comp = nbt::Compression::GZIP;
+	else if (compression == 2)
+		comp = nbt::Compression::ZLIB;
+
+	// serialize only the tags relevant to rendering and hash them
+	std::stringstream ss(std::ios::in | std::ios::out | std::ios::binary);
+	try {
+		nbt::NBTFile nbt;
+		nbt.readNBT(reinterpret_cast<const char*>(&data[0]), data.size(), comp);
+		if (!nbt.hasList<nbt::TagCompound>("sections"))
+			return 0;
+		for (size_t i = 0; i < sizeof(CHUNK_TAGS) / sizeof(CHUNK_TAGS[0]); i++)
+			if (nbt.hasTag(CHUNK_TAGS[i]))
+				nbt.findTag(CHUNK_TAGS[i]).write(ss);
+		const nbt::TagList& sections = nbt.findTag<nbt::TagList>("sections");
+		for (auto it = sections.payload.begin(); it != sections.payload.end(); ++it) {
+			const nbt::TagCompound& section = (*it)->cast<nbt::TagCompound>();
+			for (size_t i = 0; i < sizeof(SECTION_TAGS) / sizeof(SECTION_TAGS[0]); i++)
+				if (section.hasTag(SECTION_TAGS[i]))
+					section.findTag(SECTION_TAGS[i]).write(ss);
+		}
+	} catch (const nbt::NBTError& err) {
+		return 0;
+	}
+	std::string buffer = ss.str();
+	return hashBytes(buffer.data(), buffer.size());
+}
+
+}
+}
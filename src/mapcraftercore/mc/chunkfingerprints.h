@@ -0,0 +1,117 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHUNKFINGERPRINTS_H_
+#define CHUNKFINGERPRINTS_H_
+
+#include "pos.h"
+#include "world.h"
+#include "../compat/thread.h"
+
+#include <cstdint>
+#include <map>
+#include <vector>
+#include <boost/filesystem.hpp>
+
+namespace fs = boost::filesystem;
+
+namespace mapcrafter {
+namespace mc {
+
+class RegionFile;
+
+/**
+ * Persistent cache of fingerprints of the content of the chunks of a world, stored in
+ * the cache directory of the world.
+ *
+ * Minecraft updates the timestamp of a chunk whenever it saves the chunk, even if only
+ * entities moved or other metadata changed. A fingerprint is a hash of the chunk data
+ * relevant to rendering (block states, biomes and light of the chunk sections). When the
+ * timestamp of a chunk changes, its fingerprint is compared with the cached one. The
+ * chunk keeps the timestamp of its last actual content change if the fingerprint did not
+ * change, so incremental rendering skips the tiles of chunks that were only touched.
+ *
+ * Updating regions is thread-safe as long as different threads update different regions.
+ */
+class ChunkFingerprints {
+public:
+	ChunkFingerprints(const fs::path& filename);
+	~ChunkFingerprints();
+
+	/**
+	 * Reads the cache file. Returns false if the file does not exist or could not be
+	 * read, the cache is empty then.
+	 */
+	bool read();
+
+	/**
+	 * Writes the cache file. Returns false if the file could not be written.
+	 */
+	bool write() const;
+
+	/**
+	 * Replaces the timestamps of the chunks of a region file (given as local chunk
+	 * indexes z*32+x and their timestamps from the region header) by the time the
+	 * content of each chunk changed the last time.
+	 *
+	 * The headers of the region file need to be read already. The chunk data is read
+	 * only if fingerprints of chunks need to be calculated.
+	 */
+	void updateRegion(RegionFile& region_file, const std::vector<int32_t>& chunks,
+			std::vector<int32_t>& timestamps);
+
+	/**
+	 * Removes all regions from the cache which are not in the supplied set of regions.
+	 */
+	void retainRegions(const World::RegionSet& available_regions);
+
+	/**
+	 * Returns the count of chunks whose timestamp changed, but not their content,
+	 * since the cache was read.
+	 */
+	int getUnchangedCount() const;
+
+	/**
+	 * Calculates the fingerprint of the (compressed) data of a chunk.
+	 * Returns 0 if the chunk data is invalid.
+	 */
+	static uint64_t fingerprintChunk(const std::vector<uint8_t>& data, uint8_t compression);
+
+private:
+	struct ChunkEntry {
+		// local index of the chunk in the region
+		int32_t index;
+		// timestamp of the chunk and time of the last change of the content of the chunk
+		int32_t timestamp, content_timestamp;
+		uint64_t fingerprint;
+	};
+
+	fs::path filename;
+
+	// chunk entries (sorted by index) of every region
+	std::map<RegionPos, std::vector<ChunkEntry> > regions;
+	int unchanged;
+
+	mutable thread_ns::mutex mutex;
+};
+
+}
+}
+
+#endif /* CHUNKFINGERPRINTS_H_ */
@@ -19,6 +19,8 @@
 
 #include "nbt.h"
 
+#include "../util/profiler.h"
+
 #include <fstream>
 #include <boost/iostreams/copy.hpp>
 #include <boost/iostreams/filtering_stream.hpp>
@@ -409,7 +411,11 @@ void NBTFile::decompressStream(std::istream& stream, std::stringstream& decompre
 
 void NBTFile::readCompressed(std::istream& stream, Compression compression) {
 	std::stringstream decompressed(std::ios::in | std::ios::out | std::ios::binary);
-	decompressStream(stream, decompressed, compression);
+	{
+		util::ProfileTimer timer(util::ProfileStage::INFLATE);
+		decompressStream(stream, decompressed, compression);
+	}
+	util::ProfileTimer timer(util::ProfileStage::NBT_PARSE);
 	int8_t type = ((TagByte&) TagByte().read(decompressed)).payload;
 	if (type != TagCompound::TAG_TYPE)
 		throw NBTError("First tag is not a tag compound!");
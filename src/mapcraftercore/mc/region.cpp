@@ -20,6 +20,8 @@
 #include "region.h"
 
 #include "blockstate.h"
+#include "../util/metrics.h"
+#include "../util/profiler.h"
 
 #include <cstdlib>
 #include <fstream>
@@ -119,6 +121,7 @@ void RegionFile::setWorldCrop(const WorldCrop& world_crop) {
 }
 
 bool RegionFile::read() {
+	util::ProfileTimer timer(util::ProfileStage::REGION_READ);
 	std::ifstream file(filename.c_str(), std::ios_base::binary);
 	uint32_t chunk_offsets[1024];
 	if (!readHeaders(file, chunk_offsets))
@@ -129,6 +132,7 @@ bool RegionFile::read() {
 
 	std::vector<uint8_t> regiondata(filesize);
 	file.read(reinterpret_cast<char*>(&regiondata[0]), filesize);
+	util::Metrics::add(util::MetricCounter::BYTES_READ, filesize);
 
 	for (int i = 0; i < 1024; i++) {
 		// get the offsets, where the chunk data starts
@@ -281,6 +285,13 @@ void RegionFile::setChunkData(const ChunkPos& chunk, const std::vector<uint8_t>&
 	}
 }
 
+size_t RegionFile::getMemoryUsage() const {
+	size_t usage = 0;
+	for (int i = 0; i < 1024; i++)
+		usage += chunk_data[i].capacity();
+	return usage;
+}
+
 /**
  * This method tries to load a chunk from the region data and returns a status.
  */
@@ -124,6 +124,11 @@ public:
 	void setChunkData(const ChunkPos& chunk, const std::vector<uint8_t>& data,
 			uint8_t compression);
 
+	/**
+	 * Returns how much memory the raw chunk data uses.
+	 */
+	size_t getMemoryUsage() const;
+
 	/**
 	 * Loads a specific chunk into the supplied Chunk-object.
 	 * Returns as integer one of the RegionFile::CHUNK_* status codes.
@@ -20,6 +20,14 @@
 #include "worldcache.h"
 
 #include "blockstate.h"
+#include "../util/memory.h"
+#include "../util/profiler.h"
+#include "../util/trace.h"
+
+#include <algorithm>
+#include <new>
+#include <utility>
+#include <vector>
 
 namespace mapcrafter {
 namespace mc {
@@ -29,12 +37,68 @@ Block::Block()
 	  block_light(0), sky_light(mc::OUT_OF_WORLD_LIGHT), fields_set(0) {
 }
 
+namespace {
+
+/**
+ * Registers the changed memory usage of a cache entry with the memory accountant.
+ */
+template <typename Key, typename Value>
+void updateMemoryUsage(CacheEntry<Key, Value>& entry, util::MemoryComponent component) {
+	size_t bytes = entry.value.getMemoryUsage();
+	util::MemoryAccountant::add(component, (int64_t) bytes - (int64_t) entry.bytes);
+	entry.bytes = bytes;
+}
+
+/**
+ * Evicts the least recently used entries of a cache (which were last used before an
+ * access) until enough bytes were freed.
+ */
+template <typename Key, typename Value>
+size_t evictEntries(CacheEntry<Key, Value>* entries, int size, size_t bytes,
+		uint64_t used_before, util::MemoryComponent component) {
+	std::vector<std::pair<uint64_t, int>> used;
+	for (int i = 0; i < size; i++)
+		if (entries[i].bytes > 0 && entries[i].last_used < used_before)
+			used.push_back(std::make_pair(entries[i].last_used, i));
+	std::sort(used.begin(), used.end());
+
+	size_t freed = 0;
+	for (auto it = used.begin(); it != used.end() && freed < bytes; ++it) {
+		CacheEntry<Key, Value>& entry = entries[it->second];
+		freed += entry.bytes;
+		entry.used = false;
+		// assigning an empty value would keep the memory allocated by the vectors (there
+		// is no move assignment), so destroy the value and construct an empty one instead
+		entry.value.~Value();
+		new (&entry.value) Value();
+		updateMemoryUsage(entry, component);
+	}
+	return freed;
+}
+
+}
+
 WorldCache::WorldCache(mc::BlockStateRegistry& block_registry, const World& world)
-	: block_registry(block_registry), world(world) {
-	for (int i = 0; i < RSIZE; i++)
+	: block_registry(block_registry), world(world), accesses(0), released_accesses(0) {
+	for (int i = 0; i < RSIZE; i++) {
 		regioncache[i].used = false;
-	for (int i = 0; i < CSIZE; i++)
+		regioncache[i].bytes = 0;
+		regioncache[i].last_used = 0;
+	}
+	for (int i = 0; i < CSIZE; i++) {
 		chunkcache[i].used = false;
+		chunkcache[i].bytes = 0;
+		chunkcache[i].last_used = 0;
+	}
+}
+
+WorldCache::~WorldCache() {
+	for (int i = 0; i < RSIZE; i++)
+		util::MemoryAccountant::add(util::MemoryComponent::REGION_CACHE,
+				-(int64_t) regioncache[i].bytes);
+	for (int i = 0; i < CSIZE; i++)
+		util::MemoryAccountant::add(util::MemoryComponent::CHUNK_CACHE,
+				-(int64_t) chunkcache[i].bytes);
 }
 
 const World& WorldCache::getWorld() const {
@@ -61,7 +125,9 @@ RegionFile* WorldCache::getRegion(const RegionPos& pos) {
 
 	// check if region is already in cache
 	if (entry.used && entry.key == pos) {
-		//regionstats.hits++;
+		entry.last_used = ++accesses;
+		regionstats.hits++;
+		util::Profiler::count(util::ProfileCounter::REGION_CACHE_HITS);
 		return &entry.value;
 	}
 
@@ -71,10 +137,16 @@ RegionFile* WorldCache::getRegion(const RegionPos& pos) {
 		return nullptr;
 
 	// region does not exist, region in cache was not modified
-	if (!world.getRegion(pos, entry.value))
+	if (!world.getRegion(pos, entry.value)) {
+		regionstats.not_found++;
 		return nullptr;
+	}
 
-	if (!entry.value.read()) {
+	util::TraceSpan span("load_region", "io");
+	bool ok = entry.value.read();
+	updateMemoryUsage(entry, util::MemoryComponent::REGION_CACHE);
+	if (!ok) {
+		regionstats.invalid++;
 		// the region is not valid, region in cache was probably modified
 		entry.used = false;
 		// remember this region as broken and do not try to load it again
@@ -84,7 +156,9 @@ RegionFile* WorldCache::getRegion(const RegionPos& pos) {
 
 	entry.used = true;
 	entry.key = pos;
-	//regionstats.misses++;
+	entry.last_used = ++accesses;
+	regionstats.misses++;
+	util::Profiler::count(util::ProfileCounter::REGION_CACHE_MISSES);
 	return &entry.value;
 }
 
@@ -92,14 +166,16 @@ Chunk* WorldCache::getChunk(const ChunkPos& pos) {
 	CacheEntry<ChunkPos, Chunk>& entry = chunkcache[getChunkCacheIndex(pos)];
 	// check if chunk is already in cache
 	if (entry.used && entry.key == pos) {
-		//chunkstats.hits++;
+		entry.last_used = ++accesses;
+		chunkstats.hits++;
+		util::Profiler::count(util::ProfileCounter::CHUNK_CACHE_HITS);
 		return &entry.value;
 	}
 
 	// if not try to get the region of the chunk from the cache
 	RegionFile* region = getRegion(pos.getRegion());
 	if (region == nullptr) {
-		//chunkstats.unavailable++;
+		chunkstats.region_not_found++;
 		return nullptr;
 	}
 
@@ -108,13 +184,24 @@ Chunk* WorldCache::getChunk(const ChunkPos& pos) {
 	if (chunks_broken.count(pos))
 		return nullptr;
 
+	// make room for the chunk first if too much memory is used, but only evict chunks,
+	// the regions are probably needed to load the next chunks
+	if (util::MemoryAccountant::isOverLimit() && region->hasChunk(pos))
+		evictEntries(chunkcache, CSIZE, util::MemoryAccountant::getExcess(),
+				released_accesses, util::MemoryComponent::CHUNK_CACHE);
+
+	util::TraceSpan span("load_chunk", "io");
 	int status = region->loadChunk(pos, block_registry, entry.value);
 	// the chunk does not exist, chunk in cache was not modified
-	if (status == RegionFile::CHUNK_DOES_NOT_EXIST)
+	if (status == RegionFile::CHUNK_DOES_NOT_EXIST) {
+		span.cancel();
+		chunkstats.not_found++;
 		return nullptr;
+	}
 
+	updateMemoryUsage(entry, util::MemoryComponent::CHUNK_CACHE);
 	if (status != RegionFile::CHUNK_OK) {
-		//chunkstats.unavailable++;
+		chunkstats.invalid++;
 		// the chunk is not valid, chunk in cache was probably modified
 		entry.used = false;
 		// remember this chunk as broken and do not try to load it again
@@ -124,7 +211,9 @@ Chunk* WorldCache::getChunk(const ChunkPos& pos) {
 
 	entry.used = true;
 	entry.key = pos;
-	//chunkstats.misses++;
+	entry.last_used = ++accesses;
+	chunkstats.misses++;
+	util::Profiler::count(util::ProfileCounter::CHUNK_CACHE_MISSES);
 	return &entry.value;
 }
 
@@ -165,6 +254,30 @@ Block WorldCache::getBlock(const mc::BlockPos& pos, const mc::Chunk* chunk, int
 	}
 }
 
+void WorldCache::releaseEntries() {
+	released_accesses = accesses + 1;
+}
+
+size_t WorldCache::evict(size_t bytes) {
+	released_accesses = accesses + 1;
+	// the chunks are evicted first, the regions are needed to load them again
+	size_t freed = evictEntries(chunkcache, CSIZE, bytes, released_accesses,
+			util::MemoryComponent::CHUNK_CACHE);
+	if (freed < bytes)
+		freed += evictEntries(regioncache, RSIZE, bytes - freed, released_accesses,
+				util::MemoryComponent::REGION_CACHE);
+	return freed;
+}
+
+size_t WorldCache::getMemoryUsage() const {
+	size_t usage = 0;
+	for (int i = 0; i < RSIZE; i++)
+		usage += regioncache[i].bytes;
+	for (int i = 0; i < CSIZE; i++)
+		usage += chunkcache[i].bytes;
+	return usage;
+}
+
 const CacheStats& WorldCache::getRegionCacheStats() const {
 	return regionstats;
 }
@@ -54,7 +54,8 @@ const int GET_SKY_LIGHT = 16;
 const int GET_LIGHT = GET_BLOCK_LIGHT | GET_SKY_LIGHT;
 
 /**
- * Some cache statistics for debugging. Not used at the moment.
+ * Some cache statistics for debugging. The hits and misses are also counted by the
+ * profiler (see util::Profiler).
  *
  * Maybe add a set of corrupt chunks/regions to dump them at the end of the rendering.
  */
@@ -88,6 +89,11 @@ struct CacheEntry {
 	Key key;
 	Value value;
 	bool used;
+
+	// memory used by the value as accounted with the memory accountant
+	size_t bytes;
+	// when the entry was accessed the last time (see WorldCache::accesses)
+	uint64_t last_used;
 };
 
 #define RBITS 2
@@ -120,6 +126,11 @@ struct CacheEntry {
  * the coordinate of the requested region/chunk. If yes, the cache returns the objects.
  * If not, the cache tries to load the chunk/region and puts it in this cache entry
  * (overwrites an already loaded region/chunk at this cache position).
+ *
+ * The memory used by the cached regions and chunks is registered with the memory
+ * accountant (see util::MemoryAccountant). If the memory limit is exceeded, the cache
+ * evicts the least recently used chunks (which were released, see releaseEntries) when
+ * it needs to load a chunk.
  */
 class WorldCache {
 private:
@@ -137,11 +148,20 @@ private:
 	CacheStats regionstats;
 	CacheStats chunkstats;
 
+	// counts the accesses of the cache to find the least recently used entries
+	uint64_t accesses;
+	// the chunks accessed before this access may be evicted while loading chunks
+	uint64_t released_accesses;
+
 	int getRegionCacheIndex(const RegionPos& pos) const;
 	int getChunkCacheIndex(const ChunkPos& pos) const;
 
 public:
 	WorldCache(mc::BlockStateRegistry& block_registry, const World& world);
+	~WorldCache();
+
+	WorldCache(const WorldCache& other) = delete;
+	WorldCache& operator=(const WorldCache& other) = delete;
 
 	const World& getWorld() const;
 
@@ -150,6 +170,29 @@ public:
 
 	Block getBlock(const mc::BlockPos& pos, const mc::Chunk* chunk, int get = GET_ID);
 
+	/**
+	 * Marks the chunks accessed so far as not used anymore. If the memory limit is
+	 * exceeded, the cache evicts released chunks when loading other chunks. Chunks
+	 * accessed after this call are kept, because pointers to them might still be used.
+	 * Call this before rendering a new tile for example.
+	 */
+	void releaseEntries();
+
+	/**
+	 * Evicts the least recently used chunks (and then regions) from the cache until
+	 * at least the specified count of bytes was freed or the cache is empty. Returns
+	 * the count of freed bytes.
+	 *
+	 * Pointers to chunks returned by the cache are invalid afterwards, so don't call
+	 * this while rendering a tile.
+	 */
+	size_t evict(size_t bytes);
+
+	/**
+	 * Returns how much memory the cached regions and chunks use.
+	 */
+	size_t getMemoryUsage() const;
+
 	const CacheStats& getRegionCacheStats() const;
 	const CacheStats& getChunkCacheStats() const;
 };
@@ -22,6 +22,8 @@
 #include "blockatlas.h"
 #include "image.h"
 
+#include <cstring>
+
 namespace mapcrafter {
 namespace renderer {
 
@@ -106,6 +108,26 @@ bool BlockAtlas::OpenDictionnary(fs::path path, std::string name) {
 	return true;
 }
 
+void BlockAtlas::SetBlocks(uint32_t block_width, uint32_t block_height, uint32_t count,
+		const void* pixels) {
+	this->block_count = count;
+	this->block_width = block_width;
+	this->block_height = block_height;
+	this->block_ptrs.clear();
+	this->block_ptrs.reserve(count);
+	this->shaded_blocks.clear();
+
+	const size_t block_size = block_width * block_height * sizeof(RGBAPixel);
+	const char* data = static_cast<const char*>(pixels);
+	for (uint32_t i = 0; i < count; i++) {
+		std::shared_ptr<RGBAImage> ptr = std::make_shared<RGBAImage>(block_width, block_height);
+		std::memcpy(&ptr->data[0], data + i * block_size, block_size);
+		this->block_ptrs.emplace_back(ptr);
+		// the blocks are already shaded
+		this->shaded_blocks.insert(i);
+	}
+}
+
 std::shared_ptr<const RGBAImage> const BlockAtlas::GetImage(uint32_t idx) {
 	if (idx < 0 || idx >= this->block_count) {
 		LOG(ERROR) << "Block atlas doesn't match image index file ";
@@ -58,6 +58,14 @@ class BlockAtlas {
 
 	bool OpenDictionnary(fs::path path, std::string block_file);
 
+	/**
+	 * Replaces the blocks of the atlas with already cut (and shaded) blocks, the pixels
+	 * of the blocks are stored one after another. This is used to load the atlas from
+	 * the block image cache (see RenderedBlockImages::readCache).
+	 */
+	void SetBlocks(uint32_t block_width, uint32_t block_height, uint32_t count,
+			const void* pixels);
+
 	uint32_t const                         GetCount() { return this->block_count; };
 	std::shared_ptr<const RGBAImage> const GetImage(uint32_t idx);
 
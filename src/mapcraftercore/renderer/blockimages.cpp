@@ -24,9 +24,15 @@
 #include "../mc/blockstate.h"
 #include "../mc/chunk.h"
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
 #include <map>
+#include <set>
 #include <vector>
+#include <boost/iostreams/device/mapped_file.hpp>
 
 namespace mapcrafter {
 namespace util {
@@ -477,6 +483,131 @@ std::array<bool, 3> blockImageGetSideMask(const RGBAImage& uv) {
 	return side_mask;
 }
 
+namespace {
+
+// "MCBI"
+const uint32_t CACHE_MAGIC = 0x4942434d;
+// increase this when the format of the cache or the preparation of the block images changes
+const uint32_t CACHE_VERSION = 2;
+
+/**
+ * Hashes the contents of a file. Returns false if the file is not readable.
+ */
+bool hashFile(const fs::path& filename, uint64_t& h) {
+	std::ifstream in(filename.string(), std::ios::binary);
+	if (!in)
+		return false;
+	std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	h = util::hashMix(h, data.size());
+	for (size_t i = 0; i < data.size(); i += 8) {
+		uint64_t v = 0;
+		std::memcpy(&v, data.data() + i, std::min<size_t>(8, data.size() - i));
+		h = util::hashMix(h, v);
+	}
+	return true;
+}
+
+/**
+ * Appends values to the buffer of a cache file. The cache file belongs to this
+ * machine, so the values are stored in native byte order.
+ */
+class CacheWriter {
+public:
+	template <typename T>
+	void write(T value) {
+		buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	void writeBytes(const void* data, size_t size) {
+		buffer.append(static_cast<const char*>(data), size);
+	}
+
+	void writeString(const std::string& str) {
+		write<uint32_t>(str.size());
+		buffer.append(str);
+	}
+
+	template <typename T>
+	void writeVector(const std::vector<T>& vector) {
+		write<uint32_t>(vector.size());
+		writeBytes(vector.data(), vector.size() * sizeof(T));
+	}
+
+	const std::string& getBuffer() const {
+		return buffer;
+	}
+
+private:
+	std::string buffer;
+};
+
+/**
+ * Reads values written by a CacheWriter. All reads are bounds checked, after reading
+ * past the end good() returns false and the read values are invalid.
+ */
+class CacheReader {
+public:
+	CacheReader(const char* data, size_t size)
+		: data(data), size(size), pos(0), ok(true) {}
+
+	template <typename T>
+	T read() {
+		T value = T();
+		const char* ptr = skip(sizeof(T));
+		if (ptr != nullptr)
+			std::memcpy(&value, ptr, sizeof(T));
+		return value;
+	}
+
+	/**
+	 * Returns a pointer to the next bytes and skips them, nullptr if there are not
+	 * enough bytes left.
+	 */
+	const char* skip(size_t bytes) {
+		if (!ok || size - pos < bytes) {
+			ok = false;
+			return nullptr;
+		}
+		const char* ptr = data + pos;
+		pos += bytes;
+		return ptr;
+	}
+
+	std::string readString() {
+		uint32_t length = read<uint32_t>();
+		const char* ptr = skip(length);
+		return ptr != nullptr ? std::string(ptr, length) : "";
+	}
+
+	template <typename T>
+	std::vector<T> readVector() {
+		uint32_t length = read<uint32_t>();
+		if (!ok || (size - pos) / sizeof(T) < length) {
+			ok = false;
+			return std::vector<T>();
+		}
+		std::vector<T> vector(length);
+		if (length > 0)
+			std::memcpy(&vector[0], skip(length * sizeof(T)), length * sizeof(T));
+		return vector;
+	}
+
+	bool good() const {
+		return ok;
+	}
+
+	bool eof() const {
+		return pos == size;
+	}
+
+private:
+	const char* data;
+	size_t size, pos;
+	bool ok;
+};
+
+}
+
 RenderedBlockImages::RenderedBlockImages(mc::BlockStateRegistry& block_registry)
 	: block_registry(block_registry), darken_left(1.0), darken_right(1.0) {
 }
@@ -494,6 +625,19 @@ void RenderedBlockImages::setBlockSideDarkening(float darken_left, float darken_
 	this->darken_right = darken_right;
 }
 
+void RenderedBlockImages::setCacheDir(const fs::path& cache_dir) {
+	this->cache_dir = cache_dir;
+}
+
+fs::path RenderedBlockImages::getCacheFile(const std::string& view, int rotation,
+		int texture_size) const {
+	// the block side darkening is part of the name so maps with different
+	// render modes don't replace each other's cache files
+	return cache_dir / ("blockimages_" + view + "_" + util::str(rotation) + "_"
+			+ util::str(texture_size) + "_" + util::str(std::lround(darken_left * 100))
+			+ "_" + util::str(std::lround(darken_right * 100)) + ".bin");
+}
+
 bool RenderedBlockImages::loadBlockImages(fs::path path, std::string view, int rotation, int texture_size) {
 	LOG(INFO) << "I will load block images from " << path << " now";
 
@@ -503,10 +647,26 @@ bool RenderedBlockImages::loadBlockImages(fs::path path, std::string view, int r
 	}
 
 	std::string name = view + "_" + util::str(rotation) + "_" + util::str(texture_size);
-
-	BlockAtlas::instance().OpenDictionnary(path,name);
+	this->texture_size = texture_size;
 
 	fs::path info_file = path / (name + ".txt");
+	fs::path block_file = path / (name + ".png");
+
+	// use the prepared block images of the cache if the block image files didn't change
+	fs::path cache_file;
+	uint64_t cache_key = 0;
+	if (!cache_dir.empty() && fs::is_regular_file(info_file) && fs::is_regular_file(block_file)) {
+		cache_file = getCacheFile(view, rotation, texture_size);
+		cache_key = getCacheKey(info_file, block_file, texture_size);
+		if (readCache(cache_file, cache_key)) {
+			LOG(DEBUG) << "Loaded block images from cache " << cache_file << ".";
+			return true;
+		}
+	}
+
+	// every load replaces the whole block atlas
+	if (!BlockAtlas::instance().OpenDictionnary(path, name))
+		return false;
 
 	if (!fs::is_regular_file(info_file)) {
 		LOG(ERROR) << "Unable to load block images: Block info file " << info_file
@@ -628,15 +788,247 @@ bool RenderedBlockImages::loadBlockImages(fs::path path, std::string view, int r
 	prepareBlockImages();
 	//runBenchmark();
 
+	if (!cache_file.empty() && !writeCache(cache_file, cache_key)) {
+		LOG(WARNING) << "Unable to write block image cache " << cache_file << ".";
+	}
+
+	return true;
+}
+
+uint64_t RenderedBlockImages::getCacheKey(const fs::path& info_file,
+		const fs::path& block_file, int texture_size) const {
+	uint64_t h = util::hashMix(CACHE_VERSION, texture_size);
+	uint32_t darken[2];
+	std::memcpy(&darken[0], &darken_left, sizeof(float));
+	std::memcpy(&darken[1], &darken_right, sizeof(float));
+	h = util::hashMix(h, (uint64_t) darken[0] << 32 | darken[1]);
+	// an unreadable file just results in a key no cache file has, and loading the block
+	// images reports the error then
+	hashFile(info_file, h);
+	hashFile(block_file, h);
+	return h;
+}
+
+bool RenderedBlockImages::readCache(const fs::path& cache_file, uint64_t key) {
+	if (!fs::is_regular_file(cache_file))
+		return false;
+
+	boost::iostreams::mapped_file_source file;
+	try {
+		file.open(cache_file.string());
+	} catch (std::exception& e) {
+		LOG(WARNING) << "Unable to open block image cache " << cache_file << ": " << e.what();
+		return false;
+	}
+
+	CacheReader reader(file.data(), file.size());
+	uint32_t magic = reader.read<uint32_t>();
+	uint32_t version = reader.read<uint32_t>();
+	uint64_t file_key = reader.read<uint64_t>();
+	if (!reader.good() || magic != CACHE_MAGIC || version != CACHE_VERSION || file_key != key) {
+		LOG(DEBUG) << "Block image cache " << cache_file << " is outdated, ignoring it.";
+		return false;
+	}
+
+	// size of the block images in the atlas and size of the blocks for the renderer
+	uint32_t width = reader.read<uint32_t>();
+	uint32_t height = reader.read<uint32_t>();
+	uint32_t count = reader.read<uint32_t>();
+	int32_t cached_block_width = reader.read<int32_t>();
+	int32_t cached_block_height = reader.read<int32_t>();
+	reader.read<uint32_t>(); // padding, the pixels start 8 byte aligned
+	const char* pixels = nullptr;
+	if (reader.good() && width > 0 && height > 0
+			&& uint64_t(width) * height * count <= file.size() / sizeof(RGBAPixel))
+		pixels = reader.skip(size_t(width) * height * count * sizeof(RGBAPixel));
+
+	// read all block images first, the block images are only replaced if the cache is valid
+	std::vector<std::pair<mc::BlockState, std::unique_ptr<BlockImage>>> blocks;
+	uint32_t block_count = reader.read<uint32_t>();
+	for (uint32_t i = 0; i < block_count && reader.good(); i++) {
+		std::string name = reader.readString();
+		std::string variant = reader.readString();
+		std::unique_ptr<BlockImage> block(new BlockImage());
+		uint8_t flags = reader.read<uint8_t>();
+		block->side_mask = {(flags & 1) != 0, (flags & 2) != 0, (flags & 4) != 0};
+		block->is_transparent = flags & 8;
+		block->is_empty = flags & 16;
+		block->is_biome = flags & 32;
+		block->is_masked_biome = flags & 64;
+		block->is_waterlogged = flags & 128;
+		flags = reader.read<uint8_t>();
+		block->can_partial = flags & 1;
+		block->lighting_specified = flags & 2;
+		block->has_faulty_lighting = flags & 4;
+		block->biome_color = static_cast<ColorMapType>(reader.read<uint8_t>());
+		block->lighting_type = static_cast<LightingType>(reader.read<uint8_t>());
+		for (size_t j = 0; j < block->biome_colormap.colors.size(); j++)
+			block->biome_colormap.colors[j] = reader.read<uint32_t>();
+		block->biome_mask = nullptr;
+		block->shadow_edges = reader.read<int32_t>();
+		block->weight_factor = reader.read<double_t>();
+		block->images_idx = reader.readVector<uint32_t>();
+		block->uv_images_idx = reader.readVector<uint32_t>();
+		block->images_weights = reader.readVector<double_t>();
+
+		bool valid = !block->images_idx.empty()
+				&& block->uv_images_idx.size() == block->images_idx.size()
+				&& block->images_weights.size() == block->images_idx.size();
+		for (size_t j = 0; valid && j < block->images_idx.size(); j++)
+			valid = block->images_idx[j] < count && block->uv_images_idx[j] < count;
+		if (!valid)
+			break;
+		blocks.push_back(std::make_pair(mc::BlockState::parse(name, variant), std::move(block)));
+	}
+
+	if (pixels == nullptr || !reader.good() || !reader.eof() || blocks.size() != block_count) {
+		LOG(WARNING) << "Block image cache " << cache_file << " is corrupt, ignoring it.";
+		return false;
+	}
+
+	BlockAtlas::instance().SetBlocks(width, height, count, pixels);
+	block_width = cached_block_width;
+	block_height = cached_block_height;
+
+	block_images.reserve(count * 2);
+	for (auto it = blocks.begin(); it != blocks.end(); ++it) {
+		uint16_t id = block_registry.getBlockID(it->first);
+		if (block_images.size() <= id)
+			block_images.resize(id + 1, nullptr);
+		delete block_images[id];
+		block_images[id] = it->second.release();
+
+		const std::map<std::string, std::string>& properties = it->first.getProperties();
+		for (auto it2 = properties.begin(); it2 != properties.end(); ++it2)
+			block_registry.addKnownProperty(it->first.getName(), it2->first);
+	}
+
+	// the biome masks are referenced by pointer, so they are looked up again
+	for (uint16_t id = 0; id < block_images.size(); ++id) {
+		BlockImage* block = block_images[id];
+		if (block == nullptr || !block->is_biome || !block->is_masked_biome)
+			continue;
+		const mc::BlockState& block_state = block_registry.getBlockState(id);
+		uint16_t mask_id = block_registry.getBlockID(mc::BlockState::parse(
+				block_state.getName() + "_biome_mask", block_state.getVariantDescription()));
+		assert(block_images.size() > mask_id && block_images[mask_id] != nullptr);
+		block->biome_mask = &block_images[mask_id]->image(0);
+	}
+
+	const uint16_t solid_id = block_registry.getBlockID(mc::BlockState("minecraft:unknown_block"));
+	assert(block_images.size() > solid_id && block_images[solid_id] != nullptr);
+	unknown_block = *block_images[solid_id];
+	return true;
+}
+
+bool RenderedBlockImages::writeCache(const fs::path& cache_file, uint64_t key) const {
+	// the atlas contains only the blocks of this load (see loadBlockImages)
+	BlockAtlas& atlas = BlockAtlas::instance();
+	uint32_t count = atlas.GetCount();
+	if (count == 0)
+		return false;
+
+	// the block images are not square with every render view (12x16 pixels for the
+	// side view with texture size 12), but the renderer uses the block height the atlas
+	// reports, so both sizes are stored
+	int width = atlas.GetImage(0)->getWidth();
+	int height = atlas.GetImage(0)->getHeight();
+
+	CacheWriter writer;
+	writer.write<uint32_t>(CACHE_MAGIC);
+	writer.write<uint32_t>(CACHE_VERSION);
+	writer.write<uint64_t>(key);
+	writer.write<uint32_t>(width);
+	writer.write<uint32_t>(height);
+	writer.write<uint32_t>(count);
+	writer.write<int32_t>(block_width);
+	writer.write<int32_t>(block_height);
+	writer.write<uint32_t>(0);
+	for (uint32_t i = 0; i < count; i++) {
+		const RGBAImage& image = *atlas.GetImage(i);
+		if (image.getWidth() != width || image.getHeight() != height)
+			return false;
+		writer.writeBytes(&image.data[0], image.data.size() * sizeof(RGBAPixel));
+	}
+
+	uint32_t block_count = 0;
+	for (auto it = block_images.begin(); it != block_images.end(); ++it)
+		block_count += *it != nullptr;
+	writer.write<uint32_t>(block_count);
+	for (uint16_t id = 0; id < block_images.size(); ++id) {
+		const BlockImage* block = block_images[id];
+		if (block == nullptr)
+			continue;
+		const mc::BlockState& block_state = block_registry.getBlockState(id);
+		writer.writeString(block_state.getName());
+		writer.writeString(block_state.getVariantDescription());
+		writer.write<uint8_t>(block->side_mask[0] | block->side_mask[1] << 1
+				| block->side_mask[2] << 2 | block->is_transparent << 3
+				| block->is_empty << 4 | block->is_biome << 5
+				| block->is_masked_biome << 6 | block->is_waterlogged << 7);
+		writer.write<uint8_t>(block->can_partial | block->lighting_specified << 1
+				| block->has_faulty_lighting << 2);
+		writer.write<uint8_t>(static_cast<uint8_t>(block->biome_color));
+		writer.write<uint8_t>(static_cast<uint8_t>(block->lighting_type));
+		for (size_t j = 0; j < block->biome_colormap.colors.size(); j++)
+			writer.write<uint32_t>(block->biome_colormap.colors[j]);
+		writer.write<int32_t>(block->shadow_edges);
+		writer.write<double_t>(block->weight_factor);
+		writer.writeVector(block->images_idx);
+		writer.writeVector(block->uv_images_idx);
+		writer.writeVector(block->images_weights);
+	}
+
+	// write to a temporary file first, another Mapcrafter process might read the cache
+	fs::path tmp_file = cache_file;
+	tmp_file += ".tmp";
+	try {
+		if (!fs::exists(cache_file.parent_path()))
+			fs::create_directories(cache_file.parent_path());
+		std::ofstream out(tmp_file.string(), std::ios::binary);
+		const std::string& buffer = writer.getBuffer();
+		out.write(buffer.data(), buffer.size());
+		out.close();
+		if (!out)
+			return false;
+		fs::rename(tmp_file, cache_file);
+	} catch (fs::filesystem_error& e) {
+		LOG(WARNING) << e.what();
+		return false;
+	}
 	return true;
 }
 
 RGBAImage RenderedBlockImages::exportBlocks() const {
-	/*
+	// collect the images of all blocks, biome blocks are tinted with the default colors
 	std::vector<RGBAImage> blocks;
-
+	std::set<uint32_t> exported;
 	for (auto it = block_images.begin(); it != block_images.end(); ++it) {
-		blocks.push_back(it->second.image);
+		const BlockImage* block = *it;
+		if (block == nullptr)
+			continue;
+		for (size_t i = 0; i < block->images_idx.size(); i++) {
+			if (!block->is_biome) {
+				if (exported.count(block->images_idx[i]))
+					continue;
+				exported.insert(block->images_idx[i]);
+			}
+
+			RGBAImage image = block->image(i);
+			if (block->is_biome) {
+				uint32_t color = default_grass;
+				if (block->biome_color == ColorMapType::FOLIAGE
+						|| block->biome_color == ColorMapType::FOLIAGE_FLIPPED)
+					color = default_foliage;
+				else if (block->biome_color == ColorMapType::WATER)
+					color = default_water;
+				if (block->is_masked_biome)
+					blockImageTint(image, *block->biome_mask, color);
+				else
+					blockImageTint(image, color);
+			}
+			blocks.push_back(image);
+		}
 	}
 
 	if (blocks.size() == 0) {
@@ -645,21 +1037,18 @@ RGBAImage RenderedBlockImages::exportBlocks() const {
 
 	int width = 16;
 	int height = std::ceil((double) blocks.size() / width);
-	int block_size = blocks[0].getWidth();
-	RGBAImage image(width * block_size, height * block_size);
+	RGBAImage image(width * block_width, height * block_height);
 
 	for (int y = 0; y < height; y++) {
 		for (int x = 0; x < width; x++) {
-			int offset = y * width + x;
-			if ((size_t) offset >= blocks.size())
+			size_t offset = y * width + x;
+			if (offset >= blocks.size())
 				break;
-			image.alphaBlit(blocks.at(offset), x * block_size, y * block_size);
+			image.alphaBlit(blocks[offset], x * block_width, y * block_height);
 		}
 	}
 
 	return image;
-	*/
-	return RGBAImage(1, 1);
 }
 
 const BlockImage& RenderedBlockImages::getBlockImage(uint16_t id) const {
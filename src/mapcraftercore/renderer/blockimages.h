@@ -190,6 +190,20 @@ public:
 
 	void setBlockSideDarkening(float darken_left, float darken_right);
 
+	/**
+	 * Sets the directory where the prepared block images are cached. Loading and
+	 * preparing the block images of a view, rotation and texture size takes a while,
+	 * the cache is used instead as long as the block image files and the block side
+	 * darkening are unchanged. An empty path disables the cache.
+	 */
+	void setCacheDir(const fs::path& cache_dir);
+
+	/**
+	 * Returns the cache file used for the block images of a view, rotation and texture
+	 * size with the current block side darkening.
+	 */
+	fs::path getCacheFile(const std::string& view, int rotation, int texture_size) const;
+
 	bool loadBlockImages(fs::path block_dir, std::string view, int rotation, int texture_size);
 	virtual RGBAImage exportBlocks() const;
 
@@ -205,9 +219,25 @@ private:
 	void prepareBlockImages();
 	void runBenchmark();
 
+	/**
+	 * Returns the key identifying the block image files and settings the cache was
+	 * created with: A hash of the block info and image file, the texture size and the
+	 * block side darkening.
+	 */
+	uint64_t getCacheKey(const fs::path& info_file, const fs::path& block_file,
+			int texture_size) const;
+
+	/**
+	 * Reads/writes the prepared block images (the shaded block atlas and the block image
+	 * information) from/to a cache file. Reading fails if the file has a different key.
+	 */
+	bool readCache(const fs::path& cache_file, uint64_t key);
+	bool writeCache(const fs::path& cache_file, uint64_t key) const;
+
 	mc::BlockStateRegistry& block_registry;
 
 	float darken_left, darken_right;
+	fs::path cache_dir;
 
 	int texture_size;
 	int block_width, block_height;
@@ -0,0 +1,228 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "emptytileindex.h"
+
+#include "../util.h"
+
+#include <fstream>
+#include <sstream>
+
+namespace mapcrafter {
+namespace renderer {
+
+namespace {
+
+// increase this when the format of the index changes
+const int INDEX_VERSION = 1;
+
+/**
+ * Returns whether a tile is the same tile as or a child of another tile.
+ */
+bool isInSubtree(const TilePath& tile, const TilePath& root) {
+	if (tile.getDepth() < root.getDepth())
+		return false;
+	for (int level = 1; level <= root.getDepth(); level++)
+		if (tile.getNode(level) != root.getNode(level))
+			return false;
+	return true;
+}
+
+}
+
+EmptyTileIndex::EmptyTileIndex(const fs::path& filename)
+	: filename(filename), time(0) {
+}
+
+EmptyTileIndex::~EmptyTileIndex() {
+}
+
+bool EmptyTileIndex::read() {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	roots.clear();
+	time = 0;
+	std::ifstream in(filename.string());
+	if (!in)
+		return false;
+
+	std::stringstream ss;
+	ss << in.rdbuf();
+	std::string data = ss.str();
+
+	picojson::value value;
+	std::string json_error;
+	picojson::parse(value, data.begin(), data.end(), &json_error);
+	if (!json_error.empty() || !value.is<picojson::object>()) {
+		LOG(WARNING) << "Empty tile index " << filename << " is invalid, ignoring it.";
+		return false;
+	}
+
+	try {
+		const picojson::object& object = value.get<picojson::object>();
+		if (util::json_get<double>(object, "version") != INDEX_VERSION) {
+			LOG(DEBUG) << "Empty tile index " << filename << " is outdated, ignoring it.";
+			return false;
+		}
+
+		picojson::array tiles = util::json_get<picojson::array>(object, "tiles");
+		for (auto it = tiles.begin(); it != tiles.end(); ++it) {
+			TilePath tile;
+			if (!it->is<std::string>() || !TilePath::byString(it->get<std::string>(), tile))
+				throw util::JSONError("Invalid tile path " + it->to_str());
+			roots.insert(tile);
+		}
+		// indexes written by older versions don't have a time
+		if (object.count("time"))
+			time = util::json_get<double>(object, "time");
+	} catch (util::JSONError& e) {
+		LOG(WARNING) << "Empty tile index " << filename << " is invalid, ignoring it: "
+				<< e.what();
+		roots.clear();
+		time = 0;
+		return false;
+	}
+	return true;
+}
+
+bool EmptyTileIndex::write() const {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	picojson::array tiles;
+	for (auto it = roots.begin(); it != roots.end(); ++it)
+		tiles.push_back(picojson::value(it->toString()));
+
+	picojson::object object;
+	object["version"] = picojson::value((double) INDEX_VERSION);
+	object["tiles"] = picojson::value(tiles);
+	object["time"] = picojson::value((double) time);
+	std::string data = picojson::value(object).serialize();
+
+	// the output directory doesn't exist yet if all tiles are empty
+	boost::system::error_code error;
+	fs::create_directories(filename.parent_path(), error);
+	if (!util::writeFileAtomic(filename, reinterpret_cast<const uint8_t*>(data.data()),
+			data.size())) {
+		LOG(ERROR) << "Unable to write empty tile index " << filename << ".";
+		return false;
+	}
+	return true;
+}
+
+bool EmptyTileIndex::isEmpty(const TilePath& tile) const {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	return isEmptyUnlocked(tile);
+}
+
+bool EmptyTileIndex::setEmpty(const TilePath& tile, bool empty) {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+
+	// find the root of the empty subtree containing the tile, if there is one
+	TilePath root = tile;
+	bool was_empty = false;
+	for (;;) {
+		if (roots.count(root)) {
+			was_empty = true;
+			break;
+		}
+		if (root.getDepth() == 0)
+			break;
+		root = root.parent();
+	}
+
+	if (empty) {
+		if (was_empty)
+			return true;
+		// the children of the tile are part of the new empty subtree now,
+		// they are stored right after the tile in the ordered set
+		auto it = roots.lower_bound(tile);
+		while (it != roots.end() && isInSubtree(*it, tile))
+			it = roots.erase(it);
+		roots.insert(tile);
+	} else if (was_empty) {
+		// split the empty subtree: all siblings on the way from its root down to the
+		// tile remain empty subtrees
+		roots.erase(root);
+		TilePath current = root;
+		for (int level = root.getDepth() + 1; level <= tile.getDepth(); level++) {
+			int node = tile.getNode(level);
+			for (int sibling = 1; sibling <= 4; sibling++)
+				if (sibling != node)
+					roots.insert(current + sibling);
+			current += node;
+		}
+	}
+	return was_empty;
+}
+
+void EmptyTileIndex::increaseDepth() {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	std::set<TilePath> deeper_roots;
+	for (int node = 1; node <= 4; node++) {
+		// the old tile trees are moved to 1/4, 2/3, 3/2 and 4/1, the other new tiles
+		// of zoom level 2 are empty (the base tile and the tiles of zoom level 1
+		// are created again)
+		for (int child = 1; child <= 4; child++)
+			if (child != 5 - node || roots.count(TilePath()))
+				deeper_roots.insert(TilePath() + node + child);
+	}
+	for (auto it = roots.begin(); it != roots.end(); ++it) {
+		if (it->getDepth() == 0)
+			continue;
+		TilePath deeper;
+		deeper += it->getNode(1);
+		deeper += 5 - it->getNode(1);
+		for (int level = 2; level <= it->getDepth(); level++)
+			deeper += it->getNode(level);
+		deeper_roots.insert(deeper);
+	}
+	roots.swap(deeper_roots);
+}
+
+int EmptyTileIndex::getRootCount() const {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	return roots.size();
+}
+
+void EmptyTileIndex::clear() {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	roots.clear();
+}
+
+std::time_t EmptyTileIndex::getTime() const {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	return time;
+}
+
+void EmptyTileIndex::setTime(std::time_t time) {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	this->time = time;
+}
+
+bool EmptyTileIndex::isEmptyUnlocked(const TilePath& tile) const {
+	TilePath current = tile;
+	for (;;) {
+		if (roots.count(current))
+			return true;
+		if (current.getDepth() == 0)
+			return false;
+		current = current.parent();
+	}
+}
+
+}
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EMPTYTILEINDEX_H_
+#define EMPTYTILEINDEX_H_
+
+#include "tileset.h"
+#include "../compat/thread.h"
+
+#include <ctime>
+#include <set>
+#include <boost/filesystem.hpp>
+
+namespace fs = boost::filesystem;
+
+namespace mapcrafter {
+namespace renderer {
+
+/**
+ * Remembers which tiles of a map rotation are empty (fully transparent). Empty tiles
+ * are not written to the tile storage, the web interface shows nothing for them
+ * instead of requesting tiles which don't exist.
+ *
+ * A composite tile is only empty if all its children are empty, so an empty tile
+ * always means an empty subtree. The index stores only the roots of the empty subtrees
+ * which keeps it small for sparse worlds.
+ *
+ * The index is stored as JSON file (empty-tiles.json) in the output directory of the
+ * map rotation, where the web interface reads it.
+ *
+ * Empty tiles have no file with a modification time in the tile storage, so the index
+ * remembers when its tiles were rendered the last time instead.
+ */
+class EmptyTileIndex {
+public:
+	EmptyTileIndex(const fs::path& filename);
+	~EmptyTileIndex();
+
+	/**
+	 * Reads the index file. Returns false if it does not exist or is invalid, the
+	 * index is empty then.
+	 */
+	bool read();
+
+	/**
+	 * Writes the index file.
+	 */
+	bool write() const;
+
+	/**
+	 * Returns whether a tile is empty, i.e. itself or one of its parents is a root of
+	 * an empty subtree.
+	 */
+	bool isEmpty(const TilePath& tile) const;
+
+	/**
+	 * Marks a tile as empty or non-empty. A composite tile may only be marked as empty
+	 * if all its children are empty. Returns whether the tile was empty before.
+	 */
+	bool setEmpty(const TilePath& tile, bool empty);
+
+	/**
+	 * Moves the empty tiles one zoom level deeper (see TileStorage::increaseDepth).
+	 */
+	void increaseDepth();
+
+	/**
+	 * Returns the count of the roots of empty subtrees.
+	 */
+	int getRootCount() const;
+
+	/**
+	 * Removes all tiles from the index.
+	 */
+	void clear();
+
+	/**
+	 * Returns/sets the time the empty tiles were rendered the last time (the time the
+	 * scan of that render started), 0 if it is unknown.
+	 */
+	std::time_t getTime() const;
+	void setTime(std::time_t time);
+
+private:
+	bool isEmptyUnlocked(const TilePath& tile) const;
+
+	fs::path filename;
+
+	mutable thread_ns::mutex mutex;
+	std::set<TilePath> roots;
+	std::time_t time;
+};
+
+}
+}
+
+#endif /* EMPTYTILEINDEX_H_ */
@@ -29,9 +29,12 @@
 #include "../util.h"
 
 #include <jpeglib.h>
+#include <zlib.h>
 #include <algorithm>
-#include <iostream>
-#include <fstream>
+#include <cstdlib>
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
 
 namespace mapcrafter {
 namespace renderer {
@@ -131,21 +134,43 @@ void blend(RGBAPixel& dest, const RGBAPixel& source) {
 	}
 }
 
+namespace {
+
 /**
- * http://www.piko3d.com/tutorials/libpng-tutorial-loading-png-files-from-streams
+ * PNG data in memory which is read by libpng.
  */
-void pngReadData(png_structp pngPtr, png_bytep data, png_size_t length) {
-	//Here we get our IO pointer back from the read struct.
-	//This is the parameter we passed to the png_set_read_fn() function.
-	//Our std::istream pointer.
-	png_voidp a = png_get_io_ptr(pngPtr);
-	//Cast the pointer to std::istream* and read 'length' bytes into 'data'
-	((std::istream*) a)->read((char*) data, length);
+struct PNGReadBuffer {
+	const uint8_t* data;
+	size_t size;
+	size_t offset;
+};
+
+void pngReadData(png_structp png, png_bytep data, png_size_t length) {
+	PNGReadBuffer* buffer = (PNGReadBuffer*) png_get_io_ptr(png);
+	if (buffer->offset + length > buffer->size)
+		png_error(png, "Unexpected end of PNG data");
+	std::copy(buffer->data + buffer->offset, buffer->data + buffer->offset + length, data);
+	buffer->offset += length;
+}
+
+void pngWriteData(png_structp png, png_bytep data, png_size_t length) {
+	std::vector<uint8_t>* buffer = (std::vector<uint8_t>*) png_get_io_ptr(png);
+	buffer->insert(buffer->end(), data, data + length);
+}
+
+void pngFlushData(png_structp png) {
+}
+
+/**
+ * Returns a buffer for the encoded image files, it is reused for all images a thread
+ * reads/writes.
+ */
+std::vector<uint8_t>& getFileBuffer() {
+	static thread_local std::vector<uint8_t> buffer;
+	buffer.clear();
+	return buffer;
 }
 
-void pngWriteData(png_structp pngPtr, png_bytep data, png_size_t length) {
-	png_voidp a = png_get_io_ptr(pngPtr);
-	((std::ostream*) a)->write((char*) data, length);
 }
 
 RGBAImage::RGBAImage(int width, int height)
@@ -251,6 +276,27 @@ void RGBAImage::clear() {
 	std::fill(data.begin(), data.end(), 0);
 }
 
+uint64_t RGBAImage::hash() const {
+	// multiply-xorshift hash over two pixels at once
+	uint64_t h = ((uint64_t) width << 32 | (uint32_t) height) * util::HASH_MULTIPLIER;
+	size_t size = data.size();
+	for (size_t i = 0; i < size; i += 2) {
+		uint64_t v = data[i];
+		if (i + 1 < size)
+			v |= (uint64_t) data[i + 1] << 32;
+		h = util::hashMix(h, v);
+	}
+	return h ^ (h >> 32);
+}
+
+bool RGBAImage::isTransparent() const {
+	// or the alpha values of all pixels, this is easy to vectorize for the compiler
+	uint32_t alpha = 0;
+	for (size_t i = 0; i < data.size(); i++)
+		alpha |= data[i];
+	return (alpha & 0xff000000) == 0;
+}
+
 RGBAImage RGBAImage::clip(int x, int y, int width, int height) const {
 	RGBAImage image(width, height);
 	for (int xx = 0; xx < width && xx + x < this->width; xx++) {
@@ -358,6 +404,10 @@ RGBAImage RGBAImage::resize(int width, int height, InterpolationType interpolati
 	return temp;
 }
 
+void RGBAImage::resizeHalfInto(RGBAImage& dest, int x, int y, DownsampleMode mode) const {
+	imageResizeHalfInto(*this, dest, x, y, mode);
+}
+
 
 RGBAImage& RGBAImage::shearX(double factor) {
 	for (int y = 0; y < height; y++) {
@@ -428,16 +478,73 @@ void RGBAImage::blur(RGBAImage& dest, int radius) const {
 			dest.pixel(x, y) = blurKernel(*this, x, y, radius);
 }
 
+std::ostream& operator<<(std::ostream& out, PNGFilter filter) {
+	if (filter == PNGFilter::NONE)
+		out << "none";
+	else if (filter == PNGFilter::SUB)
+		out << "sub";
+	else if (filter == PNGFilter::UP)
+		out << "up";
+	else if (filter == PNGFilter::AVERAGE)
+		out << "average";
+	else if (filter == PNGFilter::PAETH)
+		out << "paeth";
+	else if (filter == PNGFilter::ADAPTIVE)
+		out << "adaptive";
+	return out;
+}
+
+std::ostream& operator<<(std::ostream& out, DownsampleMode mode) {
+	if (mode == DownsampleMode::AVERAGE)
+		out << "average";
+	else if (mode == DownsampleMode::ALPHA_WEIGHTED)
+		out << "premultiplied";
+	else if (mode == DownsampleMode::LINEAR)
+		out << "linear";
+	return out;
+}
+
+PNGWriteOptions::PNGWriteOptions(int compression_level, PNGFilter filter, bool rle)
+	: compression_level(compression_level), filter(filter), rle(rle) {
+}
+
+PNGWriteOptions PNGWriteOptions::fast() {
+	return PNGWriteOptions(1, PNGFilter::UP, true);
+}
+
+namespace {
+
+void setPNGWriteOptions(png_structp png, const PNGWriteOptions& options) {
+	// these are the zlib strategies libpng would choose itself
+	int strategy = options.filter == PNGFilter::NONE ? Z_DEFAULT_STRATEGY : Z_FILTERED;
+	png_set_compression_level(png, options.compression_level);
+	png_set_compression_strategy(png, options.rle ? Z_RLE : strategy);
+
+	int filter = PNG_ALL_FILTERS;
+	if (options.filter == PNGFilter::NONE)
+		filter = PNG_FILTER_NONE;
+	else if (options.filter == PNGFilter::SUB)
+		filter = PNG_FILTER_SUB;
+	else if (options.filter == PNGFilter::UP)
+		filter = PNG_FILTER_UP;
+	else if (options.filter == PNGFilter::AVERAGE)
+		filter = PNG_FILTER_AVG;
+	else if (options.filter == PNGFilter::PAETH)
+		filter = PNG_FILTER_PAETH;
+	png_set_filter(png, PNG_FILTER_TYPE_BASE, filter);
+}
+
+}
+
 bool RGBAImage::readPNG(const std::string& filename) {
-	std::ifstream file(filename.c_str(), std::ios::binary);
-	if (!file) {
-		return false;
-	}
+	std::vector<uint8_t>& buffer = getFileBuffer();
+	return util::readFile(filename, buffer) && decodePNG(buffer.data(), buffer.size());
+}
 
-	uint8_t png_signature[8];
-	file.read((char*) &png_signature, 8);
-	if (png_sig_cmp(png_signature, 0, 8) != 0)
+bool RGBAImage::decodePNG(const uint8_t* data, size_t size) {
+	if (size < 8 || png_sig_cmp((png_const_bytep) data, 0, 8) != 0)
 		return false;
+	PNGReadBuffer buffer = {data, size, 8};
 
 	png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
 	if (!png) {
@@ -455,7 +562,7 @@ bool RGBAImage::readPNG(const std::string& filename) {
 		return false;
 	}
 
-	png_set_read_fn(png, (png_voidp) &file, pngReadData);
+	png_set_read_fn(png, (png_voidp) &buffer, pngReadData);
 	png_set_sig_bytes(png, 8);
 
 	png_read_info(png, info);
@@ -487,7 +594,7 @@ bool RGBAImage::readPNG(const std::string& filename) {
 	png_read_update_info(png, info);
 
 	png_bytep* rows = (png_bytep*) png_malloc(png, height * sizeof(png_bytep));
-	uint32_t* p = &data[0];
+	uint32_t* p = &this->data[0];
 	for (int32_t i = 0; i < height; i++, p += width)
 		rows[i] = (png_bytep) p;
 
@@ -504,11 +611,16 @@ bool RGBAImage::readPNG(const std::string& filename) {
 	return true;
 }
 
-bool RGBAImage::writePNG(const std::string& filename) const {
-	std::ofstream file(filename.c_str(), std::ios::binary);
-	if (!file) {
-		return false;
-	}
+bool RGBAImage::writePNG(const std::string& filename,
+		const PNGWriteOptions& options) const {
+	std::vector<uint8_t>& buffer = getFileBuffer();
+	return encodePNG(buffer, options)
+			&& util::writeFileAtomic(filename, buffer.data(), buffer.size());
+}
+
+bool RGBAImage::encodePNG(std::vector<uint8_t>& buffer,
+		const PNGWriteOptions& options) const {
+	buffer.clear();
 
 	png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
 	if (png == NULL)
@@ -525,7 +637,8 @@ bool RGBAImage::writePNG(const std::string& filename) const {
 		return false;
 	}
 
-	png_set_write_fn(png, (png_voidp) &file, pngWriteData, NULL);
+	png_set_write_fn(png, (png_voidp) &buffer, pngWriteData, pngFlushData);
+	setPNGWriteOptions(png, options);
 	png_set_IHDR(png, info, width, height, 8, PNG_COLOR_TYPE_RGB_ALPHA,
 	        PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
 
@@ -541,7 +654,6 @@ bool RGBAImage::writePNG(const std::string& filename) const {
 	else
 		png_write_png(png, info, PNG_TRANSFORM_IDENTITY, NULL);
 
-	file.close();
 	png_free(png, rows);
 	png_destroy_write_struct(&png, &info);
 	return true;
@@ -572,10 +684,74 @@ void setRowPixel(png_byte* line, int bit_depth, int x, uint8_t index) {
 
 }
 
-bool RGBAImage::writeIndexedPNG(const std::string& filename, int palette_bits, bool dithered) const {
-	std::ofstream file(filename.c_str(), std::ios::binary);
-	if (!file) {
+bool RGBAImage::writeIndexedPNG(const std::string& filename, int palette_bits, bool dithered,
+		const PNGWriteOptions& options) const {
+	std::vector<uint8_t>& buffer = getFileBuffer();
+	return encodeIndexedPNG(buffer, palette_bits, dithered, options)
+			&& util::writeFileAtomic(filename, buffer.data(), buffer.size());
+}
+
+bool RGBAImage::writeIndexedPNG(const std::string& filename, Palette& palette, bool dithered,
+		const PNGWriteOptions& options) const {
+	std::vector<uint8_t>& buffer = getFileBuffer();
+	return encodeIndexedPNG(buffer, palette, dithered, options)
+			&& util::writeFileAtomic(filename, buffer.data(), buffer.size());
+}
+
+bool RGBAImage::encodeIndexedPNG(std::vector<uint8_t>& buffer, int palette_bits,
+		bool dithered, const PNGWriteOptions& options) const {
+	std::vector<RGBAPixel> colors;
+	octreeColorQuantize(*this, 1 << palette_bits, colors);
+	OctreePalette palette(colors);
+	//OctreePalette2 palette(colors);
+	return encodeIndexedPNG(buffer, palette, dithered, options);
+}
+
+bool RGBAImage::encodeIndexedPNG(std::vector<uint8_t>& buffer, Palette& palette,
+		bool dithered, const PNGWriteOptions& options) const {
+	buffer.clear();
+	const std::vector<RGBAPixel>& colors = palette.getColors();
+	int palette_size = colors.size();
+	if (width == 0 || height == 0 || palette_size == 0 || palette_size > 256)
 		return false;
+	int palette_bits = 1;
+	while ((1 << palette_bits) < palette_size)
+		palette_bits *= 2;
+
+	// the buffers are reused for all images written by a thread
+	static thread_local std::vector<uint8_t> indices;
+	static thread_local std::vector<png_byte> row_data;
+	static thread_local std::vector<png_bytep> rows;
+
+	if (dithered) {
+		static thread_local RGBAImage copy;
+		copy = *this;
+		imageDither(copy, palette, indices);
+	} else {
+		indices.resize(data.size());
+		// neighbor pixels have often the same color
+		RGBAPixel last_color = 0;
+		int last_index = -1;
+		for (size_t i = 0; i < data.size(); i++) {
+			if (last_index == -1 || data[i] != last_color) {
+				last_color = data[i];
+				last_index = palette.getNearestColor(last_color);
+			}
+			indices[i] = last_index;
+		}
+	}
+
+	size_t row_size = (width * palette_bits + 7) / 8;
+	row_data.assign(row_size * height, 0);
+	rows.resize(height);
+	for (int y = 0; y < height; y++) {
+		rows[y] = &row_data[y * row_size];
+		if (palette_bits == 8) {
+			std::copy(indices.begin() + y * width, indices.begin() + (y + 1) * width, rows[y]);
+			continue;
+		}
+		for (int x = 0; x < width; x++)
+			setRowPixel(rows[y], palette_bits, x, indices[y * width + x]);
 	}
 
 	png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
@@ -593,78 +769,26 @@ bool RGBAImage::writeIndexedPNG(const std::string& filename, int palette_bits, b
 		return false;
 	}
 
-	int palette_size = 1 << palette_bits;
-	png_set_write_fn(png, (png_voidp) &file, pngWriteData, NULL);
+	png_set_write_fn(png, (png_voidp) &buffer, pngWriteData, pngFlushData);
+	setPNGWriteOptions(png, options);
 	png_set_IHDR(png, info, width, height, palette_bits, PNG_COLOR_TYPE_PALETTE,
 			PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
 
-	//std::cout << "Doing quantization." << std::endl;
-	Octree* octree;
-	std::vector<RGBAPixel> colors;
-	octreeColorQuantize(*this, palette_size, colors, &octree);
-	palette_size = colors.size();
-	//std::cout << "Finished quantization. " << palette_size << " colors." << std::endl;
-
-	png_color* palette = (png_color*) png_malloc(png, palette_size * sizeof(png_color));
-	if (palette == NULL) {
-		png_destroy_write_struct(&png, &info);
-		return false;
-	}
-
-	png_byte* palette_alpha = (png_byte*) png_malloc(png, palette_size * sizeof(png_byte));
-	if (palette == NULL) {
-		png_free(png, palette);
-		png_destroy_write_struct(&png, &info);
-		return false;
-	}
-
+	// libpng copies the palette
+	png_color palette_colors[256];
+	png_byte palette_alpha[256];
 	for (int i = 0; i < palette_size; i++) {
-		palette[i].red = rgba_red(colors[i]);
-		palette[i].green = rgba_green(colors[i]);
-		palette[i].blue = rgba_blue(colors[i]);
+		palette_colors[i].red = rgba_red(colors[i]);
+		palette_colors[i].green = rgba_green(colors[i]);
+		palette_colors[i].blue = rgba_blue(colors[i]);
 		palette_alpha[i] = rgba_alpha(colors[i]);
 	}
-
-	png_set_PLTE(png, info, palette, palette_size);
+	png_set_PLTE(png, info, palette_colors, palette_size);
 	png_set_tRNS(png, info, palette_alpha, palette_size, NULL);
 
-	OctreePalette p(colors);
-	//OctreePalette2 p(colors);
-
-	std::vector<int> data_dithered;
-	if (dithered) {
-		RGBAImage copy = *this;
-		imageDither(copy, p, data_dithered);
-	}
-
-	png_bytep* rows = (png_bytep*) png_malloc(png, height * sizeof(png_bytep));
-	for (int y = 0; y < height; y++) {
-		rows[y] = (png_byte*) png_malloc(png, width * sizeof(png_byte));
-		for (int x = 0; x < width; x++)
-			rows[y][x] = 0;
-		for (int x = 0; x < width; x++) {
-			if (dithered) {
-				setRowPixel(rows[y], palette_bits, x, data_dithered[y * width + x]);
-			} else {
-				setRowPixel(rows[y], palette_bits, x, p.getNearestColor(pixel(x, y)));
-			}
-		}
-	}
-
-	png_set_rows(png, info, rows);
+	png_set_rows(png, info, &rows[0]);
+	png_write_png(png, info, PNG_TRANSFORM_IDENTITY, NULL);
 
-	//if (mapcrafter::util::isBigEndian())
-	//	png_write_png(png, info, PNG_TRANSFORM_BGR | PNG_TRANSFORM_SWAP_ALPHA, NULL);
-	//else
-		png_write_png(png, info, PNG_TRANSFORM_IDENTITY, NULL);
-
-	file.close();
-	for (int y = 0; y < height; y++)
-		png_free(png, rows[y]);
-	png_free(png, rows);
-	png_free(png, palette);
-	png_free(png, palette_alpha);
-	delete octree;
 	png_destroy_write_struct(&png, &info);
 	return true;
 }
@@ -718,7 +842,93 @@ my_error_exit (j_common_ptr cinfo)
   longjmp(myerr->setjmp_buffer, 1);
 }
 
+std::ostream& operator<<(std::ostream& out, JPEGSubsampling subsampling) {
+	if (subsampling == JPEGSubsampling::YUV444)
+		out << "444";
+	else if (subsampling == JPEGSubsampling::YUV422)
+		out << "422";
+	else if (subsampling == JPEGSubsampling::YUV420)
+		out << "420";
+	return out;
+}
+
+JPEGWriteOptions::JPEGWriteOptions(int quality, JPEGSubsampling subsampling, bool fast_dct)
+	: quality(quality), subsampling(subsampling), fast_dct(fast_dct) {
+}
+
+namespace {
+
+/**
+ * Buffer for the pixels composited on the background color, reused by the JPEG writes
+ * of a thread.
+ */
+std::vector<uint8_t>& getJPEGBuffer() {
+	static thread_local std::vector<uint8_t> buffer;
+	return buffer;
+}
+
+/**
+ * Composites pixels on the background color for JPEG, which doesn't support
+ * transparency, and writes them as R, G, B, X bytes. Pixels with only a bit of
+ * transparency (alpha >= 250) are taken as they are.
+ */
+void compositeRGBX(const RGBAPixel* pixels, size_t count, RGBAPixel background,
+		uint8_t* rgbx) {
+	size_t i = 0;
+#ifdef __SSE2__
+	// four pixels at once, blended like blend() does it with an opaque background:
+	// c = (c * (alpha + 1) + background * (256 - alpha)) >> 8
+	if (rgba_alpha(background) == 255 && !util::isBigEndian()) {
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i one = _mm_set1_epi16(1);
+		const __m128i c256 = _mm_set1_epi16(256);
+		const __m128i threshold = _mm_set1_epi32(249);
+		// the X byte of each pixel, always 255 like in the scalar loop below
+		const __m128i opaque = _mm_set1_epi32(0xff000000);
+		// the background color in 16 bit lanes, twice
+		const __m128i bg = _mm_unpacklo_epi8(_mm_set1_epi32(background), zero);
+		for (; i + 4 <= count; i += 4) {
+			__m128i p = _mm_loadu_si128((const __m128i*) (pixels + i));
+			__m128i lo = _mm_unpacklo_epi8(p, zero);
+			__m128i hi = _mm_unpackhi_epi8(p, zero);
+			// the alpha value of each pixel in all four lanes of the pixel
+			__m128i alpha_lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, 0xff), 0xff);
+			__m128i alpha_hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, 0xff), 0xff);
+			// the sums are at most 255 * 257 and fit into the unsigned 16 bit lanes
+			lo = _mm_srli_epi16(_mm_add_epi16(
+					_mm_mullo_epi16(lo, _mm_add_epi16(alpha_lo, one)),
+					_mm_mullo_epi16(bg, _mm_sub_epi16(c256, alpha_lo))), 8);
+			hi = _mm_srli_epi16(_mm_add_epi16(
+					_mm_mullo_epi16(hi, _mm_add_epi16(alpha_hi, one)),
+					_mm_mullo_epi16(bg, _mm_sub_epi16(c256, alpha_hi))), 8);
+			__m128i blended = _mm_packus_epi16(lo, hi);
+			__m128i keep = _mm_cmpgt_epi32(_mm_srli_epi32(p, 24), threshold);
+			_mm_storeu_si128((__m128i*) (rgbx + 4 * i), _mm_or_si128(opaque, _mm_or_si128(
+					_mm_and_si128(keep, p), _mm_andnot_si128(keep, blended))));
+		}
+	}
+#endif
+	for (; i < count; i++) {
+		RGBAPixel color = pixels[i];
+		if (rgba_alpha(color) < 250) {
+			color = background;
+			blend(color, pixels[i]);
+		}
+		rgbx[4 * i] = rgba_red(color);
+		rgbx[4 * i + 1] = rgba_green(color);
+		rgbx[4 * i + 2] = rgba_blue(color);
+		rgbx[4 * i + 3] = 255;
+	}
+}
+
+}
+
 bool RGBAImage::readJPEG(const std::string& filename) {
+	std::vector<uint8_t>& buffer = getFileBuffer();
+	return util::readFile(filename, buffer) && decodeJPEG(buffer.data(), buffer.size());
+}
+
+bool RGBAImage::decodeJPEG(const uint8_t* data, size_t size) {
 	/* This struct contains the JPEG decompression parameters and pointers to
 	 * working space (which is allocated as needed by the JPEG library).
 	 */
@@ -728,22 +938,9 @@ bool RGBAImage::readJPEG(const std::string& filename) {
 	 * struct, to avoid dangling-pointer problems.
 	 */
 	struct my_error_mgr jerr;
-	/* More stuff */
-	FILE * infile;		/* source file */
-	JSAMPARRAY buffer;		/* Output row buffer */
-	int row_stride;		/* physical row width in output buffer */
-
-	/* In this example we want to open the input file before doing anything else,
-	 * so that the setjmp() error recovery below can assume the file is open.
-	 * VERY IMPORTANT: use "b" option to fopen() if you are on a machine that
-	 * requires it in order to read binary files.
-	 */
 
-	if ((infile = fopen(filename.c_str(), "rb")) == NULL) {
-		//fprintf(stderr, "can't open %s\n", filename.c_str());
-		//return 0;
+	if (size == 0)
 		return false;
-	}
 
 	/* Step 1: allocate and initialize JPEG decompression object */
 
@@ -753,18 +950,17 @@ bool RGBAImage::readJPEG(const std::string& filename) {
 	/* Establish the setjmp return context for my_error_exit to use. */
 	if (setjmp(jerr.setjmp_buffer)) {
 		/* If we get here, the JPEG code has signaled an error.
-		 * We need to clean up the JPEG object, close the input file, and return.
+		 * We need to clean up the JPEG object and return.
 		 */
 		jpeg_destroy_decompress(&cinfo);
-		fclose(infile);
-		return 0;
+		return false;
 	}
 	/* Now we can initialize the JPEG decompression object. */
 	jpeg_create_decompress(&cinfo);
 
-	/* Step 2: specify data source (eg, a file) */
+	/* Step 2: specify data source (the image file in memory) */
 
-	jpeg_stdio_src(&cinfo, infile);
+	jpeg_mem_src(&cinfo, (unsigned char*) data, size);
 
 	/* Step 3: read file parameters with jpeg_read_header() */
 
@@ -777,9 +973,12 @@ bool RGBAImage::readJPEG(const std::string& filename) {
 
 	/* Step 4: set parameters for decompression */
 
-	/* In this example, we don't need to change any of the defaults set by
-	 * jpeg_read_header(), so we do nothing here.
+#ifdef JCS_EXTENSIONS
+	/* libjpeg-turbo can write the pixels in the memory layout of our pixels,
+	 * so we can decode directly into the image.
 	 */
+	cinfo.out_color_space = util::isBigEndian() ? JCS_EXT_ABGR : JCS_EXT_RGBA;
+#endif
 
 	/* Step 5: Start decompressor */
 
@@ -788,6 +987,17 @@ bool RGBAImage::readJPEG(const std::string& filename) {
 	 * with the stdio data source.
 	 */
 
+	/* Step 6: while (scan lines remain to be read) */
+	/*					 jpeg_read_scanlines(...); */
+
+	setSize(cinfo.output_width, cinfo.output_height);
+
+#ifdef JCS_EXTENSIONS
+	while (cinfo.output_scanline < cinfo.output_height) {
+		JSAMPROW row = (JSAMPROW) &this->data[cinfo.output_scanline * width];
+		(void) jpeg_read_scanlines(&cinfo, &row, 1);
+	}
+#else
 	/* We may need to do some setup of our own at this point before reading
 	 * the data.	After jpeg_start_decompress() we have the correct scaled
 	 * output image dimensions available, as well as the output colormap
@@ -795,16 +1005,11 @@ bool RGBAImage::readJPEG(const std::string& filename) {
 	 * In this example, we need to make an output work buffer of the right size.
 	 */
 	/* JSAMPLEs per row in output buffer */
-	row_stride = cinfo.output_width * cinfo.output_components;
+	int row_stride = cinfo.output_width * cinfo.output_components;
 	/* Make a one-row-high sample array that will go away when done with image */
-	buffer = (*cinfo.mem->alloc_sarray)
+	JSAMPARRAY buffer = (*cinfo.mem->alloc_sarray)
 		((j_common_ptr) &cinfo, JPOOL_IMAGE, row_stride, 1);
 
-	/* Step 6: while (scan lines remain to be read) */
-	/*					 jpeg_read_scanlines(...); */
-
-	setSize(cinfo.output_width, cinfo.output_height);
-
 	/* Here we use the library's state variable cinfo.output_scanline as the
 	 * loop counter, so that we don't have to keep track ourselves.
 	 */
@@ -824,6 +1029,7 @@ bool RGBAImage::readJPEG(const std::string& filename) {
 			pixel(x, cinfo.output_scanline - 1) = rgba(red, green, blue, 255);
 		}
 	}
+#endif
 
 	/* Step 7: Finish decompression */
 
@@ -837,13 +1043,6 @@ bool RGBAImage::readJPEG(const std::string& filename) {
 	/* This is an important step since it will release a good deal of memory. */
 	jpeg_destroy_decompress(&cinfo);
 
-	/* After finish_decompress, we can close the input file.
-	 * Here we postpone it until after no more JPEG errors are possible,
-	 * so as to simplify the setjmp error logic above.	(Actually, I don't
-	 * think that jpeg_destroy can do an error exit, but why assume anything...)
-	 */
-	fclose(infile);
-
 	/* At this point you may want to check to see whether any corrupt-data
 	 * warnings occurred (test whether jerr.pub.num_warnings is nonzero).
 	 */
@@ -853,8 +1052,23 @@ bool RGBAImage::readJPEG(const std::string& filename) {
 	return true;
 }
 
-bool RGBAImage::writeJPEG(const std::string& filename, int quality,
+bool RGBAImage::writeJPEG(const std::string& filename, const JPEGWriteOptions& options,
 		RGBAPixel background) const {
+	std::vector<uint8_t>& buffer = getFileBuffer();
+	return encodeJPEG(buffer, options, background)
+			&& util::writeFileAtomic(filename, buffer.data(), buffer.size());
+}
+
+bool RGBAImage::encodeJPEG(std::vector<uint8_t>& buffer, const JPEGWriteOptions& options,
+		RGBAPixel background) const {
+	buffer.clear();
+	if (width == 0 || height == 0)
+		return false;
+
+	// jpeg does not support transparency, add the background color to transparent pixels
+	std::vector<uint8_t>& rgbx = getJPEGBuffer();
+	rgbx.resize(4 * data.size());
+	compositeRGBX(&data[0], data.size(), background, rgbx.data());
 
 	/* This struct contains the JPEG compression parameters and pointers to
 	 * working space (which is allocated as needed by the JPEG library).
@@ -873,7 +1087,8 @@ bool RGBAImage::writeJPEG(const std::string& filename, int quality,
 	 */
 	struct jpeg_error_mgr jerr;
 	/* More stuff */
-	FILE * outfile;		/* target file */
+	unsigned char* output = NULL;	/* encoded image, allocated by libjpeg */
+	unsigned long output_size = 0;
 
 	/* Step 1: allocate and initialize JPEG compression object */
 
@@ -886,20 +1101,10 @@ bool RGBAImage::writeJPEG(const std::string& filename, int quality,
 	/* Now we can initialize the JPEG compression object. */
 	jpeg_create_compress(&cinfo);
 
-	/* Step 2: specify data destination (eg, a file) */
+	/* Step 2: specify data destination (a memory buffer) */
 	/* Note: steps 2 and 3 can be done in either order. */
 
-	/* Here we use the library-supplied code to send compressed data to a
-	 * stdio stream.	You can also write your own code to do something else.
-	 * VERY IMPORTANT: use "b" option to fopen() if you are on a machine that
-	 * requires it in order to write binary files.
-	 */
-	if ((outfile = fopen(filename.c_str(), "wb")) == NULL) {
-		//fprintf(stderr, "can't open %s\n", filename.c_str());
-		//exit(1);
-		return false;
-	}
-	jpeg_stdio_dest(&cinfo, outfile);
+	jpeg_mem_dest(&cinfo, &output, &output_size);
 
 	/* Step 3: set parameters for compression */
 
@@ -908,8 +1113,13 @@ bool RGBAImage::writeJPEG(const std::string& filename, int quality,
 	 */
 	cinfo.image_width = width; 	/* image width and height, in pixels */
 	cinfo.image_height = height;
+#ifdef JCS_EXTENSIONS
+	cinfo.input_components = 4;		/* # of color components per pixel */
+	cinfo.in_color_space = JCS_EXT_RGBX; 	/* colorspace of input image */
+#else
 	cinfo.input_components = 3;		/* # of color components per pixel */
 	cinfo.in_color_space = JCS_RGB; 	/* colorspace of input image */
+#endif
 	/* Now use the library's routine to set default compression parameters.
 	 * (You must set at least cinfo.in_color_space before calling this,
 	 * since the defaults depend on the source color space.)
@@ -918,7 +1128,13 @@ bool RGBAImage::writeJPEG(const std::string& filename, int quality,
 	/* Now you can set any non-default parameters you wish to.
 	 * Here we just illustrate the use of quality (quantization table) scaling:
 	 */
-	jpeg_set_quality(&cinfo, quality, TRUE /* limit to baseline-JPEG values */);
+	jpeg_set_quality(&cinfo, options.quality, TRUE /* limit to baseline-JPEG values */);
+	/* The subsampling of the color channels is set by the sampling factors of the
+	 * luminance channel, the color channels have the factors 1x1.
+	 */
+	cinfo.comp_info[0].h_samp_factor = options.subsampling == JPEGSubsampling::YUV444 ? 1 : 2;
+	cinfo.comp_info[0].v_samp_factor = options.subsampling == JPEGSubsampling::YUV420 ? 2 : 1;
+	cinfo.dct_method = options.fast_dct ? JDCT_IFAST : JDCT_ISLOW;
 
 	/* Step 4: Start compressor */
 
@@ -932,44 +1148,30 @@ bool RGBAImage::writeJPEG(const std::string& filename, int quality,
 
 	/* Here we use the library's state variable cinfo.next_scanline as the
 	 * loop counter, so that we don't have to keep track ourselves.
-	 * To keep things simple, we pass one scanline per call; you can pass
-	 * more if you wish, though.
 	 */
-	std::vector<JSAMPLE> line_buffer(width * 3, 0);
-	JSAMPLE* scanlineData = &line_buffer[0];
-
 	while (cinfo.next_scanline < cinfo.image_height) {
-		/* jpeg_write_scanlines expects an array of pointers to scanlines.
-		 * Here the array is only one element long, but you could pass
-		 * more than one scanline at a time if that's more convenient.
-		 */
+		JSAMPROW row = &rgbx[4 * width * cinfo.next_scanline];
+#ifndef JCS_EXTENSIONS
+		// pack the R, G, B, X bytes to R, G, B bytes in place
 		for (int x = 0; x < width; x++) {
-			RGBAPixel color = pixel(x, cinfo.next_scanline);
-			// jpeg does not support transparency
-			// add background color if this pixel has transparency
-			// but ignore a bit transparency
-			if (rgba_alpha(color) < 250) {
-				color = background;
-				blend(color, pixel(x, cinfo.next_scanline));
-			}
-
-			line_buffer[3 * x] = rgba_red(color);
-			line_buffer[3 * x + 1] = rgba_green(color);
-			line_buffer[3 * x + 2] = rgba_blue(color);
+			row[3 * x] = row[4 * x];
+			row[3 * x + 1] = row[4 * x + 1];
+			row[3 * x + 2] = row[4 * x + 2];
 		}
-		(void) jpeg_write_scanlines(&cinfo, &scanlineData, 1);
+#endif
+		(void) jpeg_write_scanlines(&cinfo, &row, 1);
 	}
 
 	/* Step 6: Finish compression */
 
 	jpeg_finish_compress(&cinfo);
-	/* After finish_compress, we can close the output file. */
-	fclose(outfile);
+	buffer.assign(output, output + output_size);
 
 	/* Step 7: release JPEG compression object */
 
 	/* This is an important step since it will release a good deal of memory. */
 	jpeg_destroy_compress(&cinfo);
+	free(output);
 
 	/* And we're done! */
 	return true;
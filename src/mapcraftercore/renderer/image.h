@@ -26,6 +26,7 @@
 
 #include <png.h>
 #include <cstdint>
+#include <iostream>
 #include <string>
 #include <tuple>
 #include <vector>
@@ -35,6 +36,8 @@ namespace renderer {
 
 typedef uint32_t RGBAPixel;
 
+class Palette;
+
 inline RGBAPixel rgba(uint8_t r, uint8_t g, uint8_t b, uint8_t a = 255) {
 	return (a << 24) | (b << 16) | (g << 8) | r;
 }
@@ -108,9 +111,6 @@ int rgba_distance2(RGBAPixel value1, RGBAPixel value2);
 
 void blend(RGBAPixel& dest, const RGBAPixel& source);
 
-void pngReadData(png_structp pngPtr, png_bytep data, png_size_t length);
-void pngWriteData(png_structp pngPtr, png_bytep data, png_size_t length);
-
 template <typename Pixel>
 class Image {
 public:
@@ -152,6 +152,81 @@ enum class InterpolationType {
 	AUTO
 };
 
+/**
+ * How the 2x2 pixels are averaged when images are downscaled to the half size.
+ */
+enum class DownsampleMode {
+	// averages the color channels and the alpha channel separately
+	AVERAGE,
+	// weights the colors with their alpha (like averaging premultiplied colors), so
+	// transparent pixels don't darken the edges of opaque areas
+	ALPHA_WEIGHTED,
+	// like ALPHA_WEIGHTED, but averages the colors in linear light instead of sRGB,
+	// which keeps the brightness of fine details like grass and flowers
+	LINEAR
+};
+
+std::ostream& operator<<(std::ostream& out, DownsampleMode mode);
+
+enum class PNGFilter {
+	NONE,
+	SUB,
+	UP,
+	AVERAGE,
+	PAETH,
+	// lets libpng choose the best filter for every row, compresses best but is slowest
+	ADAPTIVE
+};
+
+std::ostream& operator<<(std::ostream& out, PNGFilter filter);
+
+/**
+ * Settings of the PNG encoder, they only affect the speed of the encoder and the size
+ * of the written images, not the pixels.
+ */
+struct PNGWriteOptions {
+	PNGWriteOptions(int compression_level = 6, PNGFilter filter = PNGFilter::ADAPTIVE,
+			bool rle = false);
+
+	/**
+	 * Settings for writing PNGs as fast as possible: Fastest zlib compression level,
+	 * just one filter and run-length encoding instead of searching for matches.
+	 * The images are still reasonably small since the tiles have many uniform areas.
+	 */
+	static PNGWriteOptions fast();
+
+	// zlib compression level from 0 (no compression) to 9 (best compression)
+	int compression_level;
+	PNGFilter filter;
+	// whether zlib should use the run-length encoding strategy
+	bool rle;
+};
+
+enum class JPEGSubsampling {
+	// full resolution of the color channels
+	YUV444,
+	// half horizontal resolution of the color channels
+	YUV422,
+	// half horizontal and vertical resolution of the color channels
+	YUV420
+};
+
+std::ostream& operator<<(std::ostream& out, JPEGSubsampling subsampling);
+
+/**
+ * Settings of the JPEG encoder. The fast DCT method is a bit faster than the accurate
+ * one, but less accurate especially at high qualities.
+ */
+struct JPEGWriteOptions {
+	JPEGWriteOptions(int quality = 85, JPEGSubsampling subsampling = JPEGSubsampling::YUV420,
+			bool fast_dct = false);
+
+	// quality from 0 (worst) to 100 (best)
+	int quality;
+	JPEGSubsampling subsampling;
+	bool fast_dct;
+};
+
 // TODO better documentation...
 class RGBAImage : public Image<RGBAPixel> {
 public:
@@ -179,6 +254,16 @@ public:
 	void fill(RGBAPixel color, int x1, int y1, int w, int h);
 	void clear();
 
+	/**
+	 * Returns a (non-cryptographic) 64 bit hash of the size and the pixels of the image.
+	 */
+	uint64_t hash() const;
+
+	/**
+	 * Returns whether all pixels of the image are fully transparent.
+	 */
+	bool isTransparent() const;
+
 	RGBAImage clip(int x, int y, int width, int height) const;
 	RGBAImage colorize(double r, double g, double b, double a = 1) const;
 	RGBAImage colorize(uint8_t r, uint8_t g, uint8_t b, uint8_t a = 255) const;
@@ -192,6 +277,15 @@ public:
 	RGBAImage resize(int width, int height,
 			InterpolationType interpolation = InterpolationType::AUTO) const;
 
+	/**
+	 * Resizes the image to the half size and writes it directly to the position x, y of
+	 * another image instead of resizing it to a temporary image and blitting that. The
+	 * pixels of the other image are overwritten, completely transparent pixels are
+	 * written as 0. The half sized image must fit into the other image.
+	 */
+	void resizeHalfInto(RGBAImage& dest, int x, int y,
+			DownsampleMode mode = DownsampleMode::AVERAGE) const;
+
 	/**
 	 * (In-place) Shearing along the x-axis by a specific factor.
 	 */
@@ -214,12 +308,47 @@ public:
 	 */
 	void blur(RGBAImage& dest, int radius) const;
 
+	/*
+	 * The read/write methods work on files, the decode/encode methods on image files
+	 * in memory. Written files are replaced atomically (see util::writeFileAtomic), so
+	 * a tile is never visible half-written.
+	 */
+
 	bool readPNG(const std::string& filename);
-	bool writePNG(const std::string& filename) const;
-	bool writeIndexedPNG(const std::string& filename, int palette_bits = 8, bool dithered = true) const;
+	bool decodePNG(const uint8_t* data, size_t size);
+	bool writePNG(const std::string& filename,
+			const PNGWriteOptions& options = PNGWriteOptions()) const;
+	bool encodePNG(std::vector<uint8_t>& buffer,
+			const PNGWriteOptions& options = PNGWriteOptions()) const;
+
+	/**
+	 * Writes an indexed PNG, the palette with (at most) 2^palette_bits colors is
+	 * created by quantizing the colors of this image.
+	 */
+	bool writeIndexedPNG(const std::string& filename, int palette_bits = 8, bool dithered = true,
+			const PNGWriteOptions& options = PNGWriteOptions()) const;
+	bool encodeIndexedPNG(std::vector<uint8_t>& buffer, int palette_bits = 8,
+			bool dithered = true, const PNGWriteOptions& options = PNGWriteOptions()) const;
+
+	/**
+	 * Writes an indexed PNG with a fixed palette (at most 256 colors).
+	 */
+	bool writeIndexedPNG(const std::string& filename, Palette& palette, bool dithered = true,
+			const PNGWriteOptions& options = PNGWriteOptions()) const;
+	bool encodeIndexedPNG(std::vector<uint8_t>& buffer, Palette& palette,
+			bool dithered = true, const PNGWriteOptions& options = PNGWriteOptions()) const;
 
+	/**
+	 * Reads/writes JPEG images. JPEG doesn't support transparency, so transparent pixels
+	 * are composited on the (opaque) background color.
+	 */
 	bool readJPEG(const std::string& filename);
-	bool writeJPEG(const std::string& filename, int quality,
+	bool decodeJPEG(const uint8_t* data, size_t size);
+	bool writeJPEG(const std::string& filename,
+			const JPEGWriteOptions& options = JPEGWriteOptions(),
+			RGBAPixel background = rgba(255, 255, 255, 255)) const;
+	bool encodeJPEG(std::vector<uint8_t>& buffer,
+			const JPEGWriteOptions& options = JPEGWriteOptions(),
 			RGBAPixel background = rgba(255, 255, 255, 255)) const;
 };
 
@@ -28,7 +28,7 @@ namespace renderer {
 /**
  * Floyd-Steinberg dithering: http://en.wikipedia.org/wiki/Floyd-Steinberg_dithering
  */
-void imageDither(RGBAImage& image, Palette& palette, std::vector<int>& data) {
+void imageDither(RGBAImage& image, Palette& palette, std::vector<uint8_t>& data) {
 	int width = image.getWidth();
 	int height = image.getHeight();
 	data.resize(width * height);
@@ -20,6 +20,7 @@
 #ifndef IMAGE_DITHERING_H_
 #define IMAGE_DITHERING_H_
 
+#include <cstdint>
 #include <vector>
 
 namespace mapcrafter {
@@ -33,10 +34,11 @@ class Palette;
  *
  * The dithering is performened in-place, so the dithered colors are saved to the image
  * object. Also the dithered image data (indices of palette colors as pixels) is saved to
- * the supplied vector. You can supply a reference to an empty int vector, it will be
- * resized and all the image pixels are saved as data[y * width + x].
+ * the supplied vector. You can supply a reference to an empty vector, it will be
+ * resized and all the image pixels are saved as data[y * width + x]. The palette must not
+ * have more than 256 colors.
  */ 
-void imageDither(RGBAImage& image, Palette& palette, std::vector<int>& data);
+void imageDither(RGBAImage& image, Palette& palette, std::vector<uint8_t>& data);
 
 }
 }
@@ -19,12 +19,30 @@
 
 #include "quantization.h"
 
+#include <algorithm>
 #include <set>
-#include <queue>
 
 namespace mapcrafter {
 namespace renderer {
 
+namespace {
+
+// maximum count of free nodes which are kept per thread
+const size_t OCTREE_POOL_SIZE = 1 << 16;
+
+struct OctreeNodePool {
+	~OctreeNodePool() {
+		for (auto it = free_nodes.begin(); it != free_nodes.end(); ++it)
+			::operator delete(*it);
+	}
+
+	std::vector<void*> free_nodes;
+};
+
+thread_local OctreeNodePool octree_node_pool;
+
+}
+
 Octree::Octree(Octree* parent, int level)
 	: parent(parent), level(level), reference(0), red(0), green(0), blue(0), alpha(0), color_id(-1) {
 	for (int i = 0; i < 16; i++)
@@ -37,6 +55,24 @@ Octree::~Octree() {
 			delete children[i];
 }
 
+void* Octree::operator new(size_t size) {
+	assert(size == sizeof(Octree));
+	std::vector<void*>& free_nodes = octree_node_pool.free_nodes;
+	if (free_nodes.empty())
+		return ::operator new(size);
+	void* pointer = free_nodes.back();
+	free_nodes.pop_back();
+	return pointer;
+}
+
+void Octree::operator delete(void* pointer) {
+	std::vector<void*>& free_nodes = octree_node_pool.free_nodes;
+	if (free_nodes.size() >= OCTREE_POOL_SIZE)
+		::operator delete(pointer);
+	else
+		free_nodes.push_back(pointer);
+}
+
 Octree* Octree::getParent() {
 	return parent;
 }
@@ -335,9 +371,12 @@ void octreeColorQuantize(const RGBAImage& image, size_t max_colors,
 
 	// have an octree with the colors as leaves
 	Octree* internal_octree = new Octree();
-	// and a priority queue of leaves to be processed
+	// and a priority queue (as heap) of leaves to be processed
 	// the order of leaves is very important, see NodeComparator
-	std::priority_queue<Octree*, std::vector<Octree*>, NodeComparator> queue;
+	// the heap is reused for all images quantized by this thread
+	static thread_local std::vector<Octree*> queue;
+	queue.clear();
+	NodeComparator comparator;
 
 	// insert the colors into the octree
 	for (int x = 0; x < image.getWidth(); x++) {
@@ -347,15 +386,17 @@ void octreeColorQuantize(const RGBAImage& image, size_t max_colors,
 			node->setColor(color);
 			// add the leaf only once to the queue
 			if (node->getCount() == 1)
-				queue.push(node);
+				queue.push_back(node);
 		}
 	}
+	std::make_heap(queue.begin(), queue.end(), comparator);
 
 	// now: reduce the leaves until we have less colors than maximum
 	while (queue.size() > max_colors) {
-		Octree* node = queue.top();
+		std::pop_heap(queue.begin(), queue.end(), comparator);
+		Octree* node = queue.back();
 		assert(node->isLeaf());
-		queue.pop();
+		queue.pop_back();
 		
 		// add the color value of the leaf to the parent
 		node->reduceToParent();
@@ -364,17 +405,20 @@ void octreeColorQuantize(const RGBAImage& image, size_t max_colors,
 		delete node;
 
 		// add parent to queue if it is a leaf now
-		if (parent->isLeaf())
-			queue.push(parent);
+		if (parent->isLeaf()) {
+			queue.push_back(parent);
+			std::push_heap(queue.begin(), queue.end(), comparator);
+		}
 	}
 
 	// gather the quantized colors
 	while (queue.size()) {
-		Octree* node = queue.top();
+		std::pop_heap(queue.begin(), queue.end(), comparator);
+		Octree* node = queue.back();
 		assert(node->isLeaf());
 		node->setColorID(colors.size());
 		colors.push_back(node->getColor());
-		queue.pop();
+		queue.pop_back();
 	}
 
 	if (octree != nullptr)
@@ -57,6 +57,14 @@ public:
 	 */
 	~Octree();
 
+	/**
+	 * The nodes are allocated from a per-thread pool of free nodes. Quantizing the
+	 * colors of a tile creates and deletes thousands of nodes, that way they don't have
+	 * to be allocated on the heap again for every tile.
+	 */
+	static void* operator new(size_t size);
+	static void operator delete(void* pointer);
+
 	/**
 	 * Returns the parent of this node.
 	 */
@@ -207,6 +215,9 @@ protected:
  * When you reach a node where the children where you want to go to doesn't exist, it
  * searches in this list for the nearest color. That's not exactly 100% accurate
  * somtimes, but good enough.
+ *
+ * Looking up colors doesn't modify the palette, so one palette can be used by multiple
+ * threads at the same time.
  */
 class OctreePalette : public Palette {
 public:
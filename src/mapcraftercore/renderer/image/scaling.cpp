@@ -2,6 +2,12 @@
 
 #include "../image.h"
 
+#include <algorithm>
+#include <cmath>
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
 namespace mapcrafter {
 namespace renderer {
 
@@ -70,24 +76,223 @@ void imageResizeBilinear(const RGBAImage& image, RGBAImage& dest, int width, int
 	}
 }
 
+namespace {
+
+/**
+ * Averages 2x2 pixels, every channel is the (rounded down) average of the channels.
+ */
+inline RGBAPixel averagePixels(RGBAPixel p1, RGBAPixel p2, RGBAPixel p3, RGBAPixel p4) {
+	RGBAPixel highBits = ((p1 >> 2) & 0x3f3f3f3f) + ((p2 >> 2) & 0x3f3f3f3f) + ((p3 >> 2) & 0x3f3f3f3f) + ((p4 >> 2) & 0x3f3f3f3f);
+	RGBAPixel lowBits = (((p1 & 0x03030303) + (p2 & 0x03030303) + (p3 & 0x03030303) + (p4 & 0x03030303)) >> 2) & 0x03030303;
+	return highBits + lowBits;
+}
+
+/**
+ * Averages 2x2 pixels with the colors weighted by the alpha values of the pixels.
+ */
+inline RGBAPixel averagePixelsAlphaWeighted(RGBAPixel p1, RGBAPixel p2, RGBAPixel p3,
+		RGBAPixel p4) {
+	uint32_t a1 = rgba_alpha(p1), a2 = rgba_alpha(p2), a3 = rgba_alpha(p3),
+			a4 = rgba_alpha(p4);
+	uint32_t alpha = a1 + a2 + a3 + a4;
+	if (alpha == 0)
+		return 0;
+	if (alpha == 4 * 255)
+		return averagePixels(p1, p2, p3, p4);
+	uint32_t red = rgba_red(p1) * a1 + rgba_red(p2) * a2 + rgba_red(p3) * a3
+			+ rgba_red(p4) * a4;
+	uint32_t green = rgba_green(p1) * a1 + rgba_green(p2) * a2 + rgba_green(p3) * a3
+			+ rgba_green(p4) * a4;
+	uint32_t blue = rgba_blue(p1) * a1 + rgba_blue(p2) * a2 + rgba_blue(p3) * a3
+			+ rgba_blue(p4) * a4;
+	return rgba((red + alpha / 2) / alpha, (green + alpha / 2) / alpha,
+			(blue + alpha / 2) / alpha, alpha / 4);
+}
+
+/**
+ * Lookup tables to convert sRGB color channels to linear light and back.
+ */
+struct LinearLightTables {
+	LinearLightTables();
+
+	// sRGB channel -> linear light from 0 to 65535
+	uint32_t to_linear[256];
+	// linear light -> nearest sRGB channel
+	uint8_t to_srgb[65536];
+};
+
+LinearLightTables::LinearLightTables() {
+	for (int c = 0; c < 256; c++) {
+		double value = c / 255.0;
+		if (value <= 0.04045)
+			value = value / 12.92;
+		else
+			value = std::pow((value + 0.055) / 1.055, 2.4);
+		to_linear[c] = std::round(value * 65535);
+	}
+	// the sRGB channels survive the way there and back since every linear value is
+	// mapped to the nearest one
+	int c = 0;
+	for (int i = 0; i < 65536; i++) {
+		while (c < 255 && 2 * (uint32_t) i >= to_linear[c] + to_linear[c + 1])
+			c++;
+		to_srgb[i] = c;
+	}
+}
+
+const LinearLightTables& getLinearLightTables() {
+	static LinearLightTables tables;
+	return tables;
+}
+
+/**
+ * Averages 2x2 pixels like averagePixelsAlphaWeighted, but in linear light.
+ */
+inline RGBAPixel averagePixelsLinear(const LinearLightTables& tables, RGBAPixel p1,
+		RGBAPixel p2, RGBAPixel p3, RGBAPixel p4) {
+	uint32_t a1 = rgba_alpha(p1), a2 = rgba_alpha(p2), a3 = rgba_alpha(p3),
+			a4 = rgba_alpha(p4);
+	uint32_t alpha = a1 + a2 + a3 + a4;
+	if (alpha == 0)
+		return 0;
+	const uint32_t* linear = tables.to_linear;
+	uint32_t red = linear[rgba_red(p1)] * a1 + linear[rgba_red(p2)] * a2
+			+ linear[rgba_red(p3)] * a3 + linear[rgba_red(p4)] * a4;
+	uint32_t green = linear[rgba_green(p1)] * a1 + linear[rgba_green(p2)] * a2
+			+ linear[rgba_green(p3)] * a3 + linear[rgba_green(p4)] * a4;
+	uint32_t blue = linear[rgba_blue(p1)] * a1 + linear[rgba_blue(p2)] * a2
+			+ linear[rgba_blue(p3)] * a3 + linear[rgba_blue(p4)] * a4;
+	return rgba(tables.to_srgb[(red + alpha / 2) / alpha],
+			tables.to_srgb[(green + alpha / 2) / alpha],
+			tables.to_srgb[(blue + alpha / 2) / alpha], alpha / 4);
+}
+
+/**
+ * Averages 2x2 pixels with one of the downsample modes.
+ */
+inline RGBAPixel averagePixels(DownsampleMode mode, const LinearLightTables& tables,
+		RGBAPixel p1, RGBAPixel p2, RGBAPixel p3, RGBAPixel p4) {
+	if (mode == DownsampleMode::AVERAGE)
+		return averagePixels(p1, p2, p3, p4);
+	// uniform areas are very common in tiles, they stay like they are
+	if (p1 == p2 && p1 == p3 && p1 == p4)
+		return rgba_alpha(p1) == 0 ? 0 : p1;
+	if (mode == DownsampleMode::LINEAR)
+		return averagePixelsLinear(tables, p1, p2, p3, p4);
+	return averagePixelsAlphaWeighted(p1, p2, p3, p4);
+}
+
+/**
+ * Downscales two rows of 2 * count pixels to one row of count pixels.
+ */
+void resizeHalfRow(const RGBAPixel* row1, const RGBAPixel* row2, RGBAPixel* dest,
+		int count, DownsampleMode mode, bool clear_transparent) {
+	const LinearLightTables& tables = getLinearLightTables();
+	int i = 0;
+#ifdef __SSE2__
+	// four pixels at once, the channels of the 2x2 pixels are summed up in 16 bit lanes
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i alpha_mask = _mm_set1_epi32(0xff000000);
+	for (; i + 4 <= count; i += 4) {
+		__m128i a1 = _mm_loadu_si128((const __m128i*) (row1 + 2 * i));
+		__m128i b1 = _mm_loadu_si128((const __m128i*) (row1 + 2 * i + 4));
+		__m128i a2 = _mm_loadu_si128((const __m128i*) (row2 + 2 * i));
+		__m128i b2 = _mm_loadu_si128((const __m128i*) (row2 + 2 * i + 4));
+
+		if (mode != DownsampleMode::AVERAGE) {
+			// the other modes are only different from the average if there are translucent
+			// pixels (or always in linear light), transparent pixels stay transparent
+			__m128i alpha_and = _mm_and_si128(alpha_mask,
+					_mm_and_si128(_mm_and_si128(a1, b1), _mm_and_si128(a2, b2)));
+			__m128i alpha_or = _mm_and_si128(alpha_mask,
+					_mm_or_si128(_mm_or_si128(a1, b1), _mm_or_si128(a2, b2)));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha_or, zero)) == 0xffff) {
+				_mm_storeu_si128((__m128i*) (dest + i), zero);
+				continue;
+			}
+			bool opaque = _mm_movemask_epi8(_mm_cmpeq_epi32(alpha_and, alpha_mask)) == 0xffff;
+			if (mode == DownsampleMode::LINEAR || !opaque) {
+				// the 2x2 pixels are uniform if the pixels of the two rows are the same and
+				// the two pixels of the first row are the same
+				__m128i same_a = _mm_cmpeq_epi32(a1, a2);
+				__m128i same_b = _mm_cmpeq_epi32(b1, b2);
+				same_a = _mm_and_si128(_mm_and_si128(same_a, _mm_srli_si128(same_a, 4)),
+						_mm_cmpeq_epi32(a1, _mm_srli_si128(a1, 4)));
+				same_b = _mm_and_si128(_mm_and_si128(same_b, _mm_srli_si128(same_b, 4)),
+						_mm_cmpeq_epi32(b1, _mm_srli_si128(b1, 4)));
+				// lanes 0 and 2 tell whether the 2x2 pixels are uniform
+				if ((_mm_movemask_epi8(same_a) & 0x0f0f) == 0x0f0f
+						&& (_mm_movemask_epi8(same_b) & 0x0f0f) == 0x0f0f) {
+					__m128i result = _mm_unpacklo_epi64(
+							_mm_shuffle_epi32(a1, _MM_SHUFFLE(2, 0, 2, 0)),
+							_mm_shuffle_epi32(b1, _MM_SHUFFLE(2, 0, 2, 0)));
+					__m128i transparent = _mm_cmpeq_epi32(_mm_and_si128(result, alpha_mask),
+							zero);
+					_mm_storeu_si128((__m128i*) (dest + i), _mm_andnot_si128(transparent, result));
+					continue;
+				}
+				for (int j = i; j < i + 4; j++)
+					dest[j] = averagePixels(mode, tables, row1[2 * j], row1[2 * j + 1],
+							row2[2 * j], row2[2 * j + 1]);
+				continue;
+			}
+		}
+
+		// sum up the rows: pixels 0 and 1, 2 and 3, ...
+		__m128i sum01 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(a2, zero));
+		__m128i sum23 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(a2, zero));
+		__m128i sum45 = _mm_add_epi16(_mm_unpacklo_epi8(b1, zero), _mm_unpacklo_epi8(b2, zero));
+		__m128i sum67 = _mm_add_epi16(_mm_unpackhi_epi8(b1, zero), _mm_unpackhi_epi8(b2, zero));
+		// then the horizontally adjacent pixels
+		__m128i result01 = _mm_add_epi16(_mm_unpacklo_epi64(sum01, sum23),
+				_mm_unpackhi_epi64(sum01, sum23));
+		__m128i result23 = _mm_add_epi16(_mm_unpacklo_epi64(sum45, sum67),
+				_mm_unpackhi_epi64(sum45, sum67));
+		__m128i result = _mm_packus_epi16(_mm_srli_epi16(result01, 2),
+				_mm_srli_epi16(result23, 2));
+		if (clear_transparent) {
+			__m128i transparent = _mm_cmpeq_epi32(_mm_and_si128(result, alpha_mask), zero);
+			result = _mm_andnot_si128(transparent, result);
+		}
+		_mm_storeu_si128((__m128i*) (dest + i), result);
+	}
+#endif
+
+	for (; i < count; i++) {
+		RGBAPixel pixel = averagePixels(mode, tables, row1[2 * i], row1[2 * i + 1],
+				row2[2 * i], row2[2 * i + 1]);
+		if (clear_transparent && rgba_alpha(pixel) == 0)
+			pixel = 0;
+		dest[i] = pixel;
+	}
+}
+
+}
+
 void imageResizeHalf(const RGBAImage& image, RGBAImage& dest) {
 	int width = image.getWidth();
 	int height = image.getHeight();
 	dest.setSize(width / 2, height / 2);
 
-	for (int x = 0; x < width - 1; x += 2) {
-		for (int y = 0; y < height - 1; y += 2) {
-			RGBAPixel p1 = image.pixel(x, y);
-			RGBAPixel p2 = image.pixel(x + 1, y);
-			RGBAPixel p3 = image.pixel(x, y + 1);
-			RGBAPixel p4 = image.pixel(x + 1, y + 1);
-			RGBAPixel highBits = ((p1 >> 2) & 0x3f3f3f3f) + ((p2 >> 2) & 0x3f3f3f3f) + ((p3 >> 2) & 0x3f3f3f3f) + ((p4 >> 2) & 0x3f3f3f3f);
-			RGBAPixel lowBits = (((p1 & 0x03030303) + (p2 & 0x03030303) + (p3 & 0x03030303) + (p4 & 0x03030303)) >> 2) & 0x03030303;
-			dest.pixel(x >> 1, y >> 1) = highBits + lowBits;
-		}
-	}
+	for (int y = 0; y < height / 2; y++)
+		resizeHalfRow(&image.data[2 * y * width], &image.data[(2 * y + 1) * width],
+				&dest.data[y * (width / 2)], width / 2, DownsampleMode::AVERAGE, false);
 }
 
-}
+void imageResizeHalfInto(const RGBAImage& image, RGBAImage& dest, int x, int y,
+		DownsampleMode mode) {
+	int width = image.getWidth();
+	int height = image.getHeight();
+	// only the part which fits into the destination image
+	int count = std::min(width / 2, dest.getWidth() - x);
+	int rows = std::min(height / 2, dest.getHeight() - y);
+	if (x < 0 || y < 0 || count <= 0)
+		return;
+
+	for (int row = 0; row < rows; row++)
+		resizeHalfRow(&image.data[2 * row * width], &image.data[(2 * row + 1) * width],
+				&dest.data[(y + row) * dest.getWidth() + x], count, mode, true);
 }
 
+}
+}
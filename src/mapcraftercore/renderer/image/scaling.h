@@ -20,14 +20,16 @@
 #ifndef IMAGE_SCALING_H_
 #define IMAGE_SCALING_H_
 
+#include "../image.h"
+
 namespace mapcrafter {
 namespace renderer {
 
-class RGBAImage;
-
 void imageResizeSimple(const RGBAImage& image, RGBAImage& dest, int width, int height);
 void imageResizeBilinear(const RGBAImage& image, RGBAImage& dest, int width, int height);
 void imageResizeHalf(const RGBAImage& image, RGBAImage& dest);
+void imageResizeHalfInto(const RGBAImage& image, RGBAImage& dest, int x, int y,
+		DownsampleMode mode);
 
 }
 }
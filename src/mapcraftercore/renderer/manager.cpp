@@ -20,11 +20,18 @@
 #include "manager.h"
 
 #include "blockimages.h"
+#include "emptytileindex.h"
+#include "rendercostindex.h"
 #include "tilerenderworker.h"
+#include "tilehashstore.h"
+#include "tileimageformat.h"
+#include "tilesetindex.h"
+#include "tilestorage.h"
 #include "renderview.h"
 #include "../renderer/biomes.h"
 #include "../config/loggingconfig.h"
 #include "../mc/blockstate.h"
+#include "../mc/chunkfingerprints.h"
 #include "../thread/impl/singlethread.h"
 #include "../thread/impl/multithreading.h"
 #include "../thread/dispatcher.h"
@@ -32,9 +39,12 @@
 #include "../version.h"
 
 #include <cstring>
+#include <algorithm>
 #include <array>
+#include <chrono>
 #include <fstream>
 #include <memory>
+#include <random>
 #include <thread>
 #include <tuple>
 
@@ -142,14 +152,49 @@ RenderBehaviors RenderBehaviors::fromRenderOpts(
 	return behaviors;
 }
 
+RenderEstimate::RenderEstimate()
+	: render_tiles(0), composite_tiles(0), sampled_tiles(0), cpu_seconds(0),
+	  wall_seconds(0), output_bytes(0), memory_peak(0) {
+}
+
+RenderEstimate& RenderEstimate::operator+=(const RenderEstimate& other) {
+	render_tiles += other.render_tiles;
+	composite_tiles += other.composite_tiles;
+	sampled_tiles += other.sampled_tiles;
+	cpu_seconds += other.cpu_seconds;
+	wall_seconds += other.wall_seconds;
+	output_bytes += other.output_bytes;
+	memory_peak = std::max(memory_peak, other.memory_peak);
+	return *this;
+}
+
 RenderManager::RenderManager(const config::MapcrafterConfig& config)
-	: config(config), web_config(config), time_started_scanning(0) {
+	: config(config), web_config(config), dry_run(false), time_started_scanning(0) {
 }
 
 void RenderManager::setRenderBehaviors(const RenderBehaviors& render_behaviors) {
 	this->render_behaviors = render_behaviors;
 }
 
+void RenderManager::setProfileReport(const fs::path& profile_report) {
+	this->profile_report = profile_report;
+	util::Profiler::setEnabled(!profile_report.empty());
+}
+
+void RenderManager::setMetricsFile(const fs::path& metrics_file, int interval) {
+	metrics.reset(new util::MetricsFileExporter(metrics_file, interval));
+}
+
+void RenderManager::setTraceFile(const fs::path& trace_file, int buffer_size) {
+	this->trace_file = trace_file;
+	util::Tracer::setEnabled(!trace_file.empty() && buffer_size > 0, buffer_size);
+	util::Tracer::setThreadName("main");
+}
+
+void RenderManager::setMemoryLimit(uint64_t memory_limit) {
+	util::MemoryAccountant::setLimit(memory_limit);
+}
+
 bool RenderManager::initialize() {
 	// an output directory would be nice -- create one if it does not exist
 	if (!fs::is_directory(config.getOutputDir()) && !fs::create_directories(config.getOutputDir())) {
@@ -161,7 +206,7 @@ bool RenderManager::initialize() {
 	return web_config.readConfigJS();
 }
 
-bool RenderManager::scanWorlds() {
+bool RenderManager::scanWorlds(int threads) {
 	auto config_worlds = config.getWorlds();
 	auto config_maps = config.getMaps();
 
@@ -198,61 +243,122 @@ bool RenderManager::scanWorlds() {
 	// store the maximum max zoom level of every tile set with its rotations
 	std::map<config::TileSetGroupID, int> tile_sets_max_zoom;
 
-	// iterate through all tile sets that are needed
+	// group the needed tile sets by their worlds,
+	// all tile sets of a world are scanned at once
+	std::map<std::string, std::vector<config::TileSetID> > world_tile_sets;
 	for (auto tile_set_it = needed_tile_sets.begin();
-			tile_set_it != needed_tile_sets.end(); ++tile_set_it) {
-		config::WorldSection world_config = config.getWorld(tile_set_it->world_name);
-		RenderView* render_view = createRenderView(tile_set_it->render_view, tile_set_it->rotation, 1.0f );
+			tile_set_it != needed_tile_sets.end(); ++tile_set_it)
+		world_tile_sets[tile_set_it->world_name].push_back(*tile_set_it);
+
+	// iterate through all worlds with tile sets that are needed
+	for (auto world_it = world_tile_sets.begin(); world_it != world_tile_sets.end(); ++world_it) {
+		config::WorldSection world_config = config.getWorld(world_it->first);
 
 		// load the world
 		std::shared_ptr<mc::World> world(new mc::World(world_config.getInputDir().string(),
 				world_config.getDimension(), config.getCachePath(world_config.getShortName()).string()));
 		world->setWorldCrop(world_config.getWorldCrop());
 		if (!world->load()) {
-			LOG(FATAL) << "Unable to load world " << tile_set_it->world_name << "!";
+			LOG(FATAL) << "Unable to load world " << world_it->first << "!";
 			return false;
 		}
 		int world_version = world->getMinecraftVersion();
 		if (world_version == -1) {
 			LOG(WARNING) << "Unable to determine Minecraft version of world '"
-				<< tile_set_it->world_name << "'. Maybe level.dat doesn't exist in world directory?";
+				<< world_it->first << "'. Maybe level.dat doesn't exist in world directory?";
 			LOG(WARNING) << "Note that rendering of pre-1.13 worlds is not supported, "
 				<< "in case Mapcrafter fails to read the world.";
 			LOG(WARNING) << "See Mapcrafter legacy for rendering of older worlds. TODO";
 		} else if (world_version < 2860) {
 			// 2860 is 1.18.1, should be first version of remodeled 3d chunk based
-			LOG(ERROR) << "Rendering of world '" << tile_set_it->world_name << "'  is not supported.";
+			LOG(ERROR) << "Rendering of world '" << world_it->first << "'  is not supported.";
 			LOG(ERROR) << "This version of Mapcrafter supports only worlds of Minecraft 1.18.1 and newer";
 			LOG(ERROR) << "See Mapcrafter legacy for rendering of older worlds. TODO";
 			return false;
 		}
 
-		// create a tile set for this world
-		std::shared_ptr<TileSet> tile_set(render_view->createTileSet(tile_set_it->tile_width));
+		const std::vector<config::TileSetID>& tile_set_ids = world_it->second;
+		// the tile sets reference the rotation of their render views,
+		// so the render views have to live until the tile sets are scanned
+		std::vector<std::shared_ptr<RenderView> > render_views;
+		std::vector<std::shared_ptr<TileSetIndex> > indexes;
+		std::vector<TileSet*> scan_tile_sets;
+		std::vector<TileSetIndex*> scan_indexes;
+		for (auto tile_set_it = tile_set_ids.begin(); tile_set_it != tile_set_ids.end(); ++tile_set_it) {
+			render_views.push_back(std::shared_ptr<RenderView>(
+					createRenderView(tile_set_it->render_view, tile_set_it->rotation, 1.0f)));
+
+			// create a tile set for this world
+			std::shared_ptr<TileSet> tile_set(render_views.back()->createTileSet(tile_set_it->tile_width));
+			tile_sets[*tile_set_it] = tile_set;
+			scan_tile_sets.push_back(tile_set.get());
+
+			// the index of the tile set remembers the tiles of the region files from the
+			// last scan, it's keyed by render view, tile width and rotation of the tile set
+			indexes.push_back(std::shared_ptr<TileSetIndex>(new TileSetIndex(world->getCacheDir()
+					/ ("tileset_" + tile_set_it->toString() + ".nbt.gz"), tile_set_it->toString())));
+			indexes.back()->read();
+			scan_indexes.push_back(indexes.back().get());
+		}
+
 		// and scan the tiles of this world,
 		// we automatically center the tiles for cropped worlds, but only...
 		//  - the circular cropped ones and
 		//  - the ones with completely specified x- AND z-bounds
-		if (world_config.needsWorldCentering()) {
-			TilePos tile_offset;
-			tile_set->scan(*world, true, tile_offset);
-			web_config.setTileSetTileOffset(*tile_set_it, tile_offset);
-		} else {
-			tile_set->scan(*world);
+		std::vector<TilePos> tile_offsets(tile_set_ids.size());
+		// the fingerprints of the chunk contents make chunks that were only touched by
+		// Minecraft (entities moved etc.) keep their timestamps of the last real change
+		std::shared_ptr<mc::ChunkFingerprints> fingerprints;
+		if (world_config.useChunkFingerprints()) {
+			fingerprints.reset(new mc::ChunkFingerprints(
+					world->getCacheDir() / "chunk_fingerprints.nbt.gz"));
+			fingerprints->read();
+		}
+		TileSet::scan(*world, scan_tile_sets, scan_indexes, world_config.needsWorldCentering(),
+				tile_offsets, threads, fingerprints.get());
+		if (fingerprints && !dry_run) {
+			fingerprints->write();
+			if (fingerprints->getUnchangedCount() > 0)
+				LOG(INFO) << fingerprints->getUnchangedCount() << " chunks of world '"
+						<< world_it->first << "' were saved, but their content is unchanged.";
 		}
 
-		// key of this tile_sets_max_zoom map is a TileSetGroupID, not TileSetID as we access it
-		// since TileSetID is a subclass of TileSetGroupID, only the TileSetGroupID-'functionality' is used
-		// TADA C++ magic! (object slicing)
-		int& max_zoom = tile_sets_max_zoom[*tile_set_it];
-		max_zoom = std::max(max_zoom, tile_set->getDepth());
-
-		// set world- and tileset object in the map
-		worlds[tile_set_it->world_name][tile_set_it->rotation] = world;
-		tile_sets[*tile_set_it] = tile_set;
+		// the estimates need the chunks of the world for every rotation, the tile set
+		// indexes know them now without reading the region files again
+		if (dry_run && !indexes.empty()) {
+			std::vector<mc::ChunkPos>& chunks = world_chunks[world_it->first];
+			mc::WorldCrop world_crop = world->getWorldCrop();
+			const mc::World::RegionSet& regions = world->getAvailableRegions();
+			RegionTiles region_tiles;
+			for (auto region_it = regions.begin(); region_it != regions.end(); ++region_it) {
+				if (!indexes[0]->getRegion(*region_it, region_tiles))
+					continue;
+				for (size_t j = 0; j < region_tiles.chunks.size(); j++) {
+					int index = region_tiles.chunks[j];
+					mc::ChunkPos chunk(region_it->x * 32 + index % 32,
+							region_it->z * 32 + index / 32);
+					if (world_crop.isChunkContained(chunk))
+						chunks.push_back(chunk);
+				}
+			}
+		}
 
-		// clean up render view
-		delete render_view;
+		for (size_t i = 0; i < tile_set_ids.size(); i++) {
+			const config::TileSetID& tile_set_id = tile_set_ids[i];
+			if (!dry_run)
+				indexes[i]->write();
+			if (world_config.needsWorldCentering())
+				web_config.setTileSetTileOffset(tile_set_id, tile_offsets[i]);
+
+			// key of this tile_sets_max_zoom map is a TileSetGroupID, not TileSetID as we access it
+			// since TileSetID is a subclass of TileSetGroupID, only the TileSetGroupID-'functionality' is used
+			// TADA C++ magic! (object slicing)
+			int& max_zoom = tile_sets_max_zoom[tile_set_id];
+			max_zoom = std::max(max_zoom, tile_sets[tile_set_id]->getDepth());
+
+			// set world object in the map
+			worlds[tile_set_id.world_name][tile_set_id.rotation] = world;
+		}
 	}
 
 	// set calculated max zoom of tile sets
@@ -264,7 +370,8 @@ bool RenderManager::scanWorlds() {
 		web_config.setTileSetsMaxZoom(*tile_set_it, max_zoom);
 	}
 
-	writeTemplates();
+	if (!dry_run)
+		writeTemplates();
 	return true;
 }
 
@@ -282,7 +389,6 @@ void RenderManager::renderMap(const std::string& map, RenderRotation::Direction
 	}
 
 	config::MapSection map_config = config.getMap(map);
-	config::WorldSection world_config = config.getWorld(map_config.getWorld());
 
 	// TODO keep block state registry global per map. or are there any reasons to make more global?
 	mc::BlockStateRegistry block_registry;
@@ -298,20 +404,9 @@ void RenderManager::renderMap(const std::string& map, RenderRotation::Direction
 	}
 
 	fs::path output_dir = config.getOutputPath(map + "/" + config::ROTATION_NAMES_SHORT[rotation]);
-	// get the tile set
-	TileSet* tile_set = tile_sets[map_config.getTileSet((RenderRotation::Direction)rotation)].get();
-	if (render_behaviors.getRenderBehavior(map, rotation) == RenderBehavior::AUTO) {
-		// if incremental render, scan which tiles might have changed
-		LOG(INFO) << "Scanning required tiles...";
-		// use the incremental check method specified in the config
-		if (map_config.useImageModificationTimes())
-			tile_set->scanRequiredByFiletimes(output_dir, map_config.getImageFormatSuffix());
-		else
-			tile_set->scanRequiredByTimestamp(web_config.getMapLastRendered(map, rotation));
-	} else {
-		// or just set all tiles required if force-rendering
-		tile_set->resetRequired();
-	}
+	std::shared_ptr<TileStorage> tile_storage = TileStorage::create(
+			map_config.getTileStorage(), output_dir, map_config.getImageFormatSuffix());
+	TileSet* tile_set = scanRequiredTiles(map, rotation, *tile_storage);
 
 	// maybe we don't have to render anything at all
 	if (tile_set->getRequiredRenderTilesCount() == 0) {
@@ -320,30 +415,44 @@ void RenderManager::renderMap(const std::string& map, RenderRotation::Direction
 	}
 
 	// create other stuff for the render dispatcher
-	std::shared_ptr<BlockImages> block_images(render_view->createBlockImages(block_registry));
-	render_view->configureBlockImages(block_images.get(), world_config, map_config);
-
-	RenderedBlockImages* new_block_images = dynamic_cast<RenderedBlockImages*>(block_images.get());
-	if (new_block_images != nullptr) {
-		if (!new_block_images->loadBlockImages(map_config.getBlockDir().string(), util::str(map_config.getRenderView()), rotation, map_config.getTextureSize())) {
-			LOG(ERROR) << "Skipping remaining rotations.";
-			return;
-		}
-	}
-
-	renderer::Biome::initializeBiomes();
-
+	std::shared_ptr<BlockImages> block_images;
 	RenderContext context;
+	if (!initializeRenderContext(map, rotation, render_view.get(), block_registry,
+			block_images, context)) {
+		LOG(ERROR) << "Skipping remaining rotations.";
+		return;
+	}
 	context.output_dir = output_dir;
-	context.background_color = config.getBackgroundColor();
-	context.world_config = config.getWorld(map_config.getWorld());
-	context.map_config = map_config;
-	context.render_view = render_view.get();
-	context.block_images = block_images.get();
-	context.tile_set = tile_set;
-	context.block_registry = &block_registry;
-	context.world = worlds[map_config.getWorld()][rotation];
-	context.initializeTileRenderer();
+	context.tile_storage = tile_storage;
+
+	// the pixel hashes of the tiles are used to skip writing unchanged tiles,
+	// they are only valid for the same image format with the same settings
+	std::string hashes_key = context.tile_format->getKey();
+	context.tile_hashes.reset(new TileHashStore(config.getCachePath("tilehashes_" + map
+			+ "_" + config::ROTATION_NAMES_SHORT[rotation] + ".nbt.gz"), hashes_key));
+	// force-rendering writes all tiles again
+	if (render_behaviors.getRenderBehavior(map, rotation) == RenderBehavior::AUTO)
+		context.tile_hashes->read();
+
+	// empty tiles are not written, the web interface reads which tiles are empty
+	fs::path empty_tiles_file = output_dir / "empty-tiles.json";
+	if (map_config.skipEmptyTiles()) {
+		context.empty_tiles.reset(new EmptyTileIndex(empty_tiles_file));
+		if (render_behaviors.getRenderBehavior(map, rotation) == RenderBehavior::AUTO)
+			context.empty_tiles->read();
+	} else if (fs::exists(empty_tiles_file)) {
+		// the tiles marked as empty are not hidden anymore then, they are rendered
+		// again when they can't be read
+		fs::remove(empty_tiles_file);
+	}
+
+	// the render costs of the render tiles, the web interface can show them as overlay
+	fs::path render_costs_file = output_dir / "render-costs.json";
+	if (map_config.recordRenderCosts()) {
+		context.render_costs.reset(new RenderCostIndex(render_costs_file));
+		if (render_behaviors.getRenderBehavior(map, rotation) == RenderBehavior::AUTO)
+			context.render_costs->read();
+	}
 
 	// update map parameters in web config
 	int tile_w = context.tile_renderer->getTileWidth();
@@ -360,6 +469,18 @@ void RenderManager::renderMap(const std::string& map, RenderRotation::Direction
 
 	// do the dance
 	dispatcher->dispatch(context, progress);
+	context.tile_storage->flush();
+	if (context.empty_tiles) {
+		context.empty_tiles->setTime(time_started_scanning);
+		context.empty_tiles->write();
+	}
+	if (context.render_costs)
+		context.render_costs->write();
+
+	context.tile_hashes->write();
+	if (context.tile_hashes->getUnchangedCount() > 0)
+		LOG(INFO) << context.tile_hashes->getUnchangedCount()
+				<< " rendered tiles were unchanged and not written again.";
 
 	// update the map settings with last render time
 	web_config.setMapLastRendered(map, rotation, time_started_scanning);
@@ -371,7 +492,7 @@ bool RenderManager::run(int threads, bool batch) {
 		return false;
 
 	LOG(INFO) << "Scanning worlds...";
-	if (!scanWorlds())
+	if (!scanWorlds(threads))
 		return false;
 
 	int progress_maps = 0;
@@ -411,10 +532,30 @@ bool RenderManager::run(int threads, bool batch) {
 
 			util::LogOutputProgressHandler* log_output = new util::LogOutputProgressHandler;
 			progress->addHandler(log_output);
+			if (metrics) {
+				metrics->startRender(map_config.getShortName(),
+						config::ROTATION_NAMES_SHORT[*rotation_it]);
+				progress->addHandler(metrics.get());
+			}
 
+			if (!profile_report.empty())
+				util::Profiler::reset();
+			util::MemoryAccountant::resetPeaks();
+			auto profile_start = std::chrono::steady_clock::now();
 			std::time_t time_start = std::time(nullptr);
-			renderMap(map_config.getShortName(), *rotation_it, threads, progress.get());
+			{
+				util::TraceSpan span("render_rotation");
+				renderMap(map_config.getShortName(), *rotation_it, threads, progress.get());
+			}
 			std::time_t took = std::time(nullptr) - time_start;
+			if (metrics)
+				metrics->finishRender();
+			if (!profile_report.empty())
+				writeProfileReport(map_config.getShortName(), *rotation_it, threads,
+						std::chrono::duration<double>(std::chrono::steady_clock::now()
+								- profile_start).count());
+			if (!trace_file.empty() && !util::Tracer::write(trace_file))
+				LOG(ERROR) << "Unable to write trace " << trace_file << ".";
 
 			if (progress_bar != nullptr) {
 				progress_bar->finish();
@@ -426,6 +567,7 @@ bool RenderManager::run(int threads, bool batch) {
 				<< progress_maps << "." << progress_rotations_all << "] "
 				<< "Rendering rotation " << config::ROTATION_NAMES[*rotation_it]
 				<< " took " << took << " seconds.";
+			LOG(INFO) << "Peak memory usage: " << util::MemoryAccountant::formatPeaks() << ".";
 		}
 	}
 
@@ -435,6 +577,307 @@ bool RenderManager::run(int threads, bool batch) {
 	return true;
 }
 
+namespace {
+
+/**
+ * Logs the tile counts and the estimated costs of a render.
+ */
+void logEstimate(const std::string& prefix, const RenderEstimate& estimate, int threads) {
+	LOG(INFO) << prefix << estimate.render_tiles << " render tiles and "
+			<< estimate.composite_tiles << " composite tiles ("
+			<< estimate.sampled_tiles << " sampled).";
+	LOG(INFO) << prefix << "Estimated " << util::format_eta(estimate.cpu_seconds)
+			<< " CPU time, " << util::format_eta(estimate.wall_seconds) << " with "
+			<< threads << " thread(s), " << util::formatByteSize(estimate.output_bytes)
+			<< " output, " << util::formatByteSize(estimate.memory_peak)
+			<< " peak memory usage.";
+}
+
+/**
+ * Counts the chunks the required render tiles of a tile set need.
+ */
+int countRequiredChunks(const std::vector<mc::ChunkPos>& chunks, TileSet& tile_set) {
+	const std::vector<TilePos>& required = tile_set.getRequiredRenderTiles();
+	int count = 0;
+	std::set<TilePos> chunk_tiles;
+	for (auto chunk_it = chunks.begin(); chunk_it != chunks.end(); ++chunk_it) {
+		chunk_tiles.clear();
+		tile_set.mapChunkToTiles(*chunk_it, chunk_tiles);
+		for (auto tile_it = chunk_tiles.begin(); tile_it != chunk_tiles.end(); ++tile_it)
+			if (std::binary_search(required.begin(), required.end(),
+					*tile_it - tile_set.getTileOffset())) {
+				count++;
+				break;
+			}
+	}
+	return count;
+}
+
+}
+
+bool RenderManager::estimate(int threads, int samples) {
+	// nothing is written, but the last render times of already rendered maps are needed
+	// to find the required tiles
+	dry_run = true;
+	if (fs::is_directory(config.getOutputDir()) && !web_config.readConfigJS())
+		return false;
+
+	LOG(INFO) << "Scanning worlds...";
+	auto scan_start = std::chrono::steady_clock::now();
+	if (!scanWorlds(threads))
+		return false;
+	double scan_seconds = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - scan_start).count();
+
+	RenderEstimate estimate_all;
+	int progress_maps = 0;
+	int progress_maps_all = required_maps.size();
+	for (auto map_it = required_maps.begin(); map_it != required_maps.end(); ++map_it) {
+		progress_maps++;
+		config::MapSection map_config = config.getMap(map_it->first);
+
+		LOG(INFO) << "[" << progress_maps << "/" << progress_maps_all << "] "
+			<< "Estimating map " << map_config.getShortName() << " (\""
+			<< map_config.getLongName() << "\"):";
+
+		auto required_rotations = map_it->second;
+		int progress_rotations = 0;
+		int progress_rotations_all = required_rotations.size();
+		for (auto rotation_it = required_rotations.begin();
+				rotation_it != required_rotations.end(); ++rotation_it) {
+			progress_rotations++;
+			std::string prefix = "[" + util::str(progress_maps) + "." + util::str(progress_rotations)
+				+ "/" + util::str(progress_maps) + "." + util::str(progress_rotations_all) + "] ";
+
+			LOG(INFO) << prefix << "Estimating rotation "
+				<< config::ROTATION_NAMES[*rotation_it] << "...";
+			RenderEstimate estimate = estimateMap(map_config.getShortName(), *rotation_it,
+					threads, samples);
+			logEstimate(prefix, estimate, threads);
+			estimate_all += estimate;
+		}
+	}
+
+	// scanning the worlds takes as long as now when actually rendering
+	estimate_all.wall_seconds += scan_seconds;
+	LOG(INFO) << "Scanning the worlds took " << util::format_eta(scan_seconds) << ".";
+	logEstimate("All maps: ", estimate_all, threads);
+	if (util::MemoryAccountant::getLimit() != 0)
+		LOG(INFO) << "The peak memory usage is limited to "
+			<< util::formatByteSize(util::MemoryAccountant::getLimit()) << ".";
+	return true;
+}
+
+TileSet* RenderManager::scanRequiredTiles(const std::string& map,
+		RenderRotation::Direction rotation, TileStorage& tile_storage) {
+	config::MapSection map_config = config.getMap(map);
+	TileSet* tile_set = tile_sets[map_config.getTileSet(rotation)].get();
+	if (render_behaviors.getRenderBehavior(map, rotation) == RenderBehavior::AUTO) {
+		// if incremental render, scan which tiles might have changed
+		LOG(INFO) << "Scanning required tiles...";
+		// use the incremental check method specified in the config
+		if (map_config.useImageModificationTimes()) {
+			// the empty tiles have no files, the index knows when they were rendered
+			std::unique_ptr<EmptyTileIndex> empty_tiles;
+			if (map_config.skipEmptyTiles()) {
+				empty_tiles.reset(new EmptyTileIndex(config.getOutputPath(map + "/"
+						+ config::ROTATION_NAMES_SHORT[rotation] + "/empty-tiles.json")));
+				if (!empty_tiles->read())
+					empty_tiles.reset();
+			}
+			tile_set->scanRequiredByFiletimes(tile_storage, empty_tiles.get());
+		} else
+			tile_set->scanRequiredByTimestamp(web_config.getMapLastRendered(map, rotation));
+	} else {
+		// or just set all tiles required if force-rendering
+		tile_set->resetRequired();
+	}
+	return tile_set;
+}
+
+bool RenderManager::initializeRenderContext(const std::string& map,
+		RenderRotation::Direction rotation, RenderView* render_view,
+		mc::BlockStateRegistry& block_registry, std::shared_ptr<BlockImages>& block_images,
+		RenderContext& context) {
+	config::MapSection map_config = config.getMap(map);
+	config::WorldSection world_config = config.getWorld(map_config.getWorld());
+
+	block_images.reset(render_view->createBlockImages(block_registry));
+	render_view->configureBlockImages(block_images.get(), world_config, map_config);
+
+	RenderedBlockImages* new_block_images = dynamic_cast<RenderedBlockImages*>(block_images.get());
+	if (new_block_images != nullptr) {
+		new_block_images->setCacheDir(config.getCacheDir());
+		if (!new_block_images->loadBlockImages(map_config.getBlockDir().string(), util::str(map_config.getRenderView()), rotation, map_config.getTextureSize()))
+			return false;
+	}
+
+	renderer::Biome::initializeBiomes();
+
+	context.background_color = config.getBackgroundColor();
+	context.world_config = world_config;
+	context.map_config = map_config;
+	context.render_view = render_view;
+	context.block_images = block_images.get();
+	context.tile_set = tile_sets[map_config.getTileSet(rotation)].get();
+	context.block_registry = &block_registry;
+	context.world = worlds[map_config.getWorld()][rotation];
+	context.initializeTileRenderer();
+
+	config::Color bg = context.background_color;
+	context.tile_format.reset(new TileImageFormat(map_config,
+			rgba(bg.red, bg.green, bg.blue, 255)));
+	if (context.tile_format->useGlobalPalette() && new_block_images != nullptr) {
+		context.tile_format->setPalette(TileImageFormat::createBlockPalette(
+				new_block_images->exportBlocks()));
+	}
+	return true;
+}
+
+RenderEstimate RenderManager::estimateMap(const std::string& map,
+		RenderRotation::Direction rotation, int threads, int samples) {
+	RenderEstimate estimate;
+	config::MapSection map_config = config.getMap(map);
+
+	mc::BlockStateRegistry block_registry;
+	std::shared_ptr<RenderView> render_view(createRenderView(map_config.getRenderView(), rotation, map_config.getWaterOpacity()));
+
+	fs::path output_dir = config.getOutputPath(map + "/" + config::ROTATION_NAMES_SHORT[rotation]);
+	std::shared_ptr<TileStorage> tile_storage = TileStorage::create(
+			map_config.getTileStorage(), output_dir, map_config.getImageFormatSuffix());
+	TileSet* tile_set = scanRequiredTiles(map, rotation, *tile_storage);
+	estimate.render_tiles = tile_set->getRequiredRenderTilesCount();
+	estimate.composite_tiles = tile_set->getRequiredCompositeTilesCount();
+	if (estimate.render_tiles == 0)
+		return estimate;
+
+	std::shared_ptr<BlockImages> block_images;
+	RenderContext context;
+	if (!initializeRenderContext(map, rotation, render_view.get(), block_registry,
+			block_images, context)) {
+		LOG(ERROR) << "Unable to estimate the costs of this rotation.";
+		return estimate;
+	}
+
+	// pick runs of neighboring required tiles at random positions, the render threads
+	// render neighboring tiles after each other as well, so most of the chunks a tile
+	// needs are already cached when rendering it
+	const std::vector<TilePos>& tiles = tile_set->getRequiredRenderTiles();
+	std::set<size_t> sample_tiles;
+	if ((size_t) samples >= tiles.size()) {
+		for (size_t i = 0; i < tiles.size(); i++)
+			sample_tiles.insert(i);
+	} else {
+		const size_t RUN_LENGTH = 2;
+		// the same tiles are sampled every time, so estimates are comparable
+		std::mt19937 random(rotation);
+		std::uniform_int_distribution<size_t> distribution(0, tiles.size() - 1);
+		while (sample_tiles.size() < (size_t) samples) {
+			size_t start = distribution(random);
+			for (size_t i = start; i < start + RUN_LENGTH && i < tiles.size()
+					&& sample_tiles.size() < (size_t) samples; i++)
+				sample_tiles.insert(i);
+		}
+	}
+
+	int w = context.tile_renderer->getTileWidth();
+	int h = context.tile_renderer->getTileHeight();
+	RGBAImage image, composite(w, h);
+	double render_seconds = 0, composite_seconds = 0;
+	double render_bytes = 0;
+	int composites = 0, children = 0;
+	for (auto it = sample_tiles.begin(); it != sample_tiles.end(); ++it) {
+		auto start = std::chrono::steady_clock::now();
+		context.tile_renderer->renderTile(tiles[*it] + tile_set->getTileOffset(), image);
+		// empty tiles are not written if they are skipped
+		if (!map_config.skipEmptyTiles() || !image.isTransparent()) {
+			std::vector<uint8_t> data;
+			context.tile_format->encode(image, data, true);
+			render_bytes += data.size();
+		}
+		render_seconds += std::chrono::duration<double>(
+				std::chrono::steady_clock::now() - start).count();
+
+		// compose every four sampled tiles to a composite tile like the render threads do
+		start = std::chrono::steady_clock::now();
+		image.resizeHalfInto(composite, children % 2 == 0 ? 0 : w / 2,
+				children < 2 ? 0 : h / 2, map_config.getDownsampleMode());
+		image.clear();
+		children++;
+		if (children == 4 || std::next(it) == sample_tiles.end()) {
+			std::vector<uint8_t> data;
+			context.tile_format->encode(composite, data, false);
+			composite.clear();
+			composites++;
+			children = 0;
+		}
+		composite_seconds += std::chrono::duration<double>(
+				std::chrono::steady_clock::now() - start).count();
+	}
+
+	int sampled = sample_tiles.size();
+	estimate.sampled_tiles = sampled;
+	estimate.cpu_seconds = render_seconds / sampled * estimate.render_tiles
+			+ composite_seconds / composites * estimate.composite_tiles;
+	// a composite tile shows what its children show with half the resolution, so it's
+	// about as large as an average render tile (the sampled ones are too detailed)
+	estimate.output_bytes = render_bytes / sampled
+			* (estimate.render_tiles + estimate.composite_tiles);
+	// the threads render in parallel, but not faster than the processor cores allow
+	int render_threads = estimate.render_tiles == 1 ? 1 : threads;
+	int cores = std::thread::hardware_concurrency();
+	estimate.wall_seconds = estimate.cpu_seconds
+			/ std::max(1, cores > 0 ? std::min(render_threads, cores) : render_threads);
+
+	// every render thread has its own world cache, which fills up with the chunks of the
+	// tiles it renders (at worst with all chunks the required tiles need), and it holds an
+	// image for every zoom level of the composite tiles
+	const mc::CacheStats& chunk_stats = context.world_cache->getChunkCacheStats();
+	const mc::CacheStats& region_stats = context.world_cache->getRegionCacheStats();
+	double chunk_bytes = 0, region_bytes = 0;
+	if (chunk_stats.misses > 0)
+		chunk_bytes = (double) util::MemoryAccountant::getUsage(
+				util::MemoryComponent::CHUNK_CACHE) / chunk_stats.misses;
+	if (region_stats.misses > 0)
+		region_bytes = (double) util::MemoryAccountant::getUsage(
+				util::MemoryComponent::REGION_CACHE) / region_stats.misses;
+	double chunks = std::min(CSIZE, countRequiredChunks(
+			world_chunks[map_config.getWorld()], *tile_set));
+	double regions = std::min(RSIZE, context.world->getAvailableRegionCount());
+	double thread_bytes = chunks * chunk_bytes + regions * region_bytes
+			+ (double) tile_set->getDepth() * w * h * sizeof(RGBAPixel);
+	estimate.memory_peak = thread_bytes * render_threads;
+	if (util::MemoryAccountant::getLimit() != 0)
+		estimate.memory_peak = std::min(estimate.memory_peak,
+				util::MemoryAccountant::getLimit());
+	return estimate;
+}
+
+void RenderManager::writeProfileReport(const std::string& map,
+		RenderRotation::Direction rotation, int threads, double seconds) {
+	picojson::object profile = util::Profiler::collect().toJSON();
+	profile["map"] = picojson::value(map);
+	profile["rotation"] = picojson::value(config::ROTATION_NAMES_SHORT[rotation]);
+	profile["threads"] = picojson::value((double) threads);
+	profile["seconds"] = picojson::value(seconds);
+	picojson::object memory;
+	for (size_t i = 0; i < (size_t) util::MemoryComponent::COUNT; i++)
+		memory[util::getMemoryComponentName((util::MemoryComponent) i)] = picojson::value(
+				(double) util::MemoryAccountant::getPeak((util::MemoryComponent) i));
+	memory["total"] = picojson::value((double) util::MemoryAccountant::getPeak());
+	profile["memory_peak"] = picojson::value(memory);
+	profiles.push_back(picojson::value(profile));
+
+	picojson::object report;
+	report["version"] = picojson::value(MAPCRAFTER_VERSION);
+	report["renders"] = picojson::value(profiles);
+
+	std::ofstream out(profile_report.string());
+	out << picojson::value(report).serialize(true);
+	if (!out)
+		LOG(ERROR) << "Unable to write profile report " << profile_report << ".";
+}
+
 const std::vector<std::pair<std::string, std::set<RenderRotation::Direction> > >& RenderManager::getRequiredMaps() const {
 	return required_maps;
 }
@@ -531,12 +974,37 @@ void RenderManager::initializeMap(const std::string& map) {
 		LOG(INFO) << "I will move some files around...";
 
 		// if zoom level has increased, increase zoom levels of tile sets
+		config::Color bg = config.getBackgroundColor();
+		TileImageFormat tile_format(map_config, rgba(bg.red, bg.green, bg.blue, 255));
 		auto rotations = map_config.getRotations();
 		for (auto rotation_it = rotations.begin(); rotation_it != rotations.end(); ++rotation_it) {
 			fs::path output_dir = config.getOutputPath(map + "/"
 					+ config::ROTATION_NAMES_SHORT[*rotation_it]);
-			for (int i = old_max_zoom; i < max_zoom; i++)
-				increaseMaxZoom(output_dir, map_config.getImageFormatSuffix());
+			std::shared_ptr<TileStorage> tile_storage = TileStorage::create(
+					map_config.getTileStorage(), output_dir, tile_format.getSuffix());
+			EmptyTileIndex empty_tiles(output_dir / "empty-tiles.json");
+			bool has_empty_tiles = empty_tiles.read();
+			RenderCostIndex render_costs(output_dir / "render-costs.json");
+			bool has_render_costs = render_costs.read();
+			// the pixel hashes of the moved tiles have to be moved as well, otherwise
+			// tiles would be compared with the hashes of other tiles
+			TileHashStore tile_hashes(config.getCachePath("tilehashes_" + map + "_"
+					+ config::ROTATION_NAMES_SHORT[*rotation_it] + ".nbt.gz"),
+					tile_format.getKey());
+			bool has_tile_hashes = tile_hashes.read();
+			for (int i = old_max_zoom; i < max_zoom; i++) {
+				increaseMaxZoom(*tile_storage, tile_format);
+				empty_tiles.increaseDepth();
+				render_costs.increaseDepth();
+				tile_hashes.increaseDepth();
+			}
+			tile_storage->flush();
+			if (has_empty_tiles)
+				empty_tiles.write();
+			if (has_render_costs)
+				render_costs.write();
+			if (has_tile_hashes)
+				tile_hashes.write();
 		}
 	}
 
@@ -550,67 +1018,24 @@ void RenderManager::initializeMap(const std::string& map) {
  * This method increases the max zoom of a rendered map and makes the necessary changes
  * on the tile tree.
  */
-void RenderManager::increaseMaxZoom(const fs::path& dir,
-		std::string image_format, int jpeg_quality) const {
-	// find out tile size by reading old base.png image
+void RenderManager::increaseMaxZoom(TileStorage& tile_storage,
+		const TileImageFormat& tile_format) const {
+	// find out tile size by reading old base image
 	RGBAImage old_base;
-	if (image_format == "png") {
-		old_base.readPNG((dir / "base.png").string());
-	} else {
-		old_base.readJPEG((dir / "base.jpg").string());
-	}
+	tile_storage.readTile(TilePath(), old_base, tile_format);
 	int w = old_base.getWidth();
 	int h = old_base.getHeight();
 
-	if (fs::exists(dir / "1")) {
-		// at first rename the directories 1 2 3 4 (zoom level 0) and make new directories
-		util::moveFile(dir / "1", dir / "1_");
-		fs::create_directories(dir / "1");
-		// then move the old tile trees one zoom level deeper
-		util::moveFile(dir / "1_", dir / "1/4");
-		// also move the images of the directories
-		util::moveFile(dir / (std::string("1.") + image_format),
-				dir / (std::string("1/4.") + image_format));
-	}
-
-	// do the same for the other directories
-	if (fs::exists(dir / "2")) {
-		util::moveFile(dir / "2", dir / "2_");
-		fs::create_directories(dir / "2");
-		util::moveFile(dir / "2_", dir / "2/3");
-		util::moveFile(dir / (std::string("2.") + image_format),
-				dir / (std::string("2/3.") + image_format));
-	}
-
-	if (fs::exists(dir / "3")) {
-		util::moveFile(dir / "3", dir / "3_");
-		fs::create_directories(dir / "3");
-		util::moveFile(dir / "3_", dir / "3/2");
-		util::moveFile(dir / (std::string("3.") + image_format),
-				dir / (std::string("3/2.") + image_format));
-	}
-
-	if (fs::exists(dir / "4")) {
-		util::moveFile(dir / "4", dir / "4_");
-		fs::create_directories(dir / "4");
-		util::moveFile(dir / "4_", dir / "4/1");
-		util::moveFile(dir / (std::string("4.") + image_format),
-				dir / (std::string("4/1.") + image_format));
-	}
+	// move the old tile trees one zoom level deeper (1/ -> 1/4/, 2/ -> 2/3/, ...)
+	if (!tile_storage.increaseDepth())
+		LOG(ERROR) << "Unable to move the tiles to the next zoom level.";
 
 	// now read the images, which belong to the new directories
 	RGBAImage img1, img2, img3, img4;
-	if (image_format == "png") {
-		img1.readPNG((dir / "1/4.png").string());
-		img2.readPNG((dir / "2/3.png").string());
-		img3.readPNG((dir / "3/2.png").string());
-		img4.readPNG((dir / "4/1.png").string());
-	} else {
-		img1.readJPEG((dir / "1/4.jpg").string());
-		img2.readJPEG((dir / "2/3.jpg").string());
-		img3.readJPEG((dir / "3/2.jpg").string());
-		img4.readJPEG((dir / "4/1.jpg").string());
-	}
+	tile_storage.readTile(TilePath() + 1 + 4, img1, tile_format);
+	tile_storage.readTile(TilePath() + 2 + 3, img2, tile_format);
+	tile_storage.readTile(TilePath() + 3 + 2, img3, tile_format);
+	tile_storage.readTile(TilePath() + 4 + 1, img4, tile_format);
 
 	// create images for the new directories
 	RGBAImage new1(w, h), new2(w, h), new3(w, h), new4(w, h);
@@ -627,30 +1052,20 @@ void RenderManager::increaseMaxZoom(const fs::path& dir,
 	new3.simpleAlphaBlit(old3, w/2, 0);
 	new4.simpleAlphaBlit(old4, 0, 0);
 
-	// now save the new images in the output directory
-	if (image_format == "png") {
-		new1.writePNG((dir / "1.png").string());
-		new2.writePNG((dir / "2.png").string());
-		new3.writePNG((dir / "3.png").string());
-		new4.writePNG((dir / "4.png").string());
-	} else {
-		new1.writeJPEG((dir / "1.jpg").string(), jpeg_quality);
-		new2.writeJPEG((dir / "2.jpg").string(), jpeg_quality);
-		new3.writeJPEG((dir / "3.jpg").string(), jpeg_quality);
-		new4.writeJPEG((dir / "4.jpg").string(), jpeg_quality);
-	}
+	// now save the new images
+	tile_storage.writeTile(TilePath() + 1, new1, tile_format);
+	tile_storage.writeTile(TilePath() + 2, new2, tile_format);
+	tile_storage.writeTile(TilePath() + 3, new3, tile_format);
+	tile_storage.writeTile(TilePath() + 4, new4, tile_format);
 
-	// don't forget the base.png
+	// don't forget the base image
 	RGBAImage base(2*h, 2*h);
 	base.simpleAlphaBlit(new1, 0, 0);
 	base.simpleAlphaBlit(new2, w, 0);
 	base.simpleAlphaBlit(new3, 0, h);
 	base.simpleAlphaBlit(new4, w, h);
 	base = base.resize(0, 0, InterpolationType::HALF);
-	if (image_format == "png")
-		base.writePNG((dir / "base.png").string());
-	else
-		base.writeJPEG((dir / "base.jpg").string(), jpeg_quality);
+	tile_storage.writeTile(TilePath(), base, tile_format);
 }
 
 }
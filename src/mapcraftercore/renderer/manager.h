@@ -26,9 +26,12 @@
 #include "../config/webconfig.h"
 #include "../mc/world.h"
 #include "../mc/worldcache.h"
+#include "../util/json.h"
+#include "../util/metrics.h"
 
 #include <ctime>
 #include <map>
+#include <memory>
 #include <set>
 #include <vector>
 #include <boost/filesystem.hpp>
@@ -43,6 +46,10 @@ class IProgressHandler;
 
 namespace renderer {
 
+class TileImageFormat;
+class TileStorage;
+struct RenderContext;
+
 /**
  * This are the render options from the command line.
  */
@@ -54,6 +61,46 @@ struct RenderOpts {
 	std::vector<std::string> render_skip, render_auto, render_force;
 	bool skip_all, force_all;
 	int jobs;
+
+	fs::path profile_report;
+
+	fs::path metrics_file;
+	int metrics_interval;
+
+	fs::path trace_file;
+	int trace_buffer_size;
+
+	std::string memory_limit;
+
+	bool estimate;
+	int estimate_samples;
+};
+
+/**
+ * The estimated costs of rendering a map rotation (or the sum of multiple ones).
+ */
+struct RenderEstimate {
+	RenderEstimate();
+
+	/**
+	 * Adds the costs of another render that happens after this one, the memory peak is
+	 * the maximum of both.
+	 */
+	RenderEstimate& operator+=(const RenderEstimate& other);
+
+	// count of required render/composite tiles
+	int render_tiles, composite_tiles;
+	// count of render tiles actually rendered to estimate the costs
+	int sampled_tiles;
+
+	// time the render threads need altogether, in seconds
+	double cpu_seconds;
+	// time the rendering takes with the given count of threads, in seconds
+	double wall_seconds;
+	// size of the written tile images
+	uint64_t output_bytes;
+	// peak usage of the accounted memory (see util::MemoryAccountant)
+	uint64_t memory_peak;
 };
 
 /**
@@ -123,6 +170,34 @@ public:
 	 */
 	void setRenderBehaviors(const RenderBehaviors& render_behaviors);
 
+	/**
+	 * Enables the profiler and sets the file the profile report is written to. The
+	 * report contains the timings of the render stages and the counters of every
+	 * rendered map rotation, it is updated after each map rotation.
+	 */
+	void setProfileReport(const fs::path& profile_report);
+
+	/**
+	 * Periodically writes live metrics (progress and throughput of the map rotations,
+	 * queue depths, cache hit ratios, bytes read/written, encode latencies) to a file
+	 * in the Prometheus text format while rendering.
+	 */
+	void setMetricsFile(const fs::path& metrics_file, int interval);
+
+	/**
+	 * Enables the tracer and sets the file the timeline of the threads is written to
+	 * (as Chrome trace). Only the latest spans of every thread are kept, at most as many
+	 * as the buffer size. The file is updated after each map rotation.
+	 */
+	void setTraceFile(const fs::path& trace_file, int buffer_size);
+
+	/**
+	 * Sets how much memory (in bytes) the caches and buffers of the renderer may use,
+	 * 0 means no limit. The world caches evict chunks and the render threads wait with
+	 * new work while the limit is exceeded.
+	 */
+	void setMemoryLimit(uint64_t memory_limit);
+
 	/**
 	 * Some basic initialization things. blah.
 	 *
@@ -132,12 +207,13 @@ public:
 	bool initialize();
 
 	/**
-	 * Scans the worlds and create the tile sets.
+	 * Scans the worlds and create the tile sets. All tile sets of a world are scanned at
+	 * once with the specified count of threads.
 	 *
 	 * Returns false if a fatal error occured (for example unable to read a world)
 	 * and rendering the maps won't work.
 	 */
-	bool scanWorlds();
+	bool scanWorlds(int threads = 1);
 
 	/**
 	 * Renders a map/rotation with a specified count of threads and logs the progress to
@@ -156,6 +232,19 @@ public:
 	 */
 	bool run(int threads, bool batch);
 
+	/**
+	 * Estimates how long rendering the required maps/rotations would take with a
+	 * specified count of threads, how much output it would write and how much memory it
+	 * would need, without rendering the maps. The worlds and the required
+	 * tiles are scanned like for rendering, then a few random required render tiles of
+	 * every map rotation (samples) are rendered and encoded with the real tile renderer
+	 * and the costs are extrapolated to all required tiles.
+	 *
+	 * The estimates are logged. Returns false if a fatal error occured while scanning
+	 * the worlds.
+	 */
+	bool estimate(int threads, int samples);
+
 	/**
 	 * Returns which maps with which rotations need to get rendered.
 	 */
@@ -192,16 +281,61 @@ private:
 	void initializeMap(const std::string& map);
 
 	/**
-	 * Increases the max zoom level of a map (given as directory, the one with base.png).
+	 * Increases the max zoom level of a map rotation, the tiles are read and written
+	 * with the supplied tile storage and image format.
+	 */
+	void increaseMaxZoom(TileStorage& tile_storage, const TileImageFormat& tile_format) const;
+
+	/**
+	 * Marks the tiles of a map rotation as required that need to get rendered according
+	 * to the render behavior (incremental or complete render) and returns the tile set.
+	 */
+	TileSet* scanRequiredTiles(const std::string& map, RenderRotation::Direction rotation,
+			TileStorage& tile_storage);
+
+	/**
+	 * Creates the block images (owned by the supplied pointer), the tile renderer and
+	 * the tile image format of a map rotation and sets up the render context with them.
+	 * Returns false if the block images couldn't be loaded.
+	 */
+	bool initializeRenderContext(const std::string& map, RenderRotation::Direction rotation,
+			RenderView* render_view, mc::BlockStateRegistry& block_registry,
+			std::shared_ptr<BlockImages>& block_images, RenderContext& context);
+
+	/**
+	 * Estimates the costs of rendering a map rotation by rendering some sample tiles,
+	 * see estimate.
 	 */
-	void increaseMaxZoom(const fs::path& dir, std::string image_format,
-			int jpeg_quality = 85) const;
+	RenderEstimate estimateMap(const std::string& map, RenderRotation::Direction rotation,
+			int threads, int samples);
+
+	/**
+	 * Adds the collected profile of a rendered map rotation to the profile report and
+	 * writes the report file.
+	 */
+	void writeProfileReport(const std::string& map, RenderRotation::Direction rotation,
+			int threads, double seconds);
 
 	config::MapcrafterConfig config;
 	config::WebConfig web_config;
 
 	RenderBehaviors render_behaviors;
 
+	// where the profile report is written to, profiling is disabled if empty
+	fs::path profile_report;
+	// the profiles of the rendered map rotations
+	picojson::array profiles;
+
+	// writes the live metrics, no metrics are written if not set
+	std::shared_ptr<util::MetricsFileExporter> metrics;
+
+	// where the trace is written to, tracing is disabled if empty
+	fs::path trace_file;
+
+	// whether the worlds are only scanned to estimate the render costs, then the
+	// templates, tile set indexes and chunk fingerprints are not written
+	bool dry_run;
+
 	// time when we started scanning the worlds, used as last last render time of the maps
 	std::time_t time_started_scanning;
 	// set of initialized maps, initializeMap-method must be called for each map,
@@ -210,6 +344,8 @@ private:
 
 	// maps for world- and tile set objects
 	std::map<std::string, std::array<std::shared_ptr<mc::World>, 4> > worlds;
+	// the chunks of every world (in its world crop), only collected for estimates
+	std::map<std::string, std::vector<mc::ChunkPos> > world_chunks;
 	// (world, render view, rotation) -> tile set
 	std::map<config::TileSetID, std::shared_ptr<TileSet> > tile_sets;
 
@@ -0,0 +1,170 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "rendercostindex.h"
+
+#include "../util.h"
+
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+namespace mapcrafter {
+namespace renderer {
+
+namespace {
+
+// increase this when the format of the index changes
+const int INDEX_VERSION = 1;
+
+}
+
+RenderCost::RenderCost()
+	: milliseconds(0), blocks(0), chunks_loaded(0), bytes(0) {
+}
+
+RenderCostIndex::RenderCostIndex(const fs::path& filename)
+	: filename(filename) {
+}
+
+RenderCostIndex::~RenderCostIndex() {
+}
+
+bool RenderCostIndex::read() {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	costs.clear();
+	std::ifstream in(filename.string());
+	if (!in)
+		return false;
+
+	std::stringstream ss;
+	ss << in.rdbuf();
+	std::string data = ss.str();
+
+	picojson::value value;
+	std::string json_error;
+	picojson::parse(value, data.begin(), data.end(), &json_error);
+	if (!json_error.empty() || !value.is<picojson::object>()) {
+		LOG(WARNING) << "Render cost index " << filename << " is invalid, ignoring it.";
+		return false;
+	}
+
+	try {
+		const picojson::object& object = value.get<picojson::object>();
+		if (util::json_get<double>(object, "version") != INDEX_VERSION) {
+			LOG(DEBUG) << "Render cost index " << filename << " is outdated, ignoring it.";
+			return false;
+		}
+
+		// every tile is an array [path, microseconds, blocks, chunks loaded, bytes]
+		picojson::array tiles = util::json_get<picojson::array>(object, "tiles");
+		for (auto it = tiles.begin(); it != tiles.end(); ++it) {
+			TilePath tile;
+			if (!it->is<picojson::array>() || it->get<picojson::array>().size() != 5
+					|| !it->get(0).is<std::string>()
+					|| !TilePath::byString(it->get(0).get<std::string>(), tile))
+				throw util::JSONError("Invalid tile " + it->to_str());
+			for (size_t i = 1; i < 5; i++)
+				if (!it->get(i).is<double>())
+					throw util::JSONError("Invalid tile " + it->to_str());
+
+			RenderCost cost;
+			cost.milliseconds = it->get(1).get<double>() / 1000;
+			cost.blocks = it->get(2).get<double>();
+			cost.chunks_loaded = it->get(3).get<double>();
+			cost.bytes = it->get(4).get<double>();
+			costs[tile] = cost;
+		}
+	} catch (util::JSONError& e) {
+		LOG(WARNING) << "Render cost index " << filename << " is invalid, ignoring it: "
+				<< e.what();
+		costs.clear();
+		return false;
+	}
+	return true;
+}
+
+bool RenderCostIndex::write() const {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	picojson::array tiles;
+	for (auto it = costs.begin(); it != costs.end(); ++it) {
+		picojson::array tile;
+		tile.push_back(picojson::value(it->first.toString()));
+		// whole microseconds keep the file small
+		tile.push_back(picojson::value(std::round(it->second.milliseconds * 1000)));
+		tile.push_back(picojson::value((double) it->second.blocks));
+		tile.push_back(picojson::value((double) it->second.chunks_loaded));
+		tile.push_back(picojson::value((double) it->second.bytes));
+		tiles.push_back(picojson::value(tile));
+	}
+
+	picojson::object object;
+	object["version"] = picojson::value((double) INDEX_VERSION);
+	object["tiles"] = picojson::value(tiles);
+	std::string data = picojson::value(object).serialize();
+
+	boost::system::error_code error;
+	fs::create_directories(filename.parent_path(), error);
+	if (!util::writeFileAtomic(filename, reinterpret_cast<const uint8_t*>(data.data()),
+			data.size())) {
+		LOG(ERROR) << "Unable to write render cost index " << filename << ".";
+		return false;
+	}
+	return true;
+}
+
+void RenderCostIndex::setCost(const TilePath& tile, const RenderCost& cost) {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	costs[tile] = cost;
+}
+
+bool RenderCostIndex::getCost(const TilePath& tile, RenderCost& cost) const {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	auto it = costs.find(tile);
+	if (it == costs.end())
+		return false;
+	cost = it->second;
+	return true;
+}
+
+void RenderCostIndex::increaseDepth() {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	std::map<TilePath, RenderCost> deeper_costs;
+	for (auto it = costs.begin(); it != costs.end(); ++it) {
+		// a map with a single tile doesn't have a tile tree yet
+		if (it->first.getDepth() == 0)
+			continue;
+		// the old tile trees are moved to 1/4, 2/3, 3/2 and 4/1
+		TilePath deeper;
+		deeper += it->first.getNode(1);
+		deeper += 5 - it->first.getNode(1);
+		for (int level = 2; level <= it->first.getDepth(); level++)
+			deeper += it->first.getNode(level);
+		deeper_costs[deeper] = it->second;
+	}
+	costs.swap(deeper_costs);
+}
+
+int RenderCostIndex::getTileCount() const {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	return costs.size();
+}
+
+}
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RENDERCOSTINDEX_H_
+#define RENDERCOSTINDEX_H_
+
+#include "tileset.h"
+#include "../compat/thread.h"
+
+#include <map>
+#include <boost/filesystem.hpp>
+
+namespace fs = boost::filesystem;
+
+namespace mapcrafter {
+namespace renderer {
+
+/**
+ * What it cost to render a render tile.
+ */
+struct RenderCost {
+	RenderCost();
+
+	// wall time to render, encode and write the tile
+	double milliseconds;
+	// count of block images blitted onto the tile
+	int blocks;
+	// count of chunks which were not in the chunk cache and had to be loaded
+	int chunks_loaded;
+	// size of the written tile image, 0 if it was not written (empty or unchanged)
+	int bytes;
+};
+
+/**
+ * Remembers the render costs of the render tiles of a map rotation, so the web
+ * interface can show which parts of the map take the most time to render.
+ *
+ * The costs are stored as JSON file (render-costs.json) in the output directory of the
+ * map rotation. Incremental renders only update the costs of the rendered tiles.
+ */
+class RenderCostIndex {
+public:
+	RenderCostIndex(const fs::path& filename);
+	~RenderCostIndex();
+
+	/**
+	 * Reads the index file. Returns false if it does not exist or is invalid, the
+	 * index is empty then.
+	 */
+	bool read();
+
+	/**
+	 * Writes the index file.
+	 */
+	bool write() const;
+
+	/**
+	 * Sets the render cost of a render tile.
+	 */
+	void setCost(const TilePath& tile, const RenderCost& cost);
+
+	/**
+	 * Returns the render cost of a render tile, false if it is unknown.
+	 */
+	bool getCost(const TilePath& tile, RenderCost& cost) const;
+
+	/**
+	 * Moves the tiles one zoom level deeper (see TileStorage::increaseDepth).
+	 */
+	void increaseDepth();
+
+	/**
+	 * Returns the count of tiles with known render costs.
+	 */
+	int getTileCount() const;
+
+private:
+	fs::path filename;
+
+	mutable thread_ns::mutex mutex;
+	std::map<TilePath, RenderCost> costs;
+};
+
+}
+}
+
+#endif /* RENDERCOSTINDEX_H_ */
@@ -0,0 +1,180 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tilehashstore.h"
+
+#include "../mc/nbt.h"
+#include "../util.h"
+
+#include <algorithm>
+
+namespace mapcrafter {
+namespace renderer {
+
+namespace {
+
+// increase this when the format of the store or the image hash changes
+const int STORE_VERSION = 1;
+
+bool compareTiles(const std::pair<TilePath, uint64_t>& tile1,
+		const std::pair<TilePath, uint64_t>& tile2) {
+	return tile1.first < tile2.first;
+}
+
+}
+
+TileHashStore::TileHashStore(const fs::path& filename, const std::string& key)
+	: filename(filename), key(key), unchanged(0) {
+}
+
+TileHashStore::~TileHashStore() {
+}
+
+bool TileHashStore::read() {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	hashes.clear();
+	new_hashes.clear();
+	if (!fs::exists(filename))
+		return false;
+
+	try {
+		mc::nbt::NBTFile nbt_file;
+		nbt_file.readNBT(filename.string().c_str(), mc::nbt::Compression::GZIP);
+
+		if (nbt_file.findTag<mc::nbt::TagInt>("version").payload != STORE_VERSION
+				|| nbt_file.findTag<mc::nbt::TagString>("key").payload != key) {
+			LOG(DEBUG) << "Tile hash store " << filename << " is outdated, ignoring it.";
+			return false;
+		}
+
+		// tiles are stored as quadtree keys and depths with their hashes
+		const std::vector<int64_t>& keys = nbt_file.findTag<mc::nbt::TagLongArray>(
+				"keys").payload;
+		const std::vector<int8_t>& depths = nbt_file.findTag<mc::nbt::TagByteArray>(
+				"depths").payload;
+		const std::vector<int64_t>& tile_hashes = nbt_file.findTag<mc::nbt::TagLongArray>(
+				"hashes").payload;
+		if (keys.size() != depths.size() || keys.size() != tile_hashes.size())
+			throw mc::nbt::NBTError("Invalid tile hash store");
+
+		hashes.reserve(keys.size());
+		for (size_t i = 0; i < keys.size(); i++)
+			hashes.push_back(std::make_pair(TilePath::byKey(keys[i], depths[i]), tile_hashes[i]));
+		std::sort(hashes.begin(), hashes.end(), compareTiles);
+	} catch (mc::nbt::NBTError& e) {
+		LOG(WARNING) << "Unable to read tile hash store " << filename << ": " << e.what();
+		hashes.clear();
+		return false;
+	}
+	return true;
+}
+
+bool TileHashStore::write() {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	if (!new_hashes.empty()) {
+		std::sort(new_hashes.begin(), new_hashes.end(), compareTiles);
+		size_t old_size = hashes.size();
+		hashes.insert(hashes.end(), new_hashes.begin(), new_hashes.end());
+		std::inplace_merge(hashes.begin(), hashes.begin() + old_size, hashes.end(),
+				compareTiles);
+		new_hashes.clear();
+	}
+
+	std::vector<int64_t> keys, tile_hashes;
+	std::vector<int8_t> depths;
+	keys.reserve(hashes.size());
+	depths.reserve(hashes.size());
+	tile_hashes.reserve(hashes.size());
+	for (auto it = hashes.begin(); it != hashes.end(); ++it) {
+		keys.push_back(it->first.getKey());
+		depths.push_back(it->first.getDepth());
+		tile_hashes.push_back(it->second);
+	}
+
+	mc::nbt::NBTFile nbt_file;
+	nbt_file.addTag("key", mc::nbt::TagString(key));
+	nbt_file.addTag("version", mc::nbt::TagInt(STORE_VERSION));
+	nbt_file.addTag("keys", mc::nbt::TagLongArray(keys));
+	nbt_file.addTag("depths", mc::nbt::TagByteArray(depths));
+	nbt_file.addTag("hashes", mc::nbt::TagLongArray(tile_hashes));
+
+	try {
+		if (!fs::exists(filename.parent_path()))
+			fs::create_directories(filename.parent_path());
+		nbt_file.writeNBT(filename.string().c_str(), mc::nbt::Compression::GZIP);
+	} catch (fs::filesystem_error& e) {
+		LOG(WARNING) << "Unable to write tile hash store " << filename << ": " << e.what();
+		return false;
+	} catch (mc::nbt::NBTError& e) {
+		LOG(WARNING) << "Unable to write tile hash store " << filename << ": " << e.what();
+		return false;
+	}
+	return true;
+}
+
+bool TileHashStore::update(const TilePath& tile, uint64_t hash) {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	auto it = std::lower_bound(hashes.begin(), hashes.end(),
+			std::make_pair(tile, uint64_t(0)), compareTiles);
+	if (it == hashes.end() || it->first != tile) {
+		new_hashes.push_back(std::make_pair(tile, hash));
+		return true;
+	}
+	if (it->second == hash) {
+		unchanged++;
+		return false;
+	}
+	it->second = hash;
+	return true;
+}
+
+void TileHashStore::increaseDepth() {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	hashes.insert(hashes.end(), new_hashes.begin(), new_hashes.end());
+	new_hashes.clear();
+
+	std::vector<std::pair<TilePath, uint64_t> > deeper_hashes;
+	deeper_hashes.reserve(hashes.size());
+	for (auto it = hashes.begin(); it != hashes.end(); ++it) {
+		if (it->first.getDepth() == 0)
+			continue;
+		// the old tile trees are moved to 1/4, 2/3, 3/2 and 4/1
+		TilePath deeper;
+		deeper += it->first.getNode(1);
+		deeper += 5 - it->first.getNode(1);
+		for (int level = 2; level <= it->first.getDepth(); level++)
+			deeper += it->first.getNode(level);
+		deeper_hashes.push_back(std::make_pair(deeper, it->second));
+	}
+	std::sort(deeper_hashes.begin(), deeper_hashes.end(), compareTiles);
+	hashes.swap(deeper_hashes);
+}
+
+int TileHashStore::getTileCount() const {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	return hashes.size() + new_hashes.size();
+}
+
+int TileHashStore::getUnchangedCount() const {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	return unchanged;
+}
+
+}
+}
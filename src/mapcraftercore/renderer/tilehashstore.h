@@ -0,0 +1,105 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TILEHASHSTORE_H_
+#define TILEHASHSTORE_H_
+
+#include "tileset.h"
+#include "../compat/thread.h"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/filesystem.hpp>
+
+namespace fs = boost::filesystem;
+
+namespace mapcrafter {
+namespace renderer {
+
+/**
+ * Persistent store of the pixel hashes of the tiles of a map rotation, stored in the
+ * cache directory.
+ *
+ * Incremental rendering re-renders every tile with changed chunks, but often the
+ * pixels of the tile are still the same (for example when only entities or other chunk
+ * metadata changed). The tile renderer compares the hash of a rendered tile with the
+ * hash of the last written image and doesn't encode and write unchanged tiles again.
+ *
+ * The store belongs to a specific output format (image format and its settings), this
+ * is identified by a key. A store file with a different key is ignored.
+ *
+ * Checking and updating hashes is thread-safe.
+ */
+class TileHashStore {
+public:
+	TileHashStore(const fs::path& filename, const std::string& key);
+	~TileHashStore();
+
+	/**
+	 * Reads the store file. Returns false if the file does not exist or if it was
+	 * written for a different output format, the store is empty then.
+	 */
+	bool read();
+
+	/**
+	 * Writes the store file. Returns false if the file could not be written.
+	 */
+	bool write();
+
+	/**
+	 * Sets the new hash of a tile. Returns true if the hash is different from the one
+	 * the tile had before (or if the tile is not known yet), false if it is unchanged.
+	 */
+	bool update(const TilePath& tile, uint64_t hash);
+
+	/**
+	 * Moves the hashes of the tiles one zoom level deeper, like the tiles are moved
+	 * when the max zoom level of a map increases (1/ -> 1/4/, 2/ -> 2/3/, ...). The hash
+	 * of the base tile is dropped, it is composed again.
+	 */
+	void increaseDepth();
+
+	/**
+	 * Returns the count of tiles with known hashes.
+	 */
+	int getTileCount() const;
+
+	/**
+	 * Returns the count of tiles whose hash was unchanged when updating it.
+	 */
+	int getUnchangedCount() const;
+
+private:
+	fs::path filename;
+	std::string key;
+
+	// hashes of the tiles sorted by tile path,
+	// and hashes of new tiles which are merged into them when writing the store
+	std::vector<std::pair<TilePath, uint64_t> > hashes, new_hashes;
+	int unchanged;
+
+	mutable thread_ns::mutex mutex;
+};
+
+}
+}
+
+#endif /* TILEHASHSTORE_H_ */
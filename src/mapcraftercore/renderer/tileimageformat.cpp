@@ -0,0 +1,128 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "tileimageformat.h"
+
+#include "image/quantization.h"
+#include "../util.h"
+
+namespace mapcrafter {
+namespace renderer {
+
+TileImageFormat::TileImageFormat(const config::MapSection& map_config,
+		RGBAPixel background)
+	: format(map_config.getImageFormat()), background(background),
+	  png_indexed(map_config.isPNGIndexed()),
+	  png_global_palette(map_config.usePNGGlobalPalette()),
+	  png_options(map_config.getPNGCompressionLevel(), map_config.getPNGFilter()),
+	  png_render_tile_options(png_options),
+	  jpeg_options(map_config.getJPEGQuality(), map_config.getJPEGSubsampling(),
+			  map_config.useJPEGFastDCT()) {
+	if (map_config.usePNGFastRenderTiles())
+		png_render_tile_options = PNGWriteOptions::fast();
+}
+
+TileImageFormat::~TileImageFormat() {
+}
+
+config::ImageFormat TileImageFormat::getFormat() const {
+	return format;
+}
+
+std::string TileImageFormat::getSuffix() const {
+	if (format == config::ImageFormat::PNG)
+		return "png";
+	return "jpg";
+}
+
+std::string TileImageFormat::getKey() const {
+	std::string key = getSuffix();
+	if (format == config::ImageFormat::PNG && png_indexed)
+		key += png_global_palette ? "_indexed_global" : "_indexed";
+	else if (format == config::ImageFormat::JPEG)
+		key += "_q" + util::str(jpeg_options.quality) + "_" + util::str(jpeg_options.subsampling)
+				+ (jpeg_options.fast_dct ? "_fast" : "") + "_" + util::str(background);
+	return key;
+}
+
+bool TileImageFormat::useGlobalPalette() const {
+	return format == config::ImageFormat::PNG && png_indexed && png_global_palette;
+}
+
+void TileImageFormat::setPalette(std::shared_ptr<OctreePalette> palette) {
+	png_palette = palette;
+}
+
+std::shared_ptr<OctreePalette> TileImageFormat::createBlockPalette(const RGBAImage& blocks) {
+	// the lighting factors (of 255) the block colors are shaded with
+	const uint32_t factors[] = {255, 192, 128, 64};
+
+	// collect the visible block pixels, fully transparent pixels get an own color
+	std::vector<RGBAPixel> pixels;
+	pixels.reserve(blocks.data.size() * 4);
+	for (size_t i = 0; i < sizeof(factors) / sizeof(factors[0]); i++) {
+		for (auto it = blocks.data.begin(); it != blocks.data.end(); ++it)
+			if (rgba_alpha(*it) != 0)
+				pixels.push_back(rgba_multiply_scalar(*it, factors[i]));
+	}
+
+	std::vector<RGBAPixel> colors;
+	if (!pixels.empty()) {
+		RGBAImage sample(pixels.size(), 1);
+		sample.data = pixels;
+		octreeColorQuantize(sample, 255, colors);
+	}
+	colors.push_back(rgba(0, 0, 0, 0));
+	return std::make_shared<OctreePalette>(colors);
+}
+
+bool TileImageFormat::read(const std::string& filename, RGBAImage& image) const {
+	std::vector<uint8_t> data;
+	return util::readFile(filename, data) && decode(data.data(), data.size(), image);
+}
+
+bool TileImageFormat::write(const std::string& filename, const RGBAImage& image,
+		bool render_tile) const {
+	std::vector<uint8_t> data;
+	return encode(image, data, render_tile)
+			&& util::writeFileAtomic(filename, data.data(), data.size());
+}
+
+bool TileImageFormat::decode(const uint8_t* data, size_t size, RGBAImage& image) const {
+	if (format == config::ImageFormat::PNG)
+		return image.decodePNG(data, size);
+	return image.decodeJPEG(data, size);
+}
+
+bool TileImageFormat::encode(const RGBAImage& image, std::vector<uint8_t>& data,
+		bool render_tile) const {
+	if (format == config::ImageFormat::PNG) {
+		const PNGWriteOptions& options = render_tile ? png_render_tile_options : png_options;
+		if (png_indexed && png_palette)
+			return image.encodeIndexedPNG(data, *png_palette, true, options);
+		if (png_indexed)
+			return image.encodeIndexedPNG(data, 8, true, options);
+		return image.encodePNG(data, options);
+	}
+	return image.encodeJPEG(data, jpeg_options, background);
+}
+
+}
+}
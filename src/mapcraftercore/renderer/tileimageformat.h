@@ -0,0 +1,108 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef TILEIMAGEFORMAT_H_
+#define TILEIMAGEFORMAT_H_
+
+#include "image.h"
+#include "../config/configsections/map.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace mapcrafter {
+namespace renderer {
+
+class OctreePalette;
+
+/**
+ * Reads and writes the tile images of a map with the image format (and the settings of
+ * the image format like quality etc.) configured for the map.
+ */
+class TileImageFormat {
+public:
+	/**
+	 * The background color is used for image formats without transparency (JPEG).
+	 */
+	TileImageFormat(const config::MapSection& map_config,
+			RGBAPixel background = rgba(255, 255, 255, 255));
+	~TileImageFormat();
+
+	config::ImageFormat getFormat() const;
+
+	/**
+	 * Returns the file extension of the tile images (without dot).
+	 */
+	std::string getSuffix() const;
+
+	/**
+	 * Returns a string identifying the image format and all its settings. Written tiles
+	 * look only the same if they were written with the same key.
+	 */
+	std::string getKey() const;
+
+	/**
+	 * Whether indexed PNGs should use one palette for all tiles of the map (option
+	 * png_global_palette). The palette needs to be created from the block images and
+	 * set with setPalette then, otherwise every tile gets its own palette.
+	 */
+	bool useGlobalPalette() const;
+	void setPalette(std::shared_ptr<OctreePalette> palette);
+
+	/**
+	 * Creates a palette (256 colors) for the tiles of a map from the images of all blocks.
+	 * Also darker variants of the block colors are added since the blocks are shaded
+	 * by the lighting of the render modes.
+	 */
+	static std::shared_ptr<OctreePalette> createBlockPalette(const RGBAImage& blocks);
+
+	bool read(const std::string& filename, RGBAImage& image) const;
+
+	/**
+	 * Writes a tile image. Render tiles (the tiles of the highest zoom level) can be
+	 * written with faster PNG settings than the composite tiles, see the option
+	 * png_fast_render_tiles.
+	 */
+	bool write(const std::string& filename, const RGBAImage& image,
+			bool render_tile = false) const;
+
+	/**
+	 * Like read/write, but with the image file in memory (for tile storages which
+	 * don't store the tiles as single files).
+	 */
+	bool decode(const uint8_t* data, size_t size, RGBAImage& image) const;
+	bool encode(const RGBAImage& image, std::vector<uint8_t>& data,
+			bool render_tile = false) const;
+
+private:
+	config::ImageFormat format;
+	RGBAPixel background;
+
+	bool png_indexed, png_global_palette;
+	std::shared_ptr<OctreePalette> png_palette;
+	PNGWriteOptions png_options, png_render_tile_options;
+	JPEGWriteOptions jpeg_options;
+};
+
+}
+}
+
+#endif /* TILEIMAGEFORMAT_H_ */
@@ -48,7 +48,7 @@ TileRenderer::TileRenderer(const RenderView* render_view, mc::BlockStateRegistry
 				block_registry.getBlockID(
 					mc::BlockState::parse("minecraft:water_mask", "level=2" )))),
 		tile_image(waterlog_full_image.image(0).width, waterlog_full_image.image(0).height),
-		waterLogTinted(tile_image.image.width, tile_image.image.height) {
+		waterLogTinted(tile_image.image.width, tile_image.image.height), blocks_drawn(0) {
 	assert(block_images);
 	render_mode->initialize(render_view, images, world, &current_chunk);
 	// Pre-allocate rendering buffers
@@ -115,14 +115,23 @@ void TileRenderer::renderTile(const TilePos& tile_pos, RGBAImage& tile) {
 	tile.setSize(getTileWidth(), getTileHeight());
 
 	boost::container::vector<TileImage> tile_images;
-	renderTopBlocks(tile_pos, tile_images);
+	{
+		util::ProfileTimer timer(util::ProfileStage::BLOCK_TRAVERSAL);
+		renderTopBlocks(tile_pos, tile_images);
+	}
 
+	util::ProfileTimer timer(util::ProfileStage::BLIT);
 	// Sort them in order depending of the rotation
 	boost::range::sort(tile_images, getTileComparator());
 
 	for (auto it = tile_images.begin(); it != tile_images.end(); ++it) {
 		tile.alphaBlit(it->image, it->x, it->y);
 	}
+	blocks_drawn = tile_images.size();
+}
+
+int TileRenderer::getBlocksDrawn() const {
+	return blocks_drawn;
 }
 
 int TileRenderer::getTileWidth() const {
@@ -289,7 +298,10 @@ void TileRenderer::renderBlocks(int x, int y, mc::BlockPos top, const mc::BlockD
 			}
 
 			// let the render mode do their magic with the block image
-			render_mode->draw(tile_image.image, *block_image, tile_image.pos, id, render_view->getRotation());
+			{
+				util::ProfileTimer timer(util::ProfileStage::LIGHTING);
+				render_mode->draw(tile_image.image, *block_image, tile_image.pos, id, render_view->getRotation());
+			}
 
 		} else {
 			// Clear out the tile from previous rendering
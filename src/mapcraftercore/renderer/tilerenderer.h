@@ -70,6 +70,11 @@ public:
 
 	virtual void renderTile(const TilePos& tile_pos, RGBAImage& tile);
 
+	/**
+	 * Returns the count of block images blitted onto the last rendered tile.
+	 */
+	int getBlocksDrawn() const;
+
 	virtual int getTileSize() const = 0;
 	virtual int getTileWidth() const;
 	virtual int getTileHeight() const;
@@ -102,6 +107,9 @@ protected:
 	const BlockImage& waterlog_shore_image;
 	TileImage tile_image;
 	RGBAImage waterLogTinted;
+
+	// count of block images blitted onto the last rendered tile
+	int blocks_drawn;
 };
 
 }
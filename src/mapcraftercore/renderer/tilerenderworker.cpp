@@ -20,11 +20,16 @@
 #include "tilerenderworker.h"
 
 #include "blockimages.h"
+#include "emptytileindex.h"
 #include "image.h"
 #include "rendermode.h"
+#include "rendercostindex.h"
 #include "renderview.h"
+#include "tilehashstore.h"
+#include "tileimageformat.h"
 #include "tilerenderer.h"
 #include "tileset.h"
+#include "tilestorage.h"
 #include "../mc/worldcache.h"
 #include "../mc/blockstate.h"
 #include "../util.h"
@@ -41,7 +46,7 @@ void RenderContext::initializeTileRenderer() {
 }
 
 TileRenderWorker::TileRenderWorker()
-	: progress(nullptr) {
+	: progress(nullptr), region_hits(0), region_misses(0), chunk_hits(0), chunk_misses(0) {
 }
 
 TileRenderWorker::~TileRenderWorker() {
@@ -49,6 +54,22 @@ TileRenderWorker::~TileRenderWorker() {
 
 void TileRenderWorker::setRenderContext(const RenderContext& context) {
 	render_context = context;
+	region_hits = region_misses = chunk_hits = chunk_misses = 0;
+	if (render_context.world_cache) {
+		region_hits = render_context.world_cache->getRegionCacheStats().hits;
+		region_misses = render_context.world_cache->getRegionCacheStats().misses;
+		chunk_hits = render_context.world_cache->getChunkCacheStats().hits;
+		chunk_misses = render_context.world_cache->getChunkCacheStats().misses;
+	}
+	if (!render_context.tile_format) {
+		config::Color bg = context.background_color;
+		render_context.tile_format.reset(new TileImageFormat(context.map_config,
+				rgba(bg.red, bg.green, bg.blue, 255)));
+	}
+	if (!render_context.tile_storage) {
+		render_context.tile_storage = TileStorage::create(context.map_config.getTileStorage(),
+				context.output_dir, render_context.tile_format->getSuffix());
+	}
 }
 
 void TileRenderWorker::setRenderWork(const RenderWork& work) {
@@ -61,46 +82,82 @@ const RenderWorkResult& TileRenderWorker::getRenderWorkResult() const {
 	return render_work_result;
 }
 
-void TileRenderWorker::setProgressHandler(util::IProgressHandler* progress) {
+void TileRenderWorker::setProgressCounter(util::ProgressCounter* progress) {
 	this->progress = progress;
 }
 
-void TileRenderWorker::saveTile(const TilePath& tile, const RGBAImage& image) {
-	bool png = render_context.map_config.getImageFormat() == config::ImageFormat::PNG;
-	bool png_indexed = render_context.map_config.isPNGIndexed();
-	std::string suffix = std::string(".") + render_context.map_config.getImageFormatSuffix();
-	std::string filename = tile.toString() + suffix;
-	if (tile.getDepth() == 0)
-		filename = std::string("base") + suffix;
-	fs::path file = render_context.output_dir / filename;
-	if (!fs::exists(file.branch_path()))
-		fs::create_directories(file.branch_path());
-
-	if ((png && !png_indexed) && !image.writePNG(file.string()))
-		LOG(WARNING) << "Unable to write '" << file.string() << "'.";
-
-	if ((png && png_indexed) && !image.writeIndexedPNG(file.string()))
-		LOG(WARNING) << "Unable to write '" << file.string() << "'.";
-
-	config::Color bg = render_context.background_color;
-	if (!png && !image.writeJPEG(file.string(),
-			render_context.map_config.getJPEGQuality(), rgba(bg.red, bg.green, bg.blue, 255)))
-		LOG(WARNING) << "Unable to write '" << file.string() << "'.";
+bool TileRenderWorker::updateTileHash(const TilePath& tile, const RGBAImage& image) {
+	if (!render_context.tile_hashes)
+		return true;
+	if (render_context.tile_hashes->update(tile, image.hash()))
+		return true;
+	// the unchanged tile is not written, but its time has to be updated, otherwise it
+	// would be older than the chunks again and be rendered in every incremental run;
+	// it needs to be written anyway if the file got lost somehow
+	return !render_context.tile_storage->touchTile(tile);
+}
+
+bool TileRenderWorker::markTileEmpty(const TilePath& tile) {
+	util::Profiler::count(util::ProfileCounter::TILES_EMPTY);
+	if (render_context.empty_tiles->setEmpty(tile, true))
+		return false;
+	if (!render_context.tile_storage->removeTile(tile))
+		LOG(WARNING) << "Unable to remove empty tile '" << tile.toString() << "'.";
+	return true;
+}
+
+void TileRenderWorker::updateCacheMetrics() {
+	const mc::CacheStats& region_stats = render_context.world_cache->getRegionCacheStats();
+	const mc::CacheStats& chunk_stats = render_context.world_cache->getChunkCacheStats();
+	util::Metrics::add(util::MetricCounter::REGION_CACHE_HITS, region_stats.hits - region_hits);
+	util::Metrics::add(util::MetricCounter::REGION_CACHE_MISSES, region_stats.misses - region_misses);
+	util::Metrics::add(util::MetricCounter::CHUNK_CACHE_HITS, chunk_stats.hits - chunk_hits);
+	util::Metrics::add(util::MetricCounter::CHUNK_CACHE_MISSES, chunk_stats.misses - chunk_misses);
+	region_hits = region_stats.hits;
+	region_misses = region_stats.misses;
+	chunk_hits = chunk_stats.hits;
+	chunk_misses = chunk_stats.misses;
 }
 
-void TileRenderWorker::renderRecursive(const TilePath& tile, RGBAImage& image) {
+void TileRenderWorker::recordRenderCost(const TilePath& tile,
+		std::chrono::steady_clock::time_point start, int chunk_misses_before, size_t bytes) {
+	if (!render_context.render_costs)
+		return;
+	RenderCost cost;
+	cost.milliseconds = std::chrono::duration<double, std::milli>(
+			std::chrono::steady_clock::now() - start).count();
+	cost.blocks = render_context.tile_renderer->getBlocksDrawn();
+	cost.chunks_loaded = chunk_misses - chunk_misses_before;
+	cost.bytes = bytes;
+	render_context.render_costs->setCost(tile, cost);
+}
+
+size_t TileRenderWorker::saveTile(const TilePath& tile, const RGBAImage& image) {
+	bool render_tile = tile.getDepth() == render_context.tile_set->getDepth();
+	util::Profiler::count(util::ProfileCounter::TILES_WRITTEN);
+	size_t size = 0;
+	if (!render_context.tile_storage->writeTile(tile, image, *render_context.tile_format,
+			render_tile, &size))
+		LOG(WARNING) << "Unable to write tile '" << tile.toString() << "'.";
+	return size;
+}
+
+bool TileRenderWorker::renderRecursive(const TilePath& tile, RGBAImage& image) {
 	// if this is tile is not required or we should skip it, try to load it from file
-	if (!render_context.tile_set->isTileRequired(tile)
-			|| render_work.tiles_skip.count(tile)) {
-		bool png = render_context.map_config.getImageFormat() == config::ImageFormat::PNG;
-		fs::path file = render_context.output_dir
-				/ (tile.toString() + "." + render_context.map_config.getImageFormatSuffix());
-		if ((png && image.readPNG(file.string()))
-				|| (!png && image.readJPEG(file.string()))) {
-			if (render_work.tiles_skip.count(tile) && progress != nullptr)
-				progress->setValue(progress->getValue()
-						+ render_context.tile_set->getContainingRenderTiles(tile));
-			return;
+	bool skip = render_work.tiles_skip.count(tile);
+	if (!render_context.tile_set->isTileRequired(tile) || skip) {
+		// empty tiles are not stored, we know what they look like anyway
+		if (render_context.empty_tiles && render_context.empty_tiles->isEmpty(tile)) {
+			image.setSize(render_context.tile_renderer->getTileWidth(),
+					render_context.tile_renderer->getTileHeight());
+			image.clear();
+			return skip;
+		}
+
+		if (render_context.tile_storage->readTile(tile, image, *render_context.tile_format)) {
+			// tiles to skip were rendered by another worker,
+			// we don't know whether they changed
+			return skip;
 		}
 
 		LOG(WARNING) << "Unable to read tile '" << tile.toString()
@@ -109,9 +166,18 @@ void TileRenderWorker::renderRecursive(const TilePath& tile, RGBAImage& image) {
 
 	if (tile.getDepth() == render_context.tile_set->getDepth()) {
 		// this tile is a render tile, render it
-		render_context.tile_renderer->renderTile(tile.getTilePos()
-				+ render_context.tile_set->getTileOffset(), image);
+		// the chunks of the previous tiles may be evicted now if there is too much memory used
+		render_context.world_cache->releaseEntries();
+		auto start = std::chrono::steady_clock::now();
+		int chunk_misses_before = chunk_misses;
+		{
+			util::TraceSpan span("render_tile");
+			render_context.tile_renderer->renderTile(tile.getTilePos()
+					+ render_context.tile_set->getTileOffset(), image);
+		}
 		render_work_result.tiles_rendered++;
+		util::Profiler::count(util::ProfileCounter::RENDER_TILES);
+		updateCacheMetrics();
 
 		/*
 		// draws a border on the tile
@@ -132,12 +198,29 @@ void TileRenderWorker::renderRecursive(const TilePath& tile, RGBAImage& image) {
 		}
 		*/
 
-		// save it
-		saveTile(tile, image);
+		// empty tiles are only recorded in the empty tile index
+		if (render_context.empty_tiles) {
+			if (image.isTransparent()) {
+				bool changed = markTileEmpty(tile);
+				recordRenderCost(tile, start, chunk_misses_before, 0);
+				if (progress != nullptr)
+					progress->add(1);
+				return changed;
+			}
+			render_context.empty_tiles->setEmpty(tile, false);
+		}
+
+		// save it, but only if the image changed since the last time it was written
+		bool changed = updateTileHash(tile, image);
+		size_t bytes = 0;
+		if (changed)
+			bytes = saveTile(tile, image);
+		recordRenderCost(tile, start, chunk_misses_before, bytes);
 
 		// update progress
 		if (progress != nullptr)
-			progress->setValue(progress->getValue() + 1);
+			progress->add(1);
+		return changed;
 	} else {
 		// this tile is a composite tile, we need to compose it from its children
 		// just check, if children 1, 2, 3, 4 exists, render it, resize it to the half size
@@ -147,32 +230,31 @@ void TileRenderWorker::renderRecursive(const TilePath& tile, RGBAImage& image) {
 		int w = render_context.tile_renderer->getTileWidth();
 		int h = render_context.tile_renderer->getTileHeight();
 		image.setSize(w, h);
+		util::Profiler::count(util::ProfileCounter::COMPOSITE_TILES);
 
+		DownsampleMode downsample_mode = render_context.map_config.getDownsampleMode();
+		// every level of the recursion holds an image for the children
+		util::MemoryReservation memory(util::MemoryComponent::COMPOSITE_TILES,
+				(int64_t) w * h * sizeof(RGBAPixel));
 		RGBAImage other;
-		RGBAImage resized;
-		if (render_context.tile_set->hasTile(tile + 1)) {
-			renderRecursive(tile + 1, other);
-			other.resize(resized, 0, 0, InterpolationType::HALF);
-			image.simpleAlphaBlit(resized, 0, 0);
-			other.clear();
-		}
-		if (render_context.tile_set->hasTile(tile + 2)) {
-			renderRecursive(tile + 2, other);
-			other.resize(resized, 0, 0, InterpolationType::HALF);
-			image.simpleAlphaBlit(resized, w / 2, 0);
-			other.clear();
-		}
-		if (render_context.tile_set->hasTile(tile + 3)) {
-			renderRecursive(tile + 3, other);
-			other.resize(resized, 0, 0, InterpolationType::HALF);
-			image.simpleAlphaBlit(resized, 0, h / 2);
+		bool children_changed = false;
+		// whether one of the children is not empty, empty children don't need to be blitted
+		bool children_visible = false;
+		for (int node = 1; node <= 4; node++) {
+			TilePath child = tile + node;
+			if (!render_context.tile_set->hasTile(child))
+				continue;
+			children_changed = renderRecursive(child, other) || children_changed;
+			if (!render_context.empty_tiles || !render_context.empty_tiles->isEmpty(child)) {
+				children_visible = true;
+				// downscale the child directly into its quarter of the tile
+				util::ProfileTimer timer(util::ProfileStage::DOWNSAMPLE);
+				util::TraceSpan span("downsample");
+				other.resizeHalfInto(image, node % 2 == 1 ? 0 : w / 2, node <= 2 ? 0 : h / 2,
+						downsample_mode);
+			}
 			other.clear();
 		}
-		if (render_context.tile_set->hasTile(tile + 4)) {
-			renderRecursive(tile + 4, other);
-			other.resize(resized, 0, 0, InterpolationType::HALF);
-			image.simpleAlphaBlit(resized, w / 2, h / 2);
-		}
 
 		/*
 		// draws a border on the tile
@@ -185,21 +267,31 @@ void TileRenderWorker::renderRecursive(const TilePath& tile, RGBAImage& image) {
 			}
 		*/
 
-		// then save the tile
-		saveTile(tile, image);
+		// a composite tile is empty if all its children are empty
+		if (render_context.empty_tiles) {
+			if (!children_visible)
+				return markTileEmpty(tile);
+			render_context.empty_tiles->setEmpty(tile, false);
+		}
+
+		// then save the tile, a composite tile can only change if one of its children
+		// changed, so we don't have to compare the hashes of unchanged composite tiles
+		bool changed;
+		if (children_changed || !render_context.tile_hashes)
+			changed = updateTileHash(tile, image);
+		else
+			changed = !render_context.tile_storage->hasTile(tile);
+		if (changed)
+			saveTile(tile, image);
+		return changed;
 	}
 }
 
 void TileRenderWorker::operator()() {
-	int work = 0;
-	for (auto it = render_work.tiles.begin(); it != render_work.tiles.end(); ++it)
-		work += render_context.tile_set->getContainingRenderTiles(*it);
-	if (progress != nullptr) {
-		progress->setMax(work);
-		progress->setValue(0);
-	}
-
 	RGBAImage image;
+	util::MemoryReservation memory(util::MemoryComponent::COMPOSITE_TILES,
+			(int64_t) render_context.tile_renderer->getTileWidth()
+			* render_context.tile_renderer->getTileHeight() * sizeof(RGBAPixel));
 	// iterate through the start composite tiles
 	for (auto it = render_work.tiles.begin(); it != render_work.tiles.end(); ++it) {
 		// render this composite tile
@@ -25,6 +25,7 @@
 #include "../config/configsections/world.h"
 #include "../mc/world.h"
 
+#include <chrono>
 #include <memory>
 #include <set>
 #include <boost/filesystem.hpp>
@@ -41,12 +42,17 @@ class WorldCache;
 namespace renderer {
 
 class BlockImages;
+class EmptyTileIndex;
+class RenderCostIndex;
 class RenderMode;
 class RenderView;
 class RGBAImage;
+class TileHashStore;
+class TileImageFormat;
 class TilePath;
 class TileRenderer;
 class TileSet;
+class TileStorage;
 
 struct RenderContext {
 	fs::path output_dir;
@@ -64,6 +70,17 @@ struct RenderContext {
 	std::shared_ptr<RenderMode> render_mode;
 	std::shared_ptr<TileRenderer> tile_renderer;
 
+	// image format to read/write the tiles with, created from the map config if not set
+	std::shared_ptr<TileImageFormat> tile_format;
+	// where the tiles are stored, created from the map config if not set
+	std::shared_ptr<TileStorage> tile_storage;
+	// pixel hashes of the written tiles, used to skip writing unchanged tiles (optional)
+	std::shared_ptr<TileHashStore> tile_hashes;
+	// which tiles are empty, empty tiles are not written if set (optional)
+	std::shared_ptr<EmptyTileIndex> empty_tiles;
+	// where the render costs of the render tiles are recorded (optional)
+	std::shared_ptr<RenderCostIndex> render_costs;
+
 	/**
 	 * Creates/initializes the world cache and tile renderer with the render view and
 	 * other supplied objects (block images, tile set, world).
@@ -96,20 +113,61 @@ public:
 	void setRenderWork(const RenderWork& work);
 	const RenderWorkResult& getRenderWorkResult() const;
 
-	void setProgressHandler(util::IProgressHandler* progress);
+	/**
+	 * Sets a counter the worker adds the rendered render tiles to (optional). Skipped
+	 * tiles are not counted. The counter must only be used by the thread of this worker.
+	 */
+	void setProgressCounter(util::ProgressCounter* progress);
 
-	void saveTile(const TilePath& tile, const RGBAImage& image);
-	void renderRecursive(const TilePath& path, RGBAImage& image);
+	/**
+	 * Saves a tile. Returns the size of the written tile, 0 if it couldn't be written.
+	 */
+	size_t saveTile(const TilePath& tile, const RGBAImage& image);
+
+	/**
+	 * Renders a tile (and its children if it's a composite tile) to the image and saves
+	 * it. Returns whether the image of the tile changed, unchanged tiles are not saved
+	 * again if the render context has a tile hash store.
+	 */
+	bool renderRecursive(const TilePath& path, RGBAImage& image);
 
 	void operator()();
 
 private:
+	/**
+	 * Checks with the tile hash store whether the image of a tile is different from the
+	 * last written one and remembers the new hash. Returns true if the tile needs to be
+	 * saved, the time of an unchanged tile is updated in the tile storage instead.
+	 */
+	bool updateTileHash(const TilePath& tile, const RGBAImage& image);
+
+	/**
+	 * Marks a tile as empty in the empty tile index and removes its image from the tile
+	 * storage if it was not empty before. Returns whether the tile changed.
+	 */
+	bool markTileEmpty(const TilePath& tile);
+
+	/**
+	 * Adds the hits and misses of the world cache since the last update to the metrics.
+	 */
+	void updateCacheMetrics();
+
+	/**
+	 * Records the render cost of a render tile in the render cost index (if there is
+	 * one). The chunks loaded are the chunk cache misses before rendering the tile.
+	 */
+	void recordRenderCost(const TilePath& tile, std::chrono::steady_clock::time_point start,
+			int chunk_misses_before, size_t bytes);
+
 	RenderContext render_context;
 	RenderWork render_work;
 	RenderWorkResult render_work_result;
 
-	// progress handler
-	util::IProgressHandler* progress;
+	// progress counter
+	util::ProgressCounter* progress;
+
+	// the world cache statistics already added to the metrics
+	int region_hits, region_misses, chunk_hits, chunk_misses;
 };
 
 } /* namespace render */
@@ -19,11 +19,19 @@
 
 #include "tileset.h"
 
+#include "emptytileindex.h"
+#include "tilesetindex.h"
+#include "tilestorage.h"
 #include "../mc/chunk.h"
+#include "../mc/chunkfingerprints.h"
 #include "../mc/pos.h"
+#include "../mc/region.h"
 #include "../mc/world.h"
+#include "../mc/worldcrop.h"
+#include "../compat/thread.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cstdint>
 #include <cstdlib>
@@ -31,6 +39,9 @@
 #include <limits>
 #include <set>
 #include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
 
 namespace mapcrafter {
 namespace renderer {
@@ -88,36 +99,51 @@ std::ostream& operator<<(std::ostream& stream, const TilePos& tile) {
 	return stream;
 }
 
-TilePath::TilePath() {
+TilePath::TilePath()
+	: key(0), depth(0) {
 }
 
 TilePath::~TilePath() {
 }
 
 int TilePath::getDepth() const {
-	return path.size();
+	return depth;
+}
+
+int TilePath::getNode(int level) const {
+	return ((key >> (64 - 2 * level)) & 3) + 1;
 }
 
-const std::vector<int>& TilePath::getPath() const {
+std::vector<int> TilePath::getPath() const {
+	std::vector<int> path(depth);
+	for (int i = 0; i < depth; i++)
+		path[i] = getNode(i + 1);
 	return path;
 }
 
+uint64_t TilePath::getKey() const {
+	return key;
+}
+
 TilePath TilePath::parent() const {
 	TilePath copy(*this);
-	copy.path.pop_back();
+	if (copy.depth > 0) {
+		copy.key &= ~(uint64_t(3) << (64 - 2 * copy.depth));
+		copy.depth--;
+	}
 	return copy;
 }
 
 TilePos TilePath::getTilePos() const {
 	// calculate the radius of all tiles on the top zoom level (2^zoomlevel / 2)
-	int radius = pow(2, path.size()) / 2;
+	int radius = pow(2, depth) / 2;
 	// the startpoint is top left
 	int x = -radius;
 	int y = -radius;
-	for (size_t i = 0; i < path.size(); i++) {
+	for (int level = 1; level <= depth; level++) {
 		// now for every zoom level:
 		// get the current tile
-		int tile = path[i];
+		int tile = getNode(level);
 		// increase x by the radius if this tile is on the right side (2 or 4)
 		if (tile == 2 || tile == 4)
 			x += radius;
@@ -131,7 +157,10 @@ TilePos TilePath::getTilePos() const {
 }
 
 TilePath& TilePath::operator+=(int node) {
-	path.push_back(node);
+	if (depth >= MAX_DEPTH)
+		throw std::runtime_error("Tile path " + toString() + " is too long");
+	depth++;
+	key |= uint64_t(node - 1) << (64 - 2 * depth);
 	return *this;
 }
 
@@ -140,11 +169,17 @@ TilePath TilePath::operator+(int node) const {
 }
 
 bool TilePath::operator==(const TilePath& other) const {
-	return path == other.path;
+	return key == other.key && depth == other.depth;
+}
+
+bool TilePath::operator!=(const TilePath& other) const {
+	return !(*this == other);
 }
 
 bool TilePath::operator<(const TilePath& other) const {
-	return path < other.path;
+	if (key == other.key)
+		return depth < other.depth;
+	return key < other.key;
 }
 
 std::ostream& operator<<(std::ostream& stream, const TilePath& path) {
@@ -154,9 +189,9 @@ std::ostream& operator<<(std::ostream& stream, const TilePath& path) {
 
 std::string TilePath::toString() const {
 	std::stringstream ss;
-	for (size_t i = 0; i < path.size(); i++) {
-		ss << path[i];
-		if (i != path.size() - 1)
+	for (int level = 1; level <= depth; level++) {
+		ss << getNode(level);
+		if (level != depth)
 			ss << "/";
 	}
 	return ss.str();
@@ -219,6 +254,37 @@ TilePath TilePath::byTilePos(const TilePos& tile, int depth) {
 	return path;
 }
 
+TilePath TilePath::byKey(uint64_t key, int depth) {
+	TilePath path;
+	path.depth = std::max(0, std::min(depth, MAX_DEPTH));
+	// make sure there are no nodes set below the zoom level
+	if (path.depth == MAX_DEPTH)
+		path.key = key;
+	else if (path.depth != 0)
+		path.key = key & ~(~uint64_t(0) >> (2 * path.depth));
+	return path;
+}
+
+bool TilePath::byString(const std::string& str, TilePath& path) {
+	path = TilePath();
+	if (str.empty())
+		return true;
+	if (str.size() % 2 != 1 || (int) str.size() / 2 + 1 > MAX_DEPTH)
+		return false;
+	for (size_t i = 0; i < str.size(); i++) {
+		char c = str[i];
+		if (i % 2 == 0 && c >= '1' && c <= '4')
+			path += c - '0';
+		else if (i % 2 == 0 || (c != '/' && c != '\\'))
+			return false;
+	}
+	return true;
+}
+
+RegionTiles::RegionTiles()
+	: mtime(0), size(0), scan_time(0) {
+}
+
 TileSet::TileSet(int tile_width, const RenderRotation& rotation)
 	: rotation(rotation), tile_width(tile_width), min_depth(0), depth(0) {
 }
@@ -226,11 +292,81 @@ TileSet::TileSet(int tile_width, const RenderRotation& rotation)
 TileSet::~TileSet() {
 }
 
-void TileSet::findRenderTiles(const mc::World& world, bool auto_center,
-		TilePos& tile_offset) {
+namespace {
+
+/**
+ * Region files modified less than this many seconds before they were scanned are not
+ * taken from the tile set index. File systems store modification times with a precision
+ * of up to two seconds, and the clock used for them is coarser than the system clock.
+ */
+const int INDEX_MTIME_MARGIN = 2;
+
+/**
+ * Reads which chunks a region file contains and the timestamps of the chunks,
+ * independent of the world crop. Returns false if the region file could not be read.
+ *
+ * If chunk fingerprints are supplied, the timestamps are the times of the last changes
+ * of the content of the chunks.
+ */
+bool readRegionChunks(const fs::path& region_path, RegionTiles& region_chunks,
+		mc::ChunkFingerprints* fingerprints) {
+	mc::RegionFile region_file(region_path.string());
+	if (!region_file.readOnlyHeaders())
+		return false;
+
+	const std::set<mc::ChunkPos>& chunks = region_file.getContainingChunks();
+	region_chunks.chunks.reserve(chunks.size());
+	region_chunks.chunk_timestamps.reserve(chunks.size());
+	for (auto chunk_it = chunks.begin(); chunk_it != chunks.end(); ++chunk_it) {
+		region_chunks.chunks.push_back(chunk_it->getLocalZ() * 32 + chunk_it->getLocalX());
+		region_chunks.chunk_timestamps.push_back(region_file.getChunkTimestamp(*chunk_it));
+	}
+	if (fingerprints != nullptr)
+		fingerprints->updateRegion(region_file, region_chunks.chunks,
+				region_chunks.chunk_timestamps);
+	return true;
+}
+
+/**
+ * Sorts tiles with timestamps by their position and merges the duplicate tiles,
+ * every tile keeps the highest of its timestamps.
+ */
+void mergeTileTimestamps(std::vector<std::pair<TilePos, int> >& tiles) {
+	std::sort(tiles.begin(), tiles.end());
+	auto out = tiles.begin();
+	for (auto it = tiles.begin(); it != tiles.end(); ++it) {
+		// the tiles are sorted by position and timestamp,
+		// so the last one of equal tiles has the highest timestamp
+		if (out != tiles.begin() && (out - 1)->first == it->first)
+			(out - 1)->second = it->second;
+		else
+			*out++ = *it;
+	}
+	tiles.erase(out, tiles.end());
+}
+
+}
+
+void TileSet::findRenderTiles(std::vector<std::vector<std::pair<TilePos, int> > >& thread_tiles,
+		bool auto_center, TilePos& tile_offset) {
 	// clear maybe already calculated tiles
 	render_tiles.clear();
 	required_render_tiles.clear();
+	tile_timestamps.clear();
+
+	// merge the tiles the scanning threads found,
+	// every tile gets the highest timestamp of all chunks it contains
+	size_t count = 0;
+	for (auto thread_it = thread_tiles.begin(); thread_it != thread_tiles.end(); ++thread_it)
+		count += thread_it->size();
+	tile_timestamps.reserve(count);
+	for (auto thread_it = thread_tiles.begin(); thread_it != thread_tiles.end(); ++thread_it) {
+		tile_timestamps.insert(tile_timestamps.end(), thread_it->begin(), thread_it->end());
+		std::vector<std::pair<TilePos, int> >().swap(*thread_it);
+	}
+	mergeTileTimestamps(tile_timestamps);
+	tile_timestamps.shrink_to_fit();
+	render_tiles.reserve(tile_timestamps.size());
 
 	// the min/max x/y coordinates of the tiles in the world
 	int tiles_x_min = std::numeric_limits<int>::max(),
@@ -238,42 +374,18 @@ void TileSet::findRenderTiles(const mc::World& world, bool auto_center,
 	    tiles_y_min = std::numeric_limits<int>::max(),
 	    tiles_y_max = std::numeric_limits<int>::min();
 
-	// go through all chunks in the world
-	auto regions = world.getAvailableRegions();
-	for (auto region_it = regions.begin(); region_it != regions.end(); ++region_it) {
-		mc::RegionFile region;
-		if (!world.getRegion(*region_it, region) || !region.readOnlyHeaders())
-			continue;
-		const std::set<mc::ChunkPos>& region_chunks = region.getContainingChunks();
-		for (auto chunk_it = region_chunks.begin(); chunk_it != region_chunks.end();
-		        ++chunk_it) {
-			int timestamp = region.getChunkTimestamp(*chunk_it);
-
-			// now get all tiles of the chunk
-			std::set<TilePos> tiles;
-			mapChunkToTiles(*chunk_it, tiles);
-			for (std::set<TilePos>::const_iterator tile_it = tiles.begin();
-			        tile_it != tiles.end(); ++tile_it) {
-
-				// and update the bounds
-				tiles_x_min = std::min(tiles_x_min, tile_it->getX());
-				tiles_x_max = std::max(tiles_x_max, tile_it->getX());
-				tiles_y_min = std::min(tiles_y_min, tile_it->getY());
-				tiles_y_max = std::max(tiles_y_max, tile_it->getY());
-
-				// update tile timestamp
-				if (!render_tiles.count(*tile_it))
-					tile_timestamps[*tile_it] = timestamp;
-				else
-					tile_timestamps[*tile_it] = std::max(tile_timestamps[*tile_it], timestamp);
-
-				// insert the tile to the set of available render tiles
-				// and also make it required by default
-				render_tiles.insert(*tile_it);
-				required_render_tiles.insert(*tile_it);
-			}
-		}
+	for (auto it = tile_timestamps.begin(); it != tile_timestamps.end(); ++it) {
+		// update the bounds
+		tiles_x_min = std::min(tiles_x_min, it->first.getX());
+		tiles_x_max = std::max(tiles_x_max, it->first.getX());
+		tiles_y_min = std::min(tiles_y_min, it->first.getY());
+		tiles_y_max = std::max(tiles_y_max, it->first.getY());
+
+		// insert the tile to the set of available render tiles
+		// and also make it required by default
+		render_tiles.push_back(it->first);
 	}
+	required_render_tiles = render_tiles;
 
 	// center tiles
 	if (auto_center || tile_offset != TilePos(0, 0)) {
@@ -281,19 +393,14 @@ void TileSet::findRenderTiles(const mc::World& world, bool auto_center,
 		if (auto_center)
 			tile_offset = TilePos((tiles_x_min + tiles_x_max) / 2, (tiles_y_min + tiles_y_max) / 2);
 
-		// update all tile positions
-		std::set<TilePos> render_tiles_tmp, required_render_tiles_tmp;
-		std::map<TilePos, int> tile_timestamps_tmp;
+		// update all tile positions,
+		// moving all tiles by the same offset keeps them sorted
 		for (auto it = render_tiles.begin(); it != render_tiles.end(); ++it)
-			render_tiles_tmp.insert(*it - tile_offset);
+			*it -= tile_offset;
 		for (auto it = required_render_tiles.begin(); it != required_render_tiles.end(); ++it)
-			required_render_tiles_tmp.insert(*it - tile_offset);
+			*it -= tile_offset;
 		for (auto it = tile_timestamps.begin(); it != tile_timestamps.end(); ++it)
-			tile_timestamps_tmp[it->first - tile_offset] = it->second;
-
-		render_tiles = render_tiles_tmp;
-		required_render_tiles = required_render_tiles_tmp;
-		tile_timestamps = tile_timestamps_tmp;
+			it->first -= tile_offset;
 		this->tile_offset = tile_offset;
 	}
 
@@ -310,34 +417,70 @@ void TileSet::findRenderTiles(const mc::World& world, bool auto_center,
 	}
 }
 
-void TileSet::findRequiredCompositeTiles(const std::set<TilePos>& render_tiles,
-		std::set<TilePath>& tiles) {
+bool TileSet::mapRegionToTiles(const mc::RegionPos& region, const mc::WorldCrop& world_crop,
+		RegionTiles& region_tiles, bool update_tiles) {
+	bool complete = true;
+	std::vector<std::pair<TilePos, int> > tiles;
+	std::set<TilePos> chunk_tiles;
+	for (size_t i = 0; i < region_tiles.chunks.size(); i++) {
+		int index = region_tiles.chunks[i];
+		mc::ChunkPos chunk(region.x * 32 + index % 32, region.z * 32 + index / 32);
+		if (!world_crop.isChunkContained(chunk)) {
+			complete = false;
+			if (!update_tiles)
+				return false;
+			continue;
+		}
+		if (!update_tiles)
+			continue;
+
+		int timestamp = region_tiles.chunk_timestamps[i];
+		chunk_tiles.clear();
+		mapChunkToTiles(chunk, chunk_tiles);
+		for (auto tile_it = chunk_tiles.begin(); tile_it != chunk_tiles.end(); ++tile_it)
+			tiles.push_back(std::make_pair(*tile_it, timestamp));
+	}
+
+	if (update_tiles) {
+		mergeTileTimestamps(tiles);
+		region_tiles.tiles.swap(tiles);
+	}
+	return complete;
+}
+
+void TileSet::findRequiredCompositeTiles(const std::vector<TilePos>& render_tiles,
+		std::vector<TilePath>& tiles) {
+	tiles.clear();
+	// on zoom level 0 the only tile is a render tile
+	if (depth == 0)
+		return;
 
 	// iterate through the render tiles on the max zoom level
 	// add their parent composite tiles
-	for (std::set<TilePos>::iterator it = render_tiles.begin(); it != render_tiles.end(); ++it) {
-		TilePath path = TilePath::byTilePos(*it, depth);
-		tiles.insert(path.parent());
-	}
+	std::vector<TilePath> level;
+	level.reserve(render_tiles.size());
+	for (auto it = render_tiles.begin(); it != render_tiles.end(); ++it)
+		level.push_back(TilePath::byTilePos(*it, depth).parent());
+	std::sort(level.begin(), level.end());
+	level.erase(std::unique(level.begin(), level.end()), level.end());
 
 	// now iterate through the composite tiles from bottom to top
 	// and also add their parent composite tiles
 	for (int d = depth - 1; d > 0; d--) {
-		std::set<TilePath> tmp;
-		for (std::set<TilePath>::iterator it = tiles.begin(); it != tiles.end(); ++it) {
-			if (it->getDepth() == d)
-				tmp.insert(it->parent());
-		}
-		for (std::set<TilePath>::iterator it = tmp.begin(); it != tmp.end(); ++it)
-			tiles.insert(*it);
+		tiles.insert(tiles.end(), level.begin(), level.end());
+		// the parents of sorted paths are sorted as well
+		for (auto it = level.begin(); it != level.end(); ++it)
+			*it = it->parent();
+		level.erase(std::unique(level.begin(), level.end()), level.end());
 	}
+	tiles.insert(tiles.end(), level.begin(), level.end());
+	std::sort(tiles.begin(), tiles.end());
+	tiles.shrink_to_fit();
 }
 
 void TileSet::updateContainingRenderTiles() {
-	containing_render_tiles.clear();
 	// initialize every composite tile with 0
-	for (auto it = composite_tiles.begin(); it != composite_tiles.end(); ++it)
-		containing_render_tiles[*it] = 0;
+	containing_render_tiles.assign(composite_tiles.size(), 0);
 	// go through all required render tiles
 	// set the containing render tiles for every parent composite tile +1
 	// to have the number of required render tiles in every composite tile
@@ -345,7 +488,10 @@ void TileSet::updateContainingRenderTiles() {
 		TilePath tile = TilePath::byTilePos(*it, depth);
 		while (tile.getDepth() != 0) {
 			tile = tile.parent();
-			containing_render_tiles[tile]++;
+			auto composite_it = std::lower_bound(composite_tiles.begin(),
+					composite_tiles.end(), tile);
+			if (composite_it != composite_tiles.end() && *composite_it == tile)
+				containing_render_tiles[composite_it - composite_tiles.begin()]++;
 		}
 	}
 }
@@ -355,16 +501,132 @@ void TileSet::scan(const mc::World& world) {
 	scan(world, false, tile_offset);
 }
 
-void TileSet::scan(const mc::World& world, bool auto_center, TilePos& tile_offset) {
-	findRenderTiles(world, auto_center, tile_offset);
-	setDepth(min_depth);
+void TileSet::scan(const mc::World& world, bool auto_center, TilePos& tile_offset,
+		TileSetIndex* index) {
+	std::vector<TileSet*> tile_sets(1, this);
+	std::vector<TileSetIndex*> indexes(1, index);
+	std::vector<TilePos> tile_offsets(1, tile_offset);
+	scan(world, tile_sets, indexes, auto_center, tile_offsets, 1);
+	tile_offset = tile_offsets[0];
+}
+
+void TileSet::scan(const mc::World& world, const std::vector<TileSet*>& tile_sets,
+		const std::vector<TileSetIndex*>& indexes, bool auto_center,
+		std::vector<TilePos>& tile_offsets, int threads, mc::ChunkFingerprints* fingerprints) {
+	const mc::World::RegionSet& available_regions = world.getAvailableRegions();
+	std::vector<mc::RegionPos> regions(available_regions.begin(), available_regions.end());
+	mc::WorldCrop world_crop = world.getWorldCrop();
+	threads = std::max(1, std::min(threads, (int) regions.size()));
+
+	// tiles with timestamps found by every thread (tile set -> thread -> tiles),
+	// they are merged by the tile sets when all regions are scanned
+	std::vector<std::vector<std::vector<std::pair<TilePos, int> > > > thread_tiles(
+			tile_sets.size(), std::vector<std::vector<std::pair<TilePos, int> > >(threads));
+	// updated index entries of every thread as (tile set, region, tiles),
+	// they are put into the indexes afterwards
+	std::vector<std::vector<std::tuple<size_t, mc::RegionPos, RegionTiles> > >
+		thread_index_updates(threads);
+
+	std::atomic<size_t> next_region(0);
+	std::atomic<int> regions_read(0);
+	std::time_t scan_time = std::time(nullptr);
+
+	auto scan_regions = [&](int thread) {
+		size_t i;
+		while ((i = next_region++) < regions.size()) {
+			const mc::RegionPos& region = regions[i];
+			fs::path region_path = world.getRegionPath(region);
+
+			// modification time and size tell us whether the region file has changed
+			boost::system::error_code ec;
+			std::time_t mtime = fs::last_write_time(region_path, ec);
+			if (ec)
+				continue;
+			uintmax_t size = fs::file_size(region_path, ec);
+			if (ec)
+				continue;
+
+			// the chunk timestamps are the same for all tile sets,
+			// so the region headers are read at most once
+			RegionTiles region_chunks;
+			bool headers_read = false, headers_valid = false;
+
+			for (size_t t = 0; t < tile_sets.size(); t++) {
+				TileSet* tile_set = tile_sets[t];
+				RegionTiles region_tiles;
+				if (indexes[t] != nullptr && indexes[t]->getRegion(region, region_tiles)
+						&& region_tiles.mtime == mtime && region_tiles.size == size
+						&& region_tiles.mtime < region_tiles.scan_time - INDEX_MTIME_MARGIN) {
+					// the indexed tiles are only usable if no chunks of the region are
+					// cropped, otherwise the indexed chunks are just mapped to tiles again
+					if (region_tiles.tiles.empty()
+							|| !tile_set->mapRegionToTiles(region, world_crop, region_tiles, false))
+						tile_set->mapRegionToTiles(region, world_crop, region_tiles, true);
+				} else {
+					if (!headers_read) {
+						headers_read = true;
+						headers_valid = readRegionChunks(region_path, region_chunks, fingerprints);
+						regions_read++;
+					}
+					if (!headers_valid)
+						break;
+
+					region_tiles = region_chunks;
+					region_tiles.mtime = mtime;
+					region_tiles.size = size;
+					region_tiles.scan_time = scan_time;
+					bool complete = tile_set->mapRegionToTiles(region, world_crop,
+							region_tiles, true);
+					if (indexes[t] != nullptr) {
+						// don't index the tiles of partly cropped regions,
+						// they depend on the world crop
+						RegionTiles index_entry = region_tiles;
+						if (!complete)
+							index_entry.tiles.clear();
+						thread_index_updates[thread].push_back(
+								std::make_tuple(t, region, index_entry));
+					}
+				}
+
+				// tiles on the borders of regions are found multiple times,
+				// they are merged later when all tiles are collected
+				std::vector<std::pair<TilePos, int> >& tiles = thread_tiles[t][thread];
+				tiles.insert(tiles.end(), region_tiles.tiles.begin(), region_tiles.tiles.end());
+			}
+		}
+	};
+
+	if (threads == 1) {
+		scan_regions(0);
+	} else {
+		std::vector<thread_ns::thread> scan_threads;
+		for (int i = 0; i < threads; i++)
+			scan_threads.push_back(thread_ns::thread(scan_regions, i));
+		for (int i = 0; i < threads; i++)
+			scan_threads[i].join();
+	}
+	LOG(DEBUG) << "Read headers of " << regions_read << " of " << regions.size()
+			<< " regions, took the other ones from the tile set index.";
+
+	// update the indexes and forget about regions which do not exist anymore
+	for (auto thread_it = thread_index_updates.begin();
+			thread_it != thread_index_updates.end(); ++thread_it)
+		for (auto it = thread_it->begin(); it != thread_it->end(); ++it)
+			indexes[std::get<0>(*it)]->setRegion(std::get<1>(*it), std::get<2>(*it));
+	for (size_t t = 0; t < tile_sets.size(); t++)
+		if (indexes[t] != nullptr)
+			indexes[t]->retainRegions(available_regions);
+	if (fingerprints != nullptr)
+		fingerprints->retainRegions(available_regions);
+
+	for (size_t t = 0; t < tile_sets.size(); t++) {
+		tile_sets[t]->findRenderTiles(thread_tiles[t], auto_center, tile_offsets[t]);
+		tile_sets[t]->setDepth(tile_sets[t]->min_depth);
+	}
 }
 
 void TileSet::resetRequired() {
-	required_render_tiles.clear();
-
-	for (auto it = tile_timestamps.begin(); it != tile_timestamps.end(); ++it)
-		required_render_tiles.insert(it->first);
+	required_render_tiles = render_tiles;
 
 	required_composite_tiles.clear();
 	findRequiredCompositeTiles(required_render_tiles, required_composite_tiles);
@@ -375,10 +637,9 @@ void TileSet::resetRequired() {
 void TileSet::scanRequiredByTimestamp(int last_change) {
 	required_render_tiles.clear();
 
-	for (std::map<TilePos, int>::iterator it = tile_timestamps.begin();
-			it != tile_timestamps.end(); ++it) {
+	for (auto it = tile_timestamps.begin(); it != tile_timestamps.end(); ++it) {
 		if (it->second >= last_change)
-			required_render_tiles.insert(it->first);
+			required_render_tiles.push_back(it->first);
 	}
 
 	required_composite_tiles.clear();
@@ -387,16 +648,19 @@ void TileSet::scanRequiredByTimestamp(int last_change) {
 	updateContainingRenderTiles();
 }
 
-void TileSet::scanRequiredByFiletimes(const fs::path& output_dir,
-		std::string image_format) {
+void TileSet::scanRequiredByFiletimes(TileStorage& tile_storage,
+		const EmptyTileIndex* empty_tiles) {
 	required_render_tiles.clear();
+	std::time_t empty_time = empty_tiles != nullptr ? empty_tiles->getTime() : 0;
 
-	for (std::map<TilePos, int>::iterator it = tile_timestamps.begin();
-			it != tile_timestamps.end(); ++it) {
+	for (auto it = tile_timestamps.begin(); it != tile_timestamps.end(); ++it) {
 		TilePath path = TilePath::byTilePos(it->first, depth);
-		fs::path file = output_dir / (path.toString() + "." + image_format);
-		if (!fs::exists(file) || fs::last_write_time(file) <= it->second)
-			required_render_tiles.insert(it->first);
+		// the time is 0 if the tile does not exist, which is the case for empty tiles
+		std::time_t time = tile_storage.getTileTime(path);
+		if (time == 0 && empty_time != 0 && empty_tiles->isEmpty(path))
+			time = empty_time;
+		if (time <= it->second)
+			required_render_tiles.push_back(it->first);
 	}
 
 	required_composite_tiles.clear();
@@ -440,21 +704,23 @@ const TilePos& TileSet::getTileOffset() const {
 
 bool TileSet::hasTile(const TilePath& path) const {
 	if (path.getDepth() == depth)
-		return render_tiles.count(path.getTilePos()) != 0;
-	return composite_tiles.count(path) != 0;
+		return std::binary_search(render_tiles.begin(), render_tiles.end(), path.getTilePos());
+	return std::binary_search(composite_tiles.begin(), composite_tiles.end(), path);
 }
 
 bool TileSet::isTileRequired(const TilePath& path) const {
 	if(path.getDepth() == depth)
-		return required_render_tiles.count(path.getTilePos()) != 0;
-	return required_composite_tiles.count(path) != 0;
+		return std::binary_search(required_render_tiles.begin(), required_render_tiles.end(),
+				path.getTilePos());
+	return std::binary_search(required_composite_tiles.begin(),
+			required_composite_tiles.end(), path);
 }
 
 int TileSet::getRequiredRenderTilesCount() const {
 	return required_render_tiles.size();
 }
 
-const std::set<TilePos>& TileSet::getRequiredRenderTiles() const {
+const std::vector<TilePos>& TileSet::getRequiredRenderTiles() const {
 	return required_render_tiles;
 }
 
@@ -462,12 +728,15 @@ int TileSet::getRequiredCompositeTilesCount() const {
 	return required_composite_tiles.size();
 }
 
-const std::set<TilePath>& TileSet::getRequiredCompositeTiles() const {
+const std::vector<TilePath>& TileSet::getRequiredCompositeTiles() const {
 	return required_composite_tiles;
 }
 
 int TileSet::getContainingRenderTiles(const TilePath& tile) const {
-	return containing_render_tiles.at(tile);
+	auto it = std::lower_bound(composite_tiles.begin(), composite_tiles.end(), tile);
+	if (it == composite_tiles.end() || *it != tile)
+		throw std::out_of_range("Unknown composite tile " + tile.toString());
+	return containing_render_tiles[it - composite_tiles.begin()];
 }
 
 }
@@ -20,8 +20,11 @@
 #ifndef TILE_H_
 #define TILE_H_
 
+#include <cstdint>
+#include <ctime>
 #include <map>
 #include <set>
+#include <utility>
 #include <vector>
 #include <boost/filesystem.hpp>
 
@@ -63,12 +66,18 @@ namespace fs = boost::filesystem;
 namespace mapcrafter {
 
 namespace mc {
+class ChunkFingerprints;
 class ChunkPos;
+class RegionPos;
 class World;
+class WorldCrop;
 }
 
 namespace renderer {
 
+class EmptyTileIndex;
+class TileStorage;
+
 /**
  * This class represents the position of a tile in the quadtree.
  */
@@ -107,6 +116,10 @@ std::ostream& operator<<(std::ostream& stream, const TilePos& tile);
  * This class represents the path to a tile in the quadtree.
  * Every part in the path is a 1, 2, 3 or 4.
  * The length of the path is the zoom level of the tile.
+ *
+ * The path is encoded as quadtree key in a single integer (two bits per node) together
+ * with its length, so paths are cheap to copy and to compare and can be stored in
+ * flat containers.
  */
 class TilePath {
 public:
@@ -119,9 +132,19 @@ public:
 	int getDepth() const;
 
 	/**
-	 * Returns the path.
+	 * Returns the node (1, 2, 3 or 4) of the path on a zoom level (1 <= level <= depth).
+	 */
+	int getNode(int level) const;
+
+	/**
+	 * Returns the nodes of the path.
+	 */
+	std::vector<int> getPath() const;
+
+	/**
+	 * Returns the quadtree key of the path (see byKey-method).
 	 */
-	const std::vector<int>& getPath() const;
+	uint64_t getKey() const;
 
 	/**
 	 * Returns the path of the parent tile.
@@ -142,6 +165,7 @@ public:
 
 	// some more comparison operations
 	bool operator==(const TilePath& other) const;
+	bool operator!=(const TilePath& other) const;
 	bool operator<(const TilePath& other) const;
 
 	/**
@@ -155,12 +179,58 @@ public:
 	 */
 	static TilePath byTilePos(const TilePos& tile, int depth);
 
+	/**
+	 * Constructs a path from its quadtree key and its zoom level.
+	 * Opposite of getKey-method.
+	 */
+	static TilePath byKey(uint64_t key, int depth);
+
+	/**
+	 * Parses the string representation of a path (like "1/2/3/4", the empty string is
+	 * the path of the base tile). Opposite of toString-method.
+	 */
+	static bool byString(const std::string& str, TilePath& path);
+
+	// maximum length of a path
+	static const int MAX_DEPTH = 32;
+
 private:
-	std::vector<int> path;
+	// the nodes of the path with two bits per node (node - 1), the first node in the
+	// highest bits, so comparing (key, depth) orders the paths like their nodes
+	uint64_t key;
+	int depth;
 };
 
 std::ostream& operator<<(std::ostream& stream, const TilePath& path);
 
+/**
+ * The render tiles a single region file covers. This is what the tile set needs to know
+ * about a region when scanning the world, it is stored in the tile set index to skip
+ * unchanged region files on the next scan.
+ */
+struct RegionTiles {
+	RegionTiles();
+
+	// modification time and size of the region file, used to detect changes
+	std::time_t mtime;
+	uintmax_t size;
+	// time of the scan which read the region file, a region file modified (shortly)
+	// before that could have been modified again within the precision of its
+	// modification time, so it is read again on the next scan
+	std::time_t scan_time;
+
+	// local indexes (z*32 + x) and timestamps of all chunks of the region,
+	// independent of the world crop
+	std::vector<int32_t> chunks;
+	std::vector<int32_t> chunk_timestamps;
+
+	// the render tiles the (not cropped) chunks of the region cover, each one with the
+	// highest timestamp of the chunks of this region it contains
+	std::vector<std::pair<TilePos, int> > tiles;
+};
+
+class TileSetIndex;
+
 /**
  * This class manages all tiles required to render a world.
  */
@@ -180,9 +250,32 @@ public:
 	 * found tiles. If set to false (default), it will use tile_offset as center. The
 	 * default value for tile_offset is (0, 0) when using scan without the
 	 * auto_center and tile_offset parameters.
+	 *
+	 * If a tile set index is supplied, the tiles of region files which did not change
+	 * since the last scan are taken from the index instead of reading the region files.
+	 * The index is updated with the scanned regions afterwards.
 	 */
 	void scan(const mc::World& world);
-	void scan(const mc::World& world, bool auto_center, TilePos& tile_offset);
+	void scan(const mc::World& world, bool auto_center, TilePos& tile_offset,
+			TileSetIndex* index = nullptr);
+
+	/**
+	 * Scans multiple tile sets of the same world at once (for example all rotations of
+	 * a world). The headers of every region file are read only once for all tile sets.
+	 * The regions are distributed to the supplied count of threads. Every thread
+	 * collects the tiles it finds separately, they are merged when all regions are
+	 * scanned.
+	 *
+	 * indexes and tile_offsets need to have the same size as tile_sets, entries of
+	 * indexes may be nullptrs if a tile set has no index.
+	 *
+	 * If chunk fingerprints are supplied, chunks of changed regions whose content did
+	 * not change keep the timestamp of their last content change.
+	 */
+	static void scan(const mc::World& world, const std::vector<TileSet*>& tile_sets,
+			const std::vector<TileSetIndex*>& indexes, bool auto_center,
+			std::vector<TilePos>& tile_offsets, int threads,
+			mc::ChunkFingerprints* fingerprints = nullptr);
 
 	/**
 	 * Resets which tiles are required / not required. All tiles will be required.
@@ -197,10 +290,11 @@ public:
 
 	/**
 	 * Scans which tiles are required by using the modification times of the already
-	 * rendered image files.
+	 * rendered tiles in the tile storage. Empty tiles are not in the tile storage, the
+	 * time of the empty tile index is used for them if there is one.
 	 */
-	void scanRequiredByFiletimes(const fs::path& output_dir,
-			std::string image_format = "png");
+	void scanRequiredByFiletimes(TileStorage& tile_storage,
+			const EmptyTileIndex* empty_tiles = nullptr);
 
 	/**
 	 * Returns the width of the tiles in chunks.
@@ -244,9 +338,9 @@ public:
 	int getRequiredRenderTilesCount() const;
 
 	/**
-	 * Returns the required render tiles.
+	 * Returns the required render tiles (sorted).
 	 */
-	const std::set<TilePos>& getRequiredRenderTiles() const;
+	const std::vector<TilePos>& getRequiredRenderTiles() const;
 
 	/**
 	 * Returns the count of required composite tiles.
@@ -254,9 +348,9 @@ public:
 	int getRequiredCompositeTilesCount() const;
 
 	/**
-	 * Returns the required composite tiles.
+	 * Returns the required composite tiles (sorted).
 	 */
-	const std::set<TilePath>& getRequiredCompositeTiles() const;
+	const std::vector<TilePath>& getRequiredCompositeTiles() const;
 
 	/**
 	 * Returns the count of required render tiles a specific composite tiles contains.
@@ -283,40 +377,52 @@ private:
 
 	// all available render tiles
 	// (= tiles with the highest zoom level, tree leaves in the quadtree)
-	std::set<TilePos> render_tiles;
+	// all tile containers are sorted vectors, they are only modified as a whole when
+	// scanning and are much smaller and faster to search than trees
+	std::vector<TilePos> render_tiles;
 	// the render tiles which actually need to get rendered
-	std::set<TilePos> required_render_tiles;
+	std::vector<TilePos> required_render_tiles;
 	// timestamps of render tiles required to re-render a tile
-	// (= highest timestamp of all chunks in a tile)
-	std::map<TilePos, int> tile_timestamps;
+	// (= highest timestamp of all chunks in a tile), sorted by tile position
+	std::vector<std::pair<TilePos, int> > tile_timestamps;
 
 	// same here for composite tiles
-	std::set<TilePath> composite_tiles;
-	std::set<TilePath> required_composite_tiles;
+	std::vector<TilePath> composite_tiles;
+	std::vector<TilePath> required_composite_tiles;
 
-	// count of required render tiles contained in a composite tile
-	std::map<TilePath, int> containing_render_tiles;
+	// count of required render tiles contained in a composite tile,
+	// in the same order as composite_tiles
+	std::vector<int> containing_render_tiles;
 
 	/**
-	 * This method finds out which render level tiles a world has and which maximum
-	 * zoom level would be required to render them.
+	 * This method merges the render level tiles the scanning threads found and finds
+	 * out which maximum zoom level would be required to render them.
 	 *
 	 * The auto_center parameter describes whether it should automatically center the
 	 * found tiles. If set to false (default), it will use tile_offset as center.
 	 */
-	void findRenderTiles(const mc::World& world, bool auto_center, TilePos& tile_offset);
+	void findRenderTiles(std::vector<std::vector<std::pair<TilePos, int> > >& thread_tiles,
+			bool auto_center, TilePos& tile_offset);
+
+	/**
+	 * Maps the chunks of a region (which are not cropped) to render tiles if
+	 * update_tiles is set. Returns whether all chunks of the region are contained in
+	 * the world crop.
+	 */
+	bool mapRegionToTiles(const mc::RegionPos& region, const mc::WorldCrop& world_crop,
+			RegionTiles& region_tiles, bool update_tiles);
 
 	/**
 	 * This method finds out which composite tiles are needed, depending on a
-	 * list of available/required render tiles, and puts them into a set.
+	 * list of available/required render tiles, and puts them into a sorted vector.
 	 * So we can find out which composite tiles are available and which composite tiles
 	 * need to get rendered.
 	 */
-	void findRequiredCompositeTiles(const std::set<TilePos>& render_tiles,
-			std::set<TilePath>& tiles);
+	void findRequiredCompositeTiles(const std::vector<TilePos>& render_tiles,
+			std::vector<TilePath>& tiles);
 
 	/**
-	 * Updates the containing_render_tiles map.
+	 * Updates the containing_render_tiles counts.
 	 */
 	void updateContainingRenderTiles();
 };
@@ -0,0 +1,173 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tilesetindex.h"
+
+#include "../mc/chunk.h"
+#include "../mc/nbt.h"
+#include "../util.h"
+
+namespace mapcrafter {
+namespace renderer {
+
+namespace {
+
+// increase this when the format of the index or the chunk to tile mapping changes
+const int INDEX_VERSION = 2;
+
+/**
+ * The chunk to tile mapping of the render views depends on the height of the chunks.
+ * Include it in the version so the index is rebuilt when the height of the world changes.
+ */
+int getIndexVersion() {
+	return INDEX_VERSION * 1000 + (mc::CHUNK_HIGHEST - mc::CHUNK_LOWEST);
+}
+
+}
+
+TileSetIndex::TileSetIndex(const fs::path& filename, const std::string& key)
+	: filename(filename), key(key) {
+}
+
+TileSetIndex::~TileSetIndex() {
+}
+
+bool TileSetIndex::read() {
+	regions.clear();
+	if (!fs::exists(filename)) {
+		LOG(DEBUG) << "Tile set index " << filename << " does not exist.";
+		return false;
+	}
+
+	try {
+		mc::nbt::NBTFile nbt_file;
+		nbt_file.readNBT(filename.string().c_str(), mc::nbt::Compression::GZIP);
+
+		if (nbt_file.findTag<mc::nbt::TagInt>("version").payload != getIndexVersion()
+				|| nbt_file.findTag<mc::nbt::TagString>("key").payload != key) {
+			LOG(DEBUG) << "Tile set index " << filename << " is outdated, ignoring it.";
+			return false;
+		}
+
+		const mc::nbt::TagList& nbt_regions = nbt_file.findTag<mc::nbt::TagList>("regions");
+		for (auto region_it = nbt_regions.payload.begin();
+				region_it != nbt_regions.payload.end(); ++region_it) {
+			const mc::nbt::TagCompound& nbt_region = (*region_it)->cast<mc::nbt::TagCompound>();
+			mc::RegionPos pos(nbt_region.findTag<mc::nbt::TagInt>("x").payload,
+					nbt_region.findTag<mc::nbt::TagInt>("z").payload);
+
+			RegionTiles& region = regions[pos];
+			region.mtime = nbt_region.findTag<mc::nbt::TagLong>("mtime").payload;
+			region.size = nbt_region.findTag<mc::nbt::TagLong>("size").payload;
+			region.scan_time = nbt_region.findTag<mc::nbt::TagLong>("scan_time").payload;
+			region.chunks = nbt_region.findTag<mc::nbt::TagIntArray>("chunks").payload;
+			region.chunk_timestamps = nbt_region.findTag<mc::nbt::TagIntArray>(
+					"chunk_timestamps").payload;
+
+			// tiles are stored as (x, y, timestamp) triples
+			const std::vector<int32_t>& tiles = nbt_region.findTag<mc::nbt::TagIntArray>(
+					"tiles").payload;
+			if (region.chunks.size() != region.chunk_timestamps.size() || tiles.size() % 3 != 0)
+				throw mc::nbt::NBTError("Invalid region entry");
+			region.tiles.reserve(tiles.size() / 3);
+			for (size_t i = 0; i + 2 < tiles.size(); i += 3)
+				region.tiles.push_back(std::make_pair(TilePos(tiles[i], tiles[i+1]), tiles[i+2]));
+		}
+	} catch (mc::nbt::NBTError& e) {
+		LOG(WARNING) << "Unable to read tile set index " << filename << ": " << e.what();
+		regions.clear();
+		return false;
+	}
+
+	LOG(DEBUG) << "Read tile set index " << filename << " with " << regions.size()
+			<< " regions.";
+	return true;
+}
+
+bool TileSetIndex::write() const {
+	mc::nbt::NBTFile nbt_file;
+	mc::nbt::TagList nbt_regions(mc::nbt::TagCompound::TAG_TYPE);
+	nbt_regions.payload.reserve(regions.size());
+
+	for (auto region_it = regions.begin(); region_it != regions.end(); ++region_it) {
+		const RegionTiles& region = region_it->second;
+		mc::nbt::TagCompound* nbt_region = new mc::nbt::TagCompound();
+		nbt_region->addTag("x", mc::nbt::TagInt(region_it->first.x));
+		nbt_region->addTag("z", mc::nbt::TagInt(region_it->first.z));
+		nbt_region->addTag("mtime", mc::nbt::TagLong(region.mtime));
+		nbt_region->addTag("size", mc::nbt::TagLong(region.size));
+		nbt_region->addTag("scan_time", mc::nbt::TagLong(region.scan_time));
+		nbt_region->addTag("chunks", mc::nbt::TagIntArray(region.chunks));
+		nbt_region->addTag("chunk_timestamps", mc::nbt::TagIntArray(region.chunk_timestamps));
+
+		std::vector<int32_t> tiles;
+		tiles.reserve(region.tiles.size() * 3);
+		for (auto tile_it = region.tiles.begin(); tile_it != region.tiles.end(); ++tile_it) {
+			tiles.push_back(tile_it->first.getX());
+			tiles.push_back(tile_it->first.getY());
+			tiles.push_back(tile_it->second);
+		}
+		nbt_region->addTag("tiles", mc::nbt::TagIntArray(tiles));
+		nbt_regions.payload.push_back(mc::nbt::TagPtr(nbt_region));
+	}
+
+	nbt_file.addTag("key", mc::nbt::TagString(key));
+	nbt_file.addTag("version", mc::nbt::TagInt(getIndexVersion()));
+	nbt_file.addTag("regions", nbt_regions);
+
+	try {
+		nbt_file.writeNBT(filename.string().c_str(), mc::nbt::Compression::GZIP);
+	} catch (mc::nbt::NBTError& e) {
+		LOG(WARNING) << "Unable to write tile set index " << filename << ": " << e.what();
+		return false;
+	}
+	return true;
+}
+
+bool TileSetIndex::getRegion(const mc::RegionPos& region, RegionTiles& region_tiles) const {
+	auto it = regions.find(region);
+	if (it == regions.end())
+		return false;
+	region_tiles = it->second;
+	return true;
+}
+
+void TileSetIndex::setRegion(const mc::RegionPos& region, const RegionTiles& region_tiles) {
+	regions[region] = region_tiles;
+}
+
+void TileSetIndex::retainRegions(const mc::World::RegionSet& available_regions) {
+	for (auto it = regions.begin(); it != regions.end(); ) {
+		if (!available_regions.count(it->first))
+			it = regions.erase(it);
+		else
+			++it;
+	}
+}
+
+void TileSetIndex::clear() {
+	regions.clear();
+}
+
+int TileSetIndex::getRegionCount() const {
+	return regions.size();
+}
+
+}
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TILESETINDEX_H_
+#define TILESETINDEX_H_
+
+#include "tileset.h"
+#include "../mc/pos.h"
+#include "../mc/world.h"
+
+#include <map>
+#include <string>
+#include <boost/filesystem.hpp>
+
+namespace fs = boost::filesystem;
+
+namespace mapcrafter {
+namespace renderer {
+
+/**
+ * Persistent index of the render tiles each region file of a world covers, stored in
+ * the cache directory of the world.
+ *
+ * Scanning a world requires reading the headers of every region file and mapping every
+ * chunk to its render tiles. Since the region files identified by modification time
+ * and size did not change since the last scan, the tile set can take their tiles from
+ * the index and only needs to scan the changed regions. Region files which were
+ * modified right before the last scan are scanned again, a second modification
+ * within the precision of the modification time would go unnoticed otherwise.
+ *
+ * The index belongs to a specific tile set (world, render view, tile width and
+ * rotation), this is identified by a key. An index file with a different key (or from
+ * a different version of the index format) is ignored.
+ */
+class TileSetIndex {
+public:
+	TileSetIndex(const fs::path& filename, const std::string& key);
+	~TileSetIndex();
+
+	/**
+	 * Reads the index file. Returns false if the file does not exist or if it was
+	 * written for a different tile set, the index is empty then.
+	 */
+	bool read();
+
+	/**
+	 * Writes the index file. Returns false if the file could not be written.
+	 */
+	bool write() const;
+
+	/**
+	 * Returns the indexed tiles of a region. Returns false if the region is not indexed.
+	 */
+	bool getRegion(const mc::RegionPos& region, RegionTiles& region_tiles) const;
+
+	/**
+	 * Sets the tiles of a region.
+	 */
+	void setRegion(const mc::RegionPos& region, const RegionTiles& region_tiles);
+
+	/**
+	 * Removes all regions from the index which are not in the supplied set of regions.
+	 */
+	void retainRegions(const mc::World::RegionSet& available_regions);
+
+	/**
+	 * Removes all regions from the index.
+	 */
+	void clear();
+
+	/**
+	 * Returns the count of indexed regions.
+	 */
+	int getRegionCount() const;
+
+private:
+	fs::path filename;
+	std::string key;
+
+	std::map<mc::RegionPos, RegionTiles> regions;
+};
+
+}
+}
+
+#endif /* TILESETINDEX_H_ */
@@ -0,0 +1,780 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tilestorage.h"
+
+#include "image.h"
+#include "tileimageformat.h"
+#include "../util.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace mapcrafter {
+namespace renderer {
+
+namespace {
+
+const char ARCHIVE_MAGIC[8] = {'M', 'C', 'T', 'I', 'L', 'E', 'S', '\0'};
+const uint32_t ARCHIVE_VERSION = 1;
+// magic (8), version (4), reserved (4)
+const size_t HEADER_SIZE = 16;
+
+// "TILE"
+const uint32_t RECORD_MAGIC = 0x454c4954;
+// magic (4), path key (8), path depth (4), time (8), data size (4)
+const size_t RECORD_HEADER_SIZE = 28;
+
+// path key (8), path depth (4), record offset (8), data size (4), time (8)
+const size_t INDEX_ENTRY_SIZE = 32;
+// "INDX"
+const uint32_t FOOTER_MAGIC = 0x58444e49;
+// index offset (8), tile count (4), magic (4)
+const size_t FOOTER_SIZE = 16;
+
+// archives with more garbage than this (and more garbage than tile data) are compacted
+const uint64_t COMPACT_THRESHOLD = 1024 * 1024;
+
+void putInt(uint8_t* data, uint64_t value, int bytes) {
+	for (int i = 0; i < bytes; i++)
+		data[i] = (value >> (8 * i)) & 0xff;
+}
+
+uint64_t getInt(const uint8_t* data, int bytes) {
+	uint64_t value = 0;
+	for (int i = 0; i < bytes; i++)
+		value |= uint64_t(data[i]) << (8 * i);
+	return value;
+}
+
+/**
+ * Parses the tile path of a file in a directory tree, the file name has to end with
+ * the supplied ending (for example ".png").
+ */
+bool parseTileFile(const fs::path& dir, const fs::path& file, const std::string& ending,
+		TilePath& path) {
+	std::string dir_str = dir.string();
+	std::string name = file.string();
+	if (name.compare(0, dir_str.size(), dir_str) != 0)
+		return false;
+	name = name.substr(dir_str.size());
+	while (!name.empty() && (name[0] == '/' || name[0] == '\\'))
+		name = name.substr(1);
+	if (!util::endswith(name, ending))
+		return false;
+	name = name.substr(0, name.size() - ending.size());
+	// the base tile is stored as base.<ending>
+	if (name == "base") {
+		path = TilePath();
+		return true;
+	}
+	return !name.empty() && TilePath::byString(name, path);
+}
+
+/**
+ * Returns the path of a tile after increasing the max zoom level of the map, see
+ * TileStorage::increaseDepth.
+ */
+TilePath getDeeperTilePath(const TilePath& tile) {
+	TilePath deeper;
+	deeper += tile.getNode(1);
+	deeper += 5 - tile.getNode(1);
+	for (int level = 2; level <= tile.getDepth(); level++)
+		deeper += tile.getNode(level);
+	return deeper;
+}
+
+std::vector<uint8_t>& getTileBuffer() {
+	static thread_local std::vector<uint8_t> buffer;
+	return buffer;
+}
+
+}
+
+TileStorage::~TileStorage() {
+}
+
+bool TileStorage::readTile(const TilePath& tile, RGBAImage& image,
+		const TileImageFormat& format) {
+	std::vector<uint8_t>& buffer = getTileBuffer();
+	return readTile(tile, buffer) && format.decode(buffer.data(), buffer.size(), image);
+}
+
+bool TileStorage::writeTile(const TilePath& tile, const RGBAImage& image,
+		const TileImageFormat& format, bool render_tile, size_t* size) {
+	std::vector<uint8_t>& buffer = getTileBuffer();
+	{
+		util::ProfileTimer timer(util::ProfileStage::ENCODE);
+		util::TraceSpan span("encode");
+		auto start = std::chrono::steady_clock::now();
+		if (!format.encode(image, buffer, render_tile))
+			return false;
+		util::Metrics::getEncodeHistogram().observe(std::chrono::duration_cast<
+				std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+	}
+	util::ProfileTimer timer(util::ProfileStage::WRITE);
+	util::TraceSpan span("write", "io");
+	if (!writeTile(tile, buffer.data(), buffer.size()))
+		return false;
+	util::Metrics::add(util::MetricCounter::TILES_WRITTEN);
+	util::Metrics::add(util::MetricCounter::BYTES_WRITTEN, buffer.size());
+	if (size != nullptr)
+		*size = buffer.size();
+	return true;
+}
+
+std::shared_ptr<TileStorage> TileStorage::create(config::TileStorageType type,
+		const fs::path& output_dir, const std::string& suffix) {
+	if (type == config::TileStorageType::ARCHIVE)
+		return std::make_shared<ArchiveTileStorage>(output_dir, suffix);
+	return std::make_shared<DirectoryTileStorage>(output_dir, suffix);
+}
+
+DirectoryTileStorage::DirectoryTileStorage(const fs::path& output_dir,
+		const std::string& suffix)
+	: output_dir(output_dir), suffix(suffix) {
+}
+
+DirectoryTileStorage::~DirectoryTileStorage() {
+}
+
+bool DirectoryTileStorage::hasTile(const TilePath& tile) {
+	return fs::exists(getTileFile(tile));
+}
+
+std::time_t DirectoryTileStorage::getTileTime(const TilePath& tile) {
+	boost::system::error_code error;
+	std::time_t time = fs::last_write_time(getTileFile(tile), error);
+	return error ? 0 : time;
+}
+
+bool DirectoryTileStorage::touchTile(const TilePath& tile) {
+	boost::system::error_code error;
+	fs::last_write_time(getTileFile(tile), std::time(nullptr), error);
+	return !error;
+}
+
+bool DirectoryTileStorage::readTile(const TilePath& tile, std::vector<uint8_t>& data) {
+	return util::readFile(getTileFile(tile), data);
+}
+
+bool DirectoryTileStorage::writeTile(const TilePath& tile, const uint8_t* data,
+		size_t size) {
+	fs::path file = getTileFile(tile);
+	if (!fs::exists(file.branch_path())) {
+		boost::system::error_code error;
+		fs::create_directories(file.branch_path(), error);
+	}
+	return util::writeFileAtomic(file, data, size);
+}
+
+bool DirectoryTileStorage::removeTile(const TilePath& tile) {
+	boost::system::error_code error;
+	fs::remove(getTileFile(tile), error);
+	return !error;
+}
+
+void DirectoryTileStorage::listTiles(std::vector<TilePath>& tiles) {
+	if (!fs::is_directory(output_dir))
+		return;
+	std::string ending = "." + suffix;
+	fs::recursive_directory_iterator end;
+	for (fs::recursive_directory_iterator it(output_dir); it != end; ++it) {
+		TilePath tile;
+		if (fs::is_regular_file(it->path())
+				&& parseTileFile(output_dir, it->path(), ending, tile))
+			tiles.push_back(tile);
+	}
+}
+
+bool DirectoryTileStorage::increaseDepth() {
+	std::string ending = "." + suffix;
+	for (int node = 1; node <= 4; node++) {
+		std::string from = util::str(node);
+		std::string to = from + "/" + util::str(5 - node);
+		if (!fs::exists(output_dir / from))
+			continue;
+		// at first rename the directory of the node and make a new directory,
+		// then move the old tile tree one zoom level deeper
+		util::moveFile(output_dir / from, output_dir / (from + "_"));
+		fs::create_directories(output_dir / from);
+		util::moveFile(output_dir / (from + "_"), output_dir / to);
+		// also move the image of the directory
+		util::moveFile(output_dir / (from + ending), output_dir / (to + ending));
+	}
+	fs::remove(output_dir / ("base" + ending));
+	return true;
+}
+
+void DirectoryTileStorage::flush() {
+}
+
+fs::path DirectoryTileStorage::getTileFile(const TilePath& tile) const {
+	if (tile.getDepth() == 0)
+		return output_dir / ("base." + suffix);
+	return output_dir / (tile.toString() + "." + suffix);
+}
+
+TileArchive::TileArchive(const fs::path& filename)
+	: filename(filename), data_end(HEADER_SIZE), garbage(0), changed(false) {
+}
+
+TileArchive::~TileArchive() {
+	close();
+}
+
+bool TileArchive::open() {
+	index.clear();
+	data_end = HEADER_SIZE;
+	garbage = 0;
+	changed = false;
+
+	if (!fs::exists(filename)) {
+		boost::system::error_code error;
+		if (!filename.branch_path().empty() && !fs::exists(filename.branch_path()))
+			fs::create_directories(filename.branch_path(), error);
+		std::ofstream out(filename.string().c_str(), std::ios::binary);
+		uint8_t header[HEADER_SIZE] = {0};
+		std::memcpy(header, ARCHIVE_MAGIC, 8);
+		putInt(header + 8, ARCHIVE_VERSION, 4);
+		out.write((const char*) header, HEADER_SIZE);
+		if (!out)
+			return false;
+		// make sure an index is written even if no tiles are added
+		changed = true;
+	}
+
+	file.open(filename.string().c_str(), std::ios::in | std::ios::out | std::ios::binary);
+	if (!file)
+		return false;
+
+	uint8_t header[HEADER_SIZE];
+	if (!file.read((char*) header, HEADER_SIZE)
+			|| std::memcmp(header, ARCHIVE_MAGIC, 8) != 0
+			|| getInt(header + 8, 4) != ARCHIVE_VERSION) {
+		LOG(ERROR) << "Tile archive " << filename << " is invalid or from an unsupported "
+				<< "version of Mapcrafter.";
+		file.close();
+		return false;
+	}
+
+	uint64_t file_size = fs::file_size(filename);
+	if (!readIndex(file_size)) {
+		if (file_size > HEADER_SIZE)
+			LOG(WARNING) << "Tile archive " << filename << " was not closed properly, "
+				<< "rebuilding its index.";
+		rebuildIndex(file_size);
+	}
+	return true;
+}
+
+void TileArchive::close() {
+	if (!file.is_open())
+		return;
+	if (changed) {
+		uint64_t live = data_end - HEADER_SIZE - garbage;
+		if (!(garbage > COMPACT_THRESHOLD && garbage > live && compact()))
+			writeIndex();
+	}
+	if (file.is_open())
+		file.close();
+	index.clear();
+}
+
+bool TileArchive::hasTile(const TilePath& tile) const {
+	return index.count(tile);
+}
+
+std::time_t TileArchive::getTileTime(const TilePath& tile) const {
+	auto it = index.find(tile);
+	if (it == index.end())
+		return 0;
+	return it->second.time;
+}
+
+bool TileArchive::touchTile(const TilePath& tile, std::time_t time) {
+	auto it = index.find(tile);
+	if (it == index.end())
+		return false;
+	// only the index has the new time, the record header keeps the time it was written
+	it->second.time = time;
+	changed = true;
+	return true;
+}
+
+bool TileArchive::readTile(const TilePath& tile, std::vector<uint8_t>& data) {
+	auto it = index.find(tile);
+	if (it == index.end() || !file.is_open())
+		return false;
+
+	// check the record header as well, just in case
+	uint8_t header[RECORD_HEADER_SIZE];
+	file.clear();
+	file.seekg(it->second.offset);
+	if (!file.read((char*) header, RECORD_HEADER_SIZE)
+			|| getInt(header, 4) != RECORD_MAGIC
+			|| getInt(header + 4, 8) != tile.getKey()
+			|| (int) getInt(header + 12, 4) != tile.getDepth()
+			|| getInt(header + 24, 4) != it->second.size)
+		return false;
+
+	data.resize(it->second.size);
+	if (data.empty())
+		return true;
+	return (bool) file.read((char*) &data[0], data.size());
+}
+
+bool TileArchive::writeTile(const TilePath& tile, const uint8_t* data, size_t size,
+		std::time_t time) {
+	// records without data mark removed tiles
+	if (!file.is_open() || size == 0)
+		return false;
+
+	uint8_t header[RECORD_HEADER_SIZE];
+	putInt(header, RECORD_MAGIC, 4);
+	putInt(header + 4, tile.getKey(), 8);
+	putInt(header + 12, tile.getDepth(), 4);
+	putInt(header + 16, time, 8);
+	putInt(header + 24, size, 4);
+
+	// the new record overwrites the index, it is written again when closing the archive
+	file.clear();
+	file.seekp(data_end);
+	file.write((const char*) header, RECORD_HEADER_SIZE);
+	file.write((const char*) data, size);
+	if (!file) {
+		file.clear();
+		return false;
+	}
+	changed = true;
+
+	auto it = index.find(tile);
+	if (it != index.end())
+		garbage += RECORD_HEADER_SIZE + it->second.size;
+	Entry& entry = index[tile];
+	entry.offset = data_end;
+	entry.size = size;
+	entry.time = time;
+	data_end += RECORD_HEADER_SIZE + size;
+	return true;
+}
+
+bool TileArchive::removeTile(const TilePath& tile) {
+	auto it = index.find(tile);
+	if (it == index.end())
+		return true;
+	if (!file.is_open())
+		return false;
+
+	uint8_t header[RECORD_HEADER_SIZE];
+	putInt(header, RECORD_MAGIC, 4);
+	putInt(header + 4, tile.getKey(), 8);
+	putInt(header + 12, tile.getDepth(), 4);
+	putInt(header + 16, std::time(nullptr), 8);
+	putInt(header + 24, 0, 4);
+
+	file.clear();
+	file.seekp(data_end);
+	if (!file.write((const char*) header, RECORD_HEADER_SIZE)) {
+		file.clear();
+		return false;
+	}
+	changed = true;
+	garbage += 2 * RECORD_HEADER_SIZE + it->second.size;
+	data_end += RECORD_HEADER_SIZE;
+	index.erase(it);
+	return true;
+}
+
+void TileArchive::listTiles(std::vector<TilePath>& tiles) const {
+	for (auto it = index.begin(); it != index.end(); ++it)
+		tiles.push_back(it->first);
+}
+
+size_t TileArchive::getTileCount() const {
+	return index.size();
+}
+
+bool TileArchive::readIndex(uint64_t file_size) {
+	if (file_size < HEADER_SIZE + FOOTER_SIZE)
+		return false;
+
+	uint8_t footer[FOOTER_SIZE];
+	file.clear();
+	file.seekg(file_size - FOOTER_SIZE);
+	if (!file.read((char*) footer, FOOTER_SIZE)
+			|| getInt(footer + 12, 4) != FOOTER_MAGIC)
+		return false;
+	uint64_t index_offset = getInt(footer, 8);
+	uint64_t count = getInt(footer + 8, 4);
+	if (index_offset < HEADER_SIZE
+			|| index_offset + count * INDEX_ENTRY_SIZE + FOOTER_SIZE != file_size)
+		return false;
+
+	std::vector<uint8_t> entries(count * INDEX_ENTRY_SIZE);
+	file.seekg(index_offset);
+	if (count > 0 && !file.read((char*) &entries[0], entries.size()))
+		return false;
+
+	uint64_t live = 0;
+	for (size_t i = 0; i < count; i++) {
+		const uint8_t* data = &entries[i * INDEX_ENTRY_SIZE];
+		TilePath tile = TilePath::byKey(getInt(data, 8), getInt(data + 8, 4));
+		Entry& entry = index[tile];
+		entry.offset = getInt(data + 12, 8);
+		entry.size = getInt(data + 20, 4);
+		entry.time = getInt(data + 24, 8);
+		if (entry.offset + RECORD_HEADER_SIZE + entry.size > index_offset) {
+			index.clear();
+			return false;
+		}
+		live += RECORD_HEADER_SIZE + entry.size;
+	}
+	data_end = index_offset;
+	garbage = data_end - HEADER_SIZE - live;
+	return true;
+}
+
+void TileArchive::rebuildIndex(uint64_t file_size) {
+	index.clear();
+	garbage = 0;
+	uint64_t offset = HEADER_SIZE;
+	uint8_t header[RECORD_HEADER_SIZE];
+	file.clear();
+	while (offset + RECORD_HEADER_SIZE <= file_size) {
+		file.seekg(offset);
+		if (!file.read((char*) header, RECORD_HEADER_SIZE)
+				|| getInt(header, 4) != RECORD_MAGIC)
+			break;
+		uint64_t key = getInt(header + 4, 8);
+		int depth = getInt(header + 12, 4);
+		uint32_t size = getInt(header + 24, 4);
+		// stop at records which were not written completely
+		if (depth > TilePath::MAX_DEPTH || offset + RECORD_HEADER_SIZE + size > file_size)
+			break;
+
+		TilePath tile = TilePath::byKey(key, depth);
+		auto it = index.find(tile);
+		if (it != index.end())
+			garbage += RECORD_HEADER_SIZE + it->second.size;
+		if (size == 0) {
+			// the tile was removed
+			garbage += RECORD_HEADER_SIZE;
+			if (it != index.end())
+				index.erase(it);
+		} else {
+			Entry& entry = index[tile];
+			entry.offset = offset;
+			entry.size = size;
+			entry.time = getInt(header + 16, 8);
+		}
+		offset += RECORD_HEADER_SIZE + size;
+	}
+	file.clear();
+	data_end = offset;
+	changed = true;
+}
+
+bool TileArchive::writeIndex() {
+	std::vector<uint8_t> data(index.size() * INDEX_ENTRY_SIZE + FOOTER_SIZE);
+	uint8_t* p = data.data();
+	for (auto it = index.begin(); it != index.end(); ++it, p += INDEX_ENTRY_SIZE) {
+		putInt(p, it->first.getKey(), 8);
+		putInt(p + 8, it->first.getDepth(), 4);
+		putInt(p + 12, it->second.offset, 8);
+		putInt(p + 20, it->second.size, 4);
+		putInt(p + 24, it->second.time, 8);
+	}
+	putInt(p, data_end, 8);
+	putInt(p + 8, index.size(), 4);
+	putInt(p + 12, FOOTER_MAGIC, 4);
+
+	file.clear();
+	file.seekp(data_end);
+	file.write((const char*) data.data(), data.size());
+	file.close();
+	if (!file) {
+		LOG(ERROR) << "Unable to write the index of tile archive " << filename << ".";
+		return false;
+	}
+
+	// the old index might have been longer, the footer has to be at the end of the file
+	boost::system::error_code error;
+	fs::resize_file(filename, data_end + data.size(), error);
+	changed = false;
+	return !error;
+}
+
+bool TileArchive::compact() {
+	fs::path temp = filename;
+	temp += ".tmp";
+	boost::system::error_code error;
+	fs::remove(temp, error);
+
+	TileArchive compacted(temp);
+	if (!compacted.open())
+		return false;
+	std::vector<uint8_t> data;
+	for (auto it = index.begin(); it != index.end(); ++it) {
+		if (!readTile(it->first, data) || !compacted.writeTile(it->first,
+				data.data(), data.size(), it->second.time)) {
+			compacted.close();
+			fs::remove(temp, error);
+			return false;
+		}
+	}
+	compacted.close();
+	file.close();
+
+	fs::rename(temp, filename, error);
+	if (error) {
+		LOG(ERROR) << "Unable to replace tile archive " << filename << ": " << error.message();
+		fs::remove(temp, error);
+		return false;
+	}
+	changed = false;
+	return true;
+}
+
+ArchiveTileStorage::ArchiveTileStorage(const fs::path& output_dir,
+		const std::string& suffix, int max_open_archives)
+	: output_dir(output_dir), suffix(suffix),
+	  max_open_archives(std::max(1, max_open_archives)), use_counter(0) {
+}
+
+ArchiveTileStorage::~ArchiveTileStorage() {
+	flush();
+}
+
+bool ArchiveTileStorage::hasTile(const TilePath& tile) {
+	TilePath prefix = getArchivePrefix(tile);
+	std::shared_ptr<ArchiveSlot> slot = getArchiveSlot(prefix, false);
+	if (!slot)
+		return false;
+	thread_ns::unique_lock<thread_ns::mutex> lock(slot->mutex);
+	TileArchive* archive = openArchive(*slot, prefix, false);
+	return archive != nullptr && archive->hasTile(tile);
+}
+
+std::time_t ArchiveTileStorage::getTileTime(const TilePath& tile) {
+	TilePath prefix = getArchivePrefix(tile);
+	std::shared_ptr<ArchiveSlot> slot = getArchiveSlot(prefix, false);
+	if (!slot)
+		return 0;
+	thread_ns::unique_lock<thread_ns::mutex> lock(slot->mutex);
+	TileArchive* archive = openArchive(*slot, prefix, false);
+	return archive != nullptr ? archive->getTileTime(tile) : 0;
+}
+
+bool ArchiveTileStorage::touchTile(const TilePath& tile) {
+	TilePath prefix = getArchivePrefix(tile);
+	std::shared_ptr<ArchiveSlot> slot = getArchiveSlot(prefix, false);
+	if (!slot)
+		return false;
+	thread_ns::unique_lock<thread_ns::mutex> lock(slot->mutex);
+	TileArchive* archive = openArchive(*slot, prefix, false);
+	return archive != nullptr && archive->touchTile(tile);
+}
+
+bool ArchiveTileStorage::readTile(const TilePath& tile, std::vector<uint8_t>& data) {
+	TilePath prefix = getArchivePrefix(tile);
+	std::shared_ptr<ArchiveSlot> slot = getArchiveSlot(prefix, false);
+	if (!slot)
+		return false;
+	thread_ns::unique_lock<thread_ns::mutex> lock(slot->mutex);
+	TileArchive* archive = openArchive(*slot, prefix, false);
+	return archive != nullptr && archive->readTile(tile, data);
+}
+
+bool ArchiveTileStorage::removeTile(const TilePath& tile) {
+	TilePath prefix = getArchivePrefix(tile);
+	std::shared_ptr<ArchiveSlot> slot = getArchiveSlot(prefix, false);
+	if (!slot)
+		return true;
+	thread_ns::unique_lock<thread_ns::mutex> lock(slot->mutex);
+	TileArchive* archive = openArchive(*slot, prefix, false);
+	return archive == nullptr || archive->removeTile(tile);
+}
+
+bool ArchiveTileStorage::writeTile(const TilePath& tile, const uint8_t* data,
+		size_t size) {
+	TilePath prefix = getArchivePrefix(tile);
+	std::shared_ptr<ArchiveSlot> slot = getArchiveSlot(prefix, true);
+	thread_ns::unique_lock<thread_ns::mutex> lock(slot->mutex);
+	TileArchive* archive = openArchive(*slot, prefix, true);
+	return archive != nullptr && archive->writeTile(tile, data, size);
+}
+
+void ArchiveTileStorage::listTiles(std::vector<TilePath>& tiles) {
+	std::vector<TilePath> prefixes = findArchives();
+	for (auto it = prefixes.begin(); it != prefixes.end(); ++it) {
+		std::shared_ptr<ArchiveSlot> slot = getArchiveSlot(*it, false);
+		if (!slot)
+			continue;
+		thread_ns::unique_lock<thread_ns::mutex> lock(slot->mutex);
+		TileArchive* archive = openArchive(*slot, *it, false);
+		if (archive != nullptr)
+			archive->listTiles(tiles);
+	}
+}
+
+bool ArchiveTileStorage::increaseDepth() {
+	// all tile paths change, so every archive has to be written again: write the moved
+	// tiles to new archives in a temporary directory and replace the old archives then,
+	// the old archives stay intact if something goes wrong (but it needs twice the space)
+	std::vector<TilePath> tiles;
+	listTiles(tiles);
+	std::vector<TilePath> old_archives = findArchives();
+
+	fs::path temp_dir = output_dir;
+	temp_dir += "_";
+	boost::system::error_code error;
+	fs::remove_all(temp_dir, error);
+
+	ArchiveTileStorage temp(temp_dir, suffix, max_open_archives);
+	std::vector<uint8_t> data;
+	for (auto it = tiles.begin(); it != tiles.end(); ++it) {
+		// the base tile has to be created again anyways
+		if (it->getDepth() == 0)
+			continue;
+		if (!readTile(*it, data) || !temp.writeTile(getDeeperTilePath(*it),
+				data.data(), data.size())) {
+			LOG(ERROR) << "Unable to move tile " << *it << " to the next zoom level.";
+			fs::remove_all(temp_dir, error);
+			return false;
+		}
+	}
+	temp.flush();
+	flush();
+
+	for (auto it = old_archives.begin(); it != old_archives.end(); ++it)
+		fs::remove(getArchiveFile(*it), error);
+	std::vector<TilePath> new_archives = temp.findArchives();
+	for (auto it = new_archives.begin(); it != new_archives.end(); ++it) {
+		fs::path file = getArchiveFile(*it);
+		if (!fs::exists(file.branch_path()))
+			fs::create_directories(file.branch_path());
+		fs::rename(temp.getArchiveFile(*it), file);
+	}
+	fs::remove_all(temp_dir, error);
+	return true;
+}
+
+void ArchiveTileStorage::flush() {
+	std::vector<std::shared_ptr<ArchiveSlot>> slots;
+	{
+		thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+		for (auto it = archives.begin(); it != archives.end(); ++it)
+			slots.push_back(it->second);
+		archives_used.clear();
+	}
+
+	// closing the archives writes their indexes
+	for (auto it = slots.begin(); it != slots.end(); ++it) {
+		thread_ns::unique_lock<thread_ns::mutex> lock((*it)->mutex);
+		(*it)->archive.reset();
+	}
+}
+
+TilePath ArchiveTileStorage::getArchivePrefix(const TilePath& tile) {
+	int depth = tile.getDepth() / ARCHIVE_LEVELS * ARCHIVE_LEVELS;
+	return TilePath::byKey(tile.getKey(), depth);
+}
+
+fs::path ArchiveTileStorage::getArchiveFile(const TilePath& prefix) const {
+	std::string ending = "." + suffix + ".pack";
+	if (prefix.getDepth() == 0)
+		return output_dir / ("base" + ending);
+	return output_dir / (prefix.toString() + ending);
+}
+
+std::shared_ptr<ArchiveTileStorage::ArchiveSlot> ArchiveTileStorage::getArchiveSlot(
+		const TilePath& prefix, bool create) {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	auto it = archives.find(prefix);
+	if (it == archives.end()) {
+		if (!create) {
+			// don't block the other archives while asking the file system
+			lock.unlock();
+			if (!fs::exists(getArchiveFile(prefix)))
+				return nullptr;
+			lock.lock();
+			it = archives.find(prefix);
+		}
+		if (it == archives.end())
+			it = archives.insert(std::make_pair(prefix,
+					std::make_shared<ArchiveSlot>())).first;
+	}
+	std::shared_ptr<ArchiveSlot> slot = it->second;
+
+	// the archive not used for the longest time is closed if there are too many open
+	std::shared_ptr<ArchiveSlot> oldest_slot;
+	if (!archives_used.count(prefix) && (int) archives_used.size() >= max_open_archives) {
+		auto oldest = archives_used.begin();
+		for (auto used_it = archives_used.begin(); used_it != archives_used.end(); ++used_it)
+			if (used_it->second < oldest->second)
+				oldest = used_it;
+		oldest_slot = archives[oldest->first];
+		archives_used.erase(oldest);
+	}
+	archives_used[prefix] = ++use_counter;
+	lock.unlock();
+
+	if (oldest_slot) {
+		thread_ns::unique_lock<thread_ns::mutex> oldest_lock(oldest_slot->mutex);
+		oldest_slot->archive.reset();
+	}
+	return slot;
+}
+
+TileArchive* ArchiveTileStorage::openArchive(ArchiveSlot& slot, const TilePath& prefix,
+		bool create) {
+	if (slot.archive)
+		return slot.archive.get();
+
+	fs::path file = getArchiveFile(prefix);
+	if (!create && !fs::exists(file))
+		return nullptr;
+	std::unique_ptr<TileArchive> archive(new TileArchive(file));
+	if (!archive->open()) {
+		LOG(ERROR) << "Unable to open tile archive " << file << ".";
+		return nullptr;
+	}
+	slot.archive = std::move(archive);
+	return slot.archive.get();
+}
+
+std::vector<TilePath> ArchiveTileStorage::findArchives() const {
+	std::vector<TilePath> prefixes;
+	if (!fs::is_directory(output_dir))
+		return prefixes;
+	std::string ending = "." + suffix + ".pack";
+	fs::recursive_directory_iterator end;
+	for (fs::recursive_directory_iterator it(output_dir); it != end; ++it) {
+		TilePath prefix;
+		if (fs::is_regular_file(it->path())
+				&& parseTileFile(output_dir, it->path(), ending, prefix))
+			prefixes.push_back(prefix);
+	}
+	return prefixes;
+}
+
+}
+}
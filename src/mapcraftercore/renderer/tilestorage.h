@@ -0,0 +1,306 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TILESTORAGE_H_
+#define TILESTORAGE_H_
+
+#include "tileset.h"
+#include "../compat/thread.h"
+#include "../config/configsections/map.h"
+
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+
+namespace fs = boost::filesystem;
+
+namespace mapcrafter {
+namespace renderer {
+
+class RGBAImage;
+class TileImageFormat;
+
+/**
+ * Stores the (encoded) tile images of a map rotation. The tiles are identified by their
+ * tile path, the base tile (the tile of zoom level 0) has the empty path.
+ *
+ * The methods are safe to be called from the multiple render threads at the same time.
+ */
+class TileStorage {
+public:
+	virtual ~TileStorage();
+
+	/**
+	 * Returns whether a tile exists.
+	 */
+	virtual bool hasTile(const TilePath& tile) = 0;
+
+	/**
+	 * Returns the time a tile was written the last time, 0 if the tile does not exist.
+	 */
+	virtual std::time_t getTileTime(const TilePath& tile) = 0;
+
+	/**
+	 * Sets the time of a tile to now without writing it again, for tiles that were
+	 * rendered again but did not change. Returns false if the tile does not exist.
+	 */
+	virtual bool touchTile(const TilePath& tile) = 0;
+
+	/**
+	 * Reads/writes the image file data of a tile.
+	 */
+	virtual bool readTile(const TilePath& tile, std::vector<uint8_t>& data) = 0;
+	virtual bool writeTile(const TilePath& tile, const uint8_t* data, size_t size) = 0;
+
+	/**
+	 * Removes a tile if it exists. Returns false if an existing tile could not be removed.
+	 */
+	virtual bool removeTile(const TilePath& tile) = 0;
+
+	/**
+	 * Returns the paths of all stored tiles.
+	 */
+	virtual void listTiles(std::vector<TilePath>& tiles) = 0;
+
+	/**
+	 * Moves all tiles one zoom level deeper when the max zoom level of a map increased:
+	 * Tile 1/... becomes 1/4/..., tile 2/... becomes 2/3/... and so on. The base tile
+	 * is removed, the composite tiles of zoom level 0 and 1 have to be created again
+	 * (see RenderManager::increaseMaxZoom).
+	 */
+	virtual bool increaseDepth() = 0;
+
+	/**
+	 * Makes sure that everything written is on the disk.
+	 */
+	virtual void flush() = 0;
+
+	/**
+	 * Reads/writes a tile image with the image format of the map. The size of the
+	 * written tile is stored in size if not nullptr.
+	 */
+	bool readTile(const TilePath& tile, RGBAImage& image, const TileImageFormat& format);
+	bool writeTile(const TilePath& tile, const RGBAImage& image,
+			const TileImageFormat& format, bool render_tile = false, size_t* size = nullptr);
+
+	/**
+	 * Creates the tile storage configured for a map. The suffix is the file extension
+	 * of the image format.
+	 */
+	static std::shared_ptr<TileStorage> create(config::TileStorageType type,
+			const fs::path& output_dir, const std::string& suffix);
+};
+
+/**
+ * Stores every tile as an image file in a directory tree like 1/2/3/4.png, the base
+ * tile is stored as base.png. This is the layout the web interface reads.
+ */
+class DirectoryTileStorage : public TileStorage {
+public:
+	DirectoryTileStorage(const fs::path& output_dir, const std::string& suffix);
+	virtual ~DirectoryTileStorage();
+
+	virtual bool hasTile(const TilePath& tile);
+	virtual std::time_t getTileTime(const TilePath& tile);
+	virtual bool touchTile(const TilePath& tile);
+
+	virtual bool readTile(const TilePath& tile, std::vector<uint8_t>& data);
+	virtual bool writeTile(const TilePath& tile, const uint8_t* data, size_t size);
+	virtual bool removeTile(const TilePath& tile);
+
+	virtual void listTiles(std::vector<TilePath>& tiles);
+	virtual bool increaseDepth();
+	virtual void flush();
+
+	/**
+	 * Returns the image file of a tile.
+	 */
+	fs::path getTileFile(const TilePath& tile) const;
+
+private:
+	fs::path output_dir;
+	std::string suffix;
+};
+
+/**
+ * A single archive file containing the images of many tiles.
+ *
+ * The tile images are appended to the file as records (a header with the tile path,
+ * the time it was written and the data size, followed by the data). A replaced tile
+ * is appended again, its old record is garbage then. A removed tile is appended as
+ * record without data. When the archive is closed, an index (tile path -> offset,
+ * size, time of all tiles) and a footer pointing to the index are written to the end
+ * of the file. Archives with a lot of garbage are compacted when closing them.
+ *
+ * If the archive was not closed properly (Mapcrafter was killed during rendering), the
+ * index is rebuilt by scanning the records of the file.
+ *
+ * All numbers are stored as little endian.
+ */
+class TileArchive {
+public:
+	TileArchive(const fs::path& filename);
+	~TileArchive();
+
+	/**
+	 * Opens the archive file, it is created if it does not exist yet.
+	 */
+	bool open();
+
+	/**
+	 * Writes the index and closes the archive file.
+	 */
+	void close();
+
+	bool hasTile(const TilePath& tile) const;
+	std::time_t getTileTime(const TilePath& tile) const;
+	bool touchTile(const TilePath& tile, std::time_t time = std::time(nullptr));
+
+	bool readTile(const TilePath& tile, std::vector<uint8_t>& data);
+	bool writeTile(const TilePath& tile, const uint8_t* data, size_t size,
+			std::time_t time = std::time(nullptr));
+	bool removeTile(const TilePath& tile);
+
+	void listTiles(std::vector<TilePath>& tiles) const;
+	size_t getTileCount() const;
+
+private:
+	struct Entry {
+		uint64_t offset;
+		uint32_t size;
+		int64_t time;
+	};
+
+	/**
+	 * Reads the index from the end of the file, or rebuilds it by scanning the records
+	 * if there is no valid index.
+	 */
+	bool readIndex(uint64_t file_size);
+	void rebuildIndex(uint64_t file_size);
+	bool writeIndex();
+	bool compact();
+
+	fs::path filename;
+	std::fstream file;
+
+	std::map<TilePath, Entry> index;
+	// where the next record is written (the index starts there when the file is closed)
+	uint64_t data_end;
+	// bytes of records of replaced/removed tiles
+	uint64_t garbage;
+	bool changed;
+};
+
+/**
+ * Packs the tiles into archive files (see TileArchive) instead of storing millions of
+ * small image files. Every archive contains the tiles of a subtree with
+ * ARCHIVE_LEVELS zoom levels: The tiles of zoom level 0 to 7 are in base.png.pack,
+ * the tiles of zoom level 8 to 15 below 1/2/3/4/1/2/3/4 are in 1/2/3/4/1/2/3/4.png.pack
+ * and so on.
+ *
+ * Only a limited count of archives is kept open, archives not used for some time are
+ * closed (and their index written) when other archives need to be opened.
+ *
+ * Every archive has its own lock, so render threads working on different archives
+ * don't wait for each other while reading/writing tiles or opening an archive.
+ *
+ * Moving the tiles one zoom level deeper (increaseDepth) writes all tiles to new
+ * archives in the directory <output_dir>_ first, so it temporarily needs twice the
+ * disk space of the archives.
+ */
+class ArchiveTileStorage : public TileStorage {
+public:
+	ArchiveTileStorage(const fs::path& output_dir, const std::string& suffix,
+			int max_open_archives = 64);
+	virtual ~ArchiveTileStorage();
+
+	virtual bool hasTile(const TilePath& tile);
+	virtual std::time_t getTileTime(const TilePath& tile);
+	virtual bool touchTile(const TilePath& tile);
+
+	virtual bool readTile(const TilePath& tile, std::vector<uint8_t>& data);
+	virtual bool writeTile(const TilePath& tile, const uint8_t* data, size_t size);
+	virtual bool removeTile(const TilePath& tile);
+
+	virtual void listTiles(std::vector<TilePath>& tiles);
+	virtual bool increaseDepth();
+	virtual void flush();
+
+	/**
+	 * Returns the root of the subtree whose archive contains a tile.
+	 */
+	static TilePath getArchivePrefix(const TilePath& tile);
+
+	/**
+	 * Returns the archive file of a subtree.
+	 */
+	fs::path getArchiveFile(const TilePath& prefix) const;
+
+	static const int ARCHIVE_LEVELS = 8;
+
+private:
+	/**
+	 * An archive of a subtree with its own lock. The slot of an archive is kept when the
+	 * archive is closed, so it is never opened twice at the same time.
+	 */
+	struct ArchiveSlot {
+		thread_ns::mutex mutex;
+		// nullptr if the archive is closed
+		std::unique_ptr<TileArchive> archive;
+	};
+
+	/**
+	 * Returns the slot of the archive of a subtree, or nullptr if the archive does not
+	 * exist and create is false. If too many archives are open, the archive not used
+	 * for the longest time is closed.
+	 */
+	std::shared_ptr<ArchiveSlot> getArchiveSlot(const TilePath& prefix, bool create);
+
+	/**
+	 * Returns the archive of a slot and opens it if necessary, or nullptr if it does not
+	 * exist and create is false. The mutex of the slot must be locked.
+	 */
+	TileArchive* openArchive(ArchiveSlot& slot, const TilePath& prefix, bool create);
+
+	/**
+	 * Returns the prefixes of all archive files in the output directory.
+	 */
+	std::vector<TilePath> findArchives() const;
+
+	fs::path output_dir;
+	std::string suffix;
+	int max_open_archives;
+
+	// protects the slots and the bookkeeping of the open archives, not the archives
+	thread_ns::mutex mutex;
+	std::map<TilePath, std::shared_ptr<ArchiveSlot>> archives;
+	// when the opened archives were used the last time, to close the oldest ones
+	std::map<TilePath, uint64_t> archives_used;
+	uint64_t use_counter;
+};
+
+}
+}
+
+#endif /* TILESTORAGE_H_ */
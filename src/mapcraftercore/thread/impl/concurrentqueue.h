@@ -34,6 +34,7 @@ public:
 	~ConcurrentQueue();
 
 	bool empty();
+	size_t size();
 	void push(T item);
 	T pop();
 
@@ -57,6 +58,12 @@ bool ConcurrentQueue<T>::empty() {
 	return queue.empty();
 }
 
+template <typename T>
+size_t ConcurrentQueue<T>::size() {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	return queue.size();
+}
+
 template <typename T>
 void ConcurrentQueue<T>::push(T item) {
 	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
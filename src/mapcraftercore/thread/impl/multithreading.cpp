@@ -29,7 +29,7 @@ namespace mapcrafter {
 namespace thread {
 
 ThreadManager::ThreadManager()
-	: finished(false) {
+	: working(0), finished(false) {
 }
 
 ThreadManager::~ThreadManager() {
@@ -38,11 +38,13 @@ ThreadManager::~ThreadManager() {
 void ThreadManager::addWork(const renderer::RenderWork& work) {
 	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
 	work_queue.push(work);
+	updateMetrics();
 }
 
 void ThreadManager::addExtraWork(const renderer::RenderWork& work) {
 	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
 	work_extra_queue.push(work);
+	updateMetrics();
 	condition_wait_jobs.notify_one();
 }
 
@@ -55,14 +57,24 @@ void ThreadManager::setFinished() {
 
 bool ThreadManager::getWork(renderer::RenderWork& work) {
 	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
-	while (!finished && (work_queue.empty() && work_extra_queue.empty()))
-		condition_wait_jobs.wait(lock);
+	while (!finished) {
+		if (work_queue.empty() && work_extra_queue.empty())
+			condition_wait_jobs.wait(lock);
+		// don't start more jobs while too much memory is used, unless nothing else is
+		// rendered (the memory of the running jobs is freed when they are finished)
+		else if (working > 0 && util::MemoryAccountant::isOverLimit())
+			condition_wait_jobs.wait_for(lock, chrono_ns::milliseconds(100));
+		else
+			break;
+	}
 	if (finished)
 		return false;
 	if (!work_extra_queue.empty())
 		work = work_extra_queue.pop();
 	else if (!work_queue.empty())
 		work = work_queue.pop();
+	working++;
+	updateMetrics();
 	return true;
 }
 
@@ -75,6 +87,10 @@ void ThreadManager::workFinished(const renderer::RenderWork& work,
 		result_queue.push(result);
 		condition_wait_results.notify_one();
 	}
+	working--;
+	// threads waiting for memory can check again
+	condition_wait_jobs.notify_all();
+	updateMetrics();
 }
 
 bool ThreadManager::getResult(renderer::RenderWorkResult& result) {
@@ -84,24 +100,47 @@ bool ThreadManager::getResult(renderer::RenderWorkResult& result) {
 	if (finished)
 		return false;
 	result = result_queue.pop();
+	updateMetrics();
 	return true;
 }
 
+void ThreadManager::updateMetrics() {
+	util::Metrics::set(util::MetricGauge::WORK_QUEUE_DEPTH,
+			work_queue.size() + work_extra_queue.size());
+	util::Metrics::set(util::MetricGauge::RESULT_QUEUE_DEPTH, result_queue.size());
+}
+
 ThreadWorker::ThreadWorker(WorkerManager<renderer::RenderWork, renderer::RenderWorkResult>& manager,
-		const renderer::RenderContext& context)
+		const renderer::RenderContext& context, util::ProgressCounter* progress)
 	: manager(manager), render_context(context) {
 	render_worker.setRenderContext(context);
+	render_worker.setProgressCounter(progress);
 }
 
 ThreadWorker::~ThreadWorker() {
 }
 
 void ThreadWorker::operator()() {
+	util::Tracer::setThreadName("render thread");
 	renderer::RenderWork work;
 
-	while (manager.getWork(work)) {
-		render_worker.setRenderWork(work);
-		render_worker();
+	while (true) {
+		// free the memory of this thread's world cache if too much memory is used, other
+		// threads might need it more than this one while it is waiting
+		if (util::MemoryAccountant::isOverLimit())
+			render_context.world_cache->evict(util::MemoryAccountant::getExcess());
+
+		{
+			util::TraceSpan span("wait_for_work", "wait");
+			if (!manager.getWork(work))
+				break;
+		}
+
+		{
+			util::TraceSpan span("render_job");
+			render_worker.setRenderWork(work);
+			render_worker();
+		}
 
 		manager.workFinished(work, render_worker.getRenderWorkResult());
 	}
@@ -116,7 +155,7 @@ MultiThreadingDispatcher::~MultiThreadingDispatcher() {
 
 void MultiThreadingDispatcher::dispatch(const renderer::RenderContext& context,
 		util::IProgressHandler* progress) {
-	auto tiles = context.tile_set->getRequiredCompositeTiles();
+	const auto& tiles = context.tile_set->getRequiredCompositeTiles();
 	if (tiles.size() == 0)
 		return;
 
@@ -132,16 +171,27 @@ void MultiThreadingDispatcher::dispatch(const renderer::RenderContext& context,
 	//int render_tiles = context.tile_set->getRequiredRenderTilesCount();
 	//LOG(INFO) << thread_count << " threads will render " << render_tiles << " render tiles.";
 
+	// every thread counts its rendered tiles itself, the progress handler is updated
+	// by the reporter thread and not by the dispatcher
+	progress->setMax(context.tile_set->getRequiredRenderTilesCount());
+	util::ProgressReporter reporter(progress, thread_count);
+	reporter.start();
+
 	for (int i = 0; i < thread_count; i++) {
 		renderer::RenderContext thread_context = context;
 		thread_context.initializeTileRenderer();
-		threads.push_back(thread_ns::thread(ThreadWorker(manager, thread_context)));
+		threads.push_back(thread_ns::thread(ThreadWorker(manager, thread_context,
+				&reporter.getCounter(i))));
 	}
 
-	progress->setMax(context.tile_set->getRequiredRenderTilesCount());
 	renderer::RenderWorkResult result;
-	while (manager.getResult(result)) {
-		progress->setValue(progress->getValue() + result.tiles_rendered);
+	while (true) {
+		{
+			util::TraceSpan span("wait_for_results", "wait");
+			if (!manager.getResult(result))
+				break;
+		}
+
 		for (auto tile_it = result.render_work.tiles.begin();
 				tile_it != result.render_work.tiles.end(); ++tile_it) {
 			rendered_tiles.insert(*tile_it);
@@ -171,6 +221,7 @@ void MultiThreadingDispatcher::dispatch(const renderer::RenderContext& context,
 
 	for (int i = 0; i < thread_count; i++)
 		threads[i].join();
+	reporter.stop();
 }
 
 } /* namespace thread */
@@ -47,9 +47,16 @@ public:
 
 	bool getResult(renderer::RenderWorkResult& result);
 private:
+	/**
+	 * Updates the queue depth metrics, the mutex must be locked.
+	 */
+	void updateMetrics();
+
 	ConcurrentQueue<renderer::RenderWork> work_queue, work_extra_queue;
 	ConcurrentQueue<renderer::RenderWorkResult> result_queue;
 
+	// count of the jobs being rendered at the moment
+	int working;
 	bool finished;
 	thread_ns::mutex mutex;
 	thread_ns::condition_variable condition_wait_jobs, condition_wait_results;
@@ -58,7 +65,7 @@ private:
 class ThreadWorker {
 public:
 	ThreadWorker(WorkerManager<renderer::RenderWork, renderer::RenderWorkResult>& manager,
-			const renderer::RenderContext& context);
+			const renderer::RenderContext& context, util::ProgressCounter* progress);
 	~ThreadWorker();
 
 	void operator()();
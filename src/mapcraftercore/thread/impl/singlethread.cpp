@@ -46,11 +46,17 @@ void SingleThreadDispatcher::dispatch(const renderer::RenderContext& context,
 	renderer::RenderWork work;
 	work.tiles.insert(renderer::TilePath());
 
+	// the worker only counts the rendered tiles, the progress handler is updated
+	// by the reporter thread
+	progress->setMax(render_tiles);
+	util::ProgressReporter reporter(progress, 1);
 	renderer::TileRenderWorker worker;
 	worker.setRenderContext(context);
 	worker.setRenderWork(work);
-	worker.setProgressHandler(progress);
+	worker.setProgressCounter(&reporter.getCounter(0));
+	reporter.start();
 	worker();
+	reporter.stop();
 }
 
 } /* namespace thread */
@@ -36,7 +36,11 @@
 #include "util/logging.h"
 #include "util/progress.h"
 #include "util/math.h"
+#include "util/memory.h"
+#include "util/metrics.h"
 #include "util/other.h"
+#include "util/profiler.h"
 #include "util/terminal.h"
+#include "util/trace.h"
 
 #endif /* UTIL_H_ */
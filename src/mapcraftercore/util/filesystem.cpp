@@ -21,6 +21,7 @@
 
 #include "../util.h"
 
+#include <cstdio>
 #include <iostream>
 #include <fstream>
 
@@ -76,6 +77,42 @@ bool moveFile(const fs::path& from, const fs::path& to) {
 	return true;
 }
 
+bool readFile(const fs::path& filename, std::vector<uint8_t>& data) {
+	data.clear();
+	FILE* file = fopen(filename.string().c_str(), "rb");
+	if (file == NULL)
+		return false;
+
+	uint8_t chunk[64 * 1024];
+	size_t read;
+	while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+		data.insert(data.end(), chunk, chunk + read);
+	bool ok = !ferror(file);
+	fclose(file);
+	return ok;
+}
+
+bool writeFileAtomic(const fs::path& filename, const uint8_t* data, size_t size) {
+	fs::path temp = filename;
+	temp += ".tmp";
+
+	FILE* file = fopen(temp.string().c_str(), "wb");
+	if (file == NULL)
+		return false;
+	bool ok = fwrite(data, 1, size, file) == size;
+	ok = fclose(file) == 0 && ok;
+
+	boost::system::error_code error;
+	if (ok) {
+		// rename replaces an existing file atomically on POSIX systems
+		fs::rename(temp, filename, error);
+		if (!error)
+			return true;
+	}
+	fs::remove(temp, error);
+	return false;
+}
+
 fs::path findHomeDir() {
 	char* path;
 #if defined(OS_WINDOWS)
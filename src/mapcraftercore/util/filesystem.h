@@ -20,6 +20,8 @@
 #ifndef FILESYSTEM_H_
 #define FILESYSTEM_H_
 
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 #include <boost/filesystem.hpp>
 
@@ -32,6 +34,19 @@ bool copyFile(const fs::path& from, const fs::path& to);
 bool copyDirectory(const fs::path& from, const fs::path& to);
 bool moveFile(const fs::path& from, const fs::path& to);
 
+/**
+ * Reads the whole content of a file into a buffer.
+ */
+bool readFile(const fs::path& filename, std::vector<uint8_t>& data);
+
+/**
+ * Writes data to a file without ever leaving a partially written file behind: The data
+ * is written to a temporary file next to it first, which then replaces the file. Readers
+ * (like a web server serving the tiles of a map while it is rendered) see either the
+ * old or the new file.
+ */
+bool writeFileAtomic(const fs::path& filename, const uint8_t* data, size_t size);
+
 /**
  * Returns the home directory of the current user.
  *
@@ -22,6 +22,7 @@
 #define MATH_H_
 
 #include <cmath>
+#include <cstdint>
 
 namespace mapcrafter {
 namespace util {
@@ -62,6 +63,21 @@ bool floatingPointEquals(T a, T b, T epsilon = 0.0001) {
 	return std::abs(a - b) < epsilon;
 }
 
+/**
+ * Multiplier of the multiply-xorshift hash (2^64 divided by the golden ratio).
+ */
+const uint64_t HASH_MULTIPLIER = 0x9e3779b97f4a7c15ULL;
+
+/**
+ * Mixes a value into a (non-cryptographic) multiply-xorshift 64 bit hash.
+ */
+inline uint64_t hashMix(uint64_t h, uint64_t v) {
+	v *= HASH_MULTIPLIER;
+	v ^= v >> 32;
+	h = (h ^ v) * HASH_MULTIPLIER;
+	return h ^ (h >> 29);
+}
+
 /**
  * Binary constants helper.
  */
@@ -0,0 +1,168 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "memory.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <iomanip>
+#include <sstream>
+
+namespace mapcrafter {
+namespace util {
+
+namespace {
+
+const char* COMPONENT_NAMES[] = {
+	"region cache",
+	"chunk cache",
+	"composite tiles",
+};
+
+static_assert(sizeof(COMPONENT_NAMES) / sizeof(COMPONENT_NAMES[0]) == (size_t) MemoryComponent::COUNT,
+		"Every memory component needs a name");
+
+const char* UNITS[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+
+void updatePeak(std::atomic<uint64_t>& peak, uint64_t value) {
+	uint64_t current = peak.load(std::memory_order_relaxed);
+	while (value > current && !peak.compare_exchange_weak(current, value,
+			std::memory_order_relaxed))
+		;
+}
+
+}
+
+const char* getMemoryComponentName(MemoryComponent component) {
+	return COMPONENT_NAMES[(size_t) component];
+}
+
+std::atomic<uint64_t> MemoryAccountant::limit(0);
+std::array<std::atomic<uint64_t>, (size_t) MemoryComponent::COUNT> MemoryAccountant::usage;
+std::array<std::atomic<uint64_t>, (size_t) MemoryComponent::COUNT> MemoryAccountant::peak;
+std::atomic<uint64_t> MemoryAccountant::total_usage(0), MemoryAccountant::total_peak(0);
+
+void MemoryAccountant::setLimit(uint64_t limit) {
+	MemoryAccountant::limit = limit;
+}
+
+uint64_t MemoryAccountant::getLimit() {
+	return limit;
+}
+
+void MemoryAccountant::add(MemoryComponent component, int64_t bytes) {
+	// negative values wrap around, but that's fine as long as nobody frees more than
+	// they registered
+	size_t i = (size_t) component;
+	uint64_t value = usage[i].fetch_add(bytes, std::memory_order_relaxed) + bytes;
+	uint64_t total = total_usage.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+	if (bytes > 0) {
+		updatePeak(peak[i], value);
+		updatePeak(total_peak, total);
+	}
+}
+
+uint64_t MemoryAccountant::getUsage(MemoryComponent component) {
+	return usage[(size_t) component].load(std::memory_order_relaxed);
+}
+
+uint64_t MemoryAccountant::getUsage() {
+	return total_usage.load(std::memory_order_relaxed);
+}
+
+uint64_t MemoryAccountant::getPeak(MemoryComponent component) {
+	return peak[(size_t) component].load(std::memory_order_relaxed);
+}
+
+uint64_t MemoryAccountant::getPeak() {
+	return total_peak.load(std::memory_order_relaxed);
+}
+
+void MemoryAccountant::resetPeaks() {
+	for (size_t i = 0; i < (size_t) MemoryComponent::COUNT; i++)
+		peak[i] = usage[i].load();
+	total_peak = total_usage.load();
+}
+
+uint64_t MemoryAccountant::getExcess() {
+	uint64_t limit = MemoryAccountant::limit, total = total_usage;
+	return limit != 0 && total > limit ? total - limit : 0;
+}
+
+std::string MemoryAccountant::formatPeaks() {
+	std::ostringstream out;
+	for (size_t i = 0; i < (size_t) MemoryComponent::COUNT; i++)
+		out << COMPONENT_NAMES[i] << " " << formatByteSize(peak[i]) << ", ";
+	out << "total " << formatByteSize(total_peak);
+	return out.str();
+}
+
+bool parseByteSize(const std::string& str, uint64_t& bytes) {
+	const char* begin = str.c_str();
+	char* end;
+	double value = std::strtod(begin, &end);
+	if (end == begin || value < 0)
+		return false;
+
+	std::string unit(end);
+	if (!unit.empty() && unit[0] == ' ')
+		unit = unit.substr(1);
+	for (size_t i = 0; i < unit.size(); i++)
+		unit[i] = std::toupper(unit[i]);
+	// "8G", "8GB" and "8GiB" all mean 8 GiB
+	if (unit.size() == 3 && unit.substr(1) == "IB")
+		unit = unit.substr(0, 1);
+	else if (unit.size() == 2 && unit[1] == 'B')
+		unit = unit.substr(0, 1);
+
+	double factor = 1;
+	if (unit.empty() || unit == "B")
+		factor = 1;
+	else if (unit == "K")
+		factor = 1024.0;
+	else if (unit == "M")
+		factor = 1024.0 * 1024;
+	else if (unit == "G")
+		factor = 1024.0 * 1024 * 1024;
+	else if (unit == "T")
+		factor = 1024.0 * 1024 * 1024 * 1024;
+	else
+		return false;
+	bytes = value * factor;
+	return true;
+}
+
+std::string formatByteSize(uint64_t bytes) {
+	double value = bytes;
+	size_t unit = 0;
+	while (value >= 1024 && unit + 1 < sizeof(UNITS) / sizeof(UNITS[0])) {
+		value /= 1024;
+		unit++;
+	}
+	std::ostringstream out;
+	if (unit == 0)
+		out << bytes;
+	else
+		out << std::fixed << std::setprecision(1) << value;
+	out << " " << UNITS[unit];
+	return out.str();
+}
+
+}
+}
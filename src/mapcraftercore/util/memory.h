@@ -0,0 +1,145 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MEMORY_H_
+#define MEMORY_H_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace mapcrafter {
+namespace util {
+
+/**
+ * The parts of the renderer whose memory usage is accounted.
+ */
+enum class MemoryComponent {
+	// raw data of the region files in the world caches of the render threads
+	REGION_CACHE,
+	// decoded chunks in the world caches of the render threads
+	CHUNK_CACHE,
+	// images of the composite tiles which are composed from their children
+	COMPOSITE_TILES,
+
+	COUNT
+};
+
+const char* getMemoryComponentName(MemoryComponent component);
+
+/**
+ * Keeps track of how much memory the big caches and buffers of the renderer use, so
+ * the memory usage can be limited and the peak usage of every component reported.
+ *
+ * The components register their usage themselves, the accountant doesn't free anything.
+ * Instead, the caches evict entries and the render threads don't start new work while
+ * the usage exceeds the limit.
+ */
+class MemoryAccountant {
+public:
+	/**
+	 * Sets the memory limit in bytes, 0 means there is no limit.
+	 */
+	static void setLimit(uint64_t limit);
+	static uint64_t getLimit();
+
+	/**
+	 * Changes the accounted usage of a component by some bytes (negative if freed).
+	 */
+	static void add(MemoryComponent component, int64_t bytes);
+
+	/**
+	 * Returns the current usage of a component / of all components.
+	 */
+	static uint64_t getUsage(MemoryComponent component);
+	static uint64_t getUsage();
+
+	/**
+	 * Returns the peak usage of a component / of all components since the last reset.
+	 */
+	static uint64_t getPeak(MemoryComponent component);
+	static uint64_t getPeak();
+
+	/**
+	 * Sets the peak usages to the current usages.
+	 */
+	static void resetPeaks();
+
+	/**
+	 * Returns whether there is a limit and the usage exceeds it.
+	 */
+	static bool isOverLimit() {
+		uint64_t limit = MemoryAccountant::limit.load(std::memory_order_relaxed);
+		return limit != 0 && total_usage.load(std::memory_order_relaxed) > limit;
+	}
+
+	/**
+	 * Returns by how many bytes the usage exceeds the limit, 0 if it doesn't.
+	 */
+	static uint64_t getExcess();
+
+	/**
+	 * Returns the peak usages like "chunk cache 1.2 GiB, region cache 300 MiB, ...".
+	 */
+	static std::string formatPeaks();
+
+private:
+	static std::atomic<uint64_t> limit;
+	static std::array<std::atomic<uint64_t>, (size_t) MemoryComponent::COUNT> usage, peak;
+	static std::atomic<uint64_t> total_usage, total_peak;
+};
+
+/**
+ * Accounts some memory of a component for the lifetime of the object.
+ */
+class MemoryReservation {
+public:
+	MemoryReservation(MemoryComponent component, int64_t bytes)
+		: component(component), bytes(bytes) {
+		MemoryAccountant::add(component, bytes);
+	}
+
+	~MemoryReservation() {
+		MemoryAccountant::add(component, -bytes);
+	}
+
+	MemoryReservation(const MemoryReservation& other) = delete;
+	MemoryReservation& operator=(const MemoryReservation& other) = delete;
+
+private:
+	MemoryComponent component;
+	int64_t bytes;
+};
+
+/**
+ * Parses a size in bytes with an optional binary unit like "512M", "8G" or "8GiB".
+ * Returns false if the size is invalid.
+ */
+bool parseByteSize(const std::string& str, uint64_t& bytes);
+
+/**
+ * Formats a size in bytes with a binary unit, for example "1.5 GiB".
+ */
+std::string formatByteSize(uint64_t bytes);
+
+}
+}
+
+#endif /* MEMORY_H_ */
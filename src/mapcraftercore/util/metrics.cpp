@@ -0,0 +1,286 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "metrics.h"
+
+#include "filesystem.h"
+#include "logging.h"
+
+#include <algorithm>
+#include <ctime>
+#include <sstream>
+
+namespace mapcrafter {
+namespace util {
+
+namespace {
+
+struct MetricInfo {
+	const char* name;
+	const char* help;
+};
+
+const MetricInfo COUNTER_INFOS[] = {
+	{"mapcrafter_bytes_read_total", "Bytes read from region files."},
+	{"mapcrafter_bytes_written_total", "Bytes of encoded tiles written."},
+	{"mapcrafter_tiles_written_total", "Tiles written to the tile storage."},
+	{"mapcrafter_region_cache_hits_total", "Hits of the region caches of the render threads."},
+	{"mapcrafter_region_cache_misses_total", "Misses of the region caches of the render threads."},
+	{"mapcrafter_chunk_cache_hits_total", "Hits of the chunk caches of the render threads."},
+	{"mapcrafter_chunk_cache_misses_total", "Misses of the chunk caches of the render threads."},
+};
+
+const MetricInfo GAUGE_INFOS[] = {
+	{"mapcrafter_work_queue_depth", "Render work waiting for a render thread."},
+	{"mapcrafter_result_queue_depth", "Rendered work waiting for the dispatcher."},
+};
+
+static_assert(sizeof(COUNTER_INFOS) / sizeof(COUNTER_INFOS[0]) == (size_t) MetricCounter::COUNT,
+		"Every metric counter needs a name");
+static_assert(sizeof(GAUGE_INFOS) / sizeof(GAUGE_INFOS[0]) == (size_t) MetricGauge::COUNT,
+		"Every metric gauge needs a name");
+
+void writeHeader(std::ostream& out, const std::string& name, const std::string& help,
+		const std::string& type) {
+	out << "# HELP " << name << " " << help << "\n";
+	out << "# TYPE " << name << " " << type << "\n";
+}
+
+double getRatio(uint64_t hits, uint64_t misses) {
+	return hits + misses == 0 ? 0 : (double) hits / (hits + misses);
+}
+
+std::string escapeLabel(const std::string& value) {
+	std::string escaped;
+	for (size_t i = 0; i < value.size(); i++) {
+		if (value[i] == '\\' || value[i] == '"')
+			escaped += '\\';
+		if (value[i] == '\n')
+			escaped += "\\n";
+		else
+			escaped += value[i];
+	}
+	return escaped;
+}
+
+}
+
+const std::array<double, 10> MetricHistogram::BOUNDS = {{
+	0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1
+}};
+
+MetricHistogram::MetricHistogram()
+	: count(0), sum_ns(0) {
+	for (size_t i = 0; i < buckets.size(); i++)
+		buckets[i] = 0;
+}
+
+void MetricHistogram::observe(uint64_t duration_ns) {
+	double seconds = duration_ns / 1000000000.0;
+	size_t bucket = 0;
+	while (bucket < BOUNDS.size() && seconds > BOUNDS[bucket])
+		bucket++;
+	buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+	count.fetch_add(1, std::memory_order_relaxed);
+	sum_ns.fetch_add(duration_ns, std::memory_order_relaxed);
+}
+
+std::array<std::atomic<uint64_t>, (size_t) MetricCounter::COUNT> Metrics::counters;
+std::array<std::atomic<int64_t>, (size_t) MetricGauge::COUNT> Metrics::gauges;
+
+uint64_t Metrics::get(MetricCounter counter) {
+	return counters[(size_t) counter].load(std::memory_order_relaxed);
+}
+
+int64_t Metrics::get(MetricGauge gauge) {
+	return gauges[(size_t) gauge].load(std::memory_order_relaxed);
+}
+
+MetricHistogram& Metrics::getEncodeHistogram() {
+	static MetricHistogram histogram;
+	return histogram;
+}
+
+std::string Metrics::format() {
+	std::ostringstream out;
+	for (size_t i = 0; i < counters.size(); i++) {
+		writeHeader(out, COUNTER_INFOS[i].name, COUNTER_INFOS[i].help, "counter");
+		out << COUNTER_INFOS[i].name << " " << counters[i].load() << "\n";
+	}
+	for (size_t i = 0; i < gauges.size(); i++) {
+		writeHeader(out, GAUGE_INFOS[i].name, GAUGE_INFOS[i].help, "gauge");
+		out << GAUGE_INFOS[i].name << " " << gauges[i].load() << "\n";
+	}
+
+	writeHeader(out, "mapcrafter_region_cache_hit_ratio",
+			"Hit ratio of the region caches of the render threads.", "gauge");
+	out << "mapcrafter_region_cache_hit_ratio " << getRatio(get(MetricCounter::REGION_CACHE_HITS),
+			get(MetricCounter::REGION_CACHE_MISSES)) << "\n";
+	writeHeader(out, "mapcrafter_chunk_cache_hit_ratio",
+			"Hit ratio of the chunk caches of the render threads.", "gauge");
+	out << "mapcrafter_chunk_cache_hit_ratio " << getRatio(get(MetricCounter::CHUNK_CACHE_HITS),
+			get(MetricCounter::CHUNK_CACHE_MISSES)) << "\n";
+
+	const MetricHistogram& encode = getEncodeHistogram();
+	const std::string name = "mapcrafter_tile_encode_seconds";
+	writeHeader(out, name, "Time it took to encode the tile images.", "histogram");
+	uint64_t cumulative = 0;
+	for (size_t i = 0; i < encode.buckets.size(); i++) {
+		cumulative += encode.buckets[i].load();
+		out << name << "_bucket{le=\"";
+		if (i < MetricHistogram::BOUNDS.size())
+			out << MetricHistogram::BOUNDS[i];
+		else
+			out << "+Inf";
+		out << "\"} " << cumulative << "\n";
+	}
+	out << name << "_sum " << encode.sum_ns.load() / 1000000000.0 << "\n";
+	out << name << "_count " << encode.count.load() << "\n";
+	return out.str();
+}
+
+MetricsFileExporter::RenderProgress::RenderProgress()
+	: tiles(0), tiles_required(0), tiles_per_second(0), seconds(0), active(false) {
+}
+
+MetricsFileExporter::MetricsFileExporter(const fs::path& filename, int interval)
+	: filename(filename), interval(std::chrono::seconds(std::max(1, interval))),
+	  last_write_value(0), running(false) {
+}
+
+MetricsFileExporter::~MetricsFileExporter() {
+	if (running)
+		finishRender();
+}
+
+void MetricsFileExporter::startRender(const std::string& map, const std::string& rotation) {
+	if (running)
+		finishRender();
+
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	current = std::make_pair(map, rotation);
+	renders[current] = RenderProgress();
+	renders[current].active = true;
+	max = value = 0;
+	render_start = last_write = std::chrono::steady_clock::now();
+	last_write_value = 0;
+	writeFile();
+
+	running = true;
+	thread = thread_ns::thread(&MetricsFileExporter::run, this);
+}
+
+void MetricsFileExporter::finishRender() {
+	{
+		thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+		running = false;
+		condition_stop.notify_all();
+	}
+	if (thread.joinable())
+		thread.join();
+
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	RenderProgress& progress = renders[current];
+	progress.seconds = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - render_start).count();
+	// the rate of a finished render is its average rate
+	progress.tiles_per_second = progress.seconds > 0 ? progress.tiles / progress.seconds : 0;
+	progress.active = false;
+	writeFile();
+}
+
+void MetricsFileExporter::setMax(int max) {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	DummyProgressHandler::setMax(max);
+	renders[current].tiles_required = max;
+}
+
+void MetricsFileExporter::setValue(int value) {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	DummyProgressHandler::setValue(value);
+	renders[current].tiles = value;
+}
+
+bool MetricsFileExporter::write() {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	return writeFile();
+}
+
+void MetricsFileExporter::run() {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	while (running) {
+		auto now = std::chrono::steady_clock::now();
+		if (now < last_write + interval) {
+			auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+					last_write + interval - now);
+			condition_stop.wait_for(lock, chrono_ns::milliseconds(remaining.count() + 1));
+			continue;
+		}
+
+		// the rate since the last write, which is 0 if the render is stalled
+		RenderProgress& progress = renders[current];
+		double elapsed = std::chrono::duration<double>(now - last_write).count();
+		progress.tiles_per_second = (progress.tiles - last_write_value) / elapsed;
+		progress.seconds = std::chrono::duration<double>(now - render_start).count();
+		last_write = now;
+		last_write_value = progress.tiles;
+		writeFile();
+	}
+}
+
+bool MetricsFileExporter::writeFile() {
+	std::ostringstream out;
+	const char* names[] = {
+		"mapcrafter_render_active", "mapcrafter_render_tiles", "mapcrafter_render_tiles_required",
+		"mapcrafter_render_tiles_per_second", "mapcrafter_render_seconds"
+	};
+	const char* helps[] = {
+		"Whether the map rotation is being rendered right now.",
+		"Render tiles of the map rotation which are rendered.",
+		"Render tiles of the map rotation which need to be rendered.",
+		"Recently rendered render tiles per second (the average when finished).",
+		"Time spent rendering the map rotation.",
+	};
+	for (size_t i = 0; i < 5; i++) {
+		writeHeader(out, names[i], helps[i], "gauge");
+		for (auto it = renders.begin(); it != renders.end(); ++it) {
+			const RenderProgress& progress = it->second;
+			double values[] = {
+				(double) progress.active, (double) progress.tiles,
+				(double) progress.tiles_required, progress.tiles_per_second, progress.seconds
+			};
+			out << names[i] << "{map=\"" << escapeLabel(it->first.first) << "\",rotation=\""
+					<< escapeLabel(it->first.second) << "\"} " << values[i] << "\n";
+		}
+	}
+	out << Metrics::format();
+	writeHeader(out, "mapcrafter_last_update_timestamp_seconds",
+			"Time the metrics were written.", "gauge");
+	out << "mapcrafter_last_update_timestamp_seconds " << std::time(nullptr) << "\n";
+
+	std::string data = out.str();
+	if (!writeFileAtomic(filename, reinterpret_cast<const uint8_t*>(data.data()), data.size())) {
+		LOG(WARNING) << "Unable to write metrics file " << filename << ".";
+		return false;
+	}
+	return true;
+}
+
+}
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include "progress.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <boost/filesystem.hpp>
+
+namespace fs = boost::filesystem;
+
+namespace mapcrafter {
+namespace util {
+
+/**
+ * The counters of the live metrics. They only increase while Mapcrafter is running.
+ */
+enum class MetricCounter {
+	BYTES_READ,
+	BYTES_WRITTEN,
+	TILES_WRITTEN,
+	REGION_CACHE_HITS,
+	REGION_CACHE_MISSES,
+	CHUNK_CACHE_HITS,
+	CHUNK_CACHE_MISSES,
+
+	COUNT
+};
+
+/**
+ * The gauges of the live metrics, they are set to the current value of something.
+ */
+enum class MetricGauge {
+	// render work waiting for a render thread
+	WORK_QUEUE_DEPTH,
+	// rendered work waiting for the dispatcher
+	RESULT_QUEUE_DEPTH,
+
+	COUNT
+};
+
+/**
+ * A histogram of durations with fixed buckets (like the Prometheus histograms).
+ */
+class MetricHistogram {
+public:
+	MetricHistogram();
+
+	void observe(uint64_t duration_ns);
+
+	/**
+	 * The upper bounds (in seconds) of the buckets, the last bucket is unbounded.
+	 */
+	static const std::array<double, 10> BOUNDS;
+
+	std::array<std::atomic<uint64_t>, 11> buckets;
+	std::atomic<uint64_t> count, sum_ns;
+};
+
+/**
+ * Global metrics which can be updated from any thread. Everything is atomic, so they
+ * can be read while rendering, but they shouldn't be updated in the innermost loops.
+ */
+class Metrics {
+public:
+	static void add(MetricCounter counter, uint64_t n = 1) {
+		counters[(size_t) counter].fetch_add(n, std::memory_order_relaxed);
+	}
+
+	static void set(MetricGauge gauge, int64_t value) {
+		gauges[(size_t) gauge].store(value, std::memory_order_relaxed);
+	}
+
+	static uint64_t get(MetricCounter counter);
+	static int64_t get(MetricGauge gauge);
+
+	/**
+	 * The time the tile images took to encode.
+	 */
+	static MetricHistogram& getEncodeHistogram();
+
+	/**
+	 * Returns all metrics in the Prometheus text format.
+	 */
+	static std::string format();
+
+private:
+	static std::array<std::atomic<uint64_t>, (size_t) MetricCounter::COUNT> counters;
+	static std::array<std::atomic<int64_t>, (size_t) MetricGauge::COUNT> gauges;
+};
+
+/**
+ * A progress handler which periodically writes the progress of the rendered map
+ * rotations and the global metrics to a file in the Prometheus text format, for
+ * example for the textfile collector of the node exporter.
+ *
+ * While a map rotation is rendered, the file is written by an own thread in the
+ * configured interval (at least every second), no matter whether there is progress or
+ * not, so a stalled render is visible as well. The file is replaced atomically, so it
+ * can be read at any time.
+ */
+class MetricsFileExporter : public DummyProgressHandler {
+public:
+	MetricsFileExporter(const fs::path& filename, int interval = 15);
+	virtual ~MetricsFileExporter();
+
+	/**
+	 * Starts exporting the progress of a map rotation and the thread writing the metrics.
+	 */
+	void startRender(const std::string& map, const std::string& rotation);
+
+	/**
+	 * Finishes the current map rotation, stops the writing thread and writes the metrics.
+	 */
+	void finishRender();
+
+	virtual void setMax(int max);
+	virtual void setValue(int value);
+
+	/**
+	 * Writes the metrics now. Returns false if the file couldn't be written.
+	 */
+	bool write();
+
+private:
+	struct RenderProgress {
+		RenderProgress();
+
+		int tiles, tiles_required;
+		double tiles_per_second, seconds;
+		bool active;
+	};
+
+	void run();
+	bool writeFile();
+
+	fs::path filename;
+	std::chrono::steady_clock::duration interval;
+
+	// the progress of every map rotation, with the current one
+	std::map<std::pair<std::string, std::string>, RenderProgress> renders;
+	std::pair<std::string, std::string> current;
+
+	std::chrono::steady_clock::time_point render_start, last_write;
+	int last_write_value;
+
+	bool running;
+	thread_ns::thread thread;
+	thread_ns::mutex mutex;
+	thread_ns::condition_variable condition_stop;
+};
+
+}
+}
+
+#endif /* METRICS_H_ */
@@ -0,0 +1,278 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "profiler.h"
+
+#include "../compat/thread.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+namespace mapcrafter {
+namespace util {
+
+namespace {
+
+const char* STAGE_NAMES[] = {
+	"region_read",
+	"inflate",
+	"nbt_parse",
+	"palette_resolve",
+	"block_traversal",
+	"lighting",
+	"blit",
+	"downsample",
+	"encode",
+	"write",
+};
+
+const char* COUNTER_NAMES[] = {
+	"region_cache_hits",
+	"region_cache_misses",
+	"chunk_cache_hits",
+	"chunk_cache_misses",
+	"render_tiles",
+	"composite_tiles",
+	"tiles_written",
+	"tiles_empty",
+};
+
+static_assert(sizeof(STAGE_NAMES) / sizeof(STAGE_NAMES[0]) == (size_t) ProfileStage::COUNT,
+		"Every profile stage needs a name");
+static_assert(sizeof(COUNTER_NAMES) / sizeof(COUNTER_NAMES[0]) == (size_t) ProfileCounter::COUNT,
+		"Every profile counter needs a name");
+
+uint64_t now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double toMilliseconds(uint64_t ns) {
+	return ns / 1000000.0;
+}
+
+double getHitRate(uint64_t hits, uint64_t misses) {
+	return hits + misses == 0 ? 0 : (double) hits / (hits + misses);
+}
+
+}
+
+const char* getProfileStageName(ProfileStage stage) {
+	return STAGE_NAMES[(size_t) stage];
+}
+
+const char* getProfileCounterName(ProfileCounter counter) {
+	return COUNTER_NAMES[(size_t) counter];
+}
+
+ProfileStageStats::ProfileStageStats()
+	: count(0), total_ns(0), self_ns(0), max_ns(0) {
+	histogram.fill(0);
+}
+
+void ProfileStageStats::add(uint64_t duration_ns, uint64_t self_ns) {
+	count++;
+	total_ns += duration_ns;
+	this->self_ns += self_ns;
+	max_ns = std::max(max_ns, duration_ns);
+	histogram[getBucket(duration_ns)]++;
+}
+
+void ProfileStageStats::merge(const ProfileStageStats& other) {
+	count += other.count;
+	total_ns += other.total_ns;
+	self_ns += other.self_ns;
+	max_ns = std::max(max_ns, other.max_ns);
+	for (int i = 0; i < BUCKETS; i++)
+		histogram[i] += other.histogram[i];
+}
+
+uint64_t ProfileStageStats::getPercentile(double fraction) const {
+	if (count == 0)
+		return 0;
+	uint64_t rank = std::max<uint64_t>(1, std::ceil(fraction * count));
+	if (rank >= count)
+		return max_ns;
+	uint64_t seen = 0;
+	for (int i = 0; i < BUCKETS; i++) {
+		seen += histogram[i];
+		if (seen < rank)
+			continue;
+		// the first buckets are exact durations
+		if (i < 4)
+			return i;
+		// otherwise return the middle of the bucket
+		int power = i / 4 + 1;
+		uint64_t lower = uint64_t(4 + i % 4) << (power - 2);
+		uint64_t middle = lower + (uint64_t(1) << (power - 2)) / 2;
+		return std::min(middle, max_ns);
+	}
+	return max_ns;
+}
+
+int ProfileStageStats::getBucket(uint64_t duration_ns) {
+	if (duration_ns < 4)
+		return duration_ns;
+	int power = 63;
+	while (!(duration_ns >> power))
+		power--;
+	return 4 * (power - 1) + ((duration_ns >> (power - 2)) & 3);
+}
+
+ProfileReport::ProfileReport() {
+	counters.fill(0);
+}
+
+picojson::object ProfileReport::toJSON() const {
+	picojson::object stages_json;
+	for (size_t i = 0; i < stages.size(); i++) {
+		const ProfileStageStats& stats = stages[i];
+		picojson::object stage;
+		stage["count"] = picojson::value((double) stats.count);
+		stage["total_ms"] = picojson::value(toMilliseconds(stats.total_ns));
+		stage["self_ms"] = picojson::value(toMilliseconds(stats.self_ns));
+		stage["mean_ms"] = picojson::value(stats.count == 0 ? 0
+				: toMilliseconds(stats.total_ns) / stats.count);
+		stage["p50_ms"] = picojson::value(toMilliseconds(stats.getPercentile(0.5)));
+		stage["p90_ms"] = picojson::value(toMilliseconds(stats.getPercentile(0.9)));
+		stage["p99_ms"] = picojson::value(toMilliseconds(stats.getPercentile(0.99)));
+		stage["max_ms"] = picojson::value(toMilliseconds(stats.max_ns));
+		stages_json[getProfileStageName((ProfileStage) i)] = picojson::value(stage);
+	}
+
+	picojson::object counters_json;
+	for (size_t i = 0; i < counters.size(); i++)
+		counters_json[getProfileCounterName((ProfileCounter) i)] =
+				picojson::value((double) counters[i]);
+
+	picojson::object hit_rates;
+	hit_rates["region_cache"] = picojson::value(getHitRate(
+			counters[(size_t) ProfileCounter::REGION_CACHE_HITS],
+			counters[(size_t) ProfileCounter::REGION_CACHE_MISSES]));
+	hit_rates["chunk_cache"] = picojson::value(getHitRate(
+			counters[(size_t) ProfileCounter::CHUNK_CACHE_HITS],
+			counters[(size_t) ProfileCounter::CHUNK_CACHE_MISSES]));
+
+	picojson::object object;
+	object["stages"] = picojson::value(stages_json);
+	object["counters"] = picojson::value(counters_json);
+	object["cache_hit_rates"] = picojson::value(hit_rates);
+	return object;
+}
+
+struct Profiler::ThreadData {
+	ThreadData()
+		: child_ns(0), finished(false) {
+		counters.fill(0);
+	}
+
+	std::array<ProfileStageStats, (size_t) ProfileStage::COUNT> stages;
+	std::array<uint64_t, (size_t) ProfileCounter::COUNT> counters;
+	// time spent in the nested timers of the currently running timer
+	uint64_t child_ns;
+	// whether the thread exited, its data is dropped when resetting the profiler
+	bool finished;
+};
+
+namespace {
+
+thread_ns::mutex threads_mutex;
+std::vector<std::shared_ptr<Profiler::ThreadData>> threads;
+
+/**
+ * Registers the profiling data of a thread and marks it as finished when the
+ * thread exits.
+ */
+struct ThreadDataHolder {
+	ThreadDataHolder()
+		: data(std::make_shared<Profiler::ThreadData>()) {
+		thread_ns::unique_lock<thread_ns::mutex> lock(threads_mutex);
+		threads.push_back(data);
+	}
+
+	~ThreadDataHolder() {
+		thread_ns::unique_lock<thread_ns::mutex> lock(threads_mutex);
+		data->finished = true;
+	}
+
+	std::shared_ptr<Profiler::ThreadData> data;
+};
+
+}
+
+std::atomic<bool> Profiler::enabled(false);
+
+void Profiler::setEnabled(bool enabled) {
+	Profiler::enabled.store(enabled);
+}
+
+void Profiler::count(ProfileCounter counter, uint64_t n) {
+	if (isEnabled())
+		getThreadData().counters[(size_t) counter] += n;
+}
+
+void Profiler::reset() {
+	thread_ns::unique_lock<thread_ns::mutex> lock(threads_mutex);
+	threads.erase(std::remove_if(threads.begin(), threads.end(),
+			[](const std::shared_ptr<ThreadData>& data) { return data->finished; }),
+			threads.end());
+	for (auto it = threads.begin(); it != threads.end(); ++it) {
+		ThreadData& data = **it;
+		data.stages.fill(ProfileStageStats());
+		data.counters.fill(0);
+	}
+}
+
+ProfileReport Profiler::collect() {
+	ProfileReport report;
+	thread_ns::unique_lock<thread_ns::mutex> lock(threads_mutex);
+	for (auto it = threads.begin(); it != threads.end(); ++it) {
+		const ThreadData& data = **it;
+		for (size_t i = 0; i < report.stages.size(); i++)
+			report.stages[i].merge(data.stages[i]);
+		for (size_t i = 0; i < report.counters.size(); i++)
+			report.counters[i] += data.counters[i];
+	}
+	return report;
+}
+
+Profiler::ThreadData& Profiler::getThreadData() {
+	static thread_local ThreadDataHolder holder;
+	return *holder.data;
+}
+
+void ProfileTimer::start(ProfileStage stage) {
+	this->stage = stage;
+	data = &Profiler::getThreadData();
+	parent_child_ns = data->child_ns;
+	data->child_ns = 0;
+	start_ns = now();
+}
+
+void ProfileTimer::stop() {
+	uint64_t duration = now() - start_ns;
+	data->stages[(size_t) stage].add(duration, duration - std::min(duration, data->child_ns));
+	data->child_ns = parent_child_ns + duration;
+}
+
+}
+}
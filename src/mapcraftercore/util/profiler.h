@@ -0,0 +1,201 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include "picojson.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace mapcrafter {
+namespace util {
+
+/**
+ * The stages of the rendering process which are timed by the profiler.
+ */
+enum class ProfileStage {
+	// reading a region file
+	REGION_READ,
+	// decompressing chunk data
+	INFLATE,
+	// parsing the NBT data of a chunk
+	NBT_PARSE,
+	// resolving the block state palettes of the chunk sections to block IDs
+	PALETTE_RESOLVE,
+	// iterating through the blocks of a render tile and preparing their block images
+	BLOCK_TRAVERSAL,
+	// the render mode (lighting and overlays) drawing on the block images
+	LIGHTING,
+	// blitting the block images onto a render tile
+	BLIT,
+	// downscaling the children of a composite tile
+	DOWNSAMPLE,
+	// encoding a tile image
+	ENCODE,
+	// writing an encoded tile to the tile storage
+	WRITE,
+
+	COUNT
+};
+
+/**
+ * The counters of the profiler.
+ */
+enum class ProfileCounter {
+	REGION_CACHE_HITS,
+	REGION_CACHE_MISSES,
+	CHUNK_CACHE_HITS,
+	CHUNK_CACHE_MISSES,
+	RENDER_TILES,
+	COMPOSITE_TILES,
+	TILES_WRITTEN,
+	TILES_EMPTY,
+
+	COUNT
+};
+
+const char* getProfileStageName(ProfileStage stage);
+const char* getProfileCounterName(ProfileCounter counter);
+
+/**
+ * The timings of a stage: How often it was run, the total time spent in it (including
+ * the time of stages nested in it), the time spent in it without nested stages and a
+ * histogram of the durations to estimate percentiles.
+ *
+ * The histogram buckets are logarithmic with four buckets per power of two, so the
+ * estimated percentiles are within 12.5% of the real durations.
+ */
+struct ProfileStageStats {
+	ProfileStageStats();
+
+	/**
+	 * Adds a single run of the stage.
+	 */
+	void add(uint64_t duration_ns, uint64_t self_ns);
+
+	/**
+	 * Adds the runs of other stage statistics.
+	 */
+	void merge(const ProfileStageStats& other);
+
+	/**
+	 * Returns the estimated duration (in nanoseconds) the specified fraction (0..1) of
+	 * the runs took at most.
+	 */
+	uint64_t getPercentile(double fraction) const;
+
+	static int getBucket(uint64_t duration_ns);
+
+	static const int BUCKETS = 256;
+
+	uint64_t count;
+	uint64_t total_ns, self_ns, max_ns;
+	std::array<uint64_t, BUCKETS> histogram;
+};
+
+/**
+ * The aggregated stage timings and counters of all threads.
+ */
+struct ProfileReport {
+	ProfileReport();
+
+	/**
+	 * Returns the report as JSON object with the statistics of every stage (durations in
+	 * milliseconds), the counters and the hit rates of the world caches.
+	 */
+	picojson::object toJSON() const;
+
+	std::array<ProfileStageStats, (size_t) ProfileStage::COUNT> stages;
+	std::array<uint64_t, (size_t) ProfileCounter::COUNT> counters;
+};
+
+/**
+ * A low overhead profiler for the rendering process. Every thread records its timings
+ * and counters separately without any locking, they are only aggregated into a report
+ * when the threads are done with their work (at the end of rendering a map rotation).
+ *
+ * The profiler is disabled by default, timers and counters don't do anything then.
+ */
+class Profiler {
+public:
+	static void setEnabled(bool enabled);
+	static bool isEnabled() {
+		return enabled.load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * Increases a counter of the calling thread.
+	 */
+	static void count(ProfileCounter counter, uint64_t n = 1);
+
+	/**
+	 * Resets the timings and counters of all threads.
+	 */
+	static void reset();
+
+	/**
+	 * Aggregates the timings and counters of all threads. The other threads must not
+	 * profile anything while this is called.
+	 */
+	static ProfileReport collect();
+
+	struct ThreadData;
+
+	/**
+	 * Returns the profiling data of the calling thread.
+	 */
+	static ThreadData& getThreadData();
+
+private:
+	static std::atomic<bool> enabled;
+};
+
+/**
+ * Times a stage for the lifetime of the object (if the profiler is enabled). Timers can
+ * be nested, the time of nested timers is not counted as self time of the outer timer.
+ */
+class ProfileTimer {
+public:
+	ProfileTimer(ProfileStage stage)
+		: data(nullptr) {
+		if (Profiler::isEnabled())
+			start(stage);
+	}
+
+	~ProfileTimer() {
+		if (data != nullptr)
+			stop();
+	}
+
+private:
+	void start(ProfileStage stage);
+	void stop();
+
+	Profiler::ThreadData* data;
+	ProfileStage stage;
+	uint64_t start_ns, parent_child_ns;
+};
+
+}
+}
+
+#endif /* PROFILER_H_ */
@@ -26,6 +26,7 @@
 #include <iomanip>
 #include <iostream>
 #include <cmath>
+#include <cstdint>
 #include <cstdio>
 #include <ctime>
 #if defined(HAVE_SYS_IOCTL_H) && defined(HAVE_UNISTD_H)
@@ -276,5 +277,76 @@ void ProgressBar::finish() {
 	std::cout << std::endl;
 }
 
+ProgressCounter::ProgressCounter()
+	: value(0) {
+}
+
+void* ProgressCounter::operator new[](size_t size) {
+	// the pointer to the allocated memory is stored right before the aligned counters
+	const uintptr_t alignment = alignof(ProgressCounter);
+	char* memory = static_cast<char*>(::operator new(size + sizeof(void*) + alignment));
+	uintptr_t start = reinterpret_cast<uintptr_t>(memory) + sizeof(void*);
+	void** aligned = reinterpret_cast<void**>((start + alignment - 1) & ~(alignment - 1));
+	aligned[-1] = memory;
+	return aligned;
+}
+
+void ProgressCounter::operator delete[](void* pointer) {
+	if (pointer != nullptr)
+		::operator delete(static_cast<void**>(pointer)[-1]);
+}
+
+ProgressReporter::ProgressReporter(IProgressHandler* handler, int counters, int interval_ms)
+	: handler(handler), counters(new ProgressCounter[counters]), counters_count(counters),
+	  interval_ms(interval_ms), running(false) {
+}
+
+ProgressReporter::~ProgressReporter() {
+	stop();
+}
+
+ProgressCounter& ProgressReporter::getCounter(int index) {
+	return counters[index];
+}
+
+int ProgressReporter::getValue() const {
+	int value = 0;
+	for (int i = 0; i < counters_count; i++)
+		value += counters[i].get();
+	return value;
+}
+
+void ProgressReporter::start() {
+	if (running)
+		return;
+	running = true;
+	thread = thread_ns::thread(&ProgressReporter::run, this);
+}
+
+void ProgressReporter::stop() {
+	if (!running)
+		return;
+	{
+		thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+		running = false;
+		condition_stop.notify_all();
+	}
+	thread.join();
+	if (handler != nullptr)
+		handler->setValue(getValue());
+}
+
+void ProgressReporter::run() {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	while (running) {
+		condition_stop.wait_for(lock, chrono_ns::milliseconds(interval_ms));
+		if (!running)
+			break;
+		int value = getValue();
+		if (handler != nullptr && value != handler->getValue())
+			handler->setValue(value);
+	}
+}
+
 } /* namespace util */
 } /* namespace mapcrafter */
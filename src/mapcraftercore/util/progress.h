@@ -20,6 +20,10 @@
 #ifndef PROGRESS_H_
 #define PROGRESS_H_
 
+#include "../compat/thread.h"
+
+#include <atomic>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -132,6 +136,79 @@ private:
 			double speed_average, int eta = -1) const;
 };
 
+/**
+ * A progress counter for a single thread. Only the owning thread may add to it, other
+ * threads can read it at any time without locking. The counter has a cache line for
+ * itself, so the counters of different threads don't slow each other down.
+ */
+class alignas(64) ProgressCounter {
+public:
+	ProgressCounter();
+
+	void add(int n) {
+		// there is only one writer, so there's no need for an atomic read-modify-write
+		value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+	}
+
+	int get() const {
+		return value.load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * Arrays of counters have to be aligned as well, plain new guarantees this only
+	 * since C++17.
+	 */
+	static void* operator new[](size_t size);
+	static void operator delete[](void* pointer);
+
+private:
+	std::atomic<int> value;
+};
+
+/**
+ * Samples the sum of some progress counters in a fixed interval in its own thread and
+ * passes it to a progress handler. The progress handler is only used by the reporting
+ * thread while it is running, so it doesn't need to be thread safe.
+ */
+class ProgressReporter {
+public:
+	ProgressReporter(IProgressHandler* handler, int counters, int interval_ms = 200);
+	~ProgressReporter();
+
+	/**
+	 * Returns the progress counter of a thread.
+	 */
+	ProgressCounter& getCounter(int index);
+
+	/**
+	 * Returns the current sum of the progress counters.
+	 */
+	int getValue() const;
+
+	/**
+	 * Starts the reporting thread.
+	 */
+	void start();
+
+	/**
+	 * Stops the reporting thread and passes the final progress to the progress handler.
+	 */
+	void stop();
+
+private:
+	void run();
+
+	IProgressHandler* handler;
+	std::unique_ptr<ProgressCounter[]> counters;
+	int counters_count;
+	int interval_ms;
+
+	bool running;
+	thread_ns::thread thread;
+	thread_ns::mutex mutex;
+	thread_ns::condition_variable condition_stop;
+};
+
 } /* namespace util */
 } /* namespace mapcrafter */
 #endif /* PROGRESS_H_ */
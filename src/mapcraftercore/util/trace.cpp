@@ -0,0 +1,159 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "trace.h"
+
+#include "picojson.h"
+#include "../compat/thread.h"
+
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+namespace mapcrafter {
+namespace util {
+
+struct Tracer::ThreadBuffer {
+	ThreadBuffer(int id)
+		: id(id), next(0), dropped(0), in_use(true) {
+	}
+
+	void add(const TraceEvent& event, size_t capacity) {
+		if (events.size() < capacity) {
+			events.push_back(event);
+			return;
+		}
+		// the buffer is full, overwrite the oldest span
+		events[next] = event;
+		next = (next + 1) % events.size();
+		dropped++;
+	}
+
+	// the thread id shown in the trace
+	int id;
+	std::string name;
+
+	std::vector<TraceEvent> events;
+	// the position of the oldest span once the buffer is full
+	size_t next;
+	// how many spans were overwritten
+	uint64_t dropped;
+
+	// whether a thread is using the buffer, buffers of exited threads are reused
+	bool in_use;
+};
+
+namespace {
+
+thread_ns::mutex buffers_mutex;
+std::vector<std::shared_ptr<Tracer::ThreadBuffer>> buffers;
+
+std::atomic<size_t> buffer_size(0);
+std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+/**
+ * Takes a free buffer (or creates a new one) for a thread and releases it when the
+ * thread exits.
+ */
+struct ThreadBufferHolder {
+	ThreadBufferHolder() {
+		thread_ns::unique_lock<thread_ns::mutex> lock(buffers_mutex);
+		for (auto it = buffers.begin(); it != buffers.end(); ++it)
+			if (!(*it)->in_use) {
+				buffer = *it;
+				buffer->in_use = true;
+				return;
+			}
+		buffer = std::make_shared<Tracer::ThreadBuffer>(buffers.size() + 1);
+		buffers.push_back(buffer);
+	}
+
+	~ThreadBufferHolder() {
+		thread_ns::unique_lock<thread_ns::mutex> lock(buffers_mutex);
+		buffer->in_use = false;
+	}
+
+	std::shared_ptr<Tracer::ThreadBuffer> buffer;
+};
+
+Tracer::ThreadBuffer& getThreadBuffer() {
+	static thread_local ThreadBufferHolder holder;
+	return *holder.buffer;
+}
+
+void writeEvent(std::ostream& out, const TraceEvent& event, int tid) {
+	// the timestamps of Chrome traces are in microseconds
+	out << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"" << event.category
+		<< "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+		<< ",\"ts\":" << event.start_ns / 1000.0
+		<< ",\"dur\":" << event.duration_ns / 1000.0 << "}";
+}
+
+}
+
+std::atomic<bool> Tracer::enabled(false);
+
+void Tracer::setEnabled(bool enabled, size_t size) {
+	buffer_size.store(size);
+	Tracer::enabled.store(enabled && size > 0);
+}
+
+void Tracer::setThreadName(const std::string& name) {
+	if (isEnabled())
+		getThreadBuffer().name = name;
+}
+
+void Tracer::record(const char* name, const char* category, uint64_t start_ns,
+		uint64_t duration_ns) {
+	TraceEvent event = {name, category, start_ns, duration_ns};
+	getThreadBuffer().add(event, buffer_size.load(std::memory_order_relaxed));
+}
+
+uint64_t Tracer::now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - start_time).count();
+}
+
+bool Tracer::write(const fs::path& filename) {
+	std::ofstream out(filename.string());
+	out.precision(15);
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+		<< "\"args\":{\"name\":\"mapcrafter\"}}";
+
+	uint64_t dropped = 0;
+	thread_ns::unique_lock<thread_ns::mutex> lock(buffers_mutex);
+	for (auto it = buffers.begin(); it != buffers.end(); ++it) {
+		const ThreadBuffer& buffer = **it;
+		std::string name = buffer.name.empty() ? "thread " + std::to_string(buffer.id) : buffer.name;
+		out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer.id
+			<< ",\"args\":{\"name\":" << picojson::value(name).serialize() << "}}";
+		// write the spans from the oldest to the newest one
+		for (size_t i = 0; i < buffer.events.size(); i++)
+			writeEvent(out, buffer.events[(buffer.next + i) % buffer.events.size()], buffer.id);
+		dropped += buffer.dropped;
+	}
+
+	out << "\n],\"otherData\":{\"dropped_spans\":" << dropped << "}}\n";
+	return !out.fail();
+}
+
+}
+}
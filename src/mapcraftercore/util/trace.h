@@ -0,0 +1,128 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <boost/filesystem.hpp>
+
+namespace fs = boost::filesystem;
+
+namespace mapcrafter {
+namespace util {
+
+/**
+ * A recorded span of a thread. Name and category must be string literals.
+ */
+struct TraceEvent {
+	const char* name;
+	const char* category;
+	uint64_t start_ns, duration_ns;
+};
+
+/**
+ * Records what the threads are doing as a timeline which can be written as Chrome
+ * trace (JSON) file, for example to look at it with Perfetto or chrome://tracing.
+ *
+ * Every thread records its spans into its own ring buffer without any locking. The
+ * buffers have a fixed capacity, so only the latest spans of a thread are kept. The
+ * buffers of exited threads are reused by new threads, so the memory needed for the
+ * trace only depends on how many threads are running at the same time.
+ *
+ * The tracer is disabled by default, spans don't do anything then.
+ */
+class Tracer {
+public:
+	/**
+	 * Enables or disables the tracer. The buffer size is the maximum count of spans
+	 * kept per thread.
+	 */
+	static void setEnabled(bool enabled, size_t buffer_size = 100000);
+	static bool isEnabled() {
+		return enabled.load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * Sets the name the calling thread is shown with.
+	 */
+	static void setThreadName(const std::string& name);
+
+	/**
+	 * Records a span of the calling thread.
+	 */
+	static void record(const char* name, const char* category, uint64_t start_ns,
+			uint64_t duration_ns);
+
+	/**
+	 * Returns the current time in nanoseconds, relative to the start of the tracer.
+	 */
+	static uint64_t now();
+
+	/**
+	 * Writes the recorded spans of all threads as Chrome trace file. The other threads
+	 * must not record anything while this is called. Returns false if the file couldn't
+	 * be written.
+	 */
+	static bool write(const fs::path& filename);
+
+	struct ThreadBuffer;
+
+private:
+	static std::atomic<bool> enabled;
+};
+
+/**
+ * Records a span for the lifetime of the object (if the tracer is enabled).
+ */
+class TraceSpan {
+public:
+	TraceSpan(const char* name, const char* category = "render")
+		: name(nullptr) {
+		if (Tracer::isEnabled()) {
+			this->name = name;
+			this->category = category;
+			start_ns = Tracer::now();
+		}
+	}
+
+	~TraceSpan() {
+		if (name != nullptr)
+			Tracer::record(name, category, start_ns, Tracer::now() - start_ns);
+	}
+
+	/**
+	 * Doesn't record the span, for example if there was nothing to do after all.
+	 */
+	void cancel() {
+		name = nullptr;
+	}
+
+private:
+	const char* name;
+	const char* category;
+	uint64_t start_ns;
+};
+
+}
+}
+
+#endif /* TRACE_H_ */
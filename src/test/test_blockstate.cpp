@@ -18,6 +18,7 @@
  */
 
 #include "../mapcraftercore/mc/blockstate.h"
+#include "../mapcraftercore/renderer/blockimages.h"
 
 #include <iostream>
 #include <fstream>
@@ -25,6 +26,7 @@
 #include <boost/test/unit_test.hpp>
 
 namespace mc = mapcrafter::mc;
+namespace renderer = mapcrafter::renderer;
 
 BOOST_AUTO_TEST_CASE(blockstate_test) {
 	mc::BlockState block("mapcrafter:test");
@@ -77,3 +79,79 @@ BOOST_AUTO_TEST_CASE(blockstate_testRegistry) {
 	BOOST_CHECK_EQUAL(block_compare.getVariantDescription(), block.getVariantDescription());
 }
 
+
+BOOST_AUTO_TEST_CASE(blockimages_testCache) {
+	fs::path block_dir = "../data/blocks";
+	fs::path cache_dir = fs::temp_directory_path() / fs::unique_path();
+
+	// the first load prepares the block images and writes the cache
+	mc::BlockStateRegistry registry1;
+	renderer::RenderedBlockImages images1(registry1);
+	images1.setBlockSideDarkening(0.75, 0.6);
+	images1.setCacheDir(cache_dir);
+	BOOST_REQUIRE(images1.loadBlockImages(block_dir, "isometric", 0, 16));
+	fs::path cache_file = images1.getCacheFile("isometric", 0, 16);
+	BOOST_REQUIRE(fs::is_regular_file(cache_file));
+	uint64_t hash1 = images1.exportBlocks().hash();
+
+	// the second load reads it
+	std::time_t cache_time = fs::last_write_time(cache_file);
+	mc::BlockStateRegistry registry2;
+	renderer::RenderedBlockImages images2(registry2);
+	images2.setBlockSideDarkening(0.75, 0.6);
+	images2.setCacheDir(cache_dir);
+	BOOST_REQUIRE(images2.loadBlockImages(block_dir, "isometric", 0, 16));
+	BOOST_CHECK_EQUAL(fs::last_write_time(cache_file), cache_time);
+	BOOST_CHECK_EQUAL(images2.getBlockWidth(), images1.getBlockWidth());
+	BOOST_CHECK_EQUAL(images2.getTextureSize(), 16);
+	BOOST_CHECK_EQUAL(images2.exportBlocks().hash(), hash1);
+
+	const char* blocks[] = {"minecraft:stone", "minecraft:grass_block", "minecraft:oak_leaves",
+			"minecraft:water", "minecraft:glass"};
+	for (const char* name : blocks) {
+		const renderer::BlockImage& block1 = images1.getBlockImage(
+				registry1.getBlockID(mc::BlockState(name)));
+		const renderer::BlockImage& block2 = images2.getBlockImage(
+				registry2.getBlockID(mc::BlockState(name)));
+		BOOST_CHECK_EQUAL(block1.is_transparent, block2.is_transparent);
+		BOOST_CHECK_EQUAL(block1.is_biome, block2.is_biome);
+		BOOST_CHECK_EQUAL(block1.is_masked_biome, block2.is_masked_biome);
+		BOOST_CHECK_EQUAL((int) block1.lighting_type, (int) block2.lighting_type);
+		BOOST_CHECK_EQUAL(block1.shadow_edges, block2.shadow_edges);
+		BOOST_CHECK(block1.images_idx == block2.images_idx);
+		BOOST_CHECK(block1.side_mask == block2.side_mask);
+		BOOST_CHECK_EQUAL(block1.image(0).hash(), block2.image(0).hash());
+		if (block1.is_masked_biome)
+			BOOST_CHECK_EQUAL(block1.biome_mask->hash(), block2.biome_mask->hash());
+	}
+
+	// a different block side darkening uses another cache file
+	mc::BlockStateRegistry registry3;
+	renderer::RenderedBlockImages images3(registry3);
+	images3.setBlockSideDarkening(0.95, 0.8);
+	images3.setCacheDir(cache_dir);
+	BOOST_CHECK(images3.getCacheFile("isometric", 0, 16) != cache_file);
+	BOOST_REQUIRE(images3.loadBlockImages(block_dir, "isometric", 0, 16));
+	BOOST_CHECK(images3.exportBlocks().hash() != hash1);
+
+	// the block images of the side view are higher than wide
+	mc::BlockStateRegistry registry4;
+	renderer::RenderedBlockImages images4(registry4);
+	images4.setCacheDir(cache_dir);
+	BOOST_REQUIRE(images4.loadBlockImages(block_dir, "side", 0, 12));
+	cache_file = images4.getCacheFile("side", 0, 12);
+	BOOST_REQUIRE(fs::is_regular_file(cache_file));
+	uint64_t hash4 = images4.exportBlocks().hash();
+
+	cache_time = fs::last_write_time(cache_file);
+	mc::BlockStateRegistry registry5;
+	renderer::RenderedBlockImages images5(registry5);
+	images5.setCacheDir(cache_dir);
+	BOOST_REQUIRE(images5.loadBlockImages(block_dir, "side", 0, 12));
+	BOOST_CHECK_EQUAL(fs::last_write_time(cache_file), cache_time);
+	BOOST_CHECK_EQUAL(images5.getBlockWidth(), images4.getBlockWidth());
+	BOOST_CHECK_EQUAL(images5.getBlockHeight(), images4.getBlockHeight());
+	BOOST_CHECK_EQUAL(images5.exportBlocks().hash(), hash4);
+
+	fs::remove_all(cache_dir);
+}
@@ -17,12 +17,15 @@
  * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "../mapcraftercore/config.h"
 #include "../mapcraftercore/renderer/image.h"
+#include "../mapcraftercore/util.h"
 
 #include <cstdlib>
 #include <boost/test/unit_test.hpp>
 
 namespace renderer = mapcrafter::renderer;
+namespace util = mapcrafter::util;
 
 BOOST_AUTO_TEST_CASE(image_testIO) {
 	renderer::RGBAImage src(400, 200);
@@ -50,3 +53,184 @@ BOOST_AUTO_TEST_CASE(image_testIO) {
 		}
 	}
 }
+
+BOOST_AUTO_TEST_CASE(image_testPNGWriteOptions) {
+	renderer::RGBAImage src(128, 64);
+	uint32_t noise = 42;
+	for(int x = 0; x < src.getWidth(); x++) {
+		for(int y = 0; y < src.getHeight(); y++) {
+			// some uniform areas and some noise, like the tiles
+			if (x < 64)
+				src.setPixel(x, y, renderer::rgba(x / 8 * 30, y / 8 * 30, 100, 255));
+			else
+				src.setPixel(x, y, noise = noise * 1664525 + 1013904223);
+		}
+	}
+
+	std::vector<renderer::PNGWriteOptions> options = {
+		renderer::PNGWriteOptions(),
+		renderer::PNGWriteOptions(0, renderer::PNGFilter::NONE),
+		renderer::PNGWriteOptions(9, renderer::PNGFilter::PAETH),
+		renderer::PNGWriteOptions(3, renderer::PNGFilter::AVERAGE),
+		renderer::PNGWriteOptions::fast(),
+	};
+	for (auto it = options.begin(); it != options.end(); ++it) {
+		// the encoder settings must not change the pixels
+		renderer::RGBAImage dest;
+		BOOST_REQUIRE(src.writePNG("test.png", *it));
+		BOOST_REQUIRE(dest.readPNG("test.png"));
+		BOOST_CHECK_EQUAL(dest.getWidth(), src.getWidth());
+		BOOST_CHECK_EQUAL(dest.getHeight(), src.getHeight());
+		BOOST_CHECK(dest.data == src.data);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(image_testMemoryIO) {
+	renderer::RGBAImage src(64, 32), dest;
+	for (int x = 0; x < src.getWidth(); x++)
+		for (int y = 0; y < src.getHeight(); y++)
+			src.setPixel(x, y, renderer::rgba(x * 4, y * 8, 255 - x, x < 32 ? 255 : 128));
+
+	std::vector<uint8_t> buffer;
+	BOOST_REQUIRE(src.encodePNG(buffer));
+	BOOST_REQUIRE(dest.decodePNG(buffer.data(), buffer.size()));
+	BOOST_CHECK(dest.data == src.data);
+
+	// the file written atomically contains the same bytes as the encoded image
+	BOOST_REQUIRE(src.writePNG("test.png"));
+	std::vector<uint8_t> file_data;
+	BOOST_REQUIRE(util::readFile("test.png", file_data));
+	BOOST_CHECK(file_data == buffer);
+	BOOST_CHECK(!fs::exists("test.png.tmp"));
+
+	// truncated or invalid data must be rejected, not crash
+	BOOST_CHECK(!dest.decodePNG(buffer.data(), buffer.size() / 2));
+	BOOST_CHECK(!dest.decodePNG(buffer.data(), 4));
+
+	BOOST_REQUIRE(src.encodeJPEG(buffer, 90));
+	BOOST_REQUIRE(dest.decodeJPEG(buffer.data(), buffer.size()));
+	BOOST_CHECK_EQUAL(dest.getWidth(), src.getWidth());
+	BOOST_CHECK_EQUAL(dest.getHeight(), src.getHeight());
+	BOOST_CHECK(!dest.decodeJPEG(buffer.data(), 0));
+}
+
+BOOST_AUTO_TEST_CASE(image_testResizeHalf) {
+	// odd half width to have pixels which aren't downscaled four at once
+	renderer::RGBAImage image(22, 8);
+	uint32_t state = 42;
+	for (int x = 0; x < image.getWidth(); x++)
+		for (int y = 0; y < image.getHeight(); y++) {
+			state = state * 1103515245 + 12345;
+			// some completely transparent pixels and some translucent pixels
+			uint8_t alpha = x < 4 ? 0 : (x < 8 ? state >> 24 : 255);
+			image.setPixel(x, y, (state & 0xffffff) | (alpha << 24));
+		}
+
+	// every channel is the rounded down average of the 2x2 pixels
+	renderer::RGBAImage half = image.resize(11, 4, renderer::InterpolationType::HALF);
+	for (int x = 0; x < half.getWidth(); x++)
+		for (int y = 0; y < half.getHeight(); y++)
+			for (int shift = 0; shift < 32; shift += 8) {
+				int sum = 0;
+				for (int i = 0; i < 4; i++)
+					sum += (image.getPixel(2 * x + i % 2, 2 * y + i / 2) >> shift) & 0xff;
+				BOOST_CHECK_EQUAL((half.getPixel(x, y) >> shift) & 0xff, sum / 4);
+			}
+
+	// downscaling into another image is the same like downscaling and blitting
+	renderer::RGBAImage blitted(30, 10), fused(30, 10);
+	blitted.simpleAlphaBlit(half, 5, 3);
+	image.resizeHalfInto(fused, 5, 3);
+	BOOST_CHECK(blitted.data == fused.data);
+
+	// alpha weighted: transparent pixels don't darken the translucent ones
+	renderer::RGBAImage edge(2, 2), average(1, 1), weighted(1, 1);
+	edge.setPixel(0, 0, renderer::rgba(200, 100, 40, 255));
+	edge.resizeHalfInto(average, 0, 0);
+	edge.resizeHalfInto(weighted, 0, 0, renderer::DownsampleMode::ALPHA_WEIGHTED);
+	BOOST_CHECK_EQUAL(average.getPixel(0, 0), renderer::rgba(50, 25, 10, 63));
+	BOOST_CHECK_EQUAL(weighted.getPixel(0, 0), renderer::rgba(200, 100, 40, 63));
+
+	// opaque pixels are averaged like usual
+	renderer::RGBAImage opaque(22, 8);
+	image.clip(8, 0, 14, 8).resizeHalfInto(opaque, 0, 0, renderer::DownsampleMode::ALPHA_WEIGHTED);
+	image.clip(8, 0, 14, 8).resizeHalfInto(fused, 0, 0);
+	for (int x = 0; x < 7; x++)
+		for (int y = 0; y < 4; y++)
+			BOOST_CHECK_EQUAL(opaque.getPixel(x, y), fused.getPixel(x, y));
+}
+
+BOOST_AUTO_TEST_CASE(image_testResizeHalfLinear) {
+	// black and white average to a brighter gray in linear light
+	renderer::RGBAImage checkers(10, 2), linear(5, 1), average(5, 1);
+	for (int x = 0; x < checkers.getWidth(); x++)
+		for (int y = 0; y < 2; y++)
+			checkers.setPixel(x, y, (x + y) % 2 ? renderer::rgba(255, 255, 255, 255)
+					: renderer::rgba(0, 0, 0, 255));
+	checkers.resizeHalfInto(linear, 0, 0, renderer::DownsampleMode::LINEAR);
+	checkers.resizeHalfInto(average, 0, 0);
+	BOOST_CHECK_EQUAL(average.getPixel(0, 0), renderer::rgba(127, 127, 127, 255));
+	for (int x = 0; x < linear.getWidth(); x++)
+		BOOST_CHECK_EQUAL(linear.getPixel(x, 0), renderer::rgba(188, 188, 188, 255));
+
+	// constant channels stay the same, transparent pixels don't darken the others
+	renderer::RGBAImage blocks(10, 2), half(5, 1);
+	for (int x = 0; x < blocks.getWidth(); x++)
+		for (int y = 0; y < 2; y++)
+			blocks.setPixel(x, y, renderer::rgba(x * 20, 100, 3, 128 + x / 2));
+	blocks.setPixel(1, 1, renderer::rgba(0, 0, 0, 0));
+	blocks.resizeHalfInto(half, 0, 0, renderer::DownsampleMode::LINEAR);
+	BOOST_CHECK_EQUAL(half.getPixel(0, 0), renderer::rgba(8, 100, 3, 96));
+	BOOST_CHECK_EQUAL(half.getPixel(1, 0), renderer::rgba(51, 100, 3, 129));
+	BOOST_CHECK_EQUAL(half.getPixel(4, 0), renderer::rgba(170, 100, 3, 132));
+}
+
+BOOST_AUTO_TEST_CASE(image_testJPEGBackground) {
+	// odd width to have pixels which aren't composited four at once
+	renderer::RGBAImage src(13, 8), dest;
+	renderer::RGBAPixel background = renderer::rgba(20, 40, 200, 255);
+	for (int x = 0; x < src.getWidth(); x++)
+		for (int y = 0; y < src.getHeight(); y++)
+			src.setPixel(x, y, renderer::rgba(200, 100, 50, x * 20));
+
+	std::vector<uint8_t> buffer;
+	renderer::JPEGWriteOptions options(100, renderer::JPEGSubsampling::YUV444);
+	BOOST_REQUIRE(src.encodeJPEG(buffer, options, background));
+	BOOST_REQUIRE(dest.decodeJPEG(buffer.data(), buffer.size()));
+	BOOST_REQUIRE_EQUAL(dest.getWidth(), src.getWidth());
+
+	for (int x = 0; x < src.getWidth(); x++) {
+		renderer::RGBAPixel expected = src.getPixel(x, 0);
+		if (renderer::rgba_alpha(expected) < 250) {
+			expected = background;
+			renderer::blend(expected, src.getPixel(x, 0));
+		}
+		renderer::RGBAPixel actual = dest.getPixel(x, 4);
+		BOOST_CHECK_EQUAL(renderer::rgba_alpha(actual), 255);
+		BOOST_CHECK_SMALL(renderer::rgba_red(actual) - renderer::rgba_red(expected), 4);
+		BOOST_CHECK_SMALL(renderer::rgba_green(actual) - renderer::rgba_green(expected), 4);
+		BOOST_CHECK_SMALL(renderer::rgba_blue(actual) - renderer::rgba_blue(expected), 4);
+	}
+
+	// less color resolution makes smaller images
+	std::vector<uint8_t> subsampled;
+	options.subsampling = renderer::JPEGSubsampling::YUV420;
+	options.fast_dct = true;
+	BOOST_REQUIRE(src.encodeJPEG(subsampled, options, background));
+	BOOST_CHECK(subsampled.size() < buffer.size());
+}
+
+BOOST_AUTO_TEST_CASE(image_testHash) {
+	renderer::RGBAImage image1(16, 16), image2(16, 16), image3(8, 32);
+	BOOST_CHECK_EQUAL(image1.hash(), image2.hash());
+	// same pixels, but different size
+	BOOST_CHECK(image1.hash() != image3.hash());
+
+	image2.setPixel(15, 15, renderer::rgba(0, 0, 0, 1));
+	BOOST_CHECK(image1.hash() != image2.hash());
+	image1.setPixel(15, 15, renderer::rgba(0, 0, 0, 1));
+	BOOST_CHECK_EQUAL(image1.hash(), image2.hash());
+
+	BOOST_CHECK(renderer::RGBAImage(16, 16).isTransparent());
+	BOOST_CHECK(!image1.isTransparent());
+}
@@ -39,14 +39,16 @@ void traverseCheckOctree(const Octree* octree) {
 }
 
 void traverseReduceOctree(Octree* octree) {
+	// only the children are deleted, the root node isn't allocated on the heap
 	for (int i = 0; i < 16; i++) {
 		if (!octree->hasChildren(i))
 			continue;
-		traverseReduceOctree(octree->getChildren(i));
-	}
-	if (octree->isLeaf() && !octree->isRoot()) {
-		octree->reduceToParent();
-		delete octree;
+		Octree* child = octree->getChildren(i);
+		traverseReduceOctree(child);
+		if (child->isLeaf()) {
+			child->reduceToParent();
+			delete child;
+		}
 	}
 }
 
@@ -146,3 +148,29 @@ BOOST_AUTO_TEST_CASE(image_quantization_octree) {
 	testOctreeWithImage(platypus);
 }
 
+
+BOOST_AUTO_TEST_CASE(image_quantization_indexed_png) {
+	// colors which are exactly representable by the octree leaves
+	std::vector<RGBAPixel> colors;
+	for (int i = 0; i < 16; i++)
+		colors.push_back(rgba(i * 16, 255 - i * 8, (i % 4) * 64, i == 0 ? 0 : 255));
+
+	RGBAImage image(100, 50);
+	for (int x = 0; x < image.getWidth(); x++)
+		for (int y = 0; y < image.getHeight(); y++)
+			image.setPixel(x, y, colors[(x / 7 + y / 3) % colors.size()]);
+
+	// with a fixed palette (4 bit indices)
+	OctreePalette palette(colors);
+	RGBAImage read;
+	BOOST_REQUIRE(image.writeIndexedPNG("test.png", palette, false));
+	BOOST_REQUIRE(read.readPNG("test.png"));
+	BOOST_CHECK(read.data == image.data);
+
+	// with a palette created from the image, twice to use the reused buffers again
+	for (int i = 0; i < 2; i++) {
+		BOOST_REQUIRE(image.writeIndexedPNG("test.png", 8, false));
+		BOOST_REQUIRE(read.readPNG("test.png"));
+		BOOST_CHECK(read.data == image.data);
+	}
+}
@@ -19,14 +19,18 @@
 
 #include "../mapcraftercore/mc/blockstate.h"
 #include "../mapcraftercore/mc/chunk.h"
+#include "../mapcraftercore/mc/chunkfingerprints.h"
+#include "../mapcraftercore/mc/nbt.h"
 #include "../mapcraftercore/mc/region.h"
 #include "../mapcraftercore/util.h"
 
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <boost/filesystem.hpp>
 #include <boost/test/unit_test.hpp>
 
+namespace fs = boost::filesystem;
 namespace mc = mapcrafter::mc;
 
 BOOST_AUTO_TEST_CASE(region_testReadWrite) {
@@ -54,3 +58,100 @@ BOOST_AUTO_TEST_CASE(region_testReadWrite) {
 	}
 
 }
+
+/**
+ * Creates the zlib compressed data of a chunk with a single section with the supplied
+ * block and status, and some data irrelevant to rendering.
+ */
+static std::vector<uint8_t> createChunkData(const std::string& block, int inhabited_time,
+		const std::string& status = "full") {
+	mc::nbt::TagCompound palette_entry;
+	palette_entry.addTag("Name", mc::nbt::TagString(block));
+	mc::nbt::TagList palette(mc::nbt::TagCompound::TAG_TYPE);
+	palette.payload.push_back(mc::nbt::TagPtr(palette_entry.clone()));
+	mc::nbt::TagCompound block_states;
+	block_states.addTag("palette", palette);
+
+	mc::nbt::TagCompound section;
+	section.addTag("Y", mc::nbt::TagByte(0));
+	section.addTag("block_states", block_states);
+	mc::nbt::TagList sections(mc::nbt::TagCompound::TAG_TYPE);
+	sections.payload.push_back(mc::nbt::TagPtr(section.clone()));
+
+	mc::nbt::NBTFile nbt;
+	nbt.addTag("sections", sections);
+	nbt.addTag("Status", mc::nbt::TagString(status));
+	nbt.addTag("InhabitedTime", mc::nbt::TagLong(inhabited_time));
+	std::stringstream ss(std::ios::in | std::ios::out | std::ios::binary);
+	nbt.writeNBT(ss, mc::nbt::Compression::ZLIB);
+	std::string data = ss.str();
+	return std::vector<uint8_t>(data.begin(), data.end());
+}
+
+BOOST_AUTO_TEST_CASE(region_testChunkFingerprints) {
+	fs::path dir = fs::temp_directory_path() / fs::unique_path();
+	fs::create_directories(dir);
+	std::string region_filename = (dir / "r.0.0.mca").string();
+	fs::path cache_filename = dir / "chunk_fingerprints.nbt.gz";
+
+	// only the content relevant to rendering must change the fingerprint
+	uint64_t stone = mc::ChunkFingerprints::fingerprintChunk(
+			createChunkData("minecraft:stone", 1), 2);
+	BOOST_CHECK(stone != 0);
+	BOOST_CHECK_EQUAL(stone, mc::ChunkFingerprints::fingerprintChunk(
+			createChunkData("minecraft:stone", 2), 2));
+	BOOST_CHECK(stone != mc::ChunkFingerprints::fingerprintChunk(
+			createChunkData("minecraft:dirt", 1), 2));
+	// chunks are only rendered if they are generated completely
+	BOOST_CHECK(stone != mc::ChunkFingerprints::fingerprintChunk(
+			createChunkData("minecraft:stone", 1, "minecraft:features"), 2));
+	BOOST_CHECK_EQUAL(mc::ChunkFingerprints::fingerprintChunk(std::vector<uint8_t>(), 2), 0);
+
+	std::vector<int32_t> chunks = {0, 1};
+	std::vector<int32_t> timestamps;
+
+	mc::RegionFile region1(region_filename);
+	for (int i = 0; i < 1024; i++)
+		region1.setChunkTimestamp(mc::ChunkPos(i % 32, i / 32), 0);
+	region1.setChunkData(mc::ChunkPos(0, 0), createChunkData("minecraft:stone", 1), 2);
+	region1.setChunkTimestamp(mc::ChunkPos(0, 0), 100);
+	region1.setChunkData(mc::ChunkPos(1, 0), createChunkData("minecraft:stone", 1), 2);
+	region1.setChunkTimestamp(mc::ChunkPos(1, 0), 100);
+	BOOST_REQUIRE(region1.write());
+
+	// the first time the chunks keep their timestamps
+	mc::ChunkFingerprints fingerprints1(cache_filename);
+	BOOST_CHECK(!fingerprints1.read());
+	mc::RegionFile region2(region_filename);
+	BOOST_REQUIRE(region2.readOnlyHeaders());
+	timestamps = {100, 100};
+	fingerprints1.updateRegion(region2, chunks, timestamps);
+	BOOST_CHECK_EQUAL(timestamps[0], 100);
+	BOOST_CHECK_EQUAL(timestamps[1], 100);
+	BOOST_CHECK(fingerprints1.write());
+
+	// both chunks were saved again, but only the second one has a different block
+	region1.setChunkData(mc::ChunkPos(0, 0), createChunkData("minecraft:stone", 2), 2);
+	region1.setChunkTimestamp(mc::ChunkPos(0, 0), 200);
+	region1.setChunkData(mc::ChunkPos(1, 0), createChunkData("minecraft:dirt", 2), 2);
+	region1.setChunkTimestamp(mc::ChunkPos(1, 0), 200);
+	BOOST_REQUIRE(region1.write());
+
+	mc::ChunkFingerprints fingerprints2(cache_filename);
+	BOOST_CHECK(fingerprints2.read());
+	mc::RegionFile region3(region_filename);
+	BOOST_REQUIRE(region3.readOnlyHeaders());
+	timestamps = {200, 200};
+	fingerprints2.updateRegion(region3, chunks, timestamps);
+	BOOST_CHECK_EQUAL(timestamps[0], 100);
+	BOOST_CHECK_EQUAL(timestamps[1], 200);
+	BOOST_CHECK_EQUAL(fingerprints2.getUnchangedCount(), 1);
+
+	// unchanged chunk timestamps are taken from the cache without reading the data
+	timestamps = {200, 200};
+	fingerprints2.updateRegion(region3, chunks, timestamps);
+	BOOST_CHECK_EQUAL(timestamps[0], 100);
+	BOOST_CHECK_EQUAL(timestamps[1], 200);
+
+	fs::remove_all(dir);
+}
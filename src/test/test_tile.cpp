@@ -17,12 +17,34 @@
  * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "../bench/renderfixture.h"
+#include "../bench/syntheticdata.h"
+#include "../mapcraftercore/compat/thread.h"
+#include "../mapcraftercore/config/mapcrafterconfig.h"
+#include "../mapcraftercore/renderer/emptytileindex.h"
+#include "../mapcraftercore/renderer/manager.h"
+#include "../mapcraftercore/renderer/rendercostindex.h"
 #include "../mapcraftercore/renderer/tileset.h"
+#include "../mapcraftercore/renderer/tilehashstore.h"
+#include "../mapcraftercore/renderer/tilesetindex.h"
+#include "../mapcraftercore/renderer/tilestorage.h"
+#include "../mapcraftercore/renderer/renderviews/topdown/tileset.h"
+#include "../mapcraftercore/mc/region.h"
+#include "../mapcraftercore/mc/world.h"
+#include "../mapcraftercore/util.h"
 
+#include <ctime>
 #include <map>
+#include <memory>
+#include <sstream>
+#include <boost/filesystem.hpp>
 #include <boost/test/unit_test.hpp>
 
+namespace fs = boost::filesystem;
+namespace config = mapcrafter::config;
+namespace mc = mapcrafter::mc;
 namespace renderer = mapcrafter::renderer;
+namespace util = mapcrafter::util;
 
 #define PATH(a, b, c, d) ((((renderer::TilePath() + a) + b) + c) + d)
 
@@ -51,3 +73,518 @@ BOOST_AUTO_TEST_CASE(test_tilepos) {
 	}
 	BOOST_CHECK_EQUAL(paths.size(), 256);
 }
+
+BOOST_AUTO_TEST_CASE(test_tilepath_key) {
+	// the paths encoded as keys must be ordered like their nodes
+	std::vector<renderer::TilePath> paths;
+	std::vector<std::vector<int> > nodes;
+	for (int i = 0; i < 4 * 4 * 4; i++) {
+		renderer::TilePath path;
+		for (int d = 0; d < i % 4; d++)
+			path += (i >> (2 * d)) % 4 + 1;
+		paths.push_back(path);
+		nodes.push_back(path.getPath());
+	}
+	for (size_t i = 0; i < paths.size(); i++)
+		for (size_t j = 0; j < paths.size(); j++) {
+			BOOST_CHECK_EQUAL(paths[i] < paths[j], nodes[i] < nodes[j]);
+			BOOST_CHECK_EQUAL(paths[i] == paths[j], nodes[i] == nodes[j]);
+		}
+
+	renderer::TilePath path = PATH(1, 2, 3, 4);
+	BOOST_CHECK_EQUAL(path.toString(), "1/2/3/4");
+	BOOST_CHECK_EQUAL(path.getNode(3), 3);
+	BOOST_CHECK_EQUAL(path.parent(), PATH(1, 2, 3, 1).parent());
+	BOOST_CHECK_EQUAL(path.parent().parent().toString(), "1/2");
+	BOOST_CHECK_EQUAL(renderer::TilePath().parent().getDepth(), 0);
+
+	// the deepest paths still need to work
+	renderer::TilePath deep;
+	for (int d = 0; d < renderer::TilePath::MAX_DEPTH; d++)
+		deep += 4;
+	BOOST_CHECK_EQUAL(deep.getNode(renderer::TilePath::MAX_DEPTH), 4);
+	BOOST_CHECK_EQUAL(deep.parent() + 4, deep);
+	BOOST_CHECK_THROW(deep += 1, std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(test_tileset_index) {
+	fs::path world_dir = fs::temp_directory_path() / fs::unique_path();
+	fs::create_directories(world_dir / "region");
+
+	// a region with a few chunks, the chunk data is never read by the tile set
+	mc::RegionFile region((world_dir / "region" / "r.0.0.mca").string());
+	std::vector<uint8_t> data(16, 42);
+	for (int i = 0; i < 1024; i++)
+		region.setChunkTimestamp(mc::ChunkPos(i % 32, i / 32), 0);
+	region.setChunkData(mc::ChunkPos(0, 0), data, 2);
+	region.setChunkTimestamp(mc::ChunkPos(0, 0), 100);
+	region.setChunkData(mc::ChunkPos(5, 3), data, 2);
+	region.setChunkTimestamp(mc::ChunkPos(5, 3), 200);
+	region.setChunkData(mc::ChunkPos(31, 31), data, 2);
+	region.setChunkTimestamp(mc::ChunkPos(31, 31), 300);
+	BOOST_REQUIRE(region.write());
+
+	mc::World world(world_dir.string(), mc::Dimension::OVERWORLD, (world_dir / "cache").string());
+	BOOST_REQUIRE(world.load());
+
+	renderer::RenderRotation rotation(renderer::RenderRotation::TOP_LEFT);
+	fs::path index_file = world_dir / "cache" / "tileset.nbt.gz";
+	renderer::TilePos offset;
+
+	// scan without existing index and write the index
+	renderer::TopdownTileSet tile_set1(4, rotation);
+	renderer::TileSetIndex index1(index_file, "topdown_t4");
+	BOOST_CHECK(!index1.read());
+	tile_set1.scan(world, false, offset, &index1);
+	BOOST_CHECK_EQUAL(index1.getRegionCount(), 1);
+	BOOST_CHECK(index1.write());
+
+	// the index has to be read back with the same tiles
+	renderer::TileSetIndex index2(index_file, "topdown_t4");
+	BOOST_CHECK(index2.read());
+	renderer::RegionTiles region_tiles;
+	BOOST_REQUIRE(index2.getRegion(mc::RegionPos(0, 0), region_tiles));
+	BOOST_CHECK_EQUAL(region_tiles.chunks.size(), 3);
+	BOOST_CHECK_EQUAL(region_tiles.tiles.size(), 3);
+
+	// scanning with the index must give the same result as scanning without
+	renderer::TopdownTileSet tile_set2(4, rotation);
+	tile_set2.scan(world, false, offset, &index2);
+	BOOST_CHECK_EQUAL(tile_set1.getDepth(), tile_set2.getDepth());
+	BOOST_CHECK(tile_set1.getRequiredRenderTiles() == tile_set2.getRequiredRenderTiles());
+	tile_set2.scanRequiredByTimestamp(250);
+	BOOST_CHECK_EQUAL(tile_set2.getRequiredRenderTilesCount(), 1);
+	BOOST_CHECK(tile_set2.hasTile(renderer::TilePath::byTilePos(renderer::TilePos(7, 7),
+			tile_set2.getDepth())));
+
+	// the region file was modified right before it was scanned, so a change with the
+	// same modification time and size must be noticed
+	fs::path region_path = world_dir / "region" / "r.0.0.mca";
+	std::time_t mtime = fs::last_write_time(region_path);
+	region.setChunkTimestamp(mc::ChunkPos(0, 0), 400);
+	BOOST_REQUIRE(region.write());
+	fs::last_write_time(region_path, mtime);
+	renderer::TopdownTileSet tile_set3(4, rotation);
+	tile_set3.scan(world, false, offset, &index2);
+	tile_set3.scanRequiredByTimestamp(250);
+	BOOST_CHECK_EQUAL(tile_set3.getRequiredRenderTilesCount(), 2);
+
+	// a region file modified long before it was scanned is taken from the index
+	fs::last_write_time(region_path, mtime - 3600);
+	renderer::TopdownTileSet tile_set4(4, rotation);
+	tile_set4.scan(world, false, offset, &index2);
+	region.setChunkTimestamp(mc::ChunkPos(0, 0), 100);
+	BOOST_REQUIRE(region.write());
+	fs::last_write_time(region_path, mtime - 3600);
+	renderer::TopdownTileSet tile_set5(4, rotation);
+	tile_set5.scan(world, false, offset, &index2);
+	tile_set5.scanRequiredByTimestamp(250);
+	BOOST_CHECK_EQUAL(tile_set5.getRequiredRenderTilesCount(), 2);
+
+	// an index of a different tile set must not be used
+	renderer::TileSetIndex index3(index_file, "topdown_t2");
+	BOOST_CHECK(!index3.read());
+	BOOST_CHECK_EQUAL(index3.getRegionCount(), 0);
+
+	fs::remove_all(world_dir);
+}
+
+BOOST_AUTO_TEST_CASE(test_tileset_scan_threads) {
+	fs::path world_dir = fs::temp_directory_path() / fs::unique_path();
+	fs::create_directories(world_dir / "region");
+
+	// a few regions with some chunks each
+	std::vector<uint8_t> data(16, 42);
+	for (int r = 0; r < 6; r++) {
+		mc::RegionPos pos(r % 3 - 1, r / 3);
+		mc::RegionFile region((world_dir / "region" / ("r." + util::str(pos.x) + "."
+				+ util::str(pos.z) + ".mca")).string());
+		for (int i = 0; i < 1024; i++)
+			region.setChunkTimestamp(mc::ChunkPos(i % 32, i / 32), 0);
+		for (int i = 0; i < 10; i++) {
+			mc::ChunkPos chunk(pos.x * 32 + (i * 7 + r) % 32, pos.z * 32 + (i * 13) % 32);
+			region.setChunkData(chunk, data, 2);
+			region.setChunkTimestamp(chunk, 100 * r + i);
+		}
+		BOOST_REQUIRE(region.write());
+	}
+
+	mc::World world(world_dir.string(), mc::Dimension::OVERWORLD, (world_dir / "cache").string());
+	BOOST_REQUIRE(world.load());
+
+	std::vector<std::shared_ptr<renderer::RenderRotation> > rotations;
+	std::vector<std::shared_ptr<renderer::TileSet> > tile_sets, single_tile_sets;
+	std::vector<renderer::TileSet*> scan_tile_sets;
+	for (int i = 0; i < 4; i++) {
+		rotations.push_back(std::shared_ptr<renderer::RenderRotation>(
+				new renderer::RenderRotation(i)));
+		tile_sets.push_back(std::shared_ptr<renderer::TileSet>(
+				new renderer::TopdownTileSet(1, *rotations.back())));
+		single_tile_sets.push_back(std::shared_ptr<renderer::TileSet>(
+				new renderer::TopdownTileSet(1, *rotations.back())));
+		scan_tile_sets.push_back(tile_sets.back().get());
+	}
+
+	// scanning all rotations at once with multiple threads
+	// must give the same tiles as scanning every rotation on its own
+	std::vector<renderer::TileSetIndex*> indexes(4, nullptr);
+	std::vector<renderer::TilePos> offsets(4);
+	renderer::TileSet::scan(world, scan_tile_sets, indexes, false, offsets, 3);
+	for (int i = 0; i < 4; i++) {
+		single_tile_sets[i]->scan(world);
+		BOOST_CHECK_EQUAL(tile_sets[i]->getDepth(), single_tile_sets[i]->getDepth());
+		BOOST_CHECK(tile_sets[i]->getRequiredRenderTiles()
+				== single_tile_sets[i]->getRequiredRenderTiles());
+		BOOST_CHECK_EQUAL(tile_sets[i]->getRequiredRenderTilesCount(), 60);
+		tile_sets[i]->scanRequiredByTimestamp(450);
+		single_tile_sets[i]->scanRequiredByTimestamp(450);
+		BOOST_CHECK(tile_sets[i]->getRequiredRenderTiles()
+				== single_tile_sets[i]->getRequiredRenderTiles());
+	}
+
+	fs::remove_all(world_dir);
+}
+
+BOOST_AUTO_TEST_CASE(test_tile_hash_store) {
+	fs::path store_file = fs::temp_directory_path() / fs::unique_path() / "tilehashes.nbt.gz";
+
+	renderer::TilePath tile1 = PATH(1, 2, 3, 4), tile2 = PATH(1, 2, 3, 4).parent(),
+			tile3 = PATH(4, 4, 4, 4);
+	renderer::TileHashStore store1(store_file, "png");
+	BOOST_CHECK(!store1.read());
+	BOOST_CHECK(store1.update(tile1, 1));
+	BOOST_CHECK(store1.update(tile2, 2));
+	BOOST_CHECK(store1.write());
+
+	// known tiles are unchanged with the same hash
+	renderer::TileHashStore store2(store_file, "png");
+	BOOST_CHECK(store2.read());
+	BOOST_CHECK_EQUAL(store2.getTileCount(), 2);
+	BOOST_CHECK(!store2.update(tile1, 1));
+	BOOST_CHECK(store2.update(tile2, 3));
+	BOOST_CHECK(!store2.update(tile2, 3));
+	BOOST_CHECK(store2.update(tile3, 1));
+	BOOST_CHECK_EQUAL(store2.getUnchangedCount(), 2);
+	BOOST_CHECK(store2.write());
+
+	renderer::TileHashStore store3(store_file, "png");
+	BOOST_CHECK(store3.read());
+	BOOST_CHECK_EQUAL(store3.getTileCount(), 3);
+	BOOST_CHECK(!store3.update(tile2, 3));
+	BOOST_CHECK(!store3.update(tile3, 1));
+
+	// the hashes are moved with the tiles when the max zoom level increases
+	store3.increaseDepth();
+	renderer::TilePath deeper1 = (renderer::TilePath() + 1 + 4 + 2) + 3 + 4;
+	BOOST_CHECK_EQUAL(store3.getTileCount(), 3);
+	BOOST_CHECK(!store3.update(deeper1, 1));
+	BOOST_CHECK(store3.update(tile1, 1));
+
+	// the hashes of a different output format must not be used
+	renderer::TileHashStore store4(store_file, "jpg");
+	BOOST_CHECK(!store4.read());
+	BOOST_CHECK(store4.update(tile1, 1));
+
+	fs::remove_all(store_file.parent_path());
+}
+
+BOOST_AUTO_TEST_CASE(test_tile_archive) {
+	fs::path dir = fs::temp_directory_path() / fs::unique_path();
+	fs::path archive_file = dir / "test.pack";
+
+	std::vector<uint8_t> data1(100, 1), data2(200, 2), data3(50, 3), data;
+	renderer::TilePath tile1, tile2 = PATH(1, 2, 3, 4), tile3 = PATH(4, 3, 2, 1);
+
+	{
+		renderer::TileArchive archive(archive_file);
+		BOOST_REQUIRE(archive.open());
+		BOOST_CHECK(!archive.hasTile(tile1));
+		BOOST_CHECK(archive.writeTile(tile1, data1.data(), data1.size(), 42));
+		BOOST_CHECK(archive.writeTile(tile2, data2.data(), data2.size()));
+		// replaced tiles must be read with the new data
+		BOOST_CHECK(archive.writeTile(tile2, data3.data(), data3.size()));
+		BOOST_CHECK(archive.readTile(tile2, data));
+		BOOST_CHECK(data == data3);
+	}
+
+	{
+		// the index is written when the archive is closed
+		renderer::TileArchive archive(archive_file);
+		BOOST_REQUIRE(archive.open());
+		BOOST_CHECK_EQUAL(archive.getTileCount(), 2);
+		BOOST_CHECK_EQUAL(archive.getTileTime(tile1), 42);
+		BOOST_CHECK(archive.readTile(tile1, data));
+		BOOST_CHECK(data == data1);
+		BOOST_CHECK(archive.readTile(tile2, data));
+		BOOST_CHECK(data == data3);
+		BOOST_CHECK(!archive.readTile(tile3, data));
+		BOOST_CHECK(archive.writeTile(tile3, data2.data(), data2.size()));
+	}
+
+	{
+		// cut off the index (like an archive which was not closed) and a part of the
+		// last record, the index must be rebuilt from the complete records
+		uintmax_t size = fs::file_size(archive_file);
+		fs::resize_file(archive_file, size - 16 - 3 * 32 - 10);
+		renderer::TileArchive archive(archive_file);
+		BOOST_REQUIRE(archive.open());
+		BOOST_CHECK_EQUAL(archive.getTileCount(), 2);
+		BOOST_CHECK(archive.readTile(tile2, data));
+		BOOST_CHECK(data == data3);
+		BOOST_CHECK(!archive.hasTile(tile3));
+	}
+
+	fs::remove_all(dir);
+}
+
+BOOST_AUTO_TEST_CASE(test_tile_archive_storage) {
+	fs::path dir = fs::temp_directory_path() / fs::unique_path();
+	renderer::TilePath deep = PATH(1, 2, 3, 4) + 1 + 2 + 3 + 4 + 1;
+	BOOST_CHECK_EQUAL(renderer::ArchiveTileStorage::getArchivePrefix(deep), PATH(1, 2, 3, 4) + 1 + 2 + 3 + 4);
+	BOOST_CHECK_EQUAL(renderer::ArchiveTileStorage::getArchivePrefix(PATH(1, 2, 3, 4)), renderer::TilePath());
+
+	std::vector<uint8_t> data1(10, 1), data2(20, 2), data;
+	{
+		// only one archive open at a time, archives have to be closed and opened again
+		renderer::ArchiveTileStorage storage(dir, "png", 1);
+		BOOST_CHECK(!storage.hasTile(deep));
+		BOOST_CHECK(storage.writeTile(PATH(1, 2, 3, 4), data1.data(), data1.size()));
+		BOOST_CHECK(storage.writeTile(deep, data2.data(), data2.size()));
+		BOOST_CHECK(storage.readTile(PATH(1, 2, 3, 4), data));
+		BOOST_CHECK(data == data1);
+		BOOST_CHECK(storage.getTileTime(deep) > 0);
+	}
+	BOOST_CHECK(fs::exists(dir / "base.png.pack"));
+	BOOST_CHECK(fs::exists(dir / "1/2/3/4/1/2/3/4.png.pack"));
+
+	renderer::ArchiveTileStorage storage(dir, "png");
+	std::vector<renderer::TilePath> tiles;
+	storage.listTiles(tiles);
+	BOOST_CHECK_EQUAL(tiles.size(), 2);
+
+	// tiles are moved one zoom level deeper like 1/2/3/4 -> 1/4/2/3/4
+	BOOST_CHECK(storage.increaseDepth());
+	BOOST_CHECK(!storage.hasTile(PATH(1, 2, 3, 4)));
+	BOOST_CHECK(storage.readTile((renderer::TilePath() + 1 + 4 + 2) + 3 + 4, data));
+	BOOST_CHECK(data == data1);
+	BOOST_CHECK(storage.readTile(renderer::TilePath() + 1 + 4 + 2 + 3 + 4 + 1 + 2 + 3 + 4 + 1, data));
+	BOOST_CHECK(data == data2);
+
+	// the tiles can be exported to a directory tree like the web interface reads it
+	renderer::DirectoryTileStorage directory(dir / "export", "png");
+	tiles.clear();
+	storage.listTiles(tiles);
+	for (auto it = tiles.begin(); it != tiles.end(); ++it) {
+		BOOST_CHECK(storage.readTile(*it, data));
+		BOOST_CHECK(directory.writeTile(*it, data.data(), data.size()));
+	}
+	BOOST_CHECK(fs::exists(dir / "export/1/4/2/3/4.png"));
+	tiles.clear();
+	directory.listTiles(tiles);
+	BOOST_CHECK_EQUAL(tiles.size(), 2);
+
+	storage.flush();
+	fs::remove_all(dir);
+
+	{
+		// threads writing to more archives than can be open at the same time
+		renderer::ArchiveTileStorage concurrent(dir, "png", 2);
+		std::vector<thread_ns::thread> threads;
+		for (int t = 0; t < 4; t++) {
+			threads.push_back(thread_ns::thread([&concurrent, &data1, t]() {
+				for (int i = 0; i < 64; i++) {
+					renderer::TilePath tile = PATH(1, 2, 3, 4) + 1 + 2 + 3 + (i % 8 / 2 + 1)
+							+ (i % 2 + 1) + (t + 1) + (i / 8 % 4 + 1) + (i / 32 + 1);
+					concurrent.writeTile(tile, data1.data(), data1.size());
+				}
+			}));
+		}
+		for (size_t t = 0; t < threads.size(); t++)
+			threads[t].join();
+		tiles.clear();
+		concurrent.listTiles(tiles);
+		BOOST_CHECK_EQUAL(tiles.size(), 256);
+	}
+	tiles.clear();
+	renderer::ArchiveTileStorage(dir, "png").listTiles(tiles);
+	BOOST_CHECK_EQUAL(tiles.size(), 256);
+	fs::remove_all(dir);
+}
+
+BOOST_AUTO_TEST_CASE(test_empty_tile_index) {
+	fs::path filename = fs::temp_directory_path() / fs::unique_path();
+	renderer::EmptyTileIndex index(filename);
+
+	BOOST_CHECK(!index.setEmpty(PATH(1, 2, 3, 1), true));
+	BOOST_CHECK(!index.setEmpty(PATH(1, 2, 3, 2), true));
+	BOOST_CHECK(index.isEmpty(PATH(1, 2, 3, 1) + 4));
+	BOOST_CHECK(!index.isEmpty(PATH(1, 2, 3, 3)));
+	BOOST_CHECK(!index.isEmpty(PATH(1, 2, 3, 1).parent()));
+
+	// an empty composite tile replaces the empty subtrees of its children
+	BOOST_CHECK(!index.setEmpty(PATH(1, 2, 3, 4).parent(), true));
+	BOOST_CHECK(index.setEmpty(PATH(1, 2, 3, 4), true));
+	BOOST_CHECK_EQUAL(index.getRootCount(), 1);
+
+	// a tile which isn't empty anymore splits the empty subtree
+	BOOST_CHECK(index.setEmpty(PATH(1, 2, 3, 4) + 1, false));
+	BOOST_CHECK(!index.isEmpty(PATH(1, 2, 3, 4) + 1));
+	BOOST_CHECK(!index.isEmpty(PATH(1, 2, 3, 4)));
+	BOOST_CHECK(index.isEmpty(PATH(1, 2, 3, 3)));
+	BOOST_CHECK(index.isEmpty(PATH(1, 2, 3, 4) + 2));
+	BOOST_CHECK_EQUAL(index.getRootCount(), 6);
+
+	BOOST_CHECK_EQUAL(index.getTime(), 0);
+	index.setTime(1234567890);
+	BOOST_CHECK(index.write());
+	renderer::EmptyTileIndex index2(filename);
+	BOOST_CHECK(index2.read());
+	BOOST_CHECK_EQUAL(index2.getTime(), 1234567890);
+	BOOST_CHECK_EQUAL(index2.getRootCount(), 6);
+	BOOST_CHECK(index2.isEmpty(PATH(1, 2, 3, 3)));
+
+	// tiles are moved one zoom level deeper like 1/2/3/3 -> 1/4/2/3/3,
+	// the new tiles next to the old tile trees are empty
+	index2.increaseDepth();
+	BOOST_CHECK(index2.isEmpty((renderer::TilePath() + 1 + 4 + 2) + 3 + 3));
+	BOOST_CHECK(!index2.isEmpty((renderer::TilePath() + 1 + 4 + 2) + 3 + 4));
+	BOOST_CHECK(!index2.isEmpty(renderer::TilePath() + 1 + 4));
+	BOOST_CHECK(index2.isEmpty(renderer::TilePath() + 1 + 2));
+
+	fs::remove(filename);
+}
+
+BOOST_AUTO_TEST_CASE(test_render_cost_index) {
+	fs::path filename = fs::temp_directory_path() / fs::unique_path();
+	renderer::RenderCostIndex index(filename);
+
+	renderer::RenderCost cost;
+	cost.milliseconds = 12.5;
+	cost.blocks = 4096;
+	cost.chunks_loaded = 3;
+	cost.bytes = 23456;
+	index.setCost(PATH(1, 2, 3, 4), cost);
+	index.setCost(PATH(1, 2, 3, 1), renderer::RenderCost());
+	BOOST_CHECK(index.write());
+
+	renderer::RenderCostIndex index2(filename);
+	BOOST_CHECK(index2.read());
+	BOOST_CHECK_EQUAL(index2.getTileCount(), 2);
+	renderer::RenderCost cost2;
+	BOOST_CHECK(index2.getCost(PATH(1, 2, 3, 4), cost2));
+	BOOST_CHECK_CLOSE(cost2.milliseconds, 12.5, 0.01);
+	BOOST_CHECK_EQUAL(cost2.blocks, 4096);
+	BOOST_CHECK_EQUAL(cost2.chunks_loaded, 3);
+	BOOST_CHECK_EQUAL(cost2.bytes, 23456);
+	BOOST_CHECK(!index2.getCost(PATH(1, 2, 3, 3), cost2));
+
+	// tiles are moved one zoom level deeper like 1/2/3/4 -> 1/4/2/3/4
+	index2.increaseDepth();
+	BOOST_CHECK(index2.getCost((renderer::TilePath() + 1 + 4 + 2) + 3 + 4, cost2));
+	BOOST_CHECK_EQUAL(cost2.blocks, 4096);
+	BOOST_CHECK(!index2.getCost(PATH(1, 2, 3, 4), cost2));
+
+	fs::remove(filename);
+}
+
+/**
+ * Creates the configuration of a small map of a synthetic world for the incremental
+ * render test. The chunk fingerprints are disabled, so every chunk with a newer
+ * timestamp is rendered again even if its content did not change.
+ */
+static std::string createIncrementalConfig(const fs::path& work_dir,
+		const std::string& tile_storage) {
+	std::ostringstream config;
+	config << "output_dir = " << (work_dir / "output").string() << std::endl;
+	config << "template_dir = " << fs::absolute("../data/template").string() << std::endl;
+	config << "[world:synthetic]" << std::endl;
+	config << "input_dir = " << (work_dir / "world").string() << std::endl;
+	config << "chunk_fingerprints = false" << std::endl;
+	config << "[map:synthetic]" << std::endl;
+	config << "name = Synthetic" << std::endl;
+	config << "world = synthetic" << std::endl;
+	config << "texture_size = 12" << std::endl;
+	config << "block_dir = " << fs::absolute("../data/blocks").string() << std::endl;
+	config << "tile_storage = " << tile_storage << std::endl;
+	return config.str();
+}
+
+/**
+ * Sets the timestamps of all chunks of a world to now like the game does when it saves
+ * the chunks again.
+ */
+static void touchChunks(const fs::path& region_dir) {
+	uint32_t now = std::time(nullptr);
+	for (fs::directory_iterator it(region_dir); it != fs::directory_iterator(); ++it) {
+		mc::RegionFile region(it->path().string());
+		BOOST_REQUIRE(region.read());
+		const mc::RegionFile::ChunkMap& chunks = region.getContainingChunks();
+		for (auto chunk_it = chunks.begin(); chunk_it != chunks.end(); ++chunk_it)
+			region.setChunkTimestamp(*chunk_it, now);
+		BOOST_REQUIRE(region.write());
+	}
+}
+
+/**
+ * Returns how many render tiles an incremental render of the map would render.
+ */
+static int getRequiredTilesCount(const config::MapcrafterConfig& config) {
+	config::MapSection map_config = config.getMap("synthetic");
+	config::WorldSection world_config = config.getWorld("synthetic");
+	renderer::RenderRotation::Direction rotation = renderer::RenderRotation::TOP_LEFT;
+
+	mc::World world(world_config.getInputDir().string(), world_config.getDimension(),
+			config.getCachePath("test_world").string());
+	BOOST_REQUIRE(world.load());
+	std::unique_ptr<renderer::RenderView> render_view(renderer::createRenderView(
+			map_config.getRenderView(), rotation, map_config.getWaterOpacity()));
+	std::unique_ptr<renderer::TileSet> tile_set(
+			render_view->createTileSet(map_config.getTileWidth()));
+	tile_set->scan(world);
+
+	fs::path output_dir = config.getOutputPath(
+			"synthetic/" + config::ROTATION_NAMES_SHORT[rotation]);
+	std::shared_ptr<renderer::TileStorage> tile_storage = renderer::TileStorage::create(
+			map_config.getTileStorage(), output_dir, map_config.getImageFormatSuffix());
+	// some tiles at the border of the world are empty and not in the tile storage
+	renderer::EmptyTileIndex empty_tiles(output_dir / "empty-tiles.json");
+	BOOST_REQUIRE(empty_tiles.read());
+	BOOST_CHECK_GT(empty_tiles.getRootCount(), 0);
+	tile_set->scanRequiredByFiletimes(*tile_storage, &empty_tiles);
+	return tile_set->getRequiredRenderTilesCount();
+}
+
+BOOST_AUTO_TEST_CASE(test_incremental_render) {
+	std::vector<std::string> tile_storages = {"directory", "archive"};
+	for (auto it = tile_storages.begin(); it != tile_storages.end(); ++it) {
+		BOOST_TEST_MESSAGE("Tile storage " << *it);
+		fs::path work_dir = fs::temp_directory_path() / fs::unique_path();
+		synthetic::DirectoryRemover remover(work_dir);
+		synthetic::WorldGenerator generator(synthetic::WorldOptions(42));
+		BOOST_REQUIRE(generator.writeWorld(work_dir / "world", 3) > 0);
+
+		config::MapcrafterConfig config;
+		config::ValidationMap validation = config.parseString(
+				createIncrementalConfig(work_dir, *it), work_dir);
+		if (validation.isCritical())
+			validation.log();
+		BOOST_REQUIRE(!validation.isCritical());
+
+		renderer::RenderManager manager(config);
+		BOOST_REQUIRE(manager.run(1, true));
+		BOOST_CHECK_EQUAL(getRequiredTilesCount(config), 0);
+
+		// the timestamps have a resolution of seconds, so everything has to be at least
+		// one second newer than what it is compared to
+		thread_ns::this_thread::sleep_for(chrono_ns::milliseconds(1100));
+		touchChunks(work_dir / "world" / "region");
+		BOOST_CHECK_GT(getRequiredTilesCount(config), 0);
+		thread_ns::this_thread::sleep_for(chrono_ns::milliseconds(1100));
+
+		// the tiles are rendered again, but they did not change, so they are not written;
+		// they must not be required in the next run anyway
+		renderer::RenderManager manager2(config);
+		BOOST_REQUIRE(manager2.run(1, true));
+		BOOST_CHECK_EQUAL(getRequiredTilesCount(config), 0);
+	}
+}
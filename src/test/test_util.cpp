@@ -19,6 +19,8 @@
 
 #include "../mapcraftercore/util.h"
 
+#include <fstream>
+#include <iterator>
 #include <boost/test/unit_test.hpp>
 
 namespace util = mapcrafter::util;
@@ -47,3 +49,193 @@ BOOST_AUTO_TEST_CASE(util_testMath) {
 	BOOST_CHECK_EQUAL(util::binary<11011101>::value, 221);
 }
 
+
+BOOST_AUTO_TEST_CASE(util_testProfiler) {
+	// the percentiles are estimated within 12.5%
+	util::ProfileStageStats stats;
+	for (uint64_t i = 1; i <= 1000; i++)
+		stats.add(i * 1000, i * 1000);
+	BOOST_CHECK_EQUAL(stats.count, 1000);
+	BOOST_CHECK_EQUAL(stats.max_ns, 1000000);
+	BOOST_CHECK_CLOSE((double) stats.getPercentile(0.5), 500000, 12.5);
+	BOOST_CHECK_CLOSE((double) stats.getPercentile(0.9), 900000, 12.5);
+	BOOST_CHECK_CLOSE((double) stats.getPercentile(0.99), 990000, 12.5);
+	BOOST_CHECK_EQUAL(stats.getPercentile(1), 1000000);
+	for (uint64_t ns = 0; ns < 100000; ns += 7)
+		BOOST_CHECK_LE(util::ProfileStageStats::getBucket(ns),
+				util::ProfileStageStats::getBucket(ns + 7));
+
+	util::Profiler::setEnabled(true);
+	util::Profiler::reset();
+	{
+		util::ProfileTimer outer(util::ProfileStage::BLOCK_TRAVERSAL);
+		for (int i = 0; i < 3; i++) {
+			util::ProfileTimer inner(util::ProfileStage::LIGHTING);
+			util::Profiler::count(util::ProfileCounter::CHUNK_CACHE_HITS);
+		}
+		util::Profiler::count(util::ProfileCounter::CHUNK_CACHE_MISSES);
+	}
+	util::Profiler::setEnabled(false);
+	{
+		// nothing is recorded when the profiler is disabled
+		util::ProfileTimer timer(util::ProfileStage::BLIT);
+		util::Profiler::count(util::ProfileCounter::CHUNK_CACHE_MISSES);
+	}
+
+	util::ProfileReport report = util::Profiler::collect();
+	const util::ProfileStageStats& outer = report.stages[(size_t) util::ProfileStage::BLOCK_TRAVERSAL];
+	const util::ProfileStageStats& inner = report.stages[(size_t) util::ProfileStage::LIGHTING];
+	BOOST_CHECK_EQUAL(outer.count, 1);
+	BOOST_CHECK_EQUAL(inner.count, 3);
+	BOOST_CHECK_EQUAL(report.stages[(size_t) util::ProfileStage::BLIT].count, 0);
+	// the nested timers are not part of the self time of the outer timer
+	BOOST_CHECK_GE(outer.total_ns, inner.total_ns);
+	BOOST_CHECK_EQUAL(outer.self_ns, outer.total_ns - inner.total_ns);
+
+	picojson::object json = report.toJSON();
+	const picojson::object& rates = util::json_get<picojson::object>(json, "cache_hit_rates");
+	BOOST_CHECK_CLOSE(util::json_get<double>(rates, "chunk_cache"), 0.75, 0.001);
+	const picojson::object& stages = util::json_get<picojson::object>(json, "stages");
+	BOOST_CHECK(stages.count("palette_resolve"));
+	util::Profiler::reset();
+}
+
+BOOST_AUTO_TEST_CASE(util_testMetrics) {
+	util::MetricHistogram histogram;
+	histogram.observe(500000);
+	histogram.observe(2000000);
+	histogram.observe(3000000000);
+	BOOST_CHECK_EQUAL(histogram.buckets[0], 1);
+	BOOST_CHECK_EQUAL(histogram.buckets[1], 1);
+	BOOST_CHECK_EQUAL(histogram.buckets[histogram.buckets.size() - 1], 1);
+	BOOST_CHECK_EQUAL(histogram.count, 3);
+
+	uint64_t bytes = util::Metrics::get(util::MetricCounter::BYTES_WRITTEN);
+	util::Metrics::add(util::MetricCounter::BYTES_WRITTEN, 42);
+	BOOST_CHECK_EQUAL(util::Metrics::get(util::MetricCounter::BYTES_WRITTEN), bytes + 42);
+	util::Metrics::set(util::MetricGauge::WORK_QUEUE_DEPTH, 7);
+	std::string metrics = util::Metrics::format();
+	BOOST_CHECK(metrics.find("mapcrafter_work_queue_depth 7\n") != std::string::npos);
+	BOOST_CHECK(metrics.find("mapcrafter_tile_encode_seconds_bucket{le=\"+Inf\"}") != std::string::npos);
+	util::Metrics::set(util::MetricGauge::WORK_QUEUE_DEPTH, 0);
+
+	fs::path file = fs::temp_directory_path() / fs::unique_path("mapcrafter-metrics-%%%%%%%%.prom");
+	util::MetricsFileExporter exporter(file, 1);
+	exporter.startRender("world", "tl");
+	exporter.setMax(100);
+	exporter.setValue(50);
+	// the file is written in the interval even without further progress
+	thread_ns::this_thread::sleep_for(chrono_ns::milliseconds(1500));
+	std::ifstream in_active(file.string());
+	std::string content((std::istreambuf_iterator<char>(in_active)), std::istreambuf_iterator<char>());
+	BOOST_CHECK(content.find("mapcrafter_render_tiles{map=\"world\",rotation=\"tl\"} 50\n") != std::string::npos);
+	BOOST_CHECK(content.find("mapcrafter_render_active{map=\"world\",rotation=\"tl\"} 1\n") != std::string::npos);
+
+	exporter.finishRender();
+	std::ifstream in(file.string());
+	content.assign((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	BOOST_CHECK(content.find("mapcrafter_render_tiles{map=\"world\",rotation=\"tl\"} 50\n") != std::string::npos);
+	BOOST_CHECK(content.find("mapcrafter_render_tiles_required{map=\"world\",rotation=\"tl\"} 100\n") != std::string::npos);
+	BOOST_CHECK(content.find("mapcrafter_render_active{map=\"world\",rotation=\"tl\"} 0\n") != std::string::npos);
+	fs::remove(file);
+}
+
+BOOST_AUTO_TEST_CASE(util_testMemoryAccountant) {
+	typedef util::MemoryAccountant Accountant;
+	util::MemoryComponent chunks = util::MemoryComponent::CHUNK_CACHE;
+	util::MemoryComponent tiles = util::MemoryComponent::COMPOSITE_TILES;
+	uint64_t usage = Accountant::getUsage();
+	Accountant::resetPeaks();
+
+	Accountant::add(chunks, 1000);
+	{
+		util::MemoryReservation reservation(tiles, 500);
+		BOOST_CHECK_EQUAL(Accountant::getUsage(), usage + 1500);
+	}
+	Accountant::add(chunks, -400);
+	BOOST_CHECK_EQUAL(Accountant::getUsage(), usage + 600);
+	BOOST_CHECK_GE(Accountant::getPeak(chunks), 1000);
+	BOOST_CHECK_GE(Accountant::getPeak(tiles), 500);
+	BOOST_CHECK_EQUAL(Accountant::getPeak(), usage + 1500);
+
+	BOOST_CHECK(!Accountant::isOverLimit());
+	Accountant::setLimit(usage + 100);
+	BOOST_CHECK(Accountant::isOverLimit());
+	BOOST_CHECK_EQUAL(Accountant::getExcess(), 500);
+	Accountant::add(chunks, -600);
+	BOOST_CHECK(!Accountant::isOverLimit());
+	BOOST_CHECK_EQUAL(Accountant::getExcess(), 0);
+	Accountant::setLimit(0);
+
+	uint64_t bytes;
+	BOOST_CHECK(util::parseByteSize("512", bytes));
+	BOOST_CHECK_EQUAL(bytes, 512);
+	BOOST_CHECK(util::parseByteSize("8G", bytes));
+	BOOST_CHECK_EQUAL(bytes, 8ull << 30);
+	BOOST_CHECK(util::parseByteSize("1.5 GiB", bytes));
+	BOOST_CHECK_EQUAL(bytes, 3ull << 29);
+	BOOST_CHECK(util::parseByteSize("300mb", bytes));
+	BOOST_CHECK_EQUAL(bytes, 300ull << 20);
+	BOOST_CHECK(!util::parseByteSize("8X", bytes));
+	BOOST_CHECK(!util::parseByteSize("lots", bytes));
+	BOOST_CHECK_EQUAL(util::formatByteSize(100), "100 B");
+	BOOST_CHECK_EQUAL(util::formatByteSize(3ull << 29), "1.5 GiB");
+}
+
+BOOST_AUTO_TEST_CASE(util_testProgressReporter) {
+	util::DummyProgressHandler handler;
+	handler.setMax(4000);
+	util::ProgressReporter reporter(&handler, 4, 1);
+	reporter.start();
+
+	std::vector<thread_ns::thread> threads;
+	for (int i = 0; i < 4; i++) {
+		util::ProgressCounter* counter = &reporter.getCounter(i);
+		// every counter has a cache line for itself
+		BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(counter) % 64, 0);
+		threads.push_back(thread_ns::thread([counter]() {
+			for (int j = 0; j < 1000; j++)
+				counter->add(1);
+		}));
+	}
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+
+	BOOST_CHECK_EQUAL(reporter.getValue(), 4000);
+	reporter.stop();
+	BOOST_CHECK_EQUAL(handler.getValue(), 4000);
+}
+
+BOOST_AUTO_TEST_CASE(util_testTracer) {
+	util::Tracer::setEnabled(true, 3);
+	thread_ns::thread thread([]() {
+		util::Tracer::setThreadName("traced thread");
+		for (int i = 0; i < 5; i++)
+			util::TraceSpan span("span");
+	});
+	thread.join();
+	util::Tracer::setEnabled(false);
+
+	fs::path file = fs::temp_directory_path() / fs::unique_path("mapcrafter-trace-%%%%%%%%.json");
+	BOOST_CHECK(util::Tracer::write(file));
+	std::ifstream in(file.string());
+	picojson::value trace;
+	std::string error = picojson::parse(trace, in);
+	BOOST_CHECK(error.empty());
+	fs::remove(file);
+
+	// only the latest spans fit into the ring buffer of the thread
+	const picojson::array& events = trace.get("traceEvents").get<picojson::array>();
+	int spans = 0;
+	bool named = false;
+	for (auto it = events.begin(); it != events.end(); ++it) {
+		if (it->get("ph").get<std::string>() == "X" && it->get("name").get<std::string>() == "span")
+			spans++;
+		if (it->get("name").get<std::string>() == "thread_name"
+				&& it->get("args").get("name").get<std::string>() == "traced thread")
+			named = true;
+	}
+	BOOST_CHECK_EQUAL(spans, 3);
+	BOOST_CHECK(named);
+	BOOST_CHECK_EQUAL(trace.get("otherData").get("dropped_spans").get<double>(), 2);
+}